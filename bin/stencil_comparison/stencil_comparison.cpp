@@ -0,0 +1,118 @@
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/stencil.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+#include "core/cl/common.h"
+#include "core/scene_data.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+/// Compares the update schemes at the same valid bandwidth.
+///
+/// For each scheme, the mesh sampling rate is chosen so that the dispersion
+/// error stays below a threshold up to the cutoff. Then the same length of
+/// impulse response is simulated in a box-shaped room, and the size of the
+/// mesh, the number of steps and the running time are reported.
+
+constexpr auto speed_of_sound = 340.0;
+
+template <typename T>
+double time_seconds(T&& t) {
+    const auto start = std::chrono::steady_clock::now();
+    t();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+            .count();
+}
+
+const char* get_name(wayverb::waveguide::stencil s) {
+    switch (s) {
+        case wayverb::waveguide::stencil::rectilinear: return "rectilinear";
+        case wayverb::waveguide::stencil::interpolated_wideband:
+            return "interpolated wideband";
+    }
+    return "unknown";
+}
+
+int main(int argc, char** argv) {
+    const auto cutoff = argc > 1 ? std::stod(argv[1]) : 1000.0;
+    const auto max_error = argc > 2 ? std::stod(argv[2]) : 0.02;
+    const auto duration = argc > 3 ? std::stod(argv[3]) : 0.1;
+
+    const wayverb::core::compute_context cc{};
+
+    const wayverb::core::geo::box box{glm::vec3{0},
+                                      glm::vec3{5.56, 3.97, 2.81}};
+    const auto scene_data = wayverb::core::geo::get_scene_data(
+            box,
+            wayverb::core::make_surface<wayverb::core::simulation_bands>(0.1,
+                                                                          0));
+    const auto source = glm::vec3{1.2, 1.3, 1.4};
+    const auto receiver = glm::vec3{4.1, 2.6, 1.5};
+
+    std::cout << "cutoff: " << cutoff << " Hz, max dispersion error: "
+              << max_error * 100 << "%, duration: " << duration << " s\n";
+
+    for (const auto s : {wayverb::waveguide::stencil::rectilinear,
+                         wayverb::waveguide::stencil::interpolated_wideband}) {
+        const auto bandwidth =
+                wayverb::waveguide::compute_valid_bandwidth(s, max_error);
+        const auto sample_rate = cutoff / bandwidth;
+        const size_t steps = std::ceil(duration * sample_rate);
+
+        const auto setup_start = std::chrono::steady_clock::now();
+        const auto voxels_and_mesh =
+                wayverb::waveguide::compute_voxels_and_mesh(cc,
+                                                            scene_data,
+                                                            receiver,
+                                                            sample_rate,
+                                                            speed_of_sound,
+                                                            s);
+        const auto setup_time =
+                std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - setup_start)
+                        .count();
+        const auto& mesh = voxels_and_mesh.mesh;
+        const auto& descriptor = mesh.get_descriptor();
+
+        util::aligned::vector<float> input(steps, 0);
+        input.front() = 1;
+
+        wayverb::core::callback_accumulator<
+                wayverb::waveguide::postprocessor::node>
+                output{wayverb::waveguide::compute_index(descriptor,
+                                                         receiver)};
+        const auto run_time = time_seconds([&] {
+            wayverb::waveguide::run(
+                    cc,
+                    mesh,
+                    wayverb::waveguide::preprocessor::make_hard_source(
+                            wayverb::waveguide::compute_index(descriptor,
+                                                              source),
+                            input.begin(),
+                            input.end()),
+                    [&](auto& queue, const auto& buffer, auto step) {
+                        output(queue, buffer, step);
+                    },
+                    true);
+        });
+
+        const auto nodes = mesh.get_structure().get_condensed_nodes().size();
+        std::cout << std::setw(24) << get_name(s) << ": "
+                  << "sample rate " << std::setw(8) << sample_rate << " Hz, "
+                  << "error at cutoff " << std::setw(8)
+                  << wayverb::waveguide::compute_dispersion_error(s,
+                                                                  bandwidth) *
+                             100
+                  << "%, " << std::setw(10) << nodes << " nodes, "
+                  << std::setw(6) << steps << " steps, setup " << setup_time
+                  << " s, run " << run_time << " s ("
+                  << nodes * steps / run_time / 1e6 << " Mnode/s)"
+                  << std::endl;
+    }
+}
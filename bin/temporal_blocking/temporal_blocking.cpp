@@ -0,0 +1,98 @@
+#include "waveguide/mesh.h"
+#include "waveguide/native/engine.h"
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+#include "core/scene_data.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+/// Compares the native engine's plain per-step sweep against the temporally
+/// blocked wavefront, on box-shaped meshes of increasing size.
+
+constexpr auto speed_of_sound = 340.0;
+
+template <typename T>
+double time_seconds(T&& t) {
+    const auto start = std::chrono::steady_clock::now();
+    t();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+            .count();
+}
+
+int main(int argc, char** argv) {
+    const size_t steps = argc > 1 ? std::stoul(argv[1]) : 128;
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t block_size = argc > 2 ? std::stoul(argv[2]) : 2 * threads;
+
+    const wayverb::core::compute_context cc{};
+
+    const wayverb::core::geo::box box{glm::vec3{0}, glm::vec3{10, 8, 5}};
+    const auto scene_data = wayverb::core::geo::get_scene_data(
+            box,
+            wayverb::core::make_surface<wayverb::core::simulation_bands>(0.1,
+                                                                          0));
+    const auto source = centre(box);
+    const auto volume = dimensions(box).x * dimensions(box).y *
+                        dimensions(box).z;
+
+    std::cout << "steps: " << steps << ", block size: " << block_size
+              << ", threads: " << threads << '\n';
+
+    for (const auto target_nodes : {10e6, 25e6, 50e6, 100e6, 200e6}) {
+        //  Pick the sample rate which gives roughly the right number of nodes.
+        const auto spacing = std::cbrt(volume / target_nodes);
+        const auto sample_rate = speed_of_sound * std::sqrt(3.0) / spacing;
+
+        const auto voxels_and_mesh =
+                wayverb::waveguide::compute_voxels_and_mesh(
+                        cc, scene_data, source, sample_rate, speed_of_sound);
+        const auto& mesh = voxels_and_mesh.mesh;
+        const auto source_index = wayverb::waveguide::compute_index(
+                mesh.get_descriptor(), source);
+
+        util::aligned::vector<float> signal(steps, 0);
+        signal.front() = 1;
+        const util::aligned::vector<cl_uint> taps{
+                static_cast<cl_uint>(source_index)};
+
+        util::aligned::vector<float> per_step_output;
+        const auto per_step_time = time_seconds([&] {
+            wayverb::waveguide::native::engine engine{mesh, threads};
+            util::aligned::vector<float> previous(engine.get_num_nodes(), 0);
+            util::aligned::vector<float> current(engine.get_num_nodes(), 0);
+            for (auto i = 0u; i != steps; ++i) {
+                current[source_index] = signal[i];
+                per_step_output.emplace_back(current[source_index]);
+                wayverb::waveguide::detail::throw_if_error(
+                        engine.step(previous.data(), current.data()));
+                std::swap(previous, current);
+            }
+        });
+
+        util::aligned::vector<float> blocked_output;
+        const auto blocked_time = time_seconds([&] {
+            wayverb::waveguide::native::engine engine{mesh, threads};
+            blocked_output = wayverb::waveguide::native::run_blocked(
+                    engine, source_index, signal, taps, block_size, true);
+        });
+
+        const auto nodes = mesh.get_structure().get_condensed_nodes().size();
+        const auto rate = [&](auto seconds) {
+            return nodes * steps / seconds / 1e6;
+        };
+
+        std::cout << std::setw(12) << nodes << " nodes: per-step "
+                  << std::setw(8) << rate(per_step_time) << " Mnode/s, blocked "
+                  << std::setw(8) << rate(blocked_time) << " Mnode/s, speedup "
+                  << per_step_time / blocked_time
+                  << (per_step_output == blocked_output ? ""
+                                                        : " (OUTPUT MISMATCH)")
+                  << std::endl;
+    }
+}
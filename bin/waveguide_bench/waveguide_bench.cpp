@@ -0,0 +1,355 @@
+#include "waveguide/boundary_adjust.h"
+#include "waveguide/canonical.h"
+#include "waveguide/config.h"
+#include "waveguide/mesh.h"
+#include "waveguide/stepper.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+#include "core/scene_data.h"
+#include "core/spatial_division/voxelised_scene_data.h"
+
+#include "cereal/archives/json.hpp"
+#include "cereal/types/string.hpp"
+#include "cereal/types/vector.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/// Measures waveguide throughput, so that performance can be tracked between
+/// versions.
+///
+/// Sweeps room shape and size, single- and multi-band updates, and compute
+/// backend. For each case, reports the node update rate, the time taken by
+/// each stage of setup, and the peak resident memory of the process.
+///
+/// usage: waveguide_bench [steps] [sample rate] > results.json
+
+constexpr auto speed_of_sound = 340.0;
+
+struct bench_case final {
+    std::string shape;
+    double size;
+    size_t bands;
+    std::string backend;
+
+    size_t nodes;
+    double boundary_fraction;
+    size_t steps;
+
+    double voxelise_seconds;
+    double inside_test_seconds;
+    double boundary_finder_seconds;
+    double run_seconds;
+    double node_updates_per_second;
+
+    size_t peak_memory_bytes;
+};
+
+namespace cereal {
+
+template <typename Archive>
+void serialize(Archive& archive, bench_case& c) {
+    archive(make_nvp("shape", c.shape),
+            make_nvp("size", c.size),
+            make_nvp("bands", c.bands),
+            make_nvp("backend", c.backend),
+            make_nvp("nodes", c.nodes),
+            make_nvp("boundary_fraction", c.boundary_fraction),
+            make_nvp("steps", c.steps),
+            make_nvp("voxelise_seconds", c.voxelise_seconds),
+            make_nvp("inside_test_seconds", c.inside_test_seconds),
+            make_nvp("boundary_finder_seconds", c.boundary_finder_seconds),
+            make_nvp("run_seconds", c.run_seconds),
+            make_nvp("node_updates_per_second", c.node_updates_per_second),
+            make_nvp("peak_memory_bytes", c.peak_memory_bytes));
+}
+
+}  // namespace cereal
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+double time_seconds(T&& t) {
+    const auto start = std::chrono::steady_clock::now();
+    t();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+            .count();
+}
+
+/// Resets the peak resident set size where the platform allows it, so that
+/// each case reports its own peak rather than the peak of the whole run.
+void reset_peak_memory() {
+#ifdef __linux__
+    std::ofstream{"/proc/self/clear_refs"} << "5";
+#endif
+}
+
+size_t peak_memory_bytes() {
+#ifdef __linux__
+    //  ru_maxrss isn't affected by clear_refs, but VmHWM is.
+    std::ifstream status{"/proc/self/status"};
+    for (std::string line; std::getline(status, line);) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoul(line.substr(6)) * 1024;
+        }
+    }
+#endif
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+using scene_data = wayverb::core::gpu_scene_data;
+
+auto make_surface() {
+    return wayverb::core::make_surface<wayverb::core::simulation_bands>(0.1,
+                                                                         0);
+}
+
+/// A box with the proportions of a typical room.
+scene_data make_box(double size) {
+    return wayverb::core::geo::get_scene_data(
+            wayverb::core::geo::box{glm::vec3{0},
+                                    glm::vec3(size, size * 0.8, size * 0.5)},
+            make_surface());
+}
+
+/// A box with the same floor as make_box, but low, so that a far greater
+/// proportion of the nodes lie on the boundary.
+scene_data make_slab(double size) {
+    return wayverb::core::geo::get_scene_data(
+            wayverb::core::geo::box{glm::vec3{0},
+                                    glm::vec3(size, size * 0.8, size * 0.1)},
+            make_surface());
+}
+
+/// An extruded, irregular star-shaped floor plan, so that the walls are not
+/// aligned with the mesh.
+scene_data make_procedural(double size) {
+    constexpr auto sides = 24;
+    const auto height = size * 0.5;
+
+    util::aligned::vector<cl_float3> vertices;
+    for (auto z : {0.0, height}) {
+        for (auto i = 0; i != sides; ++i) {
+            const auto angle = 2 * M_PI * i / sides;
+            const auto radius =
+                    size * (0.4 + 0.1 * std::sin(3 * angle) +
+                            0.05 * std::cos(7 * angle));
+            vertices.push_back(cl_float3{{static_cast<float>(
+                                                  radius * std::cos(angle)),
+                                          static_cast<float>(
+                                                  radius * std::sin(angle)),
+                                          static_cast<float>(z)}});
+        }
+    }
+    const cl_uint floor_centre = vertices.size();
+    vertices.push_back(cl_float3{{0, 0, 0}});
+    const cl_uint ceiling_centre = vertices.size();
+    vertices.push_back(cl_float3{{0, 0, static_cast<float>(height)}});
+
+    util::aligned::vector<wayverb::core::triangle> triangles;
+    for (cl_uint i = 0; i != sides; ++i) {
+        const cl_uint j = (i + 1) % sides;
+        triangles.push_back({0, floor_centre, j, i});
+        triangles.push_back({0, ceiling_centre, sides + i, sides + j});
+        triangles.push_back({0, i, j, sides + j});
+        triangles.push_back({0, i, sides + j, sides + i});
+    }
+
+    return wayverb::core::make_scene_data(
+            std::move(triangles),
+            std::move(vertices),
+            util::aligned::vector<
+                    wayverb::core::surface<wayverb::core::simulation_bands>>{
+                    make_surface()});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct prepared_mesh final {
+    wayverb::waveguide::voxels_and_mesh voxels_and_mesh;
+    double voxelise_seconds;
+    wayverb::waveguide::mesh_setup_timings timings;
+};
+
+/// Does the same as compute_voxels_and_mesh, but times each stage.
+prepared_mesh prepare_mesh(const wayverb::core::compute_context& cc,
+                           const scene_data& scene,
+                           double sample_rate) {
+    const auto spacing =
+            wayverb::waveguide::config::grid_spacing(speed_of_sound,
+                                                     1 / sample_rate);
+    const auto aabb = wayverb::core::geo::compute_aabb(scene.get_vertices());
+
+    const auto voxelise_start = std::chrono::steady_clock::now();
+    auto voxelised = wayverb::core::make_voxelised_scene_data(
+            scene,
+            5,
+            wayverb::waveguide::compute_adjusted_boundary(
+                    aabb, centre(aabb), spacing));
+    const auto voxelise_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          voxelise_start)
+                    .count();
+
+    wayverb::waveguide::mesh_setup_timings timings;
+    auto mesh = wayverb::waveguide::compute_mesh(
+            cc,
+            voxelised,
+            spacing,
+            speed_of_sound,
+            wayverb::waveguide::stencil::rectilinear,
+            &timings);
+
+    return {{std::move(voxelised), std::move(mesh)}, voxelise_seconds, timings};
+}
+
+/// Runs `steps` updates after an impulse at the centre of the mesh.
+double time_run(wayverb::waveguide::stepper& stepper,
+                const wayverb::waveguide::mesh& mesh,
+                size_t steps) {
+    const auto& descriptor = mesh.get_descriptor();
+    const auto centre_index = wayverb::waveguide::compute_index(
+            descriptor,
+            wayverb::core::to_vec3{}(descriptor.min_corner) +
+                    glm::vec3{wayverb::core::to_ivec3{}(
+                            descriptor.dimensions)} *
+                            descriptor.spacing * 0.5f);
+    const cl_float impulse = 1;
+    stepper.get_queue().enqueueWriteBuffer(
+            stepper.get_current(),
+            CL_TRUE,
+            centre_index * stepper.get_bands() * sizeof(cl_float),
+            sizeof(cl_float),
+            &impulse);
+
+    const auto run_steps = [&](auto n) {
+        stepper.reset_error_flag();
+        for (auto i = 0u; i != n; ++i) {
+            stepper.enqueue_update();
+            stepper.swap();
+        }
+        wayverb::waveguide::detail::throw_if_error(stepper.read_error_flag());
+    };
+
+    //  Warm up caches and drivers before timing.
+    run_steps(std::min(steps, size_t{10}));
+    return time_seconds([&] { run_steps(steps); });
+}
+
+int main(int argc, char** argv) {
+    const size_t steps = argc > 1 ? std::stoul(argv[1]) : 200;
+    const auto sample_rate = argc > 2 ? std::stod(argv[2]) : 10000.0;
+
+    const struct {
+        const char* name;
+        scene_data (*make)(double);
+    } shapes[]{{"box", make_box},
+               {"slab", make_slab},
+               {"procedural", make_procedural}};
+
+    const struct {
+        const char* name;
+        wayverb::core::compute_backend backend;
+    } backends[]{{"opencl", wayverb::core::compute_backend::opencl},
+                 {"native", wayverb::core::compute_backend::native}};
+
+    std::vector<bench_case> results;
+
+    for (const auto size : {4.0, 8.0, 16.0}) {
+        for (const auto& shape : shapes) {
+            for (const auto& backend : backends) {
+                wayverb::core::compute_context cc{};
+                cc.backend = backend.backend;
+
+                reset_peak_memory();
+
+                const auto prepared =
+                        prepare_mesh(cc, shape.make(size), sample_rate);
+                const auto& mesh = prepared.voxels_and_mesh.mesh;
+                const auto& nodes = mesh.get_structure().get_condensed_nodes();
+
+                const auto simulated = std::count_if(
+                        nodes.begin(), nodes.end(), [](const auto& i) {
+                            return i.boundary_type !=
+                                   wayverb::waveguide::id_none;
+                        });
+                const auto boundary = std::count_if(
+                        nodes.begin(), nodes.end(), [](const auto& i) {
+                            return i.boundary_type !=
+                                           wayverb::waveguide::id_none &&
+                                   i.boundary_type !=
+                                           wayverb::waveguide::id_inside;
+                        });
+
+                //  Only the OpenCL backend can update several bands at once.
+                const auto band_counts =
+                        backend.backend ==
+                                        wayverb::core::compute_backend::opencl
+                                ? std::vector<size_t>{
+                                          1, wayverb::core::simulation_bands}
+                                : std::vector<size_t>{1};
+
+                for (const auto bands : band_counts) {
+                    const auto run_seconds = [&] {
+                        if (bands == 1) {
+                            wayverb::waveguide::stepper stepper{cc, mesh};
+                            return time_run(stepper, mesh, steps);
+                        }
+                        util::aligned::vector<util::aligned::vector<
+                                wayverb::waveguide::coefficients_canonical>>
+                                band_coefficients;
+                        for (auto band = 0u; band != bands; ++band) {
+                            band_coefficients.emplace_back(
+                                    wayverb::waveguide::
+                                            compute_flat_coefficients_for_band(
+                                                    prepared.voxels_and_mesh,
+                                                    band));
+                        }
+                        wayverb::waveguide::stepper stepper{
+                                cc, mesh, band_coefficients};
+                        return time_run(stepper, mesh, steps);
+                    }();
+
+                    results.push_back(bench_case{
+                            shape.name,
+                            size,
+                            bands,
+                            backend.name,
+                            nodes.size(),
+                            static_cast<double>(boundary) / simulated,
+                            steps,
+                            prepared.voxelise_seconds,
+                            prepared.timings.inside_test,
+                            prepared.timings.boundary_finder,
+                            run_seconds,
+                            nodes.size() * bands * steps / run_seconds,
+                            peak_memory_bytes()});
+
+                    std::cerr << shape.name << ' ' << size << " m, "
+                              << backend.name << ", " << bands
+                              << " band(s): " << nodes.size() << " nodes, "
+                              << results.back().node_updates_per_second / 1e6
+                              << " Mnode/s" << std::endl;
+                }
+            }
+        }
+    }
+
+    cereal::JSONOutputArchive{std::cout}(cereal::make_nvp("cases", results));
+}
@@ -78,23 +78,6 @@ add_library(sndfile UNKNOWN IMPORTED)
 add_dependencies(sndfile sndfile_external) 
 set_property(TARGET sndfile PROPERTY IMPORTED_LOCATION ${DEPENDENCY_INSTALL_PREFIX}/lib/libsndfile.a)
 
-# samplerate ###################################################################
-
-# The default libsamplerate distribution uses a deprecated path to Carbon, so
-# we have to manually patch it to modify the path before building.
-
-ExternalProject_Add(
-    samplerate_external
-    DOWNLOAD_COMMAND ${GIT_EXECUTABLE} clone --depth 1 https://github.com/erikd/libsamplerate.git samplerate_external
-    PATCH_COMMAND ${GIT_EXECUTABLE} apply ${CMAKE_SOURCE_DIR}/config/fix_carbon.patch
-    CONFIGURE_COMMAND <SOURCE_DIR>/autogen.sh && <SOURCE_DIR>/configure --prefix=<INSTALL_DIR> --disable-dependency-tracking --enable-shared=no
-    ${CUSTOM_MAKE_COMMAND}
-)
-
-add_library(samplerate UNKNOWN IMPORTED)
-add_dependencies(samplerate samplerate_external) 
-set_property(TARGET samplerate PROPERTY IMPORTED_LOCATION ${DEPENDENCY_INSTALL_PREFIX}/lib/libsamplerate.a)
-
 # gtest ########################################################################
 
 ExternalProject_Add(
@@ -2,6 +2,10 @@
 
 #include "raytracer/cl/reflection.h"
 
+#include "waveguide/checkpoint.h"
+#include "waveguide/postprocessor/snapshot.h"
+
+#include "core/cl/common.h"
 #include "core/gpu_scene_data.h"
 
 #include "utilities/aligned/vector.h"
@@ -9,6 +13,7 @@
 
 #include "glm/fwd.hpp"
 
+#include <experimental/optional>
 #include <memory>
 
 namespace wayverb {
@@ -16,7 +21,6 @@ namespace wayverb {
 //  forward declarations  //////////////////////////////////////////////////////
 
 namespace core {
-class compute_context;
 struct environment;
 namespace attenuator {
 class null;
@@ -98,18 +102,50 @@ public:
            const raytracer::simulation_parameters& raytracer,
            std::unique_ptr<waveguide_base> waveguide);
 
+    /// The raytracer is run once per receiver, but the waveguide is only run
+    /// once in total.
+    /// The mesh is aligned to the first receiver. The others use the closest
+    /// mesh nodes.
+    engine(const core::compute_context& compute_context,
+           const core::gpu_scene_data& scene_data,
+           const glm::vec3& source,
+           util::aligned::vector<glm::vec3> receivers,
+           const core::environment& environment,
+           const raytracer::simulation_parameters& raytracer,
+           std::unique_ptr<waveguide_base> waveguide);
+
+    /// Like the constructor above, but uses a mesh which has already been
+    /// built, and which may be shared with other engines.
+    /// The mesh must have been built for the waveguide's sampling frequency,
+    /// and anchored at the first receiver.
+    engine(const core::compute_context& compute_context,
+           std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+           const glm::vec3& source,
+           util::aligned::vector<glm::vec3> receivers,
+           const core::environment& environment,
+           const raytracer::simulation_parameters& raytracer,
+           std::unique_ptr<waveguide_base> waveguide);
+
     ~engine() noexcept;
 
+    /// returns:    results for the first receiver, or nullptr if the run was
+    ///             cancelled
     std::unique_ptr<intermediate> run(const std::atomic_bool& keep_going) const;
 
+    /// returns:    results for each receiver, in order, or an empty vector
+    ///             if the run was cancelled
+    util::aligned::vector<std::unique_ptr<intermediate>> run_all(
+            const std::atomic_bool& keep_going) const;
+
     //  notifications  /////////////////////////////////////////////////////////
 
     /// Args: Current engine state, progress within state.
     using engine_state_changed = util::event<state, double>;
 
-    /// Args: Current node pressures, total distanced travelled by sound wave.
+    /// Args: Snapshot of node pressures, total distanced travelled by sound
+    /// wave.
     using waveguide_node_pressures_changed =
-            util::event<util::aligned::vector<float>, double>;
+            util::event<waveguide::postprocessor::pressure_snapshot, double>;
 
     /// Args: Current reflections, source position.
     using raytracer_reflections_generated = util::event<
@@ -127,6 +163,29 @@ public:
     connect_raytracer_reflections_generated(
             raytracer_reflections_generated::callback_type callback);
 
+    /// Controls how often, and how much of, the mesh is sent to
+    /// waveguide_node_pressures_changed listeners.
+    /// By default, the whole mesh is sent at full precision every step.
+    void set_waveguide_snapshot_parameters(
+            const waveguide::postprocessor::snapshot_parameters& params);
+
+    /// If set, the waveguide is saved to disk as it runs, and resumes from
+    /// the saved state if there is one (see waveguide::canonical).
+    /// By default, nothing is saved.
+    void set_waveguide_checkpoint_parameters(
+            const std::experimental::optional<waveguide::checkpoint_parameters>&
+                    params);
+
+    /// If set, the waveguide mesh is split across these compute contexts,
+    /// rather than run on the engine's own context (see
+    /// waveguide::run_partitioned).
+    /// Partitioned runs can't be checkpointed, and don't send node pressures
+    /// to waveguide_node_pressures_changed listeners.
+    /// By default, the mesh isn't split.
+    void set_waveguide_partition(
+            const std::experimental::optional<
+                    util::aligned::vector<core::compute_context>>& contexts);
+
     //  cached data  ///////////////////////////////////////////////////////////
 
     const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
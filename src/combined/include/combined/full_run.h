@@ -21,6 +21,27 @@ public:
                           const raytracer::simulation_parameters& raytracer,
                           std::unique_ptr<waveguide_base> waveguide);
 
+    /// Runs the waveguide once for all receivers.
+    /// See the corresponding engine constructor.
+    postprocessing_engine(const core::compute_context& compute_context,
+                          const core::gpu_scene_data& scene_data,
+                          const glm::vec3& source,
+                          util::aligned::vector<glm::vec3> receivers,
+                          const core::environment& environment,
+                          const raytracer::simulation_parameters& raytracer,
+                          std::unique_ptr<waveguide_base> waveguide);
+
+    /// Uses a prebuilt, possibly shared, mesh.
+    /// See the corresponding engine constructor.
+    postprocessing_engine(
+            const core::compute_context& compute_context,
+            std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+            const glm::vec3& source,
+            util::aligned::vector<glm::vec3> receivers,
+            const core::environment& environment,
+            const raytracer::simulation_parameters& raytracer,
+            std::unique_ptr<waveguide_base> waveguide);
+
     postprocessing_engine(const postprocessing_engine&) = delete;
     postprocessing_engine(postprocessing_engine&&) noexcept = delete;
 
@@ -34,6 +55,95 @@ public:
         It e_capsules,
         double sample_rate,
         const std::atomic_bool& keep_going) {
+        const auto intermediates = run_engine(keep_going);
+
+        if (intermediates.empty()) {
+            return std::experimental::nullopt;
+        }
+
+        return postprocess(*intermediates.front(),
+                           b_capsules,
+                           e_capsules,
+                           sample_rate,
+                           keep_going);
+    }
+
+    /// b_receivers, e_receivers:   a range of capsules for each receiver, in
+    ///                             the same order as the receiver positions
+    ///
+    /// returns:                    the channels for each receiver
+    template <typename It>
+    std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<util::aligned::vector<float>>>>
+    run_all(It b_receivers,
+            It e_receivers,
+            double sample_rate,
+            const std::atomic_bool& keep_going) {
+        const auto intermediates = run_engine(keep_going);
+
+        if (intermediates.size() !=
+            static_cast<size_t>(std::distance(b_receivers, e_receivers))) {
+            return std::experimental::nullopt;
+        }
+
+        util::aligned::vector<
+                util::aligned::vector<util::aligned::vector<float>>>
+                ret;
+        for (auto i = 0u; i != intermediates.size(); ++i, ++b_receivers) {
+            auto channels = postprocess(*intermediates[i],
+                                        std::begin(*b_receivers),
+                                        std::end(*b_receivers),
+                                        sample_rate,
+                                        keep_going);
+            if (!channels) {
+                return std::experimental::nullopt;
+            }
+            ret.emplace_back(std::move(*channels));
+        }
+
+        return ret;
+    }
+
+    //  notifications
+
+    using engine_state_changed = engine::engine_state_changed;
+    using waveguide_node_pressures_changed =
+            engine::waveguide_node_pressures_changed;
+    using raytracer_reflections_generated =
+            engine::raytracer_reflections_generated;
+
+    engine_state_changed::connection connect_engine_state_changed(
+            engine_state_changed::callback_type callback);
+
+    waveguide_node_pressures_changed::connection
+    connect_waveguide_node_pressures_changed(
+            waveguide_node_pressures_changed::callback_type callback);
+
+    raytracer_reflections_generated::connection
+    connect_raytracer_reflections_generated(
+            raytracer_reflections_generated::callback_type callback);
+
+    /// See engine::set_waveguide_snapshot_parameters.
+    void set_waveguide_snapshot_parameters(
+            const waveguide::postprocessor::snapshot_parameters& params);
+
+    /// See engine::set_waveguide_checkpoint_parameters.
+    void set_waveguide_checkpoint_parameters(
+            const std::experimental::optional<waveguide::checkpoint_parameters>&
+                    params);
+
+    /// See engine::set_waveguide_partition.
+    void set_waveguide_partition(
+            const std::experimental::optional<
+                    util::aligned::vector<core::compute_context>>& contexts);
+
+    //  get contents
+
+    const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
+
+private:
+    util::aligned::vector<std::unique_ptr<intermediate>> run_engine(
+            const std::atomic_bool& keep_going) {
         //  Only add engine listeners if things are listening to this object.
 
         engine_state_changed::scoped_connection state;
@@ -61,18 +171,26 @@ public:
 
         //  Start running.
 
-        const auto intermediate = engine_.run(keep_going);
+        auto ret = engine_.run_all(keep_going);
 
-        if (intermediate == nullptr) {
-            return std::experimental::nullopt;
+        if (!ret.empty()) {
+            engine_state_changed_(state::postprocessing, 1.0);
         }
 
-        engine_state_changed_(state::postprocessing, 1.0);
+        return ret;
+    }
 
+    template <typename It>
+    std::experimental::optional<
+            util::aligned::vector<util::aligned::vector<float>>>
+    postprocess(const intermediate& results,
+                It b_capsules,
+                It e_capsules,
+                double sample_rate,
+                const std::atomic_bool& keep_going) const {
         util::aligned::vector<util::aligned::vector<float>> channels;
         for (auto it = b_capsules; it != e_capsules && keep_going; ++it) {
-            channels.emplace_back(
-                    (*it)->postprocess(*intermediate, sample_rate));
+            channels.emplace_back((*it)->postprocess(results, sample_rate));
         }
 
         if (!keep_going) {
@@ -82,30 +200,6 @@ public:
         return channels;
     }
 
-    //  notifications
-
-    using engine_state_changed = engine::engine_state_changed;
-    using waveguide_node_pressures_changed =
-            engine::waveguide_node_pressures_changed;
-    using raytracer_reflections_generated =
-            engine::raytracer_reflections_generated;
-
-    engine_state_changed::connection connect_engine_state_changed(
-            engine_state_changed::callback_type callback);
-
-    waveguide_node_pressures_changed::connection
-    connect_waveguide_node_pressures_changed(
-            waveguide_node_pressures_changed::callback_type callback);
-
-    raytracer_reflections_generated::connection
-    connect_raytracer_reflections_generated(
-            raytracer_reflections_generated::callback_type callback);
-
-    //  get contents
-
-    const waveguide::voxels_and_mesh& get_voxels_and_mesh() const;
-
-private:
     engine engine_;
 
     engine_state_changed engine_state_changed_;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include "core/gpu_scene_data.h"
+#include "core/spatial_division/voxelised_scene_data.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace wayverb {
+namespace combined {
+
+/// Keeps the voxelised scene and the waveguide mesh between runs, and only
+/// rebuilds the parts which a change invalidates:
+///     Geometry changes invalidate everything.
+///     Moving the mesh anchor (the first receiver), changing the waveguide
+///     sampling frequency, or switching to a backend which needs a different
+///     brick order invalidates the mesh.
+///     Material changes are applied in-place, by swapping the surfaces and
+///     refitting the boundary filters.
+///     Nothing else (other receivers, sources, capsules, raytracer settings)
+///     affects either.
+///
+/// Returned objects are shared, and are never modified once returned, so
+/// they stay valid even if the cache is updated by a later run.
+///
+/// If a cache directory is set, meshes are also kept on disk (see
+/// waveguide/mesh_cache.h), so that they survive between sessions.
+class scene_cache final {
+public:
+    /// An empty directory turns the disk cache off.
+    /// The directory must already exist.
+    void set_cache_directory(std::string directory);
+
+    using voxelised_scene = core::voxelised_scene_data<
+            cl_float3,
+            core::surface<core::simulation_bands>>;
+
+    /// A voxelised copy of the scene, for checking that sources and
+    /// receivers are inside it.
+    std::shared_ptr<const voxelised_scene> get_voxelised_scene(
+            const core::gpu_scene_data& scene);
+
+    /// The arguments are as for waveguide::compute_voxels_and_mesh.
+    /// Meshes are compacted wherever that is worthwhile.
+    std::shared_ptr<const waveguide::voxels_and_mesh> get_voxels_and_mesh(
+            const core::compute_context& cc,
+            const core::gpu_scene_data& scene,
+            const glm::vec3& anchor,
+            double sample_rate,
+            double speed_of_sound);
+
+private:
+    std::mutex mutex_;
+
+    std::string cache_directory_;
+
+    std::shared_ptr<voxelised_scene> voxelised_scene_;
+
+    struct mesh_key final {
+        glm::vec3 anchor;
+        double sample_rate;
+        double speed_of_sound;
+        /// Compacted meshes suit only backends which use the same order.
+        waveguide::brick_order order;
+    };
+    mesh_key mesh_key_;
+    std::shared_ptr<waveguide::voxels_and_mesh> voxels_and_mesh_;
+};
+
+}  // namespace combined
+}  // namespace wayverb
@@ -2,6 +2,7 @@
 
 #include "combined/full_run.h"
 #include "combined/model/persistent.h"
+#include "combined/scene_cache.h"
 
 #include "waveguide/mesh_descriptor.h"
 
@@ -11,9 +12,9 @@ namespace wayverb {
 namespace combined {
 
 /// Given a scene, and a collection of sources and receivers,
-/// For each source-receiver pair:
-///     Simulate the scene.
-///     Do microphone post-processing according to the receiver's capsules.
+/// For each source:
+///     Simulate the scene, recording the response at every receiver.
+///     Do microphone post-processing according to each receiver's capsules.
 ///     Cache the results.
 /// Once all outputs have been calculated:
 ///     Do global normalization.
@@ -22,15 +23,42 @@ namespace combined {
 ///     Signal using a callback, and quit.
 /// If the user cancels early:
 ///     Signal using a callback, and quit.
+/// The voxelised scene and waveguide mesh are kept between runs, and only
+/// rebuilt when a change to the scene or settings requires it.
+/// If a checkpoint directory is set, a cancelled or crashed waveguide run
+/// resumes where it left off the next time the same scene is rendered.
 
 class complete_engine final {
 public:
     ~complete_engine() noexcept;
 
+    /// snapshot_parameters:    controls the pressures sent to
+    ///                         waveguide_node_pressures_changed listeners
     void run(core::compute_context compute_context,
              core::gpu_scene_data scene_data,
              model::persistent persistent,
-             model::output output);
+             model::output output,
+             waveguide::postprocessor::snapshot_parameters
+                     snapshot_parameters = {});
+
+    /// Meshes are stored in, and loaded from, this directory, so that they
+    /// don't have to be rebuilt in later sessions.
+    /// Pass an empty string to stop using the disk cache.
+    void set_mesh_cache_directory(std::string directory);
+
+    /// Waveguide runs are saved in this directory as they go, one file per
+    /// source, named after everything which affects the simulation.
+    /// Files are removed once their run finishes.
+    /// Pass an empty string to stop saving runs.
+    /// The directory must already exist.
+    void set_checkpoint_directory(std::string directory);
+
+    /// Splits the waveguide mesh across these compute contexts, and runs
+    /// the slabs in parallel (see waveguide::run_partitioned).
+    /// Partitioned runs are never checkpointed.
+    /// Pass an empty list to run the waveguide on the context passed to run.
+    void set_waveguide_partition(
+            util::aligned::vector<core::compute_context> contexts);
 
     bool is_running() const;
 
@@ -72,7 +100,9 @@ private:
     void do_run(core::compute_context compute_context,
                 core::gpu_scene_data scene_data,
                 model::persistent persistent,
-                model::output output);
+                model::output output,
+                waveguide::postprocessor::snapshot_parameters
+                        snapshot_parameters);
 
     engine_state_changed engine_state_changed_;
     waveguide_node_positions_changed waveguide_node_positions_changed_;
@@ -85,6 +115,10 @@ private:
     std::atomic_bool is_running_{false};
     std::atomic_bool keep_going_{true};
 
+    scene_cache scene_cache_;
+    std::string checkpoint_directory_;
+    util::aligned::vector<core::compute_context> partition_;
+
     std::future<void> future_;
 };
 
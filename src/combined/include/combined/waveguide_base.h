@@ -2,6 +2,8 @@
 
 #include "waveguide/bandpass_band.h"
 
+#include "core/cl/common.h"
+
 #include "glm/fwd.hpp"
 
 #include <experimental/optional>
@@ -10,20 +12,21 @@
 //  forward declarations  //////////////////////////////////////////////////////
 
 namespace cl {
-class Buffer;
 class CommandQueue;
 }  // namespace cl
 
 namespace wayverb {
 
 namespace waveguide {
+class pressure_view;
 struct voxels_and_mesh;
 struct single_band_parameters;
 struct multiple_band_constant_spacing_parameters;
+struct early_termination_parameters;
+struct checkpoint_parameters;
 }  // namespace waveguide
 
 namespace core {
-class compute_context;
 struct environment;
 }  // namespace core
 
@@ -44,7 +47,45 @@ public:
 
     virtual double compute_sampling_frequency() const = 0;
 
-    virtual std::experimental::optional<
+    /// Pressures are only copied out of the mesh if the callback asks for
+    /// them (see waveguide::pressure_view).
+    using pressure_callback_t =
+            std::function<void(cl::CommandQueue& queue,
+                               const waveguide::pressure_view& pressures,
+                               size_t step,
+                               size_t steps)>;
+
+    /// Simulates the mesh once, and records the output at every receiver.
+    ///
+    /// early_termination:  if set, the simulation may stop before
+    ///                     simulation_time, once its energy decay has
+    ///                     settled (see waveguide::canonical)
+    /// checkpoint:         if set, the simulation is saved as it runs, and
+    ///                     resumes from the saved state if there is one
+    ///                     (see waveguide::canonical)
+    /// partition:          if set, the mesh is split across these contexts
+    ///                     rather than run on `cc` (see waveguide::canonical)
+    ///
+    /// returns:    the bands for each receiver, in the same order as
+    ///             `receivers`
+    virtual std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<waveguide::bandpass_band>>>
+    run(const core::compute_context& cc,
+        const waveguide::voxels_and_mesh& voxelised,
+        const glm::vec3& source,
+        const util::aligned::vector<glm::vec3>& receivers,
+        const core::environment& environment,
+        double simulation_time,
+        const std::atomic_bool& keep_going,
+        pressure_callback_t pressure_callback,
+        const std::experimental::optional<
+                waveguide::early_termination_parameters>& early_termination,
+        const std::experimental::optional<waveguide::checkpoint_parameters>&
+                checkpoint,
+        const std::experimental::optional<
+                util::aligned::vector<core::compute_context>>& partition) = 0;
+
+    std::experimental::optional<
             util::aligned::vector<waveguide::bandpass_band>>
     run(const core::compute_context& cc,
         const waveguide::voxels_and_mesh& voxelised,
@@ -53,10 +94,13 @@ public:
         const core::environment& environment,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        std::function<void(cl::CommandQueue& queue,
-                           const cl::Buffer& buffer,
-                           size_t step,
-                           size_t steps)> pressure_callback) = 0;
+        pressure_callback_t pressure_callback,
+        const std::experimental::optional<
+                waveguide::early_termination_parameters>& early_termination,
+        const std::experimental::optional<waveguide::checkpoint_parameters>&
+                checkpoint,
+        const std::experimental::optional<
+                util::aligned::vector<core::compute_context>>& partition);
 };
 
 std::unique_ptr<waveguide_base> make_waveguide_ptr(
@@ -2,7 +2,9 @@
 #include "combined/postprocess.h"
 #include "combined/waveguide_base.h"
 
+#include "waveguide/early_termination.h"
 #include "waveguide/mesh.h"
+#include "waveguide/pressure_view.h"
 
 #include "raytracer/canonical.h"
 
@@ -90,101 +92,177 @@ public:
     impl(const core::compute_context& compute_context,
          const core::gpu_scene_data& scene_data,
          const glm::vec3& source,
-         const glm::vec3& receiver,
+         util::aligned::vector<glm::vec3> receivers,
          const core::environment& environment,
          const raytracer::simulation_parameters& raytracer,
          std::unique_ptr<waveguide_base> waveguide)
             : compute_context_{compute_context}
-            , voxels_and_mesh_{waveguide::compute_voxels_and_mesh(
-                      compute_context,
-                      scene_data,
-                      receiver,
-                      waveguide->compute_sampling_frequency(),
-                      environment.speed_of_sound)}
-            , room_volume_{estimate_volume(voxels_and_mesh_.mesh)}
+            , voxels_and_mesh_{std::make_shared<waveguide::voxels_and_mesh>(
+                      waveguide::compute_voxels_and_mesh(
+                              compute_context,
+                              scene_data,
+                              check_receivers(receivers).front(),
+                              waveguide->compute_sampling_frequency(),
+                              environment.speed_of_sound,
+                              waveguide::stencil::rectilinear,
+                              true))}
+            , room_volume_{estimate_volume(voxels_and_mesh_->mesh)}
             , source_{source}
-            , receiver_{receiver}
+            , receivers_{std::move(receivers)}
             , environment_{environment}
             , raytracer_{raytracer}
             , waveguide_{std::move(waveguide)} {}
 
-    std::unique_ptr<intermediate> run(
+    impl(const core::compute_context& compute_context,
+         std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+         const glm::vec3& source,
+         util::aligned::vector<glm::vec3> receivers,
+         const core::environment& environment,
+         const raytracer::simulation_parameters& raytracer,
+         std::unique_ptr<waveguide_base> waveguide)
+            : compute_context_{compute_context}
+            , voxels_and_mesh_{check_voxels_and_mesh(
+                      std::move(voxels_and_mesh))}
+            , room_volume_{estimate_volume(voxels_and_mesh_->mesh)}
+            , source_{source}
+            , receivers_{std::move(receivers)}
+            , environment_{environment}
+            , raytracer_{raytracer}
+            , waveguide_{std::move(waveguide)} {
+        check_receivers(receivers_);
+    }
+
+    util::aligned::vector<std::unique_ptr<intermediate>> run_all(
             const std::atomic_bool& keep_going) const {
         //  RAYTRACER  /////////////////////////////////////////////////////////
 
         const auto rays_to_visualise = std::min(32ul, raytracer_.rays);
 
-        engine_state_changed_(state::starting_raytracer, 1.0);
-
-        auto raytracer_output = raytracer::canonical(
-                compute_context_,
-                voxels_and_mesh_.voxels,
-                source_,
-                receiver_,
-                environment_,
-                raytracer_,
-                rays_to_visualise,
-                keep_going,
-                [&](auto step, auto total_steps) {
-                    engine_state_changed_(state::running_raytracer,
-                                          step / (total_steps - 1.0));
-                });
-
-
-        if (!(keep_going && raytracer_output)) {
-            return nullptr;
+        const auto run_raytracer = [&](const auto& receiver) {
+            engine_state_changed_(state::starting_raytracer, 1.0);
+
+            auto ret = raytracer::canonical(
+                    compute_context_,
+                    voxels_and_mesh_->voxels,
+                    source_,
+                    receiver,
+                    environment_,
+                    raytracer_,
+                    rays_to_visualise,
+                    keep_going,
+                    [&](auto step, auto total_steps) {
+                        engine_state_changed_(state::running_raytracer,
+                                              step / (total_steps - 1.0));
+                    });
+
+            if (ret) {
+                engine_state_changed_(state::finishing_raytracer, 1.0);
+            }
+
+            return ret;
+        };
+
+        util::aligned::vector<
+                decltype(run_raytracer(receivers_.front())->aural)>
+                raytracer_outputs;
+
+        //  The waveguide is shared, so it has to be long enough for the
+        //  longest raytracer output.
+        auto max_stochastic_time = 0.0;
+
+        for (const auto& receiver : receivers_) {
+            auto raytracer_output = run_raytracer(receiver);
+
+            if (!(keep_going && raytracer_output)) {
+                return {};
+            }
+
+            //  Visual reflections are traced from the source, so they only
+            //  need to be reported once.
+            if (raytracer_outputs.empty()) {
+                raytracer_reflections_generated_(
+                        std::move(raytracer_output->visual), source_);
+            }
+
+            //  look for the max time of an impulse
+            max_stochastic_time =
+                    std::max(max_stochastic_time,
+                             max_time(raytracer_output->aural.stochastic));
+
+            raytracer_outputs.emplace_back(std::move(raytracer_output->aural));
         }
 
-        engine_state_changed_(state::finishing_raytracer, 1.0);
-
-        raytracer_reflections_generated_(std::move(raytracer_output->visual),
-                                         source_);
-
-        //  look for the max time of an impulse
-        const auto max_stochastic_time =
-                max_time(raytracer_output->aural.stochastic);
-
         //  WAVEGUIDE  /////////////////////////////////////////////////////////
         engine_state_changed_(state::starting_waveguide, 1.0);
 
+        //  The low-frequency field usually settles into a steady decay long
+        //  before max_stochastic_time, so the waveguide stops once it has,
+        //  and the rest of its output is synthesized.
+
+        //  Pressures are only streamed if there are node pressure listeners.
+        std::experimental::optional<waveguide::postprocessor::snapshot>
+                snapshot;
+        if (!waveguide_node_pressures_changed_.empty()) {
+            snapshot.emplace(
+                    compute_context_,
+                    voxels_and_mesh_->mesh,
+                    snapshot_parameters_,
+                    [&](auto pressures) {
+                        const auto time =
+                                pressures.step /
+                                waveguide_->compute_sampling_frequency();
+                        const auto distance =
+                                time * environment_.speed_of_sound;
+                        waveguide_node_pressures_changed_(std::move(pressures),
+                                                          distance);
+                    });
+        }
+
         auto waveguide_output = waveguide_->run(
                 compute_context_,
-                voxels_and_mesh_,
+                *voxels_and_mesh_,
                 source_,
-                receiver_,
+                receivers_,
                 environment_,
                 max_stochastic_time,
                 keep_going,
-                [&](auto& queue, const auto& buffer, auto step, auto steps) {
-                    //  If there are node pressure listeners.
-                    if (!waveguide_node_pressures_changed_.empty()) {
-                        auto pressures =
-                                core::read_from_buffer<float>(queue, buffer);
-                        const auto time =
-                                step / waveguide_->compute_sampling_frequency();
-                        const auto distance =
-                                time * environment_.speed_of_sound;
-                        waveguide_node_pressures_changed_(std::move(pressures),
-                                                          distance);
+                [&](auto& queue,
+                    const auto& pressures,
+                    auto step,
+                    auto steps) {
+                    if (snapshot && snapshot->is_due(step)) {
+                        (*snapshot)(queue, pressures.get(), step);
                     }
 
                     engine_state_changed_(state::running_waveguide,
                                           step / (steps - 1.0));
-                });
+                },
+                waveguide::early_termination_parameters{},
+                checkpoint_parameters_,
+                partition_);
+
+        if (snapshot) {
+            snapshot->flush();
+        }
 
         if (!(keep_going && waveguide_output)) {
-            return nullptr;
+            return {};
         }
 
         engine_state_changed_(state::finishing_waveguide, 1.0);
 
-        return make_intermediate_impl_ptr(
-                make_combined_results(std::move(raytracer_output->aural),
-                                      std::move(*waveguide_output)),
-                source_,
-                receiver_,
-                room_volume_,
-                environment_);
+        util::aligned::vector<std::unique_ptr<intermediate>> ret;
+        for (auto i = 0u; i != receivers_.size(); ++i) {
+            ret.emplace_back(make_intermediate_impl_ptr(
+                    make_combined_results(
+                            std::move(raytracer_outputs[i]),
+                            std::move((*waveguide_output)[i])),
+                    source_,
+                    receivers_[i],
+                    room_volume_,
+                    environment_));
+        }
+        return ret;
     }
 
     //  notifications  /////////////////////////////////////////////////////////
@@ -206,21 +284,60 @@ public:
         return raytracer_reflections_generated_.connect(std::move(callback));
     }
 
+    void set_waveguide_snapshot_parameters(
+            const waveguide::postprocessor::snapshot_parameters& params) {
+        snapshot_parameters_ = params;
+    }
+
+    void set_waveguide_checkpoint_parameters(
+            const std::experimental::optional<waveguide::checkpoint_parameters>&
+                    params) {
+        checkpoint_parameters_ = params;
+    }
+
+    void set_waveguide_partition(
+            const std::experimental::optional<
+                    util::aligned::vector<core::compute_context>>& contexts) {
+        partition_ = contexts;
+    }
+
     //  cached data  ///////////////////////////////////////////////////////////
 
     const waveguide::voxels_and_mesh& get_voxels_and_mesh() const {
-        return voxels_and_mesh_;
+        return *voxels_and_mesh_;
     }
 
 private:
+    static const util::aligned::vector<glm::vec3>& check_receivers(
+            const util::aligned::vector<glm::vec3>& receivers) {
+        if (receivers.empty()) {
+            throw std::runtime_error{"At least one receiver is required."};
+        }
+        return receivers;
+    }
+
+    static std::shared_ptr<const waveguide::voxels_and_mesh>
+    check_voxels_and_mesh(
+            std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh) {
+        if (!voxels_and_mesh) {
+            throw std::runtime_error{"A mesh is required."};
+        }
+        return voxels_and_mesh;
+    }
+
     core::compute_context compute_context_;
-    waveguide::voxels_and_mesh voxels_and_mesh_;
+    std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh_;
     double room_volume_;
     glm::vec3 source_;
-    glm::vec3 receiver_;
+    util::aligned::vector<glm::vec3> receivers_;
     core::environment environment_;
     raytracer::simulation_parameters raytracer_;
     std::unique_ptr<waveguide_base> waveguide_;
+    waveguide::postprocessor::snapshot_parameters snapshot_parameters_;
+    std::experimental::optional<waveguide::checkpoint_parameters>
+            checkpoint_parameters_;
+    std::experimental::optional<util::aligned::vector<core::compute_context>>
+            partition_;
 
     engine_state_changed engine_state_changed_;
     waveguide_node_pressures_changed waveguide_node_pressures_changed_;
@@ -239,7 +356,39 @@ engine::engine(const core::compute_context& compute_context,
         : pimpl_{std::make_unique<impl>(compute_context,
                                         scene_data,
                                         source,
-                                        receiver,
+                                        util::aligned::vector<glm::vec3>{
+                                                receiver},
+                                        environment,
+                                        raytracer,
+                                        std::move(waveguide))} {}
+
+engine::engine(const core::compute_context& compute_context,
+               const core::gpu_scene_data& scene_data,
+               const glm::vec3& source,
+               util::aligned::vector<glm::vec3> receivers,
+               const core::environment& environment,
+               const raytracer::simulation_parameters& raytracer,
+               std::unique_ptr<waveguide_base> waveguide)
+        : pimpl_{std::make_unique<impl>(compute_context,
+                                        scene_data,
+                                        source,
+                                        std::move(receivers),
+                                        environment,
+                                        raytracer,
+                                        std::move(waveguide))} {}
+
+engine::engine(
+        const core::compute_context& compute_context,
+        std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+        const glm::vec3& source,
+        util::aligned::vector<glm::vec3> receivers,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        std::unique_ptr<waveguide_base> waveguide)
+        : pimpl_{std::make_unique<impl>(compute_context,
+                                        std::move(voxels_and_mesh),
+                                        source,
+                                        std::move(receivers),
                                         environment,
                                         raytracer,
                                         std::move(waveguide))} {}
@@ -248,7 +397,13 @@ engine::~engine() noexcept = default;
 
 std::unique_ptr<intermediate> engine::run(
         const std::atomic_bool& keep_going) const {
-    return pimpl_->run(keep_going);
+    auto ret = pimpl_->run_all(keep_going);
+    return ret.empty() ? nullptr : std::move(ret.front());
+}
+
+util::aligned::vector<std::unique_ptr<intermediate>> engine::run_all(
+        const std::atomic_bool& keep_going) const {
+    return pimpl_->run_all(keep_going);
 }
 
 engine::engine_state_changed::connection engine::connect_engine_state_changed(
@@ -269,6 +424,23 @@ engine::connect_raytracer_reflections_generated(
     return pimpl_->connect_raytracer_reflections_generated(std::move(callback));
 }
 
+void engine::set_waveguide_snapshot_parameters(
+        const waveguide::postprocessor::snapshot_parameters& params) {
+    pimpl_->set_waveguide_snapshot_parameters(params);
+}
+
+void engine::set_waveguide_checkpoint_parameters(
+        const std::experimental::optional<waveguide::checkpoint_parameters>&
+                params) {
+    pimpl_->set_waveguide_checkpoint_parameters(params);
+}
+
+void engine::set_waveguide_partition(
+        const std::experimental::optional<
+                util::aligned::vector<core::compute_context>>& contexts) {
+    pimpl_->set_waveguide_partition(contexts);
+}
+
 const waveguide::voxels_and_mesh& engine::get_voxels_and_mesh() const {
     return pimpl_->get_voxels_and_mesh();
 }
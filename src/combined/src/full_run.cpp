@@ -20,6 +20,38 @@ postprocessing_engine::postprocessing_engine(
                   raytracer,
                   std::move(waveguide)} {}
 
+postprocessing_engine::postprocessing_engine(
+        const core::compute_context& compute_context,
+        const core::gpu_scene_data& scene_data,
+        const glm::vec3& source,
+        util::aligned::vector<glm::vec3> receivers,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        std::unique_ptr<waveguide_base> waveguide)
+        : engine_{compute_context,
+                  scene_data,
+                  source,
+                  std::move(receivers),
+                  environment,
+                  raytracer,
+                  std::move(waveguide)} {}
+
+postprocessing_engine::postprocessing_engine(
+        const core::compute_context& compute_context,
+        std::shared_ptr<const waveguide::voxels_and_mesh> voxels_and_mesh,
+        const glm::vec3& source,
+        util::aligned::vector<glm::vec3> receivers,
+        const core::environment& environment,
+        const raytracer::simulation_parameters& raytracer,
+        std::unique_ptr<waveguide_base> waveguide)
+        : engine_{compute_context,
+                  std::move(voxels_and_mesh),
+                  source,
+                  std::move(receivers),
+                  environment,
+                  raytracer,
+                  std::move(waveguide)} {}
+
 postprocessing_engine::engine_state_changed::connection
 postprocessing_engine::connect_engine_state_changed(
         engine_state_changed::callback_type callback) {
@@ -38,6 +70,23 @@ postprocessing_engine::connect_raytracer_reflections_generated(
     return raytracer_reflections_generated_.connect(std::move(callback));
 }
 
+void postprocessing_engine::set_waveguide_snapshot_parameters(
+        const waveguide::postprocessor::snapshot_parameters& params) {
+    engine_.set_waveguide_snapshot_parameters(params);
+}
+
+void postprocessing_engine::set_waveguide_checkpoint_parameters(
+        const std::experimental::optional<waveguide::checkpoint_parameters>&
+                params) {
+    engine_.set_waveguide_checkpoint_parameters(params);
+}
+
+void postprocessing_engine::set_waveguide_partition(
+        const std::experimental::optional<
+                util::aligned::vector<core::compute_context>>& contexts) {
+    engine_.set_waveguide_partition(contexts);
+}
+
 //  get contents
 
 const waveguide::voxels_and_mesh& postprocessing_engine::get_voxels_and_mesh()
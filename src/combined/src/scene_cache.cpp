@@ -0,0 +1,119 @@
+#include "combined/scene_cache.h"
+
+#include "waveguide/mesh_cache.h"
+
+#include <algorithm>
+
+namespace wayverb {
+namespace combined {
+namespace {
+
+template <typename Vertex, typename Surface>
+bool same_geometry(const core::gpu_scene_data& a,
+                   const core::generic_scene_data<Vertex, Surface>& b) {
+    //  Only the first three elements of a cl_float3 are meaningful.
+    const auto same_vertex = [](const auto& i, const auto& j) {
+        return std::equal(i.s, i.s + 3, j.s);
+    };
+    return a.get_triangles() == b.get_triangles() &&
+           a.get_vertices().size() == b.get_vertices().size() &&
+           std::equal(begin(a.get_vertices()),
+                      end(a.get_vertices()),
+                      begin(b.get_vertices()),
+                      same_vertex);
+}
+
+/// Objects which are still in use elsewhere are copied before being
+/// modified, so that users never see them change.
+template <typename T>
+void make_unique_copy(std::shared_ptr<T>& t) {
+    if (t.use_count() != 1) {
+        t = std::make_shared<T>(*t);
+    }
+}
+
+}  // namespace
+
+void scene_cache::set_cache_directory(std::string directory) {
+    std::lock_guard<std::mutex> lck{mutex_};
+    cache_directory_ = std::move(directory);
+}
+
+std::shared_ptr<const scene_cache::voxelised_scene>
+scene_cache::get_voxelised_scene(const core::gpu_scene_data& scene) {
+    std::lock_guard<std::mutex> lck{mutex_};
+
+    if (!(voxelised_scene_ &&
+          same_geometry(scene, voxelised_scene_->get_scene_data()))) {
+        voxelised_scene_ = std::make_shared<voxelised_scene>(
+                core::make_voxelised_scene_data(scene, 5, 0.1f));
+    } else if (scene.get_surfaces() !=
+               voxelised_scene_->get_scene_data().get_surfaces()) {
+        make_unique_copy(voxelised_scene_);
+        voxelised_scene_->set_surfaces(begin(scene.get_surfaces()),
+                                       end(scene.get_surfaces()));
+    }
+
+    return voxelised_scene_;
+}
+
+std::shared_ptr<const waveguide::voxels_and_mesh>
+scene_cache::get_voxels_and_mesh(const core::compute_context& cc,
+                                  const core::gpu_scene_data& scene,
+                                  const glm::vec3& anchor,
+                                  double sample_rate,
+                                  double speed_of_sound) {
+    std::lock_guard<std::mutex> lck{mutex_};
+
+    const auto is_valid = [&] {
+        return voxels_and_mesh_ &&
+               same_geometry(scene,
+                             voxels_and_mesh_->voxels.get_scene_data()) &&
+               mesh_key_.anchor == anchor &&
+               mesh_key_.order == waveguide::compute_brick_order(cc) &&
+               mesh_key_.sample_rate == sample_rate &&
+               mesh_key_.speed_of_sound == speed_of_sound;
+    };
+
+    if (!is_valid()) {
+        voxels_and_mesh_ = std::make_shared<waveguide::voxels_and_mesh>(
+                cache_directory_.empty()
+                        ? waveguide::compute_voxels_and_mesh(
+                                  cc,
+                                  scene,
+                                  anchor,
+                                  sample_rate,
+                                  speed_of_sound,
+                                  waveguide::stencil::rectilinear,
+                                  true)
+                        : waveguide::compute_voxels_and_mesh(
+                                  cc,
+                                  scene,
+                                  anchor,
+                                  sample_rate,
+                                  speed_of_sound,
+                                  cache_directory_,
+                                  true));
+        mesh_key_ = mesh_key{anchor,
+                             sample_rate,
+                             speed_of_sound,
+                             waveguide::compute_brick_order(cc)};
+    } else if (scene.get_surfaces() !=
+               voxels_and_mesh_->voxels.get_scene_data().get_surfaces()) {
+        make_unique_copy(voxels_and_mesh_);
+        auto& voxels_and_mesh = *voxels_and_mesh_;
+        voxels_and_mesh.voxels.set_surfaces(begin(scene.get_surfaces()),
+                                            end(scene.get_surfaces()));
+        voxels_and_mesh.mesh.set_coefficients(
+                waveguide::compute_boundary_coefficients(
+                        scene.get_surfaces(),
+                        compute_sample_rate(
+                                voxels_and_mesh.mesh.get_descriptor(),
+                                speed_of_sound)));
+    }
+
+    return voxels_and_mesh_;
+}
+
+}  // namespace combined
+}  // namespace wayverb
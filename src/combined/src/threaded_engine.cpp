@@ -4,14 +4,20 @@
 #include "combined/waveguide_base.h"
 
 #include "waveguide/config.h"
+#include "waveguide/mesh_cache.h"
 
 #include "core/dsp_vector_ops.h"
 #include "core/environment.h"
 
 #include "waveguide/mesh.h"
 
+#include "utilities/fnv1a.h"
+
 #include "audio_file/audio_file.h"
 
+#include <iomanip>
+#include <sstream>
+
 namespace wayverb {
 namespace combined {
 namespace {
@@ -28,6 +34,55 @@ struct channel_info final {
     std::string file_name;
 };
 
+/// Steps between waveguide snapshots.
+/// Each snapshot writes out the whole mesh, so they shouldn't be too frequent.
+constexpr size_t checkpoint_interval = 1 << 10;
+
+/// Names the checkpoint file for the waveguide run from one source.
+/// The file header only identifies the mesh and its boundaries, so the name
+/// covers the rest of the setup, and a run never resumes from a snapshot of
+/// a different one.
+std::string compute_checkpoint_path(const std::string& directory,
+                                    const core::gpu_scene_data& scene,
+                                    const model::persistent& persistent,
+                                    const glm::vec3& source,
+                                    const util::aligned::vector<glm::vec3>&
+                                            receivers,
+                                    const core::environment& environment) {
+    util::fnv1a hash;
+    hash(waveguide::compute_mesh_cache_key(
+            scene,
+            receivers.front(),
+            compute_sampling_frequency(*persistent.waveguide()),
+            environment.speed_of_sound));
+
+    for (const auto& surface : scene.get_surfaces()) {
+        for (const auto i : surface.absorption.s) {
+            hash(i);
+        }
+        for (const auto i : surface.scattering.s) {
+            hash(i);
+        }
+    }
+
+    hash(static_cast<int>(persistent.waveguide().item()->get_mode()));
+
+    const auto hash_position = [&](const auto& position) {
+        hash(position.x);
+        hash(position.y);
+        hash(position.z);
+    };
+    hash_position(source);
+    for (const auto& receiver : receivers) {
+        hash_position(receiver);
+    }
+
+    std::ostringstream ret;
+    ret << directory << "/waveguide_" << std::hex << std::setw(16)
+        << std::setfill('0') << hash.get() << ".chk";
+    return ret.str();
+}
+
 }  // namespace
 
 std::unique_ptr<capsule_base> polymorphic_capsule_model(
@@ -54,13 +109,28 @@ std::unique_ptr<waveguide_base> polymorphic_waveguide_model(
 
 complete_engine::~complete_engine() noexcept { cancel(); }
 
+void complete_engine::set_mesh_cache_directory(std::string directory) {
+    scene_cache_.set_cache_directory(std::move(directory));
+}
+
+void complete_engine::set_checkpoint_directory(std::string directory) {
+    checkpoint_directory_ = std::move(directory);
+}
+
+void complete_engine::set_waveguide_partition(
+        util::aligned::vector<core::compute_context> contexts) {
+    partition_ = std::move(contexts);
+}
+
 bool complete_engine::is_running() const { return is_running_; }
 void complete_engine::cancel() { keep_going_ = false; }
 
-void complete_engine::run(core::compute_context compute_context,
-                          core::gpu_scene_data scene_data,
-                          model::persistent persistent,
-                          model::output output) {
+void complete_engine::run(
+        core::compute_context compute_context,
+        core::gpu_scene_data scene_data,
+        model::persistent persistent,
+        model::output output,
+        waveguide::postprocessor::snapshot_parameters snapshot_parameters) {
     cancel();
 
     future_ = std::async(std::launch::async, [
@@ -68,19 +138,23 @@ void complete_engine::run(core::compute_context compute_context,
         compute_context = std::move(compute_context),
         scene_data = std::move(scene_data),
         persistent = std::move(persistent),
-        output = std::move(output)
+        output = std::move(output),
+        snapshot_parameters = std::move(snapshot_parameters)
     ] {
         do_run(std::move(compute_context),
                std::move(scene_data),
                std::move(persistent),
-               std::move(output));
+               std::move(output),
+               std::move(snapshot_parameters));
     });
 }
 
-void complete_engine::do_run(core::compute_context compute_context,
-                             core::gpu_scene_data scene_data,
-                             model::persistent persistent,
-                             model::output output) {
+void complete_engine::do_run(
+        core::compute_context compute_context,
+        core::gpu_scene_data scene_data,
+        model::persistent persistent,
+        model::output output,
+        waveguide::postprocessor::snapshot_parameters snapshot_parameters) {
     try {
         is_running_ = true;
         keep_going_ = true;
@@ -120,13 +194,13 @@ void complete_engine::do_run(core::compute_context compute_context,
         {
             //  Check that all sources and receivers are inside the mesh.
             const auto voxelised =
-                    core::make_voxelised_scene_data(scene_data, 5, 0.1f);
+                    scene_cache_.get_voxelised_scene(scene_data);
 
             if (!are_all_inside(make_position_extractor_iterator(
                                         std::begin(*persistent.sources())),
                                 make_position_extractor_iterator(
                                         std::end(*persistent.sources())),
-                                voxelised)) {
+                                *voxelised)) {
                 throw std::runtime_error{"Source is outside mesh."};
             }
 
@@ -134,7 +208,7 @@ void complete_engine::do_run(core::compute_context compute_context,
                                         std::begin(*persistent.receivers())),
                                 make_position_extractor_iterator(
                                         std::end(*persistent.receivers())),
-                                voxelised)) {
+                                *voxelised)) {
                 throw std::runtime_error{"Receiver is outside mesh."};
             }
         }
@@ -146,93 +220,129 @@ void complete_engine::do_run(core::compute_context compute_context,
 
         std::vector<channel_info> all_channels;
 
-        const auto runs = persistent.sources().item()->size() *
-                          persistent.receivers().item()->size();
+        const auto& receivers = *persistent.receivers().item();
+
+        const auto receiver_positions = util::map_to_vector(
+                std::begin(receivers), std::end(receivers), [](const auto& i) {
+                    return i.item()->get_position();
+                });
+
+        //  The waveguide output for one source contains the response at every
+        //  receiver, so there is one run per source.
+        const auto runs = persistent.sources().item()->size();
+
+        if (receiver_positions.empty()) {
+            throw std::runtime_error{"At least one receiver is required."};
+        }
+
+        //  The mesh doesn't depend on the source, so all runs share one.
+        const auto voxels_and_mesh = scene_cache_.get_voxels_and_mesh(
+                compute_context,
+                scene_data,
+                receiver_positions.front(),
+                compute_sampling_frequency(*persistent.waveguide()),
+                environment.speed_of_sound);
 
         auto run = 0;
 
-        //  For each source-receiver pair.
+        //  For each source.
         for (auto source = std::begin(*persistent.sources().item()),
                   e_source = std::end(*persistent.sources().item());
              source != e_source && keep_going_;
-             ++source) {
-            for (auto receiver = std::begin(*persistent.receivers().item()),
-                      e_receiver = std::end(*persistent.receivers().item());
-                 receiver != e_receiver && keep_going_;
-                 ++receiver, ++run) {
-                //  Set up an engine to use.
-                postprocessing_engine eng{compute_context,
-                                          scene_data,
-                                          source->item()->get_position(),
-                                          receiver->item()->get_position(),
-                                          environment,
-                                          persistent.raytracer().item()->get(),
-                                          poly_waveguide->clone()};
-
-                //  Send new node position notification.
-                waveguide_node_positions_changed_(
-                        eng.get_voxels_and_mesh().mesh.get_descriptor());
-
-                //  Register callbacks.
-                if (!engine_state_changed_.empty()) {
-                    eng.connect_engine_state_changed([this, runs, run](
-                            auto state, auto progress) {
-                        engine_state_changed_(run, runs, state, progress);
-                    });
-                }
+             ++source, ++run) {
+            //  Set up an engine to use.
+            postprocessing_engine eng{compute_context,
+                                      voxels_and_mesh,
+                                      source->item()->get_position(),
+                                      receiver_positions,
+                                      environment,
+                                      persistent.raytracer().item()->get(),
+                                      poly_waveguide->clone()};
+
+            //  Send new node position notification.
+            waveguide_node_positions_changed_(
+                    eng.get_voxels_and_mesh().mesh.get_descriptor());
+
+            //  Register callbacks.
+            if (!engine_state_changed_.empty()) {
+                eng.connect_engine_state_changed(
+                        [this, runs, run](auto state, auto progress) {
+                            engine_state_changed_(run, runs, state, progress);
+                        });
+            }
 
-                if (!waveguide_node_pressures_changed_.empty()) {
-                    eng.connect_waveguide_node_pressures_changed(
-                            make_forwarding_call(
-                                    waveguide_node_pressures_changed_));
-                }
+            if (!waveguide_node_pressures_changed_.empty()) {
+                eng.set_waveguide_snapshot_parameters(snapshot_parameters);
+                eng.connect_waveguide_node_pressures_changed(
+                        make_forwarding_call(
+                                waveguide_node_pressures_changed_));
+            }
 
-                if (!raytracer_reflections_generated_.empty()) {
-                    eng.connect_raytracer_reflections_generated(
-                            make_forwarding_call(
-                                    raytracer_reflections_generated_));
-                }
+            if (!raytracer_reflections_generated_.empty()) {
+                eng.connect_raytracer_reflections_generated(
+                        make_forwarding_call(raytracer_reflections_generated_));
+            }
 
-                const auto polymorphic_capsules = util::map_to_vector(
-                        std::begin(*receiver->item()->capsules().item()),
-                        std::end(*receiver->item()->capsules().item()),
-                        [&](const auto& i) {
-                            return polymorphic_capsule_model(
-                                    *i.item(),
-                                    receiver->item()->get_orientation());
-                        });
+            if (!partition_.empty()) {
+                eng.set_waveguide_partition(partition_);
+            } else if (!checkpoint_directory_.empty()) {
+                eng.set_waveguide_checkpoint_parameters(
+                        waveguide::checkpoint_parameters{
+                                compute_checkpoint_path(
+                                        checkpoint_directory_,
+                                        scene_data,
+                                        persistent,
+                                        source->item()->get_position(),
+                                        receiver_positions,
+                                        environment),
+                                checkpoint_interval});
+            }
+
+            const auto polymorphic_capsules = util::map_to_vector(
+                    std::begin(receivers),
+                    std::end(receivers),
+                    [&](const auto& receiver) {
+                        return util::map_to_vector(
+                                std::begin(*receiver.item()->capsules().item()),
+                                std::end(*receiver.item()->capsules().item()),
+                                [&](const auto& i) {
+                                    return polymorphic_capsule_model(
+                                            *i.item(),
+                                            receiver.item()->get_orientation());
+                                });
+                    });
 
-                //  Run the simulation, cache the result.
-                auto channel =
-                        eng.run(begin(polymorphic_capsules),
+            //  Run the simulation, cache the results.
+            auto channels =
+                    eng.run_all(begin(polymorphic_capsules),
                                 end(polymorphic_capsules),
                                 get_sample_rate(output.get_sample_rate()),
                                 keep_going_);
 
-                //  If user cancelled while processing the channel, channel
-                //  will be null, but we want to exit before throwing an
-                //  exception.
-                if (!keep_going_) {
-                    break;
-                }
+            //  If user cancelled while processing the channels, channels
+            //  will be null, but we want to exit before throwing an
+            //  exception.
+            if (!keep_going_) {
+                break;
+            }
 
-                if (!channel) {
-                    throw std::runtime_error{
-                            "Encountered unknown error, causing channel not to "
-                            "be rendered."};
-                }
+            if (!channels) {
+                throw std::runtime_error{
+                        "Encountered unknown error, causing channel not to "
+                        "be rendered."};
+            }
 
-                for (size_t i = 0,
-                            e = receiver->item()->capsules().item()->size();
-                     i != e;
-                     ++i) {
+            for (size_t i = 0, e = receivers.size(); i != e; ++i) {
+                const auto& receiver = *receivers[i].item();
+                for (size_t j = 0, e = receiver.capsules().item()->size();
+                     j != e;
+                     ++j) {
                     all_channels.emplace_back(channel_info{
-                            std::move((*channel)[i]),
+                            std::move((*channels)[i][j]),
                             compute_output_path(
                                     *source->item(),
-                                    *receiver->item(),
-                                    *(*receiver->item()->capsules().item())[i]
-                                             .item(),
+                                    receiver,
+                                    *(*receiver.capsules().item())[j].item(),
                                     output)});
                 }
             }
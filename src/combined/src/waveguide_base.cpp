@@ -19,33 +19,79 @@ public:
         return waveguide::compute_sampling_frequency(sim_params_);
     }
 
-    std::experimental::optional<util::aligned::vector<waveguide::bandpass_band>>
+    using waveguide_base::run;
+
+    std::experimental::optional<util::aligned::vector<
+            util::aligned::vector<waveguide::bandpass_band>>>
     run(const core::compute_context& cc,
         const waveguide::voxels_and_mesh& voxelised,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        std::function<void(cl::CommandQueue& queue,
-                           const cl::Buffer& buffer,
-                           size_t step,
-                           size_t steps)> pressure_callback) override {
+        pressure_callback_t pressure_callback,
+        const std::experimental::optional<
+                waveguide::early_termination_parameters>& early_termination,
+        const std::experimental::optional<waveguide::checkpoint_parameters>&
+                checkpoint,
+        const std::experimental::optional<
+                util::aligned::vector<core::compute_context>>& partition)
+            override {
         return waveguide::canonical(cc,
-                                    std::move(voxelised),
+                                    voxelised,
                                     source,
-                                    receiver,
+                                    receivers,
                                     environment,
                                     sim_params_,
                                     simulation_time,
                                     keep_going,
-                                    std::move(pressure_callback));
+                                    std::move(pressure_callback),
+                                    early_termination,
+                                    std::experimental::nullopt,
+                                    checkpoint,
+                                    partition);
     }
 
 private:
     T sim_params_;
 };
 
+std::experimental::optional<util::aligned::vector<waveguide::bandpass_band>>
+waveguide_base::run(const core::compute_context& cc,
+                    const waveguide::voxels_and_mesh& voxelised,
+                    const glm::vec3& source,
+                    const glm::vec3& receiver,
+                    const core::environment& environment,
+                    double simulation_time,
+                    const std::atomic_bool& keep_going,
+                    pressure_callback_t pressure_callback,
+                    const std::experimental::optional<
+                            waveguide::early_termination_parameters>&
+                            early_termination,
+                    const std::experimental::optional<
+                            waveguide::checkpoint_parameters>& checkpoint,
+                    const std::experimental::optional<
+                            util::aligned::vector<core::compute_context>>&
+                            partition) {
+    if (auto ret = run(cc,
+                       voxelised,
+                       source,
+                       util::aligned::vector<glm::vec3>{receiver},
+                       environment,
+                       simulation_time,
+                       keep_going,
+                       std::move(pressure_callback),
+                       early_termination,
+                       checkpoint,
+                       partition)) {
+        return std::move(ret->front());
+    }
+    return std::experimental::nullopt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 std::unique_ptr<waveguide_base> make_waveguide_ptr(
         const waveguide::single_band_parameters& t) {
     return std::make_unique<
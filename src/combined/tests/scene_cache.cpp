@@ -0,0 +1,134 @@
+#include "combined/scene_cache.h"
+
+#include "waveguide/mesh_cache.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace wayverb::combined;
+using namespace wayverb::core;
+
+namespace {
+
+constexpr auto sample_rate = 2000.0;
+constexpr auto speed_of_sound = 340.0;
+constexpr auto anchor = glm::vec3{1, 1, 1};
+
+const auto box = geo::box{glm::vec3{0}, glm::vec3{4, 3, 2}};
+
+}  // namespace
+
+TEST(scene_cache, reuse_when_unchanged) {
+    const compute_context cc{};
+    const auto scene =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0));
+
+    scene_cache cache;
+    const auto a = cache.get_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    const auto b = cache.get_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    ASSERT_EQ(a, b);
+
+    ASSERT_EQ(cache.get_voxelised_scene(scene),
+              cache.get_voxelised_scene(scene));
+}
+
+TEST(scene_cache, materials_only) {
+    const compute_context cc{};
+    const auto scene_a =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0));
+    const auto scene_b =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.5, 0));
+
+    scene_cache cache;
+    const auto a = cache.get_voxels_and_mesh(
+            cc, scene_a, anchor, sample_rate, speed_of_sound);
+    const auto b = cache.get_voxels_and_mesh(
+            cc, scene_b, anchor, sample_rate, speed_of_sound);
+
+    //  The first result is still alive, so it must not have been modified.
+    ASSERT_NE(a, b);
+    ASSERT_EQ(a->voxels.get_scene_data().get_surfaces(),
+              scene_a.get_surfaces());
+    ASSERT_EQ(b->voxels.get_scene_data().get_surfaces(),
+              scene_b.get_surfaces());
+
+    //  The mesh structure is reused, only the filters are different.
+    ASSERT_EQ(a->mesh.get_descriptor(), b->mesh.get_descriptor());
+    ASSERT_EQ(a->mesh.get_structure().get_condensed_nodes(),
+              b->mesh.get_structure().get_condensed_nodes());
+
+    const auto fresh = wayverb::waveguide::compute_voxels_and_mesh(
+            cc,
+            scene_b,
+            anchor,
+            sample_rate,
+            speed_of_sound,
+            wayverb::waveguide::stencil::rectilinear,
+            true);
+    ASSERT_EQ(b->mesh.get_structure().get_coefficients(),
+              fresh.mesh.get_structure().get_coefficients());
+}
+
+TEST(scene_cache, rebuild_on_geometry_change) {
+    const compute_context cc{};
+    const auto surface = make_surface<simulation_bands>(0.1, 0);
+    const auto scene_a = geo::get_scene_data(box, surface);
+    const auto scene_b = geo::get_scene_data(
+            geo::box{glm::vec3{0}, glm::vec3{4, 3, 3}}, surface);
+
+    scene_cache cache;
+    const auto a = cache.get_voxels_and_mesh(
+            cc, scene_a, anchor, sample_rate, speed_of_sound);
+    const auto b = cache.get_voxels_and_mesh(
+            cc, scene_b, anchor, sample_rate, speed_of_sound);
+    ASSERT_NE(a->mesh.get_descriptor(), b->mesh.get_descriptor());
+
+    const auto c = cache.get_voxels_and_mesh(
+            cc, scene_b, glm::vec3{2, 1, 1}, sample_rate, speed_of_sound);
+    ASSERT_NE(b, c);
+}
+
+TEST(scene_cache, disk_cache) {
+    const compute_context cc{};
+    const auto scene =
+            geo::get_scene_data(box, make_surface<simulation_bands>(0.1, 0));
+
+    std::ostringstream path;
+    path << SCRATCH_PATH << '/' << std::hex << std::setw(16)
+         << std::setfill('0')
+         << wayverb::waveguide::compute_mesh_cache_key(
+                    scene,
+                    anchor,
+                    sample_rate,
+                    speed_of_sound,
+                    wayverb::waveguide::compute_brick_order(cc))
+         << ".mesh";
+    std::remove(path.str().c_str());
+
+    scene_cache writer;
+    writer.set_cache_directory(SCRATCH_PATH);
+    const auto written = writer.get_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    ASSERT_TRUE(std::ifstream{path.str()}.good());
+
+    //  A new cache, as in a later session, should load the stored mesh.
+    scene_cache reader;
+    reader.set_cache_directory(SCRATCH_PATH);
+    const auto read = reader.get_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    std::remove(path.str().c_str());
+
+    ASSERT_EQ(written->mesh.get_descriptor(), read->mesh.get_descriptor());
+    ASSERT_EQ(written->mesh.get_structure().get_condensed_nodes(),
+              read->mesh.get_structure().get_condensed_nodes());
+    ASSERT_EQ(written->mesh.get_structure().get_coefficients(),
+              read->mesh.get_structure().get_coefficients());
+}
@@ -52,3 +52,33 @@ TEST(engine, engine) {
     const auto result =
             intermediate->postprocess(attenuator::null{}, output_sample_rate);
 }
+
+TEST(engine, multiple_receivers) {
+    constexpr auto min = glm::vec3{0, 0, 0};
+    constexpr auto max = glm::vec3{5.56, 3.97, 2.81};
+    const auto box = geo::box{min, max};
+    constexpr auto source = glm::vec3{2.09, 2.12, 2.12};
+    const util::aligned::vector<glm::vec3> receivers{{2.09, 3.08, 0.96},
+                                                     {4.12, 1.03, 1.54}};
+    constexpr auto output_sample_rate = 96000.0;
+    constexpr auto surface = make_surface<simulation_bands>(0.1, 0.1);
+
+    const auto scene_data = geo::get_scene_data(box, surface);
+
+    engine e{compute_context{},
+             scene_data,
+             source,
+             receivers,
+             wayverb::core::environment{},
+             simulation_parameters{1 << 16, 5},
+             make_waveguide_ptr(single_band_parameters{1000, 0.5})};
+
+    const auto intermediates = e.run_all(true);
+    ASSERT_EQ(intermediates.size(), receivers.size());
+
+    for (const auto& i : intermediates) {
+        ASSERT_NE(i, nullptr);
+        ASSERT_FALSE(i->postprocess(attenuator::null{}, output_sample_rate)
+                             .empty());
+    }
+}
@@ -22,6 +22,12 @@ public:
 
     const auto& get_output() const { return output_; }
 
+    /// Saves the outputs so far, along with the postprocessor's own state.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(output_, postprocessor_);
+    }
+
 private:
     util::aligned::vector<Ret> output_;
     T postprocessor_;
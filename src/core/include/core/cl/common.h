@@ -9,16 +9,25 @@ namespace core {
 
 enum class device_type { cpu, gpu };
 
+/// Selects the engine used to run the waveguide update.
+/// opencl: run the update kernel on the context's device.
+/// native: run a multithreaded C++ implementation of the same update on the
+///         host. The context is still used for buffers, and for the
+///         raytracer, which always runs through OpenCL.
+enum class compute_backend { opencl, native };
+
 /// invariant: device is a valid device for the context
 class compute_context final {
 public:
     compute_context();
     explicit compute_context(device_type type);
+    compute_context(device_type type, compute_backend backend);
     explicit compute_context(const cl::Context& context);
     compute_context(const cl::Context& context, const cl::Device& device);
 
     cl::Context context;
     cl::Device device;
+    compute_backend backend{compute_backend::opencl};
 };
 
 template <typename T>
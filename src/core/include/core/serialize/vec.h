@@ -16,4 +16,14 @@ void serialize(Archive& archive, glm::vec3& m) {
     archive(m.x, m.y, m.z);
 }
 
+template <typename Archive>
+void serialize(Archive& archive, glm::dvec2& m) {
+    size_type s = 2;
+    archive(make_size_tag(s));
+    if (s != 2) {
+        throw std::runtime_error("Vec array length is incorrect.");
+    }
+    archive(m.x, m.y);
+}
+
 }  // namespace cereal
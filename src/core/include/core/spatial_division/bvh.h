@@ -0,0 +1,101 @@
+#pragma once
+
+#include "core/cl/voxel_structs.h"
+#include "core/geo/triangle_vec.h"
+#include "core/scene_data.h"
+
+#include "utilities/aligned/vector.h"
+#include "utilities/map_to_vector.h"
+
+#include <experimental/optional>
+
+namespace wayverb {
+namespace core {
+
+/// A node in a flattened bounding volume hierarchy.
+///
+/// Nodes are stored depth-first, so the first child of an interior node
+/// always follows it directly.
+///
+/// For an interior node, `count` is zero and `first` is the index of the
+/// second child.
+/// For a leaf, `first` and `count` give a range of the hierarchy's triangle
+/// indices.
+struct alignas(1 << 4) bvh_node final {
+    aabb bounds;
+    cl_uint first;
+    cl_uint count;
+};
+
+template <>
+struct cl_representation<bvh_node> final {
+    static constexpr auto value = R"(
+typedef struct {
+    aabb bounds;
+    uint first;
+    uint count;
+} bvh_node;
+)";
+};
+
+constexpr auto to_tuple(const bvh_node& x) {
+    return std::tie(x.bounds, x.first, x.count);
+}
+
+constexpr bool operator==(const bvh_node& a, const bvh_node& b) {
+    return to_tuple(a) == to_tuple(b);
+}
+
+constexpr bool operator!=(const bvh_node& a, const bvh_node& b) {
+    return !(a == b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// A bounding volume hierarchy over the triangles of a scene, for finding
+/// the closest triangle to a point.
+///
+/// The voxel grid is good for rays, but a point far from any surface has to
+/// search an ever-growing block of voxels. The hierarchy instead lets whole
+/// regions of the scene be discarded as soon as they are further away than
+/// the best triangle found so far.
+///
+/// The flattened nodes can be copied straight to the GPU, where
+/// `cl_sources::bvh` walks them in exactly the same way as
+/// `closest_triangle` does on the CPU.
+class bvh final {
+public:
+    /// Builds the hierarchy by splitting at the median centroid along the
+    /// longest axis, until no more than `leaf_size` triangles remain.
+    explicit bvh(util::aligned::vector<geo::triangle_vec3> triangles,
+                 size_t leaf_size = 4);
+
+    const util::aligned::vector<bvh_node>& get_nodes() const;
+
+    /// Indices into the scene's triangles, in the order referenced by the
+    /// leaves.
+    const util::aligned::vector<cl_uint>& get_triangle_indices() const;
+
+    /// The index of the scene triangle closest to `pt`, or nothing if there
+    /// are no triangles.
+    std::experimental::optional<size_t> closest_triangle(
+            const glm::vec3& pt) const;
+
+private:
+    /// The triangles, in leaf order.
+    util::aligned::vector<geo::triangle_vec3> triangles_;
+    util::aligned::vector<cl_uint> triangle_indices_;
+    util::aligned::vector<bvh_node> nodes_;
+};
+
+template <typename Vertex, typename Surface>
+bvh make_bvh(const generic_scene_data<Vertex, Surface>& scene) {
+    const auto& triangles = scene.get_triangles();
+    return bvh{util::map_to_vector(
+            begin(triangles), end(triangles), [&](const auto& i) {
+                return geo::get_triangle_vec3(i, scene.get_vertices().data());
+            })};
+}
+
+}  // namespace core
+}  // namespace wayverb
@@ -35,7 +35,13 @@ public:
             , surfaces_{
                       load_to_buffer(context_,
                                      scene_data.get_scene_data().get_surfaces(),
-                                     true)} {}
+                                     true)}
+            , bvh_nodes_{load_to_buffer(
+                      context_, scene_data.get_bvh().get_nodes(), true)}
+            , bvh_triangle_indices_{load_to_buffer(
+                      context_,
+                      scene_data.get_bvh().get_triangle_indices(),
+                      true)} {}
 
     cl::Context get_context() const { return context_; }
 
@@ -47,6 +53,11 @@ public:
     const cl::Buffer& get_vertices_buffer() const { return vertices_; }
     const cl::Buffer& get_surfaces_buffer() const { return surfaces_; }
 
+    const cl::Buffer& get_bvh_nodes_buffer() const { return bvh_nodes_; }
+    const cl::Buffer& get_bvh_triangle_indices_buffer() const {
+        return bvh_triangle_indices_;
+    }
+
 private:
     const cl::Context context_;
 
@@ -57,6 +68,9 @@ private:
     const cl::Buffer triangles_;
     const cl::Buffer vertices_;
     const cl::Buffer surfaces_;
+
+    const cl::Buffer bvh_nodes_;
+    const cl::Buffer bvh_triangle_indices_;
 };
 
 template <typename Vertex, typename Surface>
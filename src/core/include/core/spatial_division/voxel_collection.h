@@ -102,6 +102,11 @@ public:
             : aabb_{tree.get_aabb()}
             , data_{detail::voxelise(tree)} {}
 
+    /// Construct from voxel data which has already been computed.
+    voxel_collection(const aabb_type& aabb, data_type data)
+            : aabb_{aabb}
+            , data_{std::move(data)} {}
+
     aabb_type get_aabb() const { return aabb_; }
     size_t get_side() const { return data_.size(); }
     const auto& get_voxel(indexing::index_t<n> i) const {
@@ -135,6 +140,11 @@ auto voxel_aabb(const voxel_collection<n>& voxels, indexing::index_t<n> i) {
 /// Returns a flat array-representation of the collection.
 util::aligned::vector<cl_uint> get_flattened(const voxel_collection<3>& voxels);
 
+/// The inverse of get_flattened.
+/// Throws if `flattened` is not a valid flat representation.
+voxel_collection<3> get_unflattened(
+        const geo::box& aabb, const util::aligned::vector<cl_uint>& flattened);
+
 /// arguments
 ///     a ray and
 ///     a set of indices to objects to test against some condition
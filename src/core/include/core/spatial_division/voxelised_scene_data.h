@@ -3,6 +3,7 @@
 #include "core/azimuth_elevation.h"
 #include "core/geo/geometric.h"
 #include "core/scene_data.h"
+#include "core/spatial_division/bvh.h"
 #include "core/spatial_division/voxel_collection.h"
 
 #include <random>
@@ -41,11 +42,23 @@ public:
                                           scene_.get_vertices().data()));
                       },
                       compute_triangle_indices(scene_.get_triangles().size()),
-                      aabb}} {}
+                      aabb}}
+            , bvh_{make_bvh(scene_)} {}
+
+    /// For when the voxels have already been computed for this scene (e.g.
+    /// when loading from a cache).
+    /// The caller is responsible for upholding the invariant.
+    voxelised_scene_data(scene_data scene, voxel_collection<3> voxels)
+            : scene_{std::move(scene)}
+            , voxels_{std::move(voxels)}
+            , bvh_{make_bvh(scene_)} {}
 
     const scene_data& get_scene_data() const { return scene_; }
     const voxel_collection<3>& get_voxels() const { return voxels_; }
 
+    /// For nearest-surface queries, which the voxels are poorly suited to.
+    const bvh& get_bvh() const { return bvh_; }
+
     //  We can allow modifying surfaces without violating the invariant.
     template <typename It>
     void set_surfaces(It begin, It end) {
@@ -56,6 +69,7 @@ public:
 private:
     scene_data scene_;
     voxel_collection<3> voxels_;
+    bvh bvh_;
 };
 
 template <typename Vertex, typename Surface, typename T>
@@ -0,0 +1,213 @@
+#include "core/cl/bvh.h"
+
+namespace wayverb {
+namespace core {
+namespace cl_sources {
+const char* bvh = R"(
+//  adapted from
+//  http://www.geometrictools.com/GTEngine/Include/Mathematics/GteDistPointtriangleExact.h
+float point_triangle_distance_squared(triangle_verts triangle, float3 point);
+float point_triangle_distance_squared(triangle_verts triangle, float3 point) {
+    //  do I hate this? yes
+    //  am I going to do anything about it? it works
+    const float3 diff = point - triangle.v0;
+    const float3 e0 = triangle.v1 - triangle.v0;
+    const float3 e1 = triangle.v2 - triangle.v0;
+    const float a00 = dot(e0, e0);
+    const float a01 = dot(e0, e1);
+    const float a11 = dot(e1, e1);
+    const float b0 = -dot(diff, e0);
+    const float b1 = -dot(diff, e1);
+    const float det = a00 * a11 - a01 * a01;
+
+    float t0 = a01 * b1 - a11 * b0;
+    float t1 = a01 * b0 - a00 * b1;
+
+    if (t0 + t1 <= det) {
+        if (t0 < 0) {
+            if (t1 < 0) {
+                if (b0 < 0) {
+                    t1 = 0;
+                    if (a00 <= -b0) {
+                        t0 = 1;
+                    } else {
+                        t0 = -b0 / a00;
+                    }
+                } else {
+                    t0 = 0;
+                    if (0 <= b1) {
+                        t1 = 0;
+                    } else if (a11 <= -b1) {
+                        t1 = 1;
+                    } else {
+                        t1 = -b1 / a11;
+                    }
+                }
+            } else {
+                t0 = 0;
+                if (0 <= b1) {
+                    t1 = 0;
+                } else if (a11 <= -b1) {
+                    t1 = 1;
+                } else {
+                    t1 = -b1 / a11;
+                }
+            }
+        } else if (t1 < 0) {
+            t1 = 0;
+            if (0 <= b0) {
+                t0 = 0;
+            } else if (a00 <= -b0) {
+                t0 = 1;
+            } else {
+                t0 = -b0 / a00;
+            }
+        } else {
+            const float invDet = 1 / det;
+            t0 *= invDet;
+            t1 *= invDet;
+        }
+    } else {
+        if (t0 < 0) {
+            const float tmp0 = a01 + b0;
+            const float tmp1 = a11 + b1;
+            if (tmp0 < tmp1) {
+                const float numer = tmp1 - tmp0;
+                const float denom = a00 - 2 * a01 + a11;
+                if (denom <= numer) {
+                    t0 = 1;
+                    t1 = 0;
+                } else {
+                    t0 = numer / denom;
+                    t1 = 1 - t0;
+                }
+            } else {
+                t0 = 0;
+                if (tmp1 <= 0) {
+                    t1 = 1;
+                } else if (0 <= b1) {
+                    t1 = 0;
+                } else {
+                    t1 = -b1 / a11;
+                }
+            }
+        } else if (t1 < 0) {
+            const float tmp0 = a01 + b1;
+            const float tmp1 = a00 + b0;
+            if (tmp0 < tmp1) {
+                const float numer = tmp1 - tmp0;
+                const float denom = a00 - 2 * a01 + a11;
+                if (denom <= numer) {
+                    t1 = 1;
+                    t0 = 0;
+                } else {
+                    t1 = numer / denom;
+                    t0 = 1 - t1;
+                }
+            } else {
+                t1 = 0;
+                if (tmp1 <= 0) {
+                    t0 = 1;
+                } else if (0 <= b0) {
+                    t0 = 0;
+                } else {
+                    t0 = -b0 / a00;
+                }
+            }
+        } else {
+            const float numer = a11 + b1 - a01 - b0;
+            if (numer <= 0) {
+                t0 = 0;
+                t1 = 1;
+            } else {
+                const float denom = a00 - 2 * a01 + a11;
+                if (denom <= numer) {
+                    t0 = 1;
+                    t1 = 0;
+                } else {
+                    t0 = numer / denom;
+                    t1 = 1 - t0;
+                }
+            }
+        }
+    }
+
+    const float3 closest = triangle.v0 + e0 * t0 + e1 * t1;
+    const float3 d = point - closest;
+    return dot(d, d);
+}
+
+float point_triangle_dist_squared(triangle t, const global float3* vertices, float3 point);
+float point_triangle_dist_squared(triangle t, const global float3* vertices, float3 point) {
+    const triangle_verts this_triangle_verts = {vertices[t.v0],
+                                                vertices[t.v1],
+                                                vertices[t.v2]};
+    return point_triangle_distance_squared(this_triangle_verts, point);
+}
+
+float min_dist_to_cuboid_squared(float3 pt, aabb cuboid);
+float min_dist_to_cuboid_squared(float3 pt, aabb cuboid) {
+    const float3 d = max((float3)(0), max(cuboid.c0 - pt, pt - cuboid.c1));
+    return dot(d, d);
+}
+
+#define BVH_MAX_STACK_DEPTH 64
+
+//  Finds the closest triangle to a point by walking a bounding volume
+//  hierarchy, nearer children first, skipping any node which is further away
+//  than the best triangle so far.
+//  Returns ~(uint)(0) if there are no triangles.
+uint bvh_closest_triangle(float3 pt,
+                          const global bvh_node* nodes,
+                          const global uint* triangle_indices,
+                          const global triangle* triangles,
+                          const global float3* vertices);
+uint bvh_closest_triangle(float3 pt,
+                          const global bvh_node* nodes,
+                          const global uint* triangle_indices,
+                          const global triangle* triangles,
+                          const global float3* vertices) {
+    float best_distance = INFINITY;
+    uint best_index = ~(uint)(0);
+
+    uint stack[BVH_MAX_STACK_DEPTH];
+    uint stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size) {
+        const uint index = stack[--stack_size];
+        const bvh_node node = nodes[index];
+        if (best_distance <= min_dist_to_cuboid_squared(pt, node.bounds)) {
+            continue;
+        }
+
+        if (node.count) {
+            for (uint i = node.first; i != node.first + node.count; ++i) {
+                const uint triangle_index = triangle_indices[i];
+                const float d = point_triangle_dist_squared(
+                        triangles[triangle_index], vertices, pt);
+                if (d < best_distance) {
+                    best_distance = d;
+                    best_index = triangle_index;
+                }
+            }
+        } else {
+            uint near = index + 1;
+            uint far = node.first;
+            if (min_dist_to_cuboid_squared(pt, nodes[far].bounds) <
+                min_dist_to_cuboid_squared(pt, nodes[near].bounds)) {
+                const uint tmp = near;
+                near = far;
+                far = tmp;
+            }
+            stack[stack_size++] = far;
+            stack[stack_size++] = near;
+        }
+    }
+
+    return best_index;
+}
+)";
+}  // namespace cl_sources
+}  // namespace core
+}  // namespace wayverb
@@ -29,6 +29,8 @@ cl::Context get_context(device_type type) {
 cl::Device get_device(const cl::Context& context) {
     auto devices = context.getInfo<CL_CONTEXT_DEVICES>();
 
+#ifndef WAYVERB_SINGLE_PRECISION_FILTERS
+    //  Waveguide boundary filters are run in double precision.
     devices.erase(
             std::remove_if(
                     begin(devices),
@@ -44,6 +46,7 @@ cl::Device get_device(const cl::Context& context) {
         throw std::runtime_error(
                 "No available OpenCL devices support double precision.");
     }
+#endif
 
     devices.erase(remove_if(begin(devices),
                             end(devices),
@@ -81,6 +84,11 @@ compute_context::compute_context() {
 compute_context::compute_context(device_type type)
         : compute_context(core::get_context(type)) {}
 
+compute_context::compute_context(device_type type, compute_backend backend)
+        : compute_context(type) {
+    this->backend = backend;
+}
+
 compute_context::compute_context(const cl::Context& context)
         : compute_context(context, core::get_device(context)) {}
 
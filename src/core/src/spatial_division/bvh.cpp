@@ -0,0 +1,186 @@
+#include "core/spatial_division/bvh.h"
+#include "core/conversions.h"
+#include "core/geo/box.h"
+#include "core/geo/geometric.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace wayverb {
+namespace core {
+
+namespace {
+
+/// Deep enough for a median-split hierarchy over any number of triangles
+/// which can be indexed with a cl_uint.
+constexpr size_t max_stack_depth = 64;
+
+geo::box compute_bounds(const geo::triangle_vec3& t) {
+    return {glm::min(glm::min(t.s[0], t.s[1]), t.s[2]),
+            glm::max(glm::max(t.s[0], t.s[1]), t.s[2])};
+}
+
+glm::vec3 compute_centroid(const geo::triangle_vec3& t) {
+    return (t.s[0] + t.s[1] + t.s[2]) / 3.0f;
+}
+
+geo::box combine(const geo::box& a, const geo::box& b) {
+    return {glm::min(a.get_min(), b.get_min()),
+            glm::max(a.get_max(), b.get_max())};
+}
+
+float min_distance_squared(const glm::vec3& pt, const aabb& bounds) {
+    const auto d = glm::max(
+            glm::vec3{0},
+            glm::max(to_vec3{}(bounds.c0) - pt, pt - to_vec3{}(bounds.c1)));
+    return glm::dot(d, d);
+}
+
+class bvh_builder final {
+public:
+    bvh_builder(const util::aligned::vector<geo::triangle_vec3>& triangles,
+                size_t leaf_size)
+            : bounds_{util::map_to_vector(
+                      begin(triangles), end(triangles), compute_bounds)}
+            , centroids_{util::map_to_vector(
+                      begin(triangles), end(triangles), compute_centroid)}
+            , order_(triangles.size())
+            , leaf_size_{leaf_size} {
+        std::iota(order_.begin(), order_.end(), 0);
+        if (!order_.empty()) {
+            build(0, order_.size());
+        }
+    }
+
+    util::aligned::vector<cl_uint>& get_order() { return order_; }
+    util::aligned::vector<bvh_node>& get_nodes() { return nodes_; }
+
+private:
+    void build(size_t b, size_t e) {
+        const auto index = nodes_.size();
+        nodes_.emplace_back();
+
+        auto bounds = bounds_[order_[b]];
+        auto centroid_bounds =
+                geo::box{centroids_[order_[b]], centroids_[order_[b]]};
+        for (auto i = b + 1; i != e; ++i) {
+            bounds = combine(bounds, bounds_[order_[i]]);
+            const auto c = centroids_[order_[i]];
+            centroid_bounds = combine(centroid_bounds, geo::box{c, c});
+        }
+
+        nodes_[index].bounds = aabb{to_cl_float3{}(bounds.get_min()),
+                                    to_cl_float3{}(bounds.get_max())};
+
+        const auto extent = dimensions(centroid_bounds);
+        const auto axis = extent.x < extent.y
+                                  ? (extent.y < extent.z ? 2 : 1)
+                                  : (extent.x < extent.z ? 2 : 0);
+
+        //  If the centroids all coincide, there is no useful split.
+        if (e - b <= leaf_size_ || extent[axis] == 0) {
+            nodes_[index].first = b;
+            nodes_[index].count = e - b;
+            return;
+        }
+
+        const auto m = b + (e - b) / 2;
+        std::nth_element(order_.begin() + b,
+                         order_.begin() + m,
+                         order_.begin() + e,
+                         [&](auto i, auto j) {
+                             return centroids_[i][axis] < centroids_[j][axis];
+                         });
+
+        build(b, m);
+        nodes_[index].first = nodes_.size();
+        nodes_[index].count = 0;
+        build(m, e);
+    }
+
+    util::aligned::vector<geo::box> bounds_;
+    util::aligned::vector<glm::vec3> centroids_;
+    util::aligned::vector<cl_uint> order_;
+    util::aligned::vector<bvh_node> nodes_;
+    size_t leaf_size_;
+};
+
+}  // namespace
+
+bvh::bvh(util::aligned::vector<geo::triangle_vec3> triangles,
+         size_t leaf_size) {
+    if (!leaf_size) {
+        throw std::runtime_error{
+                "BVH leaves must hold at least one triangle."};
+    }
+    if (std::numeric_limits<cl_uint>::max() < triangles.size()) {
+        throw std::runtime_error{"Too many triangles for a BVH."};
+    }
+
+    bvh_builder builder{triangles, leaf_size};
+    triangle_indices_ = std::move(builder.get_order());
+    nodes_ = std::move(builder.get_nodes());
+    triangles_ = util::map_to_vector(begin(triangle_indices_),
+                                     end(triangle_indices_),
+                                     [&](auto i) { return triangles[i]; });
+}
+
+const util::aligned::vector<bvh_node>& bvh::get_nodes() const {
+    return nodes_;
+}
+
+const util::aligned::vector<cl_uint>& bvh::get_triangle_indices() const {
+    return triangle_indices_;
+}
+
+std::experimental::optional<size_t> bvh::closest_triangle(
+        const glm::vec3& pt) const {
+    if (nodes_.empty()) {
+        return std::experimental::nullopt;
+    }
+
+    auto best_distance = std::numeric_limits<float>::infinity();
+    size_t best_index = 0;
+
+    std::array<cl_uint, max_stack_depth> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size) {
+        const auto index = stack[--stack_size];
+        const auto& node = nodes_[index];
+        if (best_distance <= min_distance_squared(pt, node.bounds)) {
+            continue;
+        }
+
+        if (node.count) {
+            for (auto i = node.first, e = node.first + node.count; i != e;
+                 ++i) {
+                const auto d =
+                        geo::point_triangle_distance_squared(triangles_[i], pt);
+                if (d < best_distance) {
+                    best_distance = d;
+                    best_index = i;
+                }
+            }
+        } else {
+            //  Visit the nearer child first, so that the further one is
+            //  more likely to be culled.
+            auto near = index + 1;
+            auto far = node.first;
+            if (min_distance_squared(pt, nodes_[far].bounds) <
+                min_distance_squared(pt, nodes_[near].bounds)) {
+                std::swap(near, far);
+            }
+            stack[stack_size++] = far;
+            stack[stack_size++] = near;
+        }
+    }
+
+    return triangle_indices_[best_index];
+}
+
+}  // namespace core
+}  // namespace wayverb
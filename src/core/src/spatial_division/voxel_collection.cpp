@@ -36,6 +36,38 @@ util::aligned::vector<cl_uint> get_flattened(
     return ret;
 }
 
+voxel_collection<3> get_unflattened(
+        const geo::box& aabb, const util::aligned::vector<cl_uint>& flattened) {
+    //  The flat representation starts with a table of offsets, one per voxel,
+    //  so the first offset gives the number of voxels.
+    if (flattened.empty()) {
+        throw std::runtime_error{"Flattened voxel data is empty."};
+    }
+    const auto side = static_cast<size_t>(std::round(std::cbrt(flattened[0])));
+    if (side * side * side != flattened[0]) {
+        throw std::runtime_error{"Flattened voxel data has the wrong size."};
+    }
+
+    auto data = detail::voxel_data_trait<3>::get_blank(side);
+    for (auto x = 0u; x != side; ++x) {
+        for (auto y = 0u; y != side; ++y) {
+            for (auto z = 0u; z != side; ++z) {
+                const auto offset = flattened[x * side * side + y * side + z];
+                if (flattened.size() <= offset ||
+                    flattened.size() <= offset + flattened[offset]) {
+                    throw std::runtime_error{
+                            "Flattened voxel data is truncated."};
+                }
+                const auto begin = flattened.begin() + offset + 1;
+                detail::index<3>(data, glm::ivec3(x, y, z))
+                        .assign(begin, begin + flattened[offset]);
+            }
+        }
+    }
+
+    return {aabb, std::move(data)};
+}
+
 namespace {
 std::experimental::optional<glm::ivec3> get_starting_index(
         const voxel_collection<3>& voxels, const geo::ray& ray) {
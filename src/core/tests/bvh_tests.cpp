@@ -0,0 +1,194 @@
+#include "core/cl/bvh.h"
+#include "core/cl/common.h"
+#include "core/cl/scene_structs.h"
+#include "core/cl/triangle.h"
+#include "core/conversions.h"
+#include "core/geo/geometric.h"
+#include "core/program_wrapper.h"
+#include "core/spatial_division/bvh.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+using namespace wayverb::core;
+
+namespace {
+
+auto random_triangles(size_t num, std::default_random_engine& engine) {
+    std::uniform_real_distribution<float> position{-10, 10};
+    std::uniform_real_distribution<float> offset{-0.5, 0.5};
+    util::aligned::vector<geo::triangle_vec3> ret;
+    ret.reserve(num);
+    for (size_t i = 0; i != num; ++i) {
+        const glm::vec3 corner{
+                position(engine), position(engine), position(engine)};
+        const auto vertex = [&] {
+            return corner +
+                   glm::vec3{offset(engine), offset(engine), offset(engine)};
+        };
+        ret.emplace_back(geo::triangle_vec3{{{vertex(), vertex(), vertex()}}});
+    }
+    return ret;
+}
+
+float brute_force_distance_squared(
+        const util::aligned::vector<geo::triangle_vec3>& triangles,
+        const glm::vec3& pt) {
+    auto ret = std::numeric_limits<float>::infinity();
+    for (const auto& t : triangles) {
+        ret = std::min(ret, geo::point_triangle_distance_squared(t, pt));
+    }
+    return ret;
+}
+
+class closest_triangle_program final {
+public:
+    closest_triangle_program(const compute_context& cc)
+            : wrapper_{cc,
+                       std::vector<std::string>{
+                               cl_representation_v<aabb>,
+                               cl_representation_v<triangle_verts>,
+                               cl_representation_v<triangle>,
+                               cl_representation_v<bvh_node>,
+                               cl_sources::bvh,
+                               source_}} {}
+
+    auto get_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,
+                                   cl::Buffer,
+                                   cl::Buffer,
+                                   cl::Buffer,
+                                   cl::Buffer,
+                                   cl::Buffer>("closest_triangle_test");
+    }
+
+private:
+    program_wrapper wrapper_;
+    static constexpr auto source_ = R"(
+kernel void closest_triangle_test(const global float3* points,
+                                  const global bvh_node* nodes,
+                                  const global uint* triangle_indices,
+                                  const global triangle* triangles,
+                                  const global float3* vertices,
+                                  global uint* output) {
+    const size_t thread = get_global_id(0);
+    output[thread] = bvh_closest_triangle(
+            points[thread], nodes, triangle_indices, triangles, vertices);
+}
+)";
+};
+
+}  // namespace
+
+TEST(bvh, empty) {
+    const bvh b{{}};
+    ASSERT_TRUE(b.get_nodes().empty());
+    ASSERT_FALSE(b.closest_triangle(glm::vec3{0}));
+}
+
+TEST(bvh, structure) {
+    std::default_random_engine engine{0};
+    const auto triangles = random_triangles(1000, engine);
+    const bvh b{triangles, 4};
+
+    //  Every triangle must appear in exactly one leaf, and every leaf must
+    //  bound its triangles.
+    auto indices = b.get_triangle_indices();
+    std::sort(indices.begin(), indices.end());
+    for (size_t i = 0; i != indices.size(); ++i) {
+        ASSERT_EQ(indices[i], i);
+    }
+
+    size_t in_leaves = 0;
+    for (const auto& node : b.get_nodes()) {
+        ASSERT_LE(node.count, 4);
+        for (auto i = node.first; i != node.first + node.count; ++i) {
+            for (const auto& v : triangles[b.get_triangle_indices()[i]].s) {
+                ASSERT_TRUE(glm::all(glm::lessThanEqual(
+                        to_vec3{}(node.bounds.c0), v)));
+                ASSERT_TRUE(glm::all(glm::lessThanEqual(
+                        v, to_vec3{}(node.bounds.c1))));
+            }
+        }
+        in_leaves += node.count;
+    }
+    ASSERT_EQ(in_leaves, triangles.size());
+}
+
+TEST(bvh, closest_triangle) {
+    std::default_random_engine engine{1};
+    const auto triangles = random_triangles(2000, engine);
+    const bvh b{triangles};
+
+    std::uniform_real_distribution<float> position{-15, 15};
+    for (auto i = 0; i != 500; ++i) {
+        const glm::vec3 pt{
+                position(engine), position(engine), position(engine)};
+
+        const auto brute_force = brute_force_distance_squared(triangles, pt);
+
+        const auto closest = b.closest_triangle(pt);
+        ASSERT_TRUE(closest);
+        ASSERT_EQ(geo::point_triangle_distance_squared(triangles[*closest], pt),
+                  brute_force);
+    }
+}
+
+TEST(bvh, gpu_closest_triangle) {
+    std::default_random_engine engine{2};
+    const auto triangle_vecs = random_triangles(2000, engine);
+    const bvh b{triangle_vecs};
+
+    util::aligned::vector<cl_float3> vertices;
+    util::aligned::vector<triangle> triangles;
+    for (const auto& t : triangle_vecs) {
+        const auto first = static_cast<cl_uint>(vertices.size());
+        for (const auto& v : t.s) {
+            vertices.emplace_back(to_cl_float3{}(v));
+        }
+        triangles.emplace_back(triangle{0, first, first + 1, first + 2});
+    }
+
+    std::uniform_real_distribution<float> position{-15, 15};
+    util::aligned::vector<cl_float3> points(1000);
+    for (auto& pt : points) {
+        pt = to_cl_float3{}(glm::vec3{
+                position(engine), position(engine), position(engine)});
+    }
+
+    const compute_context cc{};
+    const closest_triangle_program program{cc};
+    cl::CommandQueue queue{cc.context, cc.device};
+
+    const auto points_buffer = load_to_buffer(cc.context, points, true);
+    const auto nodes_buffer = load_to_buffer(cc.context, b.get_nodes(), true);
+    const auto indices_buffer =
+            load_to_buffer(cc.context, b.get_triangle_indices(), true);
+    const auto triangles_buffer = load_to_buffer(cc.context, triangles, true);
+    const auto vertices_buffer = load_to_buffer(cc.context, vertices, true);
+    cl::Buffer output_buffer{
+            cc.context, CL_MEM_READ_WRITE, sizeof(cl_uint) * points.size()};
+
+    program.get_kernel()(cl::EnqueueArgs{queue, cl::NDRange{points.size()}},
+                         points_buffer,
+                         nodes_buffer,
+                         indices_buffer,
+                         triangles_buffer,
+                         vertices_buffer,
+                         output_buffer);
+    const auto closest = read_from_buffer<cl_uint>(queue, output_buffer);
+
+    //  The device may round differently from the host, so ties and
+    //  near-ties are allowed to go either way.
+    for (auto i = 0u; i != points.size(); ++i) {
+        const auto pt = to_vec3{}(points[i]);
+        ASSERT_LT(closest[i], triangle_vecs.size());
+        const auto brute_force =
+                brute_force_distance_squared(triangle_vecs, pt);
+        ASSERT_NEAR(geo::point_triangle_distance_squared(
+                            triangle_vecs[closest[i]], pt),
+                    brute_force,
+                    1.0e-4 * brute_force + 1.0e-6);
+    }
+}
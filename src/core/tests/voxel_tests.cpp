@@ -57,6 +57,11 @@ TEST(voxel, flatten) {
     for (const auto& scene : get_test_scenes()) {
         const auto voxelised = get_voxelised(scene);
         const auto f = get_flattened(voxelised.get_voxels());
+
+        const auto unflattened =
+                get_unflattened(voxelised.get_voxels().get_aabb(), f);
+        ASSERT_EQ(voxelised.get_voxels().get_side(), unflattened.get_side());
+        ASSERT_EQ(f, get_flattened(unflattened));
     }
 }
 
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace util {
+
+/// FNV-1a, which is plenty for telling inputs apart (not for security).
+/// Values are hashed byte by byte, so only hash plain values, never structs
+/// which might contain padding.
+class fnv1a final {
+public:
+    template <typename T>
+    void operator()(const T& t) {
+        static_assert(std::is_arithmetic<T>{}, "only hash plain values");
+        const auto bytes = reinterpret_cast<const unsigned char*>(&t);
+        for (auto i = 0u; i != sizeof(T); ++i) {
+            state_ = (state_ ^ bytes[i]) * 0x100000001b3;
+        }
+    }
+
+    std::uint64_t get() const { return state_; }
+
+private:
+    std::uint64_t state_{0xcbf29ce484222325};
+};
+
+}  // namespace util
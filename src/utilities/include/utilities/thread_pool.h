@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+
+/// A fixed-size pool of worker threads, suitable for running the same short
+/// job many times over (e.g. once per simulation step).
+/// The calling thread takes part in the work, so a pool constructed with a
+/// single thread runs everything inline.
+class thread_pool final {
+public:
+    explicit thread_pool(
+            size_t threads = std::max(1u, std::thread::hardware_concurrency()));
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    thread_pool(thread_pool&&) noexcept = delete;
+    thread_pool& operator=(thread_pool&&) noexcept = delete;
+
+    ~thread_pool() noexcept;
+
+    /// Calls f(i) for each i in [0, tasks), distributing calls across the
+    /// pool. Blocks until every call has returned.
+    /// If any call throws, the first exception is rethrown here once all
+    /// calls have finished.
+    void parallel_for(size_t tasks, const std::function<void(size_t)>& f);
+
+    size_t get_num_threads() const;
+
+private:
+    void worker();
+    void run_tasks(std::unique_lock<std::mutex>& lck);
+
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable work_finished_;
+
+    const std::function<void(size_t)>* job_{nullptr};
+    size_t tasks_{0};
+    size_t next_task_{0};
+    size_t running_{0};
+    std::exception_ptr exception_;
+    bool quit_{false};
+};
+
+}  // namespace util
@@ -0,0 +1,84 @@
+#include "utilities/thread_pool.h"
+
+namespace util {
+
+thread_pool::thread_pool(size_t threads) {
+    //  The calling thread does work too, so we need one fewer worker.
+    for (auto i = 1ul; i < threads; ++i) {
+        threads_.emplace_back([this] { worker(); });
+    }
+}
+
+thread_pool::~thread_pool() noexcept {
+    {
+        const std::lock_guard<std::mutex> lck{mutex_};
+        quit_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& i : threads_) {
+        i.join();
+    }
+}
+
+void thread_pool::parallel_for(size_t tasks,
+                               const std::function<void(size_t)>& f) {
+    std::unique_lock<std::mutex> lck{mutex_};
+    job_ = &f;
+    tasks_ = tasks;
+    next_task_ = 0;
+    exception_ = nullptr;
+    work_available_.notify_all();
+
+    run_tasks(lck);
+
+    work_finished_.wait(lck,
+                        [&] { return next_task_ == tasks_ && running_ == 0; });
+    job_ = nullptr;
+
+    if (exception_) {
+        std::rethrow_exception(exception_);
+    }
+}
+
+size_t thread_pool::get_num_threads() const { return threads_.size() + 1; }
+
+void thread_pool::worker() {
+    std::unique_lock<std::mutex> lck{mutex_};
+    for (;;) {
+        work_available_.wait(lck, [&] {
+            return quit_ || (job_ != nullptr && next_task_ != tasks_);
+        });
+        if (quit_) {
+            return;
+        }
+        run_tasks(lck);
+    }
+}
+
+void thread_pool::run_tasks(std::unique_lock<std::mutex>& lck) {
+    while (next_task_ != tasks_) {
+        const auto task = next_task_++;
+        const auto& job = *job_;
+        ++running_;
+
+        lck.unlock();
+        std::exception_ptr exception;
+        try {
+            job(task);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        lck.lock();
+
+        if (exception && !exception_) {
+            exception_ = exception;
+        }
+        --running_;
+    }
+
+    if (running_ == 0) {
+        work_finished_.notify_all();
+    }
+}
+
+}  // namespace util
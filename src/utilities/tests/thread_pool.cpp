@@ -0,0 +1,55 @@
+#include "utilities/thread_pool.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <numeric>
+
+using namespace util;
+
+TEST(thread_pool, visits_every_task_once) {
+    thread_pool pool{4};
+    for (auto tasks : {0ul, 1ul, 3ul, 100ul}) {
+        std::vector<std::atomic<int>> visits(tasks);
+        for (auto& i : visits) {
+            i = 0;
+        }
+        pool.parallel_for(tasks, [&](auto i) { ++visits[i]; });
+        for (const auto& i : visits) {
+            ASSERT_EQ(i, 1);
+        }
+    }
+}
+
+TEST(thread_pool, repeated_jobs) {
+    thread_pool pool{8};
+    for (auto i = 0; i != 1000; ++i) {
+        std::atomic<size_t> sum{0};
+        pool.parallel_for(100, [&](auto i) { sum += i; });
+        ASSERT_EQ(sum, 4950);
+    }
+}
+
+TEST(thread_pool, single_thread) {
+    thread_pool pool{1};
+    ASSERT_EQ(pool.get_num_threads(), 1);
+    auto count = 0;
+    pool.parallel_for(10, [&](auto) { ++count; });
+    ASSERT_EQ(count, 10);
+}
+
+TEST(thread_pool, rethrows) {
+    thread_pool pool{4};
+    ASSERT_THROW(pool.parallel_for(10,
+                                   [](auto i) {
+                                       if (i == 3) {
+                                           throw std::runtime_error{"oops"};
+                                       }
+                                   }),
+                 std::runtime_error);
+
+    //  The pool should still be usable afterwards.
+    std::atomic<int> count{0};
+    pool.parallel_for(10, [&](auto) { ++count; });
+    ASSERT_EQ(count, 10);
+}
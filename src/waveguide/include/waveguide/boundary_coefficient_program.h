@@ -16,11 +16,9 @@ public:
         return wrapper_.get_kernel<cl::Buffer,       /// nodes
                                    mesh_descriptor,  /// descriptor
                                    cl::Buffer,       /// 1d boundary index
-                                   cl::Buffer,       /// voxel_index
-                                   core::aabb,       /// global_aabb
-                                   cl_uint,          /// side
+                                   cl::Buffer,       /// bvh_nodes
+                                   cl::Buffer,       /// bvh_triangle_indices
                                    cl::Buffer,       /// triangles
-                                   cl_uint,          /// num_triangles
                                    cl::Buffer        /// vertices
                                    >("boundary_coefficient_finder_1d");
     }
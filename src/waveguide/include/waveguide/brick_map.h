@@ -0,0 +1,94 @@
+#pragma once
+
+#include "waveguide/cl/structs.h"
+#include "waveguide/cl/utils.h"
+#include "waveguide/mesh_descriptor.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <cstdint>
+
+namespace wayverb {
+namespace waveguide {
+
+/// The order in which the stored bricks of a compacted mesh are laid out.
+enum class brick_order {
+    /// x varies fastest, then y, then z.
+    linear,
+    /// Bricks follow a Z-order (Morton) curve, so bricks which neighbour one
+    /// another along any axis are usually close in memory.
+    morton,
+};
+
+/// Interleaves the bits of the coordinates, x in the lowest bit.
+/// Each coordinate must be non-negative and fit in 21 bits.
+std::uint64_t compute_morton_code(const glm::ivec3& locator);
+
+/// Describes the storage layout of a compacted mesh.
+///
+/// The mesh is divided into cubic bricks of nodes.
+/// Only bricks which contain at least one inside or boundary node are stored.
+/// Every other brick maps to slot 0, which is never updated, and which only
+/// holds outside nodes with zero pressure, so that neighbour lookups don't
+/// need to special-case missing bricks.
+struct brick_map final {
+    /// Must match BRICK_SIZE in the waveguide kernel.
+    static constexpr size_t brick_size = 4;
+    static constexpr size_t brick_volume = brick_size * brick_size * brick_size;
+
+    /// The number of bricks along each axis.
+    glm::ivec3 dimensions;
+
+    /// The storage slot of each brick.
+    util::aligned::vector<cl_uint> slots;
+
+    /// The number of stored bricks, including the empty brick in slot 0.
+    size_t num_slots;
+
+    /// The order of the stored bricks.
+    brick_order order;
+
+    /// The brick stored in each slot, i.e. the inverse of `slots`.
+    /// Slot 0 doesn't hold a particular brick, and maps to brick 0.
+    util::aligned::vector<cl_uint> bricks;
+};
+
+/// Finds the bricks which contain inside or boundary nodes, and assigns them
+/// storage slots in the given order.
+brick_map compute_brick_map(const mesh_descriptor& descriptor,
+                            const util::aligned::vector<condensed_node>& nodes,
+                            brick_order order = brick_order::morton);
+
+/// Builds the layout described by a table of storage slots, such as one
+/// written out from an existing brick_map.
+/// Throws if the table doesn't describe a valid layout.
+brick_map make_brick_map(const mesh_descriptor& descriptor,
+                         util::aligned::vector<cl_uint> slots,
+                         brick_order order);
+
+/// returns:    the storage slot of the brick containing the node at `locator`
+size_t compute_slot(const brick_map& bricks, const glm::ivec3& locator);
+
+/// returns:    the position of the node at `locator` in compacted storage
+size_t compute_storage_index(const brick_map& bricks,
+                             const glm::ivec3& locator);
+
+/// returns:    the locator of the node at `storage_index` in compacted
+///             storage
+glm::ivec3 compute_locator(const brick_map& bricks, size_t storage_index);
+
+/// The total number of nodes in compacted storage, including the empty brick.
+size_t compute_num_stored_nodes(const brick_map& bricks);
+
+/// The table which the waveguide kernels use to find nodes in compacted
+/// storage: the slot of every brick, followed by the brick in every slot.
+util::aligned::vector<cl_uint> compute_brick_table(const brick_map& bricks);
+
+/// Copies the nodes which belong to stored bricks into compacted storage.
+util::aligned::vector<condensed_node> compact_nodes(
+        const mesh_descriptor& descriptor,
+        const brick_map& bricks,
+        const util::aligned::vector<condensed_node>& nodes);
+
+}  // namespace waveguide
+}  // namespace wayverb
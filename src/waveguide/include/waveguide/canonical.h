@@ -2,13 +2,17 @@
 
 #include "waveguide/bandpass_band.h"
 #include "waveguide/calibration.h"
+#include "waveguide/early_termination.h"
 #include "waveguide/fitted_boundary.h"
-#include "waveguide/postprocessor/directional_receiver.h"
-#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/native/out_of_core.h"
+#include "waveguide/partition.h"
+#include "waveguide/postprocessor/directional_receivers.h"
+#include "waveguide/postprocessor/energy_decay.h"
+#include "waveguide/preprocessor/device_sources.h"
+#include "waveguide/pressure_view.h"
 #include "waveguide/simulation_parameters.h"
 #include "waveguide/waveguide.h"
 
-#include "core/callback_accumulator.h"
 #include "core/environment.h"
 #include "core/reverb_time.h"
 
@@ -26,71 +30,531 @@ namespace wayverb {
 namespace waveguide {
 namespace detail {
 
-template <typename Callback>
-std::experimental::optional<band> canonical_impl(
+inline size_t compute_mesh_index(const mesh& mesh, const glm::vec3& pt) {
+    const auto ret = compute_index(mesh.get_descriptor(), pt);
+    if (!waveguide::is_inside(mesh, ret)) {
+        throw std::runtime_error{
+                "Source/receiver node position appears to be outside mesh."};
+    }
+    return ret;
+}
+
+/// A calibrated impulse, followed by silence.
+///
+/// The calibration factor is only known for the rectilinear stencil, so
+/// other stencils are rejected rather than being run at the wrong level.
+inline util::aligned::vector<float> compute_input(
+        const mesh& mesh,
+        const core::environment& environment,
+        size_t steps) {
+    if (mesh.get_stencil() != stencil::rectilinear) {
+        throw std::runtime_error{
+                "Source calibration is only known for rectilinear meshes."};
+    }
+    auto ret = util::aligned::vector<float>(steps, 0.0f);
+    if (!ret.empty()) {
+        ret.front() = rectilinear_calibration_factor(
+                mesh.get_descriptor().spacing, environment.acoustic_impedance);
+    }
+    return ret;
+}
+
+using optional_early_termination =
+        std::experimental::optional<early_termination_parameters>;
+
+using optional_out_of_core =
+        std::experimental::optional<native::out_of_core_parameters>;
+
+using optional_checkpoint = std::experimental::optional<checkpoint_parameters>;
+
+/// The compute contexts to split the mesh across (see run_partitioned).
+using optional_partition = std::experimental::optional<
+        util::aligned::vector<core::compute_context>>;
+
+/// Each band of a sequential multi-band run is a separate simulation, so it
+/// gets its own snapshot file.
+inline optional_checkpoint get_band_checkpoint(
+        const optional_checkpoint& checkpoint, size_t band) {
+    if (!checkpoint) {
+        return std::experimental::nullopt;
+    }
+    return checkpoint_parameters{
+            util::build_string(checkpoint->path, ".band", band),
+            checkpoint->interval};
+}
+
+inline std::unique_ptr<stepper> make_stepper(
         const core::compute_context& cc,
         const mesh& mesh,
+        const optional_out_of_core& out_of_core) {
+    return out_of_core ? std::make_unique<stepper>(cc, mesh, *out_of_core)
+                       : std::make_unique<stepper>(cc, mesh);
+}
+
+inline auto make_energy_decay(const core::compute_context& cc,
+                              const mesh& mesh,
+                              size_t bands,
+                              double sample_rate,
+                              const optional_early_termination& params) {
+    std::experimental::optional<postprocessor::energy_decay> ret;
+    if (params) {
+        ret.emplace(cc,
+                    mesh.get_structure().get_condensed_nodes().size(),
+                    bands,
+                    sample_rate,
+                    *params);
+    }
+    return ret;
+}
+
+/// Steps run between reads of the receiver outputs.
+/// Every receiver is read back at once, so this is the only time the host
+/// waits for the device (apart from energy decay measurements).
+constexpr size_t batch_size = 64;
+
+/// Drives the mesh from device_sources with run_batched, until the energy
+/// decay (if any) has settled.
+class canonical_preprocessor final {
+public:
+    canonical_preprocessor(
+            preprocessor::device_sources& sources,
+            const std::experimental::optional<postprocessor::energy_decay>&
+                    energy_decay)
+            : sources_{sources}
+            , energy_decay_{energy_decay} {}
+
+    size_t prepare(cl::CommandQueue& queue,
+                   size_t first_step,
+                   size_t max_steps) {
+        if (energy_decay_ && energy_decay_->is_settled()) {
+            return 0;
+        }
+        return sources_.prepare(queue, first_step, max_steps);
+    }
+
+    void operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t step) {
+        sources_(queue, buffer, step);
+    }
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(sources_);
+    }
+
+private:
+    preprocessor::device_sources& sources_;
+    const std::experimental::optional<postprocessor::energy_decay>&
+            energy_decay_;
+};
+
+/// Records the receivers and energy decay with run_batched, and passes the
+/// pressures to a per-step callback.
+template <typename Callback>
+class canonical_postprocessor final {
+public:
+    canonical_postprocessor(
+            postprocessor::directional_receivers& receivers,
+            std::experimental::optional<postprocessor::energy_decay>&
+                    energy_decay,
+            Callback callback)
+            : receivers_{receivers}
+            , energy_decay_{energy_decay}
+            , callback_{std::move(callback)} {}
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step) {
+        receivers_(queue, buffer, step);
+        if (energy_decay_) {
+            (*energy_decay_)(queue, buffer, step);
+        }
+        callback_(queue, buffer, step);
+    }
+
+    void finish(cl::CommandQueue& queue, size_t first_step, size_t steps) {
+        receivers_.finish(queue, first_step, steps);
+    }
+
+    /// The callback is not saved.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(receivers_);
+        if (energy_decay_) {
+            archive(*energy_decay_);
+        }
+    }
+
+private:
+    postprocessor::directional_receivers& receivers_;
+    std::experimental::optional<postprocessor::energy_decay>& energy_decay_;
+    Callback callback_;
+};
+
+template <typename Callback>
+auto make_canonical_postprocessor(
+        postprocessor::directional_receivers& receivers,
+        std::experimental::optional<postprocessor::energy_decay>& energy_decay,
+        Callback callback) {
+    return canonical_postprocessor<Callback>{
+            receivers, energy_decay, std::move(callback)};
+}
+
+inline auto compute_mesh_indices(
+        const mesh& mesh, const util::aligned::vector<glm::vec3>& points) {
+    return util::map_to_vector(begin(points), end(points), [&](const auto& i) {
+        return compute_mesh_index(mesh, i);
+    });
+}
+
+/// Runs a single simulation, and records the output at every receiver in
+/// every band of the stepper.
+///
+/// The simulation runs in batches, and the taps of every receiver are read
+/// back together at the end of each batch.
+///
+/// If early_termination is set, the simulation may stop as soon as its
+/// energy decay has settled. The rest of each output is then synthesized.
+///
+/// If checkpoint is set, the simulation is saved between batches, and
+/// resumes from the snapshot file if there is one (see run_batched).
+/// The callback is only called for steps run since resuming.
+///
+/// returns:    for each receiver, one band per band of the stepper
+template <typename Callback>
+std::experimental::optional<util::aligned::vector<util::aligned::vector<band>>>
+canonical_run(const core::compute_context& cc,
+              stepper& stepper,
+              const mesh& mesh,
+              double simulation_time,
+              const glm::vec3& source,
+              const util::aligned::vector<glm::vec3>& receivers,
+              const core::environment& environment,
+              const std::atomic_bool& keep_going,
+              Callback&& callback,
+              const optional_early_termination& early_termination =
+                      std::experimental::nullopt,
+              const optional_checkpoint& checkpoint =
+                      std::experimental::nullopt) {
+    const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
+                                                 environment.speed_of_sound);
+
+    const auto ideal_steps = std::ceil(sample_rate * simulation_time);
+    const auto input = compute_input(mesh, environment, ideal_steps);
+
+    const auto bands = stepper.get_bands();
+
+    auto energy_decay = make_energy_decay(
+            cc, mesh, bands, sample_rate, early_termination);
+
+    postprocessor::directional_receivers outputs{
+            cc,
+            mesh,
+            sample_rate,
+            get_ambient_density(environment),
+            compute_mesh_indices(mesh, receivers),
+            batch_size,
+            bands};
+
+    const auto num_nodes = mesh.get_structure().get_condensed_nodes().size();
+    const auto first_band =
+            bands == 1 ? cl::Buffer{}
+                       : cl::Buffer{cc.context,
+                                    CL_MEM_READ_WRITE,
+                                    sizeof(cl_float) * num_nodes};
+
+    preprocessor::device_sources sources{
+            cc,
+            {{compute_storage_index(mesh, compute_mesh_index(mesh, source)),
+              input,
+              preprocessor::injection::hard}},
+            bands};
+
+    canonical_preprocessor pre{sources, energy_decay};
+    auto post = make_canonical_postprocessor(
+            outputs,
+            energy_decay,
+            [&](auto& queue, const auto& buffer, auto step) {
+                callback(queue,
+                         bands == 1 ? pressure_view{buffer}
+                                    : pressure_view{queue,
+                                                    buffer,
+                                                    num_nodes,
+                                                    bands,
+                                                    first_band},
+                         step,
+                         ideal_steps);
+            });
+
+    const auto steps =
+            checkpoint ? run_batched(stepper,
+                                     pre,
+                                     post,
+                                     batch_size,
+                                     *checkpoint,
+                                     keep_going)
+                       : run_batched(
+                                 stepper, pre, post, batch_size, keep_going);
+
+    const auto is_settled = energy_decay && energy_decay->is_settled();
+    if (!keep_going || (steps != ideal_steps && !is_settled)) {
+        return std::experimental::nullopt;
+    }
+
+    util::aligned::vector<util::aligned::vector<band>> ret;
+    for (auto i = 0u; i != outputs.get_num_receivers(); ++i) {
+        util::aligned::vector<band> receiver_bands;
+        for (auto b = 0u; b != bands; ++b) {
+            receiver_bands.emplace_back(
+                    band{outputs.get_output(i, b), sample_rate});
+            if (steps != ideal_steps) {
+                synthesize_tail(receiver_bands.back(),
+                                ideal_steps,
+                                energy_decay->get_decay_rates()[b],
+                                energy_decay->get_fit_steps(),
+                                compute_cutoff_frequency(sample_rate, 1),
+                                environment.acoustic_impedance);
+            }
+        }
+        ret.emplace_back(std::move(receiver_bands));
+    }
+    return ret;
+}
+
+/// Like canonical_run, but splits the mesh across several compute contexts
+/// with run_partitioned.
+/// The taps of every receiver are recorded, and integrated once the
+/// simulation has finished.
+///
+/// No slab holds the whole pressure field, so there is no per-step callback.
+/// The simulation always runs for the whole of simulation_time.
+///
+/// returns:    one band per receiver, in the same order as `receivers`
+inline std::experimental::optional<util::aligned::vector<band>>
+canonical_partitioned(
+        const util::aligned::vector<core::compute_context>& contexts,
+        const mesh& mesh,
         double simulation_time,
         const glm::vec3& source,
-        const glm::vec3& receiver,
+        const util::aligned::vector<glm::vec3>& receivers,
         const core::environment& environment,
-        const std::atomic_bool& keep_going,
-        Callback&& callback) {
+        const std::atomic_bool& keep_going) {
     const auto sample_rate = compute_sample_rate(mesh.get_descriptor(),
                                                  environment.speed_of_sound);
 
-    const auto compute_mesh_index = [&](const auto& pt) {
-        const auto ret = compute_index(mesh.get_descriptor(), pt);
-        if (!waveguide::is_inside(
-                    mesh.get_structure().get_condensed_nodes()[ret])) {
-            throw std::runtime_error{
-                    "Source/receiver node position appears to be outside "
-                    "mesh."};
-        }
-        return ret;
-    };
-
     const auto ideal_steps = std::ceil(sample_rate * simulation_time);
+    const auto input = compute_input(mesh, environment, ideal_steps);
 
-    const auto input = [&] {
-        auto raw = util::aligned::vector<float>(ideal_steps, 0.0f);
-        if (!raw.empty()) {
-            raw.front() = rectilinear_calibration_factor(
-                    mesh.get_descriptor().spacing,
-                    environment.acoustic_impedance);
-        }
-        return raw;
-    }();
+    //  Taps are node indices, as each slab stores nodes in its own order.
+    auto outputs =
+            util::map_to_vector(begin(receivers), end(receivers), [&](auto& i) {
+                return postprocessor::directional_receiver{
+                        mesh.get_descriptor(),
+                        sample_rate,
+                        get_ambient_density(environment),
+                        compute_mesh_index(mesh, i)};
+            });
 
-    auto output_accumulator =
-            core::callback_accumulator<postprocessor::directional_receiver>{
-                    mesh.get_descriptor(),
-                    sample_rate,
-                    get_ambient_density(environment),
-                    compute_mesh_index(receiver)};
+    util::aligned::vector<cl_uint> taps;
+    for (const auto& i : outputs) {
+        const auto nodes = i.get_tap_nodes();
+        taps.insert(end(taps), begin(nodes), end(nodes));
+    }
 
-    const auto steps =
-            run(cc,
-                mesh,
-                preprocessor::make_hard_source(
-                        compute_mesh_index(source), begin(input), end(input)),
-                [&](auto& queue, const auto& buffer, auto step) {
-                    output_accumulator(queue, buffer, step);
-                    callback(queue, buffer, step, ideal_steps);
-                },
-                keep_going);
-
-    if (steps != ideal_steps) {
+    const auto pressures = run_partitioned(contexts,
+                                           mesh,
+                                           compute_mesh_index(mesh, source),
+                                           input,
+                                           taps,
+                                           keep_going,
+                                           batch_size);
+
+    const auto steps = pressures.size() / taps.size();
+    if (!keep_going || steps != ideal_steps) {
         return std::experimental::nullopt;
     }
 
-    return band{std::move(output_accumulator.get_output()), sample_rate};
+    util::aligned::vector<band> ret;
+    for (auto i = 0u; i != outputs.size(); ++i) {
+        band b{{}, sample_rate};
+        b.directional.reserve(steps);
+        for (auto step = 0u; step != steps; ++step) {
+            b.directional.emplace_back(outputs[i].integrate(
+                    pressures.data() + step * taps.size() +
+                    i * postprocessor::directional_receiver::num_taps));
+        }
+        ret.emplace_back(std::move(b));
+    }
+    return ret;
+}
+
+/// Runs a single simulation with the mesh's own boundary coefficients.
+///
+/// out_of_core:    if set, keep the pressures in memory-mapped files (see
+///                 stepper)
+/// checkpoint:     if set, save the simulation as it runs (see
+///                 canonical_run)
+/// partition:      if set, split the mesh across these contexts instead of
+///                 running it on `cc` (see canonical_partitioned). Can't be
+///                 combined with out_of_core or checkpoint.
+///
+/// returns:    one band per receiver, in the same order as `receivers`
+template <typename Callback>
+std::experimental::optional<util::aligned::vector<band>> canonical_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        double simulation_time,
+        const glm::vec3& source,
+        const util::aligned::vector<glm::vec3>& receivers,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback,
+        const optional_early_termination& early_termination =
+                std::experimental::nullopt,
+        const optional_out_of_core& out_of_core = std::experimental::nullopt,
+        const optional_checkpoint& checkpoint = std::experimental::nullopt,
+        const optional_partition& partition = std::experimental::nullopt) {
+    if (partition) {
+        if (out_of_core || checkpoint) {
+            throw std::runtime_error{
+                    "Partitioned simulations can't be run out of core or "
+                    "checkpointed."};
+        }
+        return canonical_partitioned(*partition,
+                                     mesh,
+                                     simulation_time,
+                                     source,
+                                     receivers,
+                                     environment,
+                                     keep_going);
+    }
+
+    const auto stepper = make_stepper(cc, mesh, out_of_core);
+    if (auto ret = canonical_run(cc,
+                                 *stepper,
+                                 mesh,
+                                 simulation_time,
+                                 source,
+                                 receivers,
+                                 environment,
+                                 keep_going,
+                                 std::forward<Callback>(callback),
+                                 early_termination,
+                                 checkpoint)) {
+        return util::map_to_vector(begin(*ret), end(*ret), [](auto& i) {
+            return std::move(i.front());
+        });
+    }
+    return std::experimental::nullopt;
+}
+
+/// Like canonical_impl, but simulates every band in a single pass, with
+/// pressures stored node-major, band-minor.
+/// The node classification and neighbour lookups are shared by all bands,
+/// and every band of every receiver is read back together.
+///
+/// band_coefficients:  for each band, one set of coefficients per surface
+///
+/// returns:            for each receiver, one band per set of coefficients
+template <typename Callback>
+std::experimental::optional<util::aligned::vector<util::aligned::vector<band>>>
+canonical_packed_impl(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        const util::aligned::vector<
+                util::aligned::vector<coefficients_canonical>>&
+                band_coefficients,
+        double simulation_time,
+        const glm::vec3& source,
+        const util::aligned::vector<glm::vec3>& receivers,
+        const core::environment& environment,
+        const std::atomic_bool& keep_going,
+        Callback&& callback,
+        const optional_early_termination& early_termination =
+                std::experimental::nullopt,
+        const optional_checkpoint& checkpoint = std::experimental::nullopt) {
+    stepper stepper{cc, mesh, band_coefficients};
+    return canonical_run(cc,
+                         stepper,
+                         mesh,
+                         simulation_time,
+                         source,
+                         receivers,
+                         environment,
+                         keep_going,
+                         std::forward<Callback>(callback),
+                         early_termination,
+                         checkpoint);
 }
 
 }  // namespace detail
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Run a waveguide using:
+///     specified sample rate
+///     receivers at closest available locations
+///     source at closest available location
+///     single hard source
+///     one directional receiver per receiver position
+///
+/// The mesh is only simulated once, no matter how many receivers there are.
+///
+/// pressure_callback:  called after every step with
+///                     (queue, const pressure_view&, step, total_steps)
+/// early_termination:  if set, the simulation may stop once the energy decay
+///                     in the mesh has settled, and the remainder of each
+///                     output is synthesized from the measured decay rate
+/// out_of_core:        if set, the pressures are kept in memory-mapped files
+///                     rather than in RAM. Requires the native backend.
+/// checkpoint:         if set, the simulation is saved to this file as it
+///                     runs, and resumes from it if it already exists
+/// partition:          if set, the mesh is split across these compute
+///                     contexts, and the slabs are run in parallel. The
+///                     pressure callback isn't called, and early_termination
+///                     is ignored.
+///
+/// returns:    the bands for each receiver, in the same order as `receivers`
+template <typename PressureCallback>
+std::experimental::optional<
+        util::aligned::vector<util::aligned::vector<bandpass_band>>>
+canonical(const core::compute_context& cc,
+          voxels_and_mesh voxelised,
+          const glm::vec3& source,
+          const util::aligned::vector<glm::vec3>& receivers,
+          const core::environment& environment,
+          const single_band_parameters& sim_params,
+          double simulation_time,
+          const std::atomic_bool& keep_going,
+          PressureCallback&& pressure_callback,
+          const detail::optional_early_termination& early_termination =
+                  std::experimental::nullopt,
+          const detail::optional_out_of_core& out_of_core =
+                  std::experimental::nullopt,
+          const detail::optional_checkpoint& checkpoint =
+                  std::experimental::nullopt,
+          const detail::optional_partition& partition =
+                  std::experimental::nullopt) {
+    if (auto ret = detail::canonical_impl(cc,
+                                          voxelised.mesh,
+                                          simulation_time,
+                                          source,
+                                          receivers,
+                                          environment,
+                                          keep_going,
+                                          pressure_callback,
+                                          early_termination,
+                                          out_of_core,
+                                          checkpoint,
+                                          partition)) {
+        return util::map_to_vector(begin(*ret), end(*ret), [&](auto& i) {
+            return util::aligned::vector<bandpass_band>{bandpass_band{
+                    std::move(i), util::make_range(0.0, sim_params.cutoff)}};
+        });
+    }
+
+    return std::experimental::nullopt;
+}
+
 /// Run a waveguide using:
 ///     specified sample rate
 ///     receiver at specified location
@@ -107,17 +571,30 @@ std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
         const single_band_parameters& sim_params,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        PressureCallback&& pressure_callback) {
-    if (auto ret = detail::canonical_impl(cc,
-                                          voxelised.mesh,
-                                          simulation_time,
-                                          source,
-                                          receiver,
-                                          environment,
-                                          keep_going,
-                                          pressure_callback)) {
-        return util::aligned::vector<bandpass_band>{bandpass_band{
-                std::move(*ret), util::make_range(0.0, sim_params.cutoff)}};
+        PressureCallback&& pressure_callback,
+        const detail::optional_early_termination& early_termination =
+                std::experimental::nullopt,
+        const detail::optional_out_of_core& out_of_core =
+                std::experimental::nullopt,
+        const detail::optional_checkpoint& checkpoint =
+                std::experimental::nullopt,
+        const detail::optional_partition& partition =
+                std::experimental::nullopt) {
+    if (auto ret = canonical(
+                cc,
+                std::move(voxelised),
+                source,
+                util::aligned::vector<glm::vec3>{receiver},
+                environment,
+                sim_params,
+                simulation_time,
+                keep_going,
+                std::forward<PressureCallback>(pressure_callback),
+                early_termination,
+                out_of_core,
+                checkpoint,
+                partition)) {
+        return std::move(ret->front());
     }
 
     return std::experimental::nullopt;
@@ -125,18 +602,132 @@ std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-inline auto set_flat_coefficients_for_band(voxels_and_mesh& voxels_and_mesh,
-                                           size_t band) {
-    voxels_and_mesh.mesh.set_coefficients(util::map_to_vector(
+inline auto compute_flat_coefficients_for_band(
+        const voxels_and_mesh& voxels_and_mesh, size_t band) {
+    return util::map_to_vector(
             begin(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
             end(voxels_and_mesh.voxels.get_scene_data().get_surfaces()),
             [&](const auto& surface) {
                 return to_flat_coefficients(surface.absorption.s[band]);
-            }));
+            });
+}
+
+inline auto set_flat_coefficients_for_band(voxels_and_mesh& voxels_and_mesh,
+                                           size_t band) {
+    voxels_and_mesh.mesh.set_coefficients(
+            compute_flat_coefficients_for_band(voxels_and_mesh, band));
 }
 
 /// This is a sort of middle ground - more accurate boundary modelling, but
-/// really unbelievably slow.
+/// slower, as each node has to be updated once per band.
+///
+/// All bands are updated together in a single pass over the mesh, except on
+/// the native backend (including out-of-core runs) and in partitioned runs,
+/// which run the mesh once per band.
+/// Each of those runs is saved to its own checkpoint file, named after
+/// `checkpoint.path`. A resumed run only resumes the band that was
+/// interrupted, so the bands before it are simulated again.
+/// The mesh is simulated once per band at most, no matter how many receivers
+/// there are.
+///
+/// returns:    the bands for each receiver, in the same order as `receivers`
+template <typename PressureCallback>
+std::experimental::optional<
+        util::aligned::vector<util::aligned::vector<bandpass_band>>>
+canonical(const core::compute_context& cc,
+          voxels_and_mesh voxelised,
+          const glm::vec3& source,
+          const util::aligned::vector<glm::vec3>& receivers,
+          const core::environment& environment,
+          const multiple_band_constant_spacing_parameters& sim_params,
+          double simulation_time,
+          const std::atomic_bool& keep_going,
+          PressureCallback&& pressure_callback,
+          const detail::optional_early_termination& early_termination =
+                  std::experimental::nullopt,
+          const detail::optional_out_of_core& out_of_core =
+                  std::experimental::nullopt,
+          const detail::optional_checkpoint& checkpoint =
+                  std::experimental::nullopt,
+          const detail::optional_partition& partition =
+                  std::experimental::nullopt) {
+    //  For each receiver, the output in each band.
+    using rendered_t = util::aligned::vector<util::aligned::vector<band>>;
+
+    const auto render_packed =
+            [&]() -> std::experimental::optional<rendered_t> {
+        util::aligned::vector<util::aligned::vector<coefficients_canonical>>
+                band_coefficients;
+        for (auto band = 0; band != sim_params.bands; ++band) {
+            band_coefficients.emplace_back(
+                    compute_flat_coefficients_for_band(voxelised, band));
+        }
+        return detail::canonical_packed_impl(cc,
+                                             voxelised.mesh,
+                                             band_coefficients,
+                                             simulation_time,
+                                             source,
+                                             receivers,
+                                             environment,
+                                             keep_going,
+                                             pressure_callback,
+                                             early_termination,
+                                             checkpoint);
+    };
+
+    const auto render_sequential =
+            [&]() -> std::experimental::optional<rendered_t> {
+        rendered_t ret(receivers.size());
+        for (auto band = 0; band != sim_params.bands; ++band) {
+            set_flat_coefficients_for_band(voxelised, band);
+
+            auto rendered_bands = detail::canonical_impl(
+                    cc,
+                    voxelised.mesh,
+                    simulation_time,
+                    source,
+                    receivers,
+                    environment,
+                    keep_going,
+                    pressure_callback,
+                    early_termination,
+                    out_of_core,
+                    detail::get_band_checkpoint(checkpoint, band),
+                    partition);
+            if (!rendered_bands) {
+                return std::experimental::nullopt;
+            }
+
+            for (auto i = 0u; i != receivers.size(); ++i) {
+                ret[i].emplace_back(std::move((*rendered_bands)[i]));
+            }
+        }
+        return ret;
+    };
+
+    const auto is_sequential = cc.backend == core::compute_backend::native ||
+                               out_of_core || partition;
+    auto rendered = is_sequential ? render_sequential() : render_packed();
+
+    if (!rendered) {
+        return std::experimental::nullopt;
+    }
+
+    const auto band_params = hrtf_data::hrtf_band_params_hz();
+
+    return util::map_to_vector(
+            begin(*rendered), end(*rendered), [&](auto& bands) {
+                util::aligned::vector<bandpass_band> ret;
+                for (auto band = 0u; band != bands.size(); ++band) {
+                    ret.emplace_back(bandpass_band{
+                            std::move(bands[band]),
+                            util::make_range(band_params.edges[band],
+                                             band_params.edges[band + 1])});
+                }
+                return ret;
+            });
+}
+
 template <typename PressureCallback>
 std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
         const core::compute_context& cc,
@@ -147,33 +738,33 @@ std::experimental::optional<util::aligned::vector<bandpass_band>> canonical(
         const multiple_band_constant_spacing_parameters& sim_params,
         double simulation_time,
         const std::atomic_bool& keep_going,
-        PressureCallback&& pressure_callback) {
-    const auto band_params = hrtf_data::hrtf_band_params_hz();
-
-    util::aligned::vector<bandpass_band> ret{};
-
-    //  For each band, up to the maximum band specified.
-    for (auto band = 0; band != sim_params.bands; ++band) {
-        set_flat_coefficients_for_band(voxelised, band);
-
-        if (auto rendered_band = detail::canonical_impl(cc,
-                                                        voxelised.mesh,
-                                                        simulation_time,
-                                                        source,
-                                                        receiver,
-                                                        environment,
-                                                        keep_going,
-                                                        pressure_callback)) {
-            ret.emplace_back(bandpass_band{
-                    std::move(*rendered_band),
-                    util::make_range(band_params.edges[band],
-                                     band_params.edges[band + 1])});
-        } else {
-            return std::experimental::nullopt;
-        }
+        PressureCallback&& pressure_callback,
+        const detail::optional_early_termination& early_termination =
+                std::experimental::nullopt,
+        const detail::optional_out_of_core& out_of_core =
+                std::experimental::nullopt,
+        const detail::optional_checkpoint& checkpoint =
+                std::experimental::nullopt,
+        const detail::optional_partition& partition =
+                std::experimental::nullopt) {
+    if (auto ret = canonical(
+                cc,
+                std::move(voxelised),
+                source,
+                util::aligned::vector<glm::vec3>{receiver},
+                environment,
+                sim_params,
+                simulation_time,
+                keep_going,
+                std::forward<PressureCallback>(pressure_callback),
+                early_termination,
+                out_of_core,
+                checkpoint,
+                partition)) {
+        return std::move(ret->front());
     }
 
-    return ret;
+    return std::experimental::nullopt;
 }
 
 }  // namespace waveguide
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <experimental/optional>
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+namespace wayverb {
+namespace waveguide {
+
+class stepper;
+
+/// Controls periodic snapshots of a running simulation (see run and
+/// run_batched).
+struct checkpoint_parameters final {
+    /// The snapshot file. If it exists when the simulation starts, the
+    /// simulation resumes from it.
+    std::string path;
+
+    /// The number of steps between snapshots.
+    /// Batched runs only save between batches, so they save at the end of
+    /// the first batch to finish at least this many steps after the last
+    /// snapshot.
+    size_t interval;
+};
+
+/// Writes a snapshot of the simulation, as it is before `step` is run.
+/// The snapshot is written to a temporary file and then moved into place, so
+/// that an interrupted write never replaces a good snapshot.
+///
+/// write_extra:    saves any other state needed to resume, e.g. the state of
+///                 the pre- and post-processors
+void write_checkpoint(const std::string& path,
+                      size_t step,
+                      stepper& stepper,
+                      const std::function<void(std::ostream&)>& write_extra);
+
+/// Restores a snapshot saved by write_checkpoint.
+///
+/// read_extra:     restores the state saved by write_extra
+///
+/// returns:        the step to resume from, or nullopt if there is no file
+///                 at `path`
+///
+/// Throws if the snapshot is unreadable, or was saved from a simulation with
+/// a different mesh descriptor, number of bands, state size, backend or set
+/// of boundaries (see stepper::get_boundary_hash).
+std::experimental::optional<size_t> read_checkpoint(
+        const std::string& path,
+        stepper& stepper,
+        const std::function<void(std::istream&)>& read_extra);
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -11,7 +11,15 @@ constexpr size_t biquad_sections{3};
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// The precision of boundary filter coefficients and state.
+/// Define WAYVERB_SINGLE_PRECISION_FILTERS to halve the size of the boundary
+/// data, and to allow devices without double support.
+/// Filters which are unstable at this precision are re-fitted by make_stable.
+#ifdef WAYVERB_SINGLE_PRECISION_FILTERS
+using filt_real = cl_float;
+#else
 using filt_real = cl_double;
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -54,6 +62,17 @@ inline bool operator!=(const coefficients<D>& a, const coefficients<D>& b) {
     return !(a == b);
 }
 
+/// The order of the filter once trailing zero coefficients are dropped.
+/// Lower-order boundary filters are stored padded with zeros.
+template <size_t D>
+inline size_t effective_order(const coefficients<D>& c) {
+    auto ret = D;
+    while (ret && c.b[ret] == 0 && c.a[ret] == 0) {
+        --ret;
+    }
+    return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 using memory_biquad = memory<biquad_order>;
@@ -83,9 +102,15 @@ struct alignas(1 << 3) biquad_coefficients_array final {
 
 template <>
 struct core::cl_representation<waveguide::filt_real> final {
+#ifdef WAYVERB_SINGLE_PRECISION_FILTERS
+    static constexpr auto value = R"(
+typedef float filt_real;
+)";
+#else
     static constexpr auto value = R"(
 typedef double filt_real;
 )";
+#endif
 };
 
 template <>
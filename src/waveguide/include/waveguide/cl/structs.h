@@ -73,6 +73,27 @@ using boundary_data_array_1 = boundary_data_array<1>;
 using boundary_data_array_2 = boundary_data_array<2>;
 using boundary_data_array_3 = boundary_data_array<3>;
 
+////////////////////////////////////////////////////////////////////////////////
+
+/// A run of consecutive nodes which all take the same update.
+/// Runs are at most max_length nodes long, so that the OpenCL kernels can
+/// give each run a fixed number of work-items.
+struct alignas(1 << 3) node_run final {
+    /// Must match NODE_RUN_LENGTH in the waveguide kernel.
+    static constexpr cl_uint max_length = 32;
+
+    cl_uint begin{};
+    cl_uint length{};
+};
+
+inline bool operator==(const node_run& a, const node_run& b) {
+    return std::tie(a.begin, a.length) == std::tie(b.begin, b.length);
+}
+
+inline bool operator!=(const node_run& a, const node_run& b) {
+    return !(a == b);
+}
+
 }  // namespace waveguide
 
 template <>
@@ -99,6 +120,16 @@ typedef struct {
 )";
 };
 
+template <>
+struct core::cl_representation<waveguide::node_run> final {
+    static constexpr auto value = R"(
+typedef struct {
+    uint begin;
+    uint length;
+} node_run;
+)";
+};
+
 template <>
 struct core::cl_representation<waveguide::boundary_data> final {
     static constexpr auto value = R"(
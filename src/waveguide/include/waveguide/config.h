@@ -1,5 +1,7 @@
 #pragma once
 
+#include "waveguide/stencil.h"
+
 #include "utilities/aligned/vector.h"
 
 #include <vector>
@@ -8,9 +10,17 @@ namespace wayverb {
 namespace waveguide {
 namespace config {
 
-double speed_of_sound(double time_step, double grid_spacing);
-double time_step(double speed_of_sound, double grid_spacing);
-double grid_spacing(double speed_of_sound, double time_step);
+/// These relations depend on the Courant number of the update scheme.
+/// Schemes with larger Courant numbers use finer grids at a given time step.
+double speed_of_sound(double time_step,
+                      double grid_spacing,
+                      stencil s = stencil::rectilinear);
+double time_step(double speed_of_sound,
+                 double grid_spacing,
+                 stencil s = stencil::rectilinear);
+double grid_spacing(double speed_of_sound,
+                    double time_step,
+                    stencil s = stencil::rectilinear);
 
 }  // namespace config
 
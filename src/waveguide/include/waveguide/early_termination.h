@@ -0,0 +1,49 @@
+#pragma once
+
+#include "waveguide/bandpass_band.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Controls when a simulation may stop before its requested length.
+///
+/// The total energy in the mesh is measured every `interval` steps, and its
+/// decay (in dB) is fitted with a straight line over the last `window`
+/// measurements.
+/// The simulation stops once, in every band:
+///     the energy has fallen at least `min_decay` dB below its peak,
+///     the fit is close to a straight line,
+///     and it agrees with the fit over the `window` measurements before it.
+/// The rest of the output is then synthesized from the fitted decay rate.
+struct early_termination_parameters final {
+    size_t interval{64};
+    size_t window{32};
+
+    /// The fit's correlation coefficient must be at least this close to -1.
+    double min_correlation{0.99};
+
+    /// Maximum relative difference between consecutive decay rates.
+    double max_slope_change{0.05};
+
+    /// In dB.
+    double min_decay{15};
+};
+
+/// Extends the output in `band` to `steps` samples, with noise which decays
+/// exponentially at `decay_rate`.
+///
+/// decay_rate:         in dB per second, must be negative
+/// reference_steps:    the level of the tail is matched to the RMS pressure
+///                     of this many samples at the end of the existing output
+/// cutoff:             the noise is lowpassed at this frequency, in Hz
+/// acoustic_impedance: each sample's intensity is set to match its pressure,
+///                     with a random direction, as in a diffuse field
+void synthesize_tail(band& band,
+                     size_t steps,
+                     double decay_rate,
+                     size_t reference_steps,
+                     double cutoff,
+                     double acoustic_impedance);
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "core/program_wrapper.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Kernels for measuring the acoustic energy in the mesh while it runs.
+class energy_program final {
+public:
+    energy_program(const core::compute_context& cc);
+
+    /// Each thread sums the squared pressures of a strided subset of nodes,
+    /// for a single band. The host adds up the partial sums.
+    auto get_partial_energy_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl_uint,     /// nodes
+                                   cl_uint,     /// bands
+                                   cl::Buffer   /// output
+                                   >("partial_energy");
+    }
+
+private:
+    core::program_wrapper wrapper_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
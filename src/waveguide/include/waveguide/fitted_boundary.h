@@ -7,6 +7,7 @@
 
 #include "core/cosine_interp.h"
 #include "core/filter_coefficients.h"
+#include "core/freqz.h"
 #include "core/surfaces.h"
 
 #include "hrtf/multiband.h"
@@ -14,6 +15,8 @@
 #include "utilities/for_each.h"
 #include "utilities/map.h"
 
+#include <numeric>
+
 namespace wayverb {
 namespace waveguide {
 namespace detail {
@@ -54,31 +57,69 @@ constexpr auto make_coefficients_canonical(
         const core::filter_coefficients<sizeof...(Ix) - 1, sizeof...(Ix) - 1>&
                 coeffs,
         std::index_sequence<Ix...>) {
-    return coefficients_canonical{{std::get<Ix>(coeffs.b)...},
-                                  {std::get<Ix>(coeffs.a)...}};
+    return coefficients_canonical{
+            {static_cast<filt_real>(std::get<Ix>(coeffs.b))...},
+            {static_cast<filt_real>(std::get<Ix>(coeffs.a))...}};
 }
 
+/// Lower-order filters are padded with zero coefficients.
+template <size_t N>
 constexpr auto make_coefficients_canonical(
-        const core::filter_coefficients<coefficients_canonical::order,
-                                        coefficients_canonical::order>&
-                coeffs) {
-    return make_coefficients_canonical(
-            coeffs,
-            std::make_index_sequence<coefficients_canonical::order + 1>{});
+        const core::filter_coefficients<N, N>& coeffs) {
+    static_assert(N <= coefficients_canonical::order,
+                  "Filter order is too high for canonical coefficients.");
+    return make_coefficients_canonical(coeffs,
+                                       std::make_index_sequence<N + 1>{});
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 inline auto to_flat_coefficients(double absorption) {
     return to_impedance_coefficients(coefficients_canonical{
-            {core::absorption_to_pressure_reflectance(absorption)}, {1}});
+            {static_cast<filt_real>(
+                    core::absorption_to_pressure_reflectance(absorption))},
+            {1}});
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// The largest difference between the magnitude response of `coeffs` and the
+/// target reflectance, at any of the band centres.
+/// Band centres are given from 0-1 (dc to nyquist).
+template <size_t order, typename T, typename U>
+double max_reflectance_error(const coefficients<order>& coeffs,
+                             const T& band_centres,
+                             const U& reflectance) {
+    std::array<double, order + 1> b, a;
+    std::copy(std::begin(coeffs.b), std::end(coeffs.b), b.begin());
+    std::copy(std::begin(coeffs.a), std::end(coeffs.a), a.begin());
+
+    auto ret = 0.0;
+    for (auto i = 0u; i != band_centres.size(); ++i) {
+        const auto response =
+                std::abs(core::freqz(b, a, M_PI * band_centres[i]));
+        ret = std::max(ret, std::abs(response - reflectance[i]));
+    }
+    return ret;
+}
+
+/// Fits a filter to the reflectance of a surface, at the lowest order which
+/// is good enough.
+///
+/// Boundary filters are the most expensive part of the boundary update, and
+/// most surfaces have fairly flat absorption, so there's no need to give
+/// every surface the full canonical order.
+/// A flat (0th-order) filter is tried first, then a 2nd-order one, and the
+/// first which is stable and within `tolerance` of the target reflectance
+/// at every band centre is used.
+/// Otherwise, the filter has the full canonical order.
+///
+/// Lower orders are padded with zero coefficients, which the boundary
+/// updates use to skip the unused part of the filter.
 template <typename T>
 auto compute_reflectance_filter_coefficients(T&& absorption,
-                                             double sample_rate) {
+                                             double sample_rate,
+                                             double tolerance = 0.01) {
     const auto band_centres =
             util::map([](auto i) { return i * 2; },
                       hrtf_data::hrtf_band_centres(sample_rate));
@@ -88,6 +129,29 @@ auto compute_reflectance_filter_coefficients(T&& absorption,
             },
             absorption);
 
+    const auto within_tolerance = [&](const auto& coeffs) {
+        return max_reflectance_error(coeffs, band_centres, reflectance) <=
+               tolerance;
+    };
+
+    const auto flat = coefficients_canonical{
+            {static_cast<filt_real>(
+                    std::accumulate(std::begin(reflectance),
+                                    std::end(reflectance),
+                                    0.0) /
+                    reflectance.size())},
+            {1}};
+    if (within_tolerance(flat)) {
+        return flat;
+    }
+
+    const auto second_order = make_coefficients_canonical(
+            arbitrary_magnitude_filter<2>(make_frequency_domain_envelope(
+                    band_centres, reflectance)));
+    if (is_stable(second_order.a) && within_tolerance(second_order)) {
+        return second_order;
+    }
+
     constexpr auto lim = 1000;
     for (auto delay = 0; delay != lim; ++delay) {
         const auto reflectance_coeffs = make_coefficients_canonical(
@@ -2,6 +2,7 @@
 
 #include "waveguide/mesh_descriptor.h"
 #include "waveguide/setup.h"
+#include "waveguide/stencil.h"
 
 #include "core/gpu_scene_data.h"
 #include "core/spatial_division/voxelised_scene_data.h"
@@ -11,10 +12,15 @@ namespace waveguide {
 
 class mesh final {
 public:
-    mesh(mesh_descriptor descriptor, vectors vectors);
+    /// s:  the update scheme which the mesh spacing and boundary coefficients
+    ///     were chosen for
+    mesh(mesh_descriptor descriptor,
+         vectors vectors,
+         stencil s = stencil::rectilinear);
 
     const mesh_descriptor& get_descriptor() const;
     const vectors& get_structure() const;
+    stencil get_stencil() const;
 
     void set_coefficients(coefficients_canonical coefficients);
     void set_coefficients(
@@ -23,22 +29,79 @@ public:
 private:
     mesh_descriptor descriptor_;
     vectors vectors_;
+    stencil stencil_;
 };
 
 /// Uses the number of 'inside' nodes and the mesh spacing to estimate the
 /// total volume of the room.
+/// Works with both compacted and uncompacted meshes.
 double estimate_volume(const mesh& mesh);
 
+/// The node at `node_index`, which is an outside node if it isn't stored.
+condensed_node get_node(const mesh& m, size_t node_index);
+
 bool is_inside(const mesh& m, size_t node_index);
 
+/// Finds where a node lives in the mesh's node and pressure buffers.
+/// For uncompacted meshes, this is just the node index.
+/// Throws if the node is not stored in a compacted mesh.
+size_t compute_storage_index(const mesh& m, size_t node_index);
+
+/// Whether the node has a place in the mesh's node and pressure buffers.
+/// Always true for uncompacted meshes.
+/// Unstored nodes are outside nodes, whose pressure is always zero.
+bool is_stored(const mesh& m, size_t node_index);
+
+/// Returns a copy of the mesh which only stores bricks of nodes containing
+/// inside or boundary nodes.
+/// This is worthwhile for rooms which fill their bounding box poorly (L-shapes,
+/// corridors, balconies).
+/// Pre- and post-processors should use compute_storage_index to find nodes.
+///
+/// Nodes are stored brick-by-brick, with bricks in the given order. The
+/// lists of nodes to update are in storage order, so neighbouring
+/// work-items touch neighbouring memory.
+/// The native engine (and so out-of-core runs) needs linear brick order.
+mesh compact(const mesh& m, brick_order order = brick_order::morton);
+
+/// The brick order which suits the context's backend.
+/// OpenCL devices get Morton order, so that a work-group's neighbour reads
+/// stay close together. The native engine needs linear order.
+brick_order compute_brick_order(const core::compute_context& cc);
+
+/// Whether compacting an uncompacted mesh would store at most three quarters
+/// of its nodes.
+/// Below that, the saving isn't worth the extra indirection in every
+/// neighbour lookup.
+bool is_worth_compacting(const mesh& m);
+
+/// Fits a boundary filter to each surface's absorption coefficients, for a
+/// mesh running at `sample_rate`.
+util::aligned::vector<coefficients_canonical> compute_boundary_coefficients(
+        const util::aligned::vector<core::surface<core::simulation_bands>>&
+                surfaces,
+        double sample_rate);
+
+/// Wall-clock time spent in each stage of compute_mesh, in seconds.
+struct mesh_setup_timings final {
+    /// Classifying nodes as inside or outside the scene.
+    double inside_test{};
+    /// Finding each boundary node's closest surface.
+    double boundary_finder{};
+};
+
 ///  use this if you already have a voxelised scene
+///
+///  timings:   if not null, filled with the time taken by each setup stage
 mesh compute_mesh(
         const core::compute_context& cc,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         float mesh_spacing,
-        float speed_of_sound);
+        float speed_of_sound,
+        stencil s = stencil::rectilinear,
+        mesh_setup_timings* timings = nullptr);
 
 struct voxels_and_mesh final {
     core::voxelised_scene_data<cl_float3, core::surface<core::simulation_bands>>
@@ -48,13 +111,18 @@ struct voxels_and_mesh final {
 
 /// this one should be prefered - will set up a voxelised scene with the correct
 /// boundaries, and then will use it to create a mesh
+///
+/// allow_compaction:   if set, and is_worth_compacting, the mesh is
+///                     compacted in the order from compute_brick_order
 voxels_and_mesh compute_voxels_and_mesh(
         const core::compute_context& cc,
         const core::gpu_scene_data& scene,
         const glm::vec3& anchor,  //  probably the receiver if you want it to
                                   //  coincide with an actual node
         double sample_rate,
-        double speed_of_sound);
+        double speed_of_sound,
+        stencil s = stencil::rectilinear,
+        bool allow_compaction = false);
 
 }  // namespace waveguide
 }  // namespace wayverb
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include <cstdint>
+#include <experimental/optional>
+#include <string>
+
+namespace wayverb {
+namespace waveguide {
+
+/// Hashes everything which affects the layout of a mesh built by
+/// compute_voxels_and_mesh: the scene geometry (including which surface each
+/// triangle uses), the mesh spacing, the anchor, and the brick order the
+/// mesh may be compacted in (if any).
+/// Surface materials are not included, because boundary coefficients are
+/// cheap to recompute when a mesh is loaded.
+std::uint64_t compute_mesh_cache_key(
+        const core::gpu_scene_data& scene,
+        const glm::vec3& anchor,
+        double sample_rate,
+        double speed_of_sound,
+        std::experimental::optional<brick_order> compaction =
+                std::experimental::nullopt);
+
+/// Writes the parts of a mesh which are expensive to compute (the mesh
+/// descriptor, node classification, boundary indices, voxel index and brick
+/// layout) to a binary file.
+///
+/// The file is a fixed-size header followed by raw arrays, each aligned to
+/// 8 bytes, so that it can be memory-mapped. It is only meant to be read back
+/// on the machine which wrote it.
+/// Meshes for stencils other than the rectilinear one can't be stored.
+void write_mesh_cache(const std::string& path,
+                      std::uint64_t key,
+                      const voxels_and_mesh& voxels_and_mesh);
+
+/// Loads a mesh written by write_mesh_cache, and fits boundary coefficients
+/// to the surfaces in `scene`.
+///
+/// returns:    nullopt if the file can't be read, or if it was written with a
+///             different key or file format
+std::experimental::optional<voxels_and_mesh> read_mesh_cache(
+        const std::string& path,
+        std::uint64_t key,
+        const core::gpu_scene_data& scene,
+        double speed_of_sound);
+
+/// Like compute_voxels_and_mesh, but looks for a cached mesh in
+/// `cache_directory` first, and stores newly computed meshes there.
+/// The directory must already exist.
+/// Failing to store a mesh isn't an error: it is logged, and the mesh is
+/// returned anyway.
+/// Meshes compacted for one backend aren't reused for another which needs a
+/// different brick order.
+voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
+                                        const core::gpu_scene_data& scene,
+                                        const glm::vec3& anchor,
+                                        double sample_rate,
+                                        double speed_of_sound,
+                                        const std::string& cache_directory,
+                                        bool allow_compaction = false);
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -23,6 +23,19 @@ public:
                                    >("set_node_inside");
     }
 
+    /// Classifies a whole column of nodes per thread, using one ray along
+    /// the z axis. Should be run with one thread per (x, y) column.
+    auto get_column_inside_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,       /// nodes
+                                   mesh_descriptor,  /// descriptor
+                                   cl::Buffer,       /// voxel_index
+                                   core::aabb,       /// global_aabb
+                                   cl_uint,          /// side
+                                   cl::Buffer,       /// triangles
+                                   cl::Buffer        /// vertices
+                                   >("set_column_inside");
+    }
+
     auto get_node_boundary_kernel() const {
         return wrapper_.get_kernel<cl::Buffer,      /// nodes
                                    mesh_descriptor  /// descriptor
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "waveguide/cl/structs.h"
+#include "waveguide/mesh.h"
+
+#include "utilities/aligned/vector.h"
+#include "utilities/thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <iosfwd>
+
+namespace wayverb {
+namespace waveguide {
+namespace native {
+
+/// A host implementation of the `condensed_waveguide` kernel.
+///
+/// The mesh is split into slabs of single z-planes (or single layers of
+/// bricks, for compacted meshes), which are updated in parallel on a thread
+/// pool.
+/// Each slab covers a contiguous range of storage, so compacted meshes must
+/// use linear brick order.
+/// Within each slab, nodes are grouped using the mesh's node_index_data.
+/// Runs of interior nodes (which use the plain rectilinear update) are stored
+/// separately from everything else, so that the inner loop is branch-free and
+/// can be vectorised by the compiler.
+/// Boundary nodes go through a port of the boundary filter code from the
+/// kernel, and hold their own copy of the boundary filter state.
+class engine final {
+public:
+    explicit engine(const mesh& mesh,
+                    size_t threads = std::max(
+                            1u, std::thread::hardware_concurrency()));
+
+    /// Computes the next pressure at every node, and writes it to `previous`.
+    ///
+    /// returns:    a combination of error_code flags, like the kernel's
+    ///             error_flag
+    error_code step(float* previous, const float* current);
+
+    /// Called with the pressures of one step, over the storage range of one
+    /// or more whole slabs.
+    /// May read and write pressures in [begin, end), and nowhere else.
+    /// Calls for different slabs may happen concurrently.
+    using slab_callback = std::function<void(
+            size_t step, float* pressures, size_t begin, size_t end)>;
+
+    /// Called after each wavefront of step_blocked, with the range of
+    /// slabs [begin, end) which later wavefronts of the same call may
+    /// still read or write.
+    /// Slabs below `begin` are finished with, and slabs from `end` onwards
+    /// haven't been touched yet.
+    using wavefront_callback = std::function<void(size_t begin, size_t end)>;
+
+    /// Computes `steps` steps at once, with the same result as calling step
+    /// and swapping the buffers `steps` times.
+    ///
+    /// Rather than sweeping the whole mesh once per step, slabs are updated
+    /// in a pipelined wavefront: each time level trails the one before it by
+    /// two slabs, so a slab is still in cache when the next step reads it.
+    /// Time levels run in parallel, so `steps` should be at least the number
+    /// of threads.
+    /// Each boundary node is still updated exactly once per step, in step
+    /// order, so the boundary filter state matches the per-step sweep.
+    ///
+    /// callback:   called for every slab at every step in [0, steps), once
+    ///             that step's pressures are final and before they are read.
+    ///             Use it to inject inputs and record outputs.
+    ///             Step 0 may be passed the whole mesh in one call.
+    /// progress:   optional; use it to manage where the pressures live.
+    ///
+    /// On return, `current` points at the newest pressures and `previous` at
+    /// the ones before.
+    error_code step_blocked(float*& previous,
+                            float*& current,
+                            size_t steps,
+                            const slab_callback& callback,
+                            const wavefront_callback& progress = nullptr);
+
+    const mesh_descriptor& get_descriptor() const;
+
+    /// The number of stored nodes, i.e. the size of each pressure buffer.
+    size_t get_num_nodes() const;
+
+    /// The storage index of the first node of each slab, followed by the end
+    /// of the last slab.
+    const util::aligned::vector<size_t>& get_slab_offsets() const;
+
+    /// The size in bytes of the boundary filter state.
+    size_t get_boundary_state_size() const;
+
+    /// Saves or restores the boundary filter state.
+    /// Each boundary node's boundary_data_array_N is written out whole
+    /// (filter memory and coefficient indices together), in the order the
+    /// mesh lists them. This is not the OpenCL backend's layout, which keeps
+    /// filter memory and coefficient indices in separate arrays, so state
+    /// can't be moved between backends.
+    void write_boundary_state(std::ostream& os) const;
+    void read_boundary_state(std::istream& is);
+
+private:
+    /// A half-open range of consecutive node indices.
+    struct run final {
+        size_t begin;
+        size_t end;
+    };
+
+    /// An inside node on the edge of the mesh, with its neighbours
+    /// precomputed.
+    struct edge_node final {
+        size_t index;
+        std::array<cl_uint, num_ports> neighbors;
+    };
+
+    /// A boundary node, with its neighbours precomputed.
+    struct boundary_node final {
+        size_t index;
+        condensed_node node;
+        std::array<cl_uint, num_ports> neighbors;
+        /// Errors raised by the surrounding nodes, which never change.
+        cl_int surrounding_errors;
+    };
+
+    struct slab final {
+        /// Nodes which use the normal update, and which have six neighbours.
+        util::aligned::vector<run> interior;
+        /// Boundary nodes, grouped by the number of boundaries they touch.
+        util::aligned::vector<boundary_node> boundary_1;
+        util::aligned::vector<boundary_node> boundary_2;
+        util::aligned::vector<boundary_node> boundary_3;
+        /// Inside nodes on the mesh edge.
+        util::aligned::vector<edge_node> other;
+    };
+
+    cl_int step_slab(const slab& s, float* previous, const float* current);
+
+    mesh_descriptor descriptor_;
+    size_t num_nodes_;
+    util::aligned::vector<coefficients_canonical> coefficients_;
+    /// The effective order of each set of coefficients.
+    util::aligned::vector<size_t> coefficient_orders_;
+    util::aligned::vector<boundary_data_array_1> boundary_data_1_;
+    util::aligned::vector<boundary_data_array_2> boundary_data_2_;
+    util::aligned::vector<boundary_data_array_3> boundary_data_3_;
+
+    /// For compacted meshes, the slot of each stored brick's neighbour in
+    /// each direction. Empty for uncompacted meshes.
+    util::aligned::vector<std::array<cl_uint, num_ports>> slot_neighbors_;
+
+    util::aligned::vector<size_t> slab_offsets_;
+    util::aligned::vector<slab> slabs_;
+    util::aligned::vector<cl_int> slab_errors_;
+    util::thread_pool pool_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Runs a whole simulation on the engine using step_blocked, with a hard
+/// source and a set of receiver taps.
+///
+/// source:     storage index of the node whose pressure is set from
+///             `signal` (see compute_storage_index)
+/// signal:     one value per step; the simulation runs for this many steps
+/// taps:       storage indices of the nodes to record, e.g. from
+///             get_tap_nodes
+/// block_size: number of steps to compute in each call to step_blocked
+///
+/// returns:    the pressure at every tap for each completed step, one row of
+///             taps per step, as for postprocessor::taps
+util::aligned::vector<float> run_blocked(
+        engine& engine,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        size_t block_size,
+        const std::atomic_bool& keep_going);
+
+}  // namespace native
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "waveguide/native/engine.h"
+
+#include <memory>
+#include <string>
+
+namespace wayverb {
+namespace waveguide {
+namespace native {
+
+struct out_of_core_parameters final {
+    /// Where to put the pressure files.
+    /// This should be on fast local storage, ideally an SSD.
+    std::string scratch_directory;
+
+    /// Pressures are loaded and evicted in groups of this many of the
+    /// engine's slabs, which are z-planes (or layers of bricks, for compacted
+    /// meshes).
+    size_t planes_per_slab{16};
+
+    /// Steps computed during each pass over the pressure files.
+    /// Larger blocks mean fewer passes, but a deeper wavefront to keep
+    /// resident.
+    size_t block_size{32};
+};
+
+/// The two pressure fields of a simulation, kept in unlinked, memory-mapped
+/// temporary files in `scratch_directory` rather than in RAM.
+///
+/// To stream through the files, call begin_pass, then pass `advance` to
+/// engine::step_blocked as its wavefront callback, then call end_pass.
+/// As the wavefront moves up the mesh, the slab above it is requested from
+/// disk while the current one is being updated, and slabs which the pass
+/// has finished with are written back and dropped from the page cache.
+/// The scratch directory should be on a real disk: a tmpfs can't drop
+/// pages which are only held in memory.
+///
+/// Only the pressures are kept on disk. The engine's node and boundary
+/// structures stay in RAM.
+class pressure_files final {
+public:
+    /// The files are laid out like the engine's pressure buffers.
+    pressure_files(const engine& engine, const out_of_core_parameters& params);
+
+    pressure_files(const pressure_files&) = delete;
+    pressure_files& operator=(const pressure_files&) = delete;
+
+    ~pressure_files() noexcept;
+
+    /// One of the two fields, which start out full of zeros.
+    ///
+    /// i:  0 or 1
+    float* get_field(size_t i);
+
+    /// Requests the bottom of the mesh, where every pass starts.
+    void begin_pass();
+
+    /// Matches engine::wavefront_callback.
+    void advance(size_t begin, size_t end);
+
+    /// Drops whatever the pass left resident.
+    void end_pass();
+
+    /// The number of bytes of both files currently held in memory, whether
+    /// mapped or only cached.
+    size_t get_resident_bytes() const;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+/// Does the same as run_blocked, but keeps the pressures in pressure_files.
+///
+/// Each block of steps streams through the files once, in step_blocked's
+/// wavefront order, so only about `2 * block_size + 2 * planes_per_slab`
+/// of the engine's slabs of each field need to be resident at once.
+/// Tap outputs are the only results kept in RAM.
+///
+/// This only covers the pressures, which take 8 bytes per node.
+/// The mesh (which is needed to build the engine) and the engine's own node
+/// and boundary structures are still held in memory, so this only takes
+/// the pressures' share off the memory needed per node. It doesn't let
+/// meshes whose structure alone is larger than RAM run.
+/// To drive the same storage with ordinary pre- and post-processors, use a
+/// stepper constructed with out_of_core_parameters instead.
+///
+/// returns:    the pressure at every tap for each completed step, exactly as
+///             run_blocked would
+util::aligned::vector<float> run_out_of_core(
+        engine& engine,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        const out_of_core_parameters& params,
+        const std::atomic_bool& keep_going);
+
+}  // namespace native
+}  // namespace waveguide
+}  // namespace wayverb
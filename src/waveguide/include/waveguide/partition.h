@@ -0,0 +1,79 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <atomic>
+
+namespace wayverb {
+namespace waveguide {
+
+/// One slab of a larger mesh, cut perpendicular to `axis`.
+///
+/// The slab owns the planes [begin, end) of the full mesh. Where it borders
+/// another slab, it also holds one 'halo' plane belonging to the neighbour,
+/// so that its own nodes can be updated without reading outside the slab.
+/// Halo boundary nodes are stored as plain reentrant nodes with no boundary
+/// state: their computed values are meaningless, and must be replaced with
+/// the neighbour's values after every step.
+struct partition final {
+    mesh mesh;
+    size_t axis;
+    /// The plane of the full mesh which is the first plane of `mesh`.
+    size_t offset;
+    size_t begin;
+    size_t end;
+};
+
+/// Splits a mesh into `slabs` slabs of nearly equal thickness, along its
+/// longest axis.
+/// The slabs of a compacted mesh are compacted in the same brick order.
+util::aligned::vector<partition> partition_mesh(const mesh& mesh,
+                                                size_t slabs);
+
+/// Finds the storage index in `p.mesh` of a node of the full mesh described
+/// by `descriptor`.
+/// Throws if the slab is compacted and doesn't store the node.
+size_t compute_partition_index(const mesh_descriptor& descriptor,
+                               const partition& p,
+                               size_t index);
+
+/// Returns the storage indices in `p.mesh` of the nodes on a plane of the
+/// full mesh, in an order which is the same for every slab.
+/// Outside nodes are left out.
+util::aligned::vector<cl_uint> compute_plane_indices(const partition& p,
+                                                     size_t plane);
+
+/// Runs a whole simulation on several compute contexts at once, with a hard
+/// source and a set of receiver taps.
+///
+/// The mesh is split into one slab per context, and each slab runs on its
+/// own thread. After every step, neighbouring slabs swap the plane of
+/// pressures next to their shared face through host memory.
+/// Contexts may share a device, but the speed-up comes from running slabs on
+/// different devices (or on native backends with their own threads).
+///
+/// Like run_batched, the slabs only check for errors, and read back the
+/// taps, once per batch. The source is injected on the device.
+///
+/// source:     index of the node in `mesh` whose pressure is set from `signal`
+///             (a node index, not a storage index, even for compacted meshes)
+/// signal:     one value per step; the simulation runs for this many steps
+/// taps:       node indices in `mesh` to record
+///
+/// returns:    the pressure at every tap for each completed step, one row of
+///             taps per step, as for native::run_blocked
+util::aligned::vector<float> run_partitioned(
+        const util::aligned::vector<core::compute_context>& contexts,
+        const mesh& mesh,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        const std::atomic_bool& keep_going,
+        size_t batch_size = 64);
+
+}  // namespace waveguide
+}  // namespace wayverb
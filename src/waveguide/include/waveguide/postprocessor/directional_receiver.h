@@ -1,14 +1,12 @@
 #pragma once
 
+#include "core/cl/include.h"
+#include "core/serialize/vec.h"
+
 #include "glm/glm.hpp"
 
 #include <array>
 
-namespace cl {
-class Buffer;
-class CommandQueue;
-}  // namespace cl
-
 namespace wayverb {
 namespace core {
 struct environment;
@@ -17,6 +15,7 @@ struct environment;
 namespace waveguide {
 
 struct mesh_descriptor;
+class mesh;
 
 namespace postprocessor {
 
@@ -27,9 +26,20 @@ public:
                          double ambient_density,
                          size_t output_node);
 
+    /// Use this constructor if the mesh might be compacted.
+    directional_receiver(const mesh& mesh,
+                         double sample_rate,
+                         double ambient_density,
+                         size_t output_node);
+
     struct output final {
         glm::vec3 intensity;
         float pressure;
+
+        template <typename Archive>
+        void serialize(Archive& archive) {
+            archive(intensity, pressure);
+        }
     };
 
     using return_type = output;
@@ -37,8 +47,28 @@ public:
                            const cl::Buffer& buffer,
                            size_t step);
 
+    static constexpr auto num_taps = 7;
+
+    /// The nodes which must be recorded to compute the output: the output
+    /// node, followed by its six neighbours.
+    std::array<cl_uint, num_taps> get_tap_nodes() const;
+
+    /// Computes the next output from pressures which have already been read
+    /// back from the device (e.g. by postprocessor::taps).
+    /// Must be called once per step, in order.
+    ///
+    /// tap_pressures:  pressures at the nodes given by get_tap_nodes
+    return_type integrate(const cl_float* tap_pressures);
+
     size_t get_output_node() const;
 
+    /// Saves the integrated velocity, which is the only state that changes
+    /// during a simulation.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(velocity_.x, velocity_.y, velocity_.z);
+    }
+
 private:
     double mesh_spacing_;
     double sample_rate_;
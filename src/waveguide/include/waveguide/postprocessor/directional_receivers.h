@@ -0,0 +1,79 @@
+#pragma once
+
+#include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/postprocessor/taps.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+/// Records the output of several directional receivers at once, for use with
+/// run_batched.
+///
+/// The tap nodes of every receiver are gathered into a single ring buffer on
+/// the device, so however many receivers and bands there are, each batch is
+/// read back in one go. The receivers are then integrated on the host.
+class directional_receivers final {
+public:
+    /// output_nodes:   the node index of each receiver
+    /// capacity:       length of the ring buffer in steps, which must be at
+    ///                 least the batch size
+    /// bands:          the number of bands stored at each node (see stepper).
+    ///                 Each receiver records every band.
+    directional_receivers(const core::compute_context& cc,
+                          const mesh& mesh,
+                          double sample_rate,
+                          double ambient_density,
+                          const util::aligned::vector<size_t>& output_nodes,
+                          size_t capacity,
+                          size_t bands = 1);
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    void finish(cl::CommandQueue& queue, size_t first_step, size_t steps);
+
+    size_t get_num_receivers() const;
+    size_t get_bands() const;
+
+    /// The output of a single receiver in a single band, one element per
+    /// completed step.
+    const util::aligned::vector<directional_receiver::output>& get_output(
+            size_t receiver, size_t band = 0) const;
+
+    /// Saves the outputs so far, along with each receiver's own state.
+    /// Should only be called between batches.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        for (auto& i : receivers_) {
+            archive(i);
+        }
+        archive(taps_, outputs_);
+    }
+
+private:
+    /// Receivers are ordered by output node, then by band.
+    static util::aligned::vector<directional_receiver> make_receivers(
+            const mesh& mesh,
+            double sample_rate,
+            double ambient_density,
+            const util::aligned::vector<size_t>& output_nodes,
+            size_t bands);
+
+    static util::aligned::vector<cl_uint> compute_tap_nodes(
+            const util::aligned::vector<directional_receiver>& receivers,
+            size_t bands);
+
+    size_t bands_;
+    util::aligned::vector<directional_receiver> receivers_;
+    taps taps_;
+    util::aligned::vector<util::aligned::vector<directional_receiver::output>>
+            outputs_;
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "waveguide/early_termination.h"
+#include "waveguide/energy_program.h"
+
+#include "core/serialize/vec.h"
+
+#include "utilities/aligned/vector.h"
+
+#include "glm/glm.hpp"
+
+#include <experimental/optional>
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+/// Watches the total energy in the mesh while it runs, to find out when its
+/// decay has settled into a steady exponential (see
+/// early_termination_parameters).
+/// Energy is summed on the device, so only a few hundred values are read back
+/// per measurement.
+class energy_decay final {
+public:
+    /// bands:  the number of bands stored at each node (see stepper)
+    energy_decay(const core::compute_context& cc,
+                 size_t nodes,
+                 size_t bands,
+                 double sample_rate,
+                 const early_termination_parameters& params);
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    /// True once the decay in every band has settled.
+    bool is_settled() const;
+
+    /// The most recent decay rate in each band, in dB per second.
+    /// Only meaningful once is_settled returns true.
+    const util::aligned::vector<double>& get_decay_rates() const;
+
+    /// The number of steps covered by each fit.
+    size_t get_fit_steps() const;
+
+    /// Saves the measurements so far.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(band_states_, decay_rates_, is_settled_);
+    }
+
+private:
+    struct band_state final {
+        /// Time in seconds against energy in dB.
+        util::aligned::vector<glm::dvec2> history;
+        double peak{-std::numeric_limits<double>::infinity()};
+
+        template <typename Archive>
+        void serialize(Archive& archive) {
+            archive(history, peak);
+        }
+    };
+
+    void update(band_state& band, size_t step, double energy) const;
+
+    /// Returns the decay rate if the band has settled.
+    std::experimental::optional<double> check_settled(
+            const band_state& band) const;
+
+    using kernel_t = decltype(
+            std::declval<energy_program>().get_partial_energy_kernel());
+
+    size_t nodes_;
+    size_t bands_;
+    double sample_rate_;
+    early_termination_parameters params_;
+
+    size_t threads_;
+    cl::Buffer partial_buffer_;
+    util::aligned::vector<cl_float> partial_;
+    kernel_t kernel_;
+
+    util::aligned::vector<band_state> band_states_;
+    util::aligned::vector<double> decay_rates_;
+    bool is_settled_{false};
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
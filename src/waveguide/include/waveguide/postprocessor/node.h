@@ -2,6 +2,8 @@
 
 #include "core/cl/include.h"
 
+#include "utilities/aligned/vector.h"
+
 namespace wayverb {
 namespace waveguide {
 namespace postprocessor {
@@ -17,8 +19,34 @@ public:
 
     size_t get_output_node() const;
 
+    /// Stateless, so there is nothing to save.
+    template <typename Archive>
+    void serialize(Archive&) {}
+
+private:
+    size_t output_node_;
+};
+
+/// Records the pressure at a single node, for use with run_batched.
+/// Pressures are gathered on the device, and read back once per batch.
+class batched_node final {
+public:
+    explicit batched_node(size_t output_node);
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    void finish(cl::CommandQueue& queue, size_t first_step, size_t steps);
+
+    const util::aligned::vector<float>& get_output() const;
+    size_t get_output_node() const;
+
 private:
     size_t output_node_;
+    cl::Buffer batch_;
+    size_t capacity_{0};
+    util::aligned::vector<float> output_;
 };
 
 }  // namespace postprocessor
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+#include "waveguide/snapshot_program.h"
+
+#include "utilities/aligned/vector.h"
+
+#include "glm/glm.hpp"
+
+#include <deque>
+#include <experimental/optional>
+#include <functional>
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+/// A box of mesh nodes, as a half-open range of node locators.
+struct snapshot_region final {
+    glm::ivec3 begin;
+    glm::ivec3 end;
+};
+
+inline bool operator==(const snapshot_region& a, const snapshot_region& b) {
+    return a.begin == b.begin && a.end == b.end;
+}
+
+inline bool operator!=(const snapshot_region& a, const snapshot_region& b) {
+    return !(a == b);
+}
+
+snapshot_region compute_whole_mesh_region(const mesh_descriptor& descriptor);
+
+/// The single plane of nodes at `index` along `axis` (0, 1 or 2).
+snapshot_region compute_plane_region(const mesh_descriptor& descriptor,
+                                     size_t axis,
+                                     size_t index);
+
+size_t compute_num_nodes(const snapshot_region& region);
+
+/// The positions of the nodes in a region, in snapshot order.
+util::aligned::vector<glm::vec3> compute_node_positions(
+        const mesh_descriptor& descriptor, const snapshot_region& region);
+
+struct snapshot_parameters final {
+    /// A snapshot is taken every `interval` steps.
+    size_t interval{1};
+
+    /// If set, only nodes inside this box are captured. Otherwise the whole
+    /// mesh is captured.
+    std::experimental::optional<snapshot_region> region;
+
+    /// If set, pressures are sent as single bytes, with 0 and 255
+    /// representing -quantisation_range and +quantisation_range.
+    std::experimental::optional<float> quantisation_range;
+};
+
+struct pressure_snapshot final {
+    size_t step;
+    snapshot_region region;
+
+    /// One pressure per node in the region, x varying fastest.
+    /// Empty if the snapshot is quantised.
+    util::aligned::vector<float> pressures;
+
+    /// Used instead of `pressures` if the snapshot is quantised.
+    util::aligned::vector<cl_uchar> quantised;
+    float quantisation_range;
+};
+
+/// Returns the snapshot's pressures, undoing any quantisation.
+util::aligned::vector<float> get_pressures(const pressure_snapshot& snapshot);
+
+/// Streams pressures out of a running mesh, for visualisation.
+///
+/// Snapshots are taken on the device, and read back without blocking the
+/// simulation. Reads are queued, each with its own storage and event, and
+/// taking a snapshot never waits for them. Finished reads are passed to the
+/// callback in step order when the next snapshot is taken, or by finish at
+/// the end of a batch, by which time the device is idle. At most a batch's
+/// worth of reads is outstanding at once.
+/// Only works with single-band pressure buffers.
+/// Regions are in node locators even for compacted meshes, and nodes which
+/// a compacted mesh doesn't store read as zero.
+class snapshot final {
+public:
+    using callback_t = std::function<void(pressure_snapshot)>;
+
+    snapshot(const core::compute_context& cc,
+             const mesh& mesh,
+             const snapshot_parameters& params,
+             callback_t callback);
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    /// Whether a snapshot will be taken at this step.
+    /// Other steps don't need the pressures at all.
+    bool is_due(size_t step) const;
+
+    /// Passes every outstanding snapshot to the callback, so that the
+    /// snapshot can also be used as (part of) a run_batched postprocessor.
+    /// Called between batches, so there is nothing left to wait for.
+    void finish(cl::CommandQueue& queue, size_t first_step, size_t steps);
+
+    /// Waits for every outstanding read, and passes the snapshots to the
+    /// callback. Call this once the simulation has finished.
+    void flush();
+
+private:
+    using snapshot_kernel_t = decltype(
+            std::declval<snapshot_program>().get_snapshot_kernel());
+    using quantised_kernel_t = decltype(
+            std::declval<snapshot_program>().get_quantised_snapshot_kernel());
+
+    mesh_descriptor descriptor_;
+    snapshot_parameters params_;
+    snapshot_region region_;
+    callback_t callback_;
+
+    /// Null unless the mesh is compacted.
+    cl::Buffer brick_buffer_;
+    cl::Buffer output_buffer_;
+    snapshot_program program_;
+    snapshot_kernel_t snapshot_kernel_;
+    quantised_kernel_t quantised_kernel_;
+
+    struct pending_snapshot final {
+        pressure_snapshot snapshot;
+        cl::Event read;
+    };
+
+    /// Passes snapshots from the front of the queue to the callback, until
+    /// one is found whose read hasn't finished. If `wait` is set, waits for
+    /// every read instead.
+    void hand_off(bool wait);
+
+    /// The queue is in-order, so each read finishes before the next kernel
+    /// overwrites the output buffer.
+    std::deque<pending_snapshot> pending_;
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "waveguide/tap_program.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+/// Records the pressure at a set of nodes on every step, for use with
+/// run_batched.
+/// Pressures are gathered into a ring buffer on the device with a single
+/// kernel call per step, and read back in one go at the end of each batch.
+class taps final {
+public:
+    /// capacity:   length of the ring buffer in steps, which must be at least
+    ///             the batch size
+    taps(const core::compute_context& cc,
+         util::aligned::vector<cl_uint> nodes,
+         size_t capacity);
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step);
+
+    void finish(cl::CommandQueue& queue, size_t first_step, size_t steps);
+
+    size_t get_num_taps() const;
+    size_t get_num_steps() const;
+
+    /// Recorded pressures, ordered by step and then by tap.
+    const util::aligned::vector<cl_float>& get_output() const;
+
+    /// Saves the pressures read back so far.
+    /// The ring buffer is empty between batches, so it isn't saved.
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(output_);
+    }
+
+private:
+    static util::aligned::vector<cl_uint> check_nodes(
+            util::aligned::vector<cl_uint> nodes);
+
+    using kernel_t = decltype(std::declval<tap_program>().get_gather_kernel());
+
+    util::aligned::vector<cl_uint> nodes_;
+    size_t capacity_;
+
+    cl::Buffer node_buffer_;
+    cl::Buffer ring_buffer_;
+    kernel_t kernel_;
+
+    util::aligned::vector<cl_float> output_;
+};
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "waveguide/source_program.h"
+
+#include "utilities/aligned/vector.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace preprocessor {
+
+/// How a source's signal is applied to its node.
+enum class injection {
+    /// The node's pressure is replaced with the signal.
+    hard,
+    /// The signal is added to the node's pressure.
+    soft,
+};
+
+struct source_signal final {
+    /// The storage index of the node (see compute_storage_index).
+    size_t node;
+    util::aligned::vector<float> signal;
+    injection type;
+};
+
+/// Drives the mesh from any number of sources at once.
+///
+/// Every signal is uploaded once, and a small kernel applies them on the
+/// device before each step, so unlike hard_source and soft_source, the host
+/// never waits for the device.
+/// Sources are applied in order, so several may share a node.
+/// Each source stops once its signal runs out, and the simulation stops once
+/// every source has run out.
+/// Works with both run and run_batched.
+class device_sources final {
+public:
+    /// bands:  the number of bands stored at each node (see stepper).
+    ///         The same input is applied to every band.
+    device_sources(const core::compute_context& cc,
+                   const util::aligned::vector<source_signal>& sources,
+                   size_t bands = 1);
+
+    bool operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t step);
+
+    /// For run_batched. Signals are already on the device, so this never
+    /// blocks.
+    ///
+    /// returns:    the number of steps left in the longest signal, up to
+    ///             max_steps
+    size_t prepare(cl::CommandQueue& queue,
+                   size_t first_step,
+                   size_t max_steps) const;
+
+    /// The length of the longest signal.
+    size_t get_num_steps() const;
+
+    /// Only depends on the step number, so there is nothing to save.
+    template <typename Archive>
+    void serialize(Archive&) {}
+
+private:
+    using kernel_t = decltype(
+            std::declval<source_program>().get_inject_sources_kernel());
+
+    size_t sources_;
+    size_t steps_;
+    size_t bands_;
+
+    cl::Buffer nodes_;
+    cl::Buffer soft_;
+    cl::Buffer lengths_;
+    cl::Buffer signals_;
+    kernel_t kernel_;
+};
+
+}  // namespace preprocessor
+}  // namespace waveguide
+}  // namespace wayverb
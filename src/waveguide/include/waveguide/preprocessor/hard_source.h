@@ -2,35 +2,135 @@
 
 #include "core/cl/common.h"
 
+#include <algorithm>
+#include <iterator>
+
 namespace wayverb {
 namespace waveguide {
 namespace preprocessor {
 
+/// bands:  the number of bands stored at each node (see stepper).
+///         The same input is written to every band.
 template <typename It>
 class hard_source final {
 public:
-    hard_source(size_t node, It begin, It end)
+    hard_source(size_t node, It begin, It end, size_t bands = 1)
             : node_{node}
             , begin_{begin}
-            , end_{end} {}
+            , end_{end}
+            , values_(bands) {}
 
     bool operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t) {
         if (begin_ == end_) {
             return false;
         }
-        core::write_value(queue, buffer, node_, *begin_++);
+        std::fill(values_.begin(), values_.end(), *begin_++);
+        ++consumed_;
+        queue.enqueueWriteBuffer(buffer,
+                                 CL_TRUE,
+                                 sizeof(cl_float) * node_ * values_.size(),
+                                 sizeof(cl_float) * values_.size(),
+                                 values_.data());
         return true;
     }
 
+    /// Only the position in the input is saved, so the source must be
+    /// restored into one constructed with the same input.
+    template <typename Archive>
+    void save(Archive& archive) const {
+        archive(consumed_);
+    }
+
+    template <typename Archive>
+    void load(Archive& archive) {
+        size_t consumed;
+        archive(consumed);
+        if (consumed < consumed_ ||
+            std::distance(begin_, end_) <
+                    static_cast<std::ptrdiff_t>(consumed - consumed_)) {
+            throw std::runtime_error{"Saved source position is out of range."};
+        }
+        std::advance(begin_, consumed - consumed_);
+        consumed_ = consumed;
+    }
+
+private:
+    size_t node_;
+    It begin_;
+    It end_;
+    util::aligned::vector<cl_float> values_;
+    size_t consumed_{0};
+};
+
+template <typename It>
+auto make_hard_source(size_t node, It begin, It end, size_t bands = 1) {
+    return hard_source<It>{node, begin, end, bands};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// A hard source for use with run_batched.
+/// Each batch of the input signal is uploaded in one go, and then copied into
+/// the mesh on the device before each step.
+template <typename It>
+class batched_hard_source final {
+public:
+    batched_hard_source(size_t node, It begin, It end)
+            : node_{node}
+            , begin_{begin}
+            , end_{end} {}
+
+    size_t prepare(cl::CommandQueue& queue,
+                   size_t first_step,
+                   size_t max_steps) {
+        util::aligned::vector<cl_float> batch;
+        for (; begin_ != end_ && batch.size() != max_steps; ++begin_) {
+            batch.emplace_back(*begin_);
+        }
+
+        if (batch.empty()) {
+            return 0;
+        }
+
+        if (capacity_ < batch.size()) {
+            capacity_ = max_steps;
+            signal_ = cl::Buffer{queue.getInfo<CL_QUEUE_CONTEXT>(),
+                                 CL_MEM_READ_ONLY,
+                                 sizeof(cl_float) * capacity_};
+        }
+
+        //  The queue is in-order, so this won't overwrite values which are
+        //  still waiting to be copied from the previous batch.
+        queue.enqueueWriteBuffer(signal_,
+                                 CL_TRUE,
+                                 0,
+                                 sizeof(cl_float) * batch.size(),
+                                 batch.data());
+        first_step_ = first_step;
+        return batch.size();
+    }
+
+    void operator()(cl::CommandQueue& queue, cl::Buffer& buffer, size_t step) {
+        queue.enqueueCopyBuffer(signal_,
+                                buffer,
+                                sizeof(cl_float) * (step - first_step_),
+                                sizeof(cl_float) * node_,
+                                sizeof(cl_float));
+    }
+
 private:
     size_t node_;
     It begin_;
     It end_;
+
+    cl::Buffer signal_;
+    size_t capacity_{0};
+    size_t first_step_{0};
 };
 
 template <typename It>
-auto make_hard_source(size_t node, It begin, It end) {
-    return hard_source<It>{node, begin, end};
+auto make_batched_hard_source(size_t node, It begin, It end) {
+    return batched_hard_source<It>{node, begin, end};
 }
 
 }  // namespace preprocessor
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core/cl/include.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// The pressures passed to canonical's pressure callback.
+///
+/// Callbacks expect one pressure per node. When several bands are simulated
+/// at once (see stepper), the first band has to be copied out of the packed
+/// pressures, so the copy is only made if the callback asks for it. Callbacks
+/// which just report progress never pay for it.
+class pressure_view final {
+public:
+    /// Pressures with one band, which can be used as they are.
+    explicit pressure_view(const cl::Buffer& pressures);
+
+    /// Pressures with several bands per node.
+    ///
+    /// first_band:    somewhere to copy the first band to, with room for one
+    ///                float per node
+    pressure_view(cl::CommandQueue& queue,
+                  const cl::Buffer& pressures,
+                  size_t nodes,
+                  size_t bands,
+                  const cl::Buffer& first_band);
+
+    /// The pressure at every node in the first band.
+    /// If the pressures are packed, this enqueues a copy on first use.
+    const cl::Buffer& get() const;
+
+private:
+    cl::CommandQueue* queue_{nullptr};
+    const cl::Buffer* pressures_;
+    size_t nodes_{0};
+    size_t bands_{1};
+    const cl::Buffer* first_band_{nullptr};
+    mutable bool is_copied_{false};
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
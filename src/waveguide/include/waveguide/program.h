@@ -1,6 +1,7 @@
 #pragma once
 
 #include "waveguide/cl/structs.h"
+#include "waveguide/stencil.h"
 
 #include "core/cl/common.h"
 #include "core/program_wrapper.h"
@@ -18,22 +19,84 @@ namespace waveguide {
 
 class program final {
 public:
-    program(const core::compute_context& cc);
+    /// bands:  the number of bands to update at once.
+    ///         Pressures are stored node-major, band-minor, and boundary
+    ///         coefficients surface-major, band-minor.
+    ///
+    /// Boundary filter state is stored as a structure of arrays, separately
+    /// for nodes touching 1, 2 and 3 boundaries, so that neighbouring
+    /// work-items read and write neighbouring memory.
+    /// For a group of `nodes` boundary nodes touching `d` boundaries:
+    ///  - filter_memory holds `memory_canonical::order * lanes` filt_reals,
+    ///    where `lanes = d * bands * nodes`. Tap `t` of dimension `i`, band
+    ///    `b` of boundary node `n` is at
+    ///    `t * lanes + (i * bands + b) * nodes + n`.
+    ///  - coefficient_indices holds `d * nodes` uints, with the coefficient
+    ///    index of dimension `i` of boundary node `n` at `i * nodes + n`.
+    /// Use get_coefficient_index_table to build the coefficient indices.
+    ///
+    /// s:      the update scheme. All kernels except the filter tests use it.
+    explicit program(const core::compute_context& cc,
+                     size_t bands = 1,
+                     stencil s = stencil::rectilinear);
 
+    /// Updates any kind of node, but branches on the node type.
     auto get_kernel() const {
         return program_wrapper_
                 .get_kernel<cl::Buffer,  /// previous
                             cl::Buffer,  /// current
                             cl::Buffer,  /// nodes
+                            cl::Buffer,  /// indices
                             cl_int3,     /// dimensions
-                            cl::Buffer,  /// boundary_data_1
-                            cl::Buffer,  /// boundary_data_2
-                            cl::Buffer,  /// boundary_data_3
+                            cl::Buffer,  /// bricks
+                            cl::Buffer,  /// filter_memory_1
+                            cl::Buffer,  /// coefficient_indices_1
+                            cl_uint,     /// boundary_nodes_1
+                            cl::Buffer,  /// filter_memory_2
+                            cl::Buffer,  /// coefficient_indices_2
+                            cl_uint,     /// boundary_nodes_2
+                            cl::Buffer,  /// filter_memory_3
+                            cl::Buffer,  /// coefficient_indices_3
+                            cl_uint,     /// boundary_nodes_3
                             cl::Buffer,  /// boundary_coefficients
                             cl::Buffer   /// error_flag
                             >("condensed_waveguide");
     }
 
+    /// Updates interior nodes only.
+    /// Takes a list of node_runs, and needs node_run::max_length work-items
+    /// per run.
+    auto get_interior_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// runs
+                            cl_int3,     /// dimensions
+                            cl::Buffer,  /// bricks
+                            cl::Buffer   /// error_flag
+                            >("condensed_waveguide_interior");
+    }
+
+    /// Updates boundary nodes which touch `dimensions` boundaries.
+    template <size_t dimensions>
+    auto get_boundary_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer,  /// previous
+                            cl::Buffer,  /// current
+                            cl::Buffer,  /// nodes
+                            cl::Buffer,  /// indices
+                            cl_int3,     /// dimensions
+                            cl::Buffer,  /// bricks
+                            cl::Buffer,  /// filter_memory
+                            cl::Buffer,  /// coefficient_indices
+                            cl_uint,     /// boundary_nodes
+                            cl::Buffer,  /// boundary_coefficients
+                            cl::Buffer   /// error_flag
+                            >(util::build_string("condensed_waveguide_boundary_",
+                                                 dimensions)
+                                      .c_str());
+    }
+
     auto get_zero_buffer_kernel() const {
         return program_wrapper_.get_kernel<cl::Buffer>("zero_buffer");
     }
@@ -50,6 +113,14 @@ public:
                         "filter_test_2");
     }
 
+    /// As filter_test_2, but with the filter memory stored tap-major, as
+    /// for the boundary filters.
+    auto get_filter_test_strided_kernel() const {
+        return program_wrapper_
+                .get_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(
+                        "filter_test_strided");
+    }
+
     template <cl_program_info T>
     auto get_info() const {
         return program_wrapper_.template get_info<T>();
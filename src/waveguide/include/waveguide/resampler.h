@@ -0,0 +1,100 @@
+#pragma once
+
+#include "utilities/aligned/vector.h"
+
+#include <cstddef>
+
+namespace wayverb {
+namespace waveguide {
+
+enum class resampler_quality {
+    /// Short filters with a wide transition band.
+    fast,
+    medium,
+    /// Long filters with a narrow transition band and high stopband
+    /// attenuation.
+    best,
+};
+
+/// The ratio `output / input` of two sampling rates, as a fraction.
+struct resampling_ratio final {
+    size_t up;
+    size_t down;
+};
+
+/// Finds the closest fraction to `out_sr / in_sr` whose numerator is no
+/// greater than `max_up`.
+/// Waveguide sampling rates are rarely whole numbers, but usually have
+/// simple ratios to audio rates, which this finds exactly.
+resampling_ratio compute_resampling_ratio(double in_sr,
+                                          double out_sr,
+                                          size_t max_up = 4096);
+
+/// A rational-ratio polyphase resampler.
+///
+/// The signal is notionally upsampled by `up`, low-pass filtered with a
+/// Kaiser-windowed sinc, and downsampled by `down`. Each output sample is
+/// computed directly from one phase of the filter, stored as a contiguous
+/// table so that the inner loop is a plain dot product which the compiler
+/// can vectorise.
+///
+/// The output is aligned with the input (the filter delay is compensated),
+/// and has unit gain in the passband.
+///
+/// Input may be pushed in blocks of any size, so that long signals never
+/// need to be held in memory all at once.
+class resampler final {
+public:
+    resampler(double in_sr,
+              double out_sr,
+              resampler_quality quality = resampler_quality::best);
+
+    /// Consumes a block of input, appending all output samples which can
+    /// now be computed to `output`.
+    void push(const float* begin,
+              const float* end,
+              util::aligned::vector<float>& output);
+
+    /// Appends the remaining output, treating the input as zero after the
+    /// end, until the output covers all the input pushed so far.
+    /// Resets the resampler, ready for a new signal.
+    void flush(util::aligned::vector<float>& output);
+
+    resampling_ratio get_ratio() const;
+
+private:
+    /// The first sample of `history_` used by an output sample.
+    /// History starts with `taps_ - 1` zeros, so that the first output
+    /// samples can read 'before' the start of the input.
+    size_t first_input(size_t output_index) const;
+
+    /// Computes output samples while there is enough input for them.
+    void compute_available(util::aligned::vector<float>& output);
+
+    resampling_ratio ratio_;
+    size_t taps_;
+    size_t centre_;
+
+    /// `up` phases, each of `taps_` coefficients, in the order in which they
+    /// multiply the input.
+    util::aligned::vector<float> table_;
+
+    /// Input samples still needed, starting at `history_begin_`.
+    util::aligned::vector<float> history_;
+    size_t history_begin_{0};
+    size_t history_end_{0};
+
+    size_t input_size_{0};
+    size_t output_index_{0};
+};
+
+/// Resamples a whole signal in one go.
+util::aligned::vector<float> resample(
+        const float* data,
+        size_t size,
+        double in_sr,
+        double out_sr,
+        resampler_quality quality = resampler_quality::best);
+
+}  // namespace waveguide
+}  // namespace wayverb
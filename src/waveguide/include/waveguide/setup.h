@@ -1,6 +1,7 @@
 #pragma once
 
 #include "waveguide/boundary_coefficient_finder.h"
+#include "waveguide/brick_map.h"
 #include "waveguide/cl/utils.h"
 #include "waveguide/mesh_descriptor.h"
 #include "waveguide/program.h"
@@ -15,6 +16,8 @@
 
 #include "glm/fwd.hpp"
 
+#include <experimental/optional>
+
 namespace wayverb {
 namespace waveguide {
 
@@ -24,17 +27,59 @@ constexpr bool is_inside(const condensed_node& c) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Node indices, grouped by the kind of update each node needs, so that each
+/// group can be run by its own specialised kernel or loop.
+/// Indices are storage indices, so for compacted meshes they follow the brick
+/// layout, and each list is in storage order.
+struct node_index_data final {
+    /// Inside or reentrant nodes which are not on the edge of the mesh.
+    /// These use the plain rectilinear update, and all six neighbours are
+    /// guaranteed to exist.
+    /// They make up most of a typical mesh and usually lie in long rows, so
+    /// they are stored as runs rather than one index per node.
+    util::aligned::vector<node_run> interior;
+
+    /// Boundary nodes, grouped by the number of boundaries they touch.
+    util::aligned::vector<cl_uint> boundary_1;
+    util::aligned::vector<cl_uint> boundary_2;
+    util::aligned::vector<cl_uint> boundary_3;
+
+    /// Inside nodes on the edge of the mesh, which need the general (branchy)
+    /// update.
+    /// Outside nodes aren't listed anywhere. Their pressure starts at zero
+    /// and must stay there, so they never need updating.
+    util::aligned::vector<cl_uint> other;
+};
+
+/// bricks:     the layout of `nodes`, if they are in compacted storage
+node_index_data compute_node_index_data(
+        const mesh_descriptor& descriptor,
+        const util::aligned::vector<condensed_node>& nodes,
+        const std::experimental::optional<brick_map>& bricks =
+                std::experimental::nullopt);
+
+////////////////////////////////////////////////////////////////////////////////
+
 class vectors final {
 public:
     vectors(util::aligned::vector<condensed_node> nodes,
             util::aligned::vector<coefficients_canonical> coefficients,
-            boundary_index_data boundary_index_data);
+            boundary_index_data boundary_index_data,
+            node_index_data node_index_data,
+            std::experimental::optional<brick_map> bricks =
+                    std::experimental::nullopt);
 
     template <size_t n>
     const util::aligned::vector<boundary_index_array<n>>& get_boundary_indices()
             const;
 
     const util::aligned::vector<condensed_node>& get_condensed_nodes() const;
+    const node_index_data& get_node_indices() const;
+
+    /// If the nodes are stored in compacted form, returns the layout of the
+    /// stored nodes. Otherwise, nodes are stored in a dense grid, and node
+    /// indices can be used directly.
+    const std::experimental::optional<brick_map>& get_brick_map() const;
     const util::aligned::vector<coefficients_canonical>& get_coefficients()
             const;
 
@@ -45,6 +90,8 @@ private:
     util::aligned::vector<condensed_node> condensed_nodes_;
     util::aligned::vector<coefficients_canonical> coefficients_;
     boundary_index_data boundary_index_data_;
+    node_index_data node_index_data_;
+    std::experimental::optional<brick_map> brick_map_;
 };
 
 template <>
@@ -84,5 +131,22 @@ inline util::aligned::vector<boundary_data_array<n>> get_boundary_data(
     });
 }
 
+/// The coefficient indices of the boundary nodes touching `n` boundaries,
+/// dimension-major, as used by the OpenCL boundary kernels.
+/// The index for dimension `i` of boundary node `node` is at
+/// `i * nodes + node`.
+template <size_t n>
+inline util::aligned::vector<cl_uint> get_coefficient_index_table(
+        const vectors& d) {
+    const auto& indices = d.get_boundary_indices<n>();
+    util::aligned::vector<cl_uint> ret(indices.size() * n);
+    for (auto node = 0u; node != indices.size(); ++node) {
+        for (auto i = 0u; i != n; ++i) {
+            ret[i * indices.size() + node] = indices[node].array[i];
+        }
+    }
+    return ret;
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
@@ -32,8 +32,9 @@ constexpr bool operator!=(const single_band_parameters& a,
 struct multiple_band_constant_spacing_parameters final {
     /// The number of bands which should be simulated with the waveguide.
     /// Be careful with high numbers.
-    /// The waveguide will be run once, at the required sampling rate, for each
-    /// band, so i.e. 4 bands will take 4 times as long.
+    /// All bands are updated together in one pass over the mesh, but each
+    /// node still has to be updated once per band, and the pressure and
+    /// filter state grow with the number of bands.
     size_t bands;
 
     /// The cutoff to use for all bands.
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "core/program_wrapper.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Kernels for copying a box of pressures out of the mesh, for visualisation.
+/// Nodes are numbered as for compute_index, and the output is ordered the
+/// same way within the box.
+/// For compacted meshes, pass the table from compute_brick_table as `bricks`.
+/// Otherwise, pass a null buffer.
+class snapshot_program final {
+public:
+    snapshot_program(const core::compute_context& cc);
+
+    auto get_snapshot_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl_int3,     /// dimensions
+                                   cl::Buffer,  /// bricks
+                                   cl_int3,     /// origin
+                                   cl_int3,     /// extent
+                                   cl::Buffer   /// output
+                                   >("snapshot");
+    }
+
+    /// Pressures in [-range, range] are mapped to [0, 255], and saturate
+    /// outside it.
+    auto get_quantised_snapshot_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl_int3,     /// dimensions
+                                   cl::Buffer,  /// bricks
+                                   cl_int3,     /// origin
+                                   cl_int3,     /// extent
+                                   cl_float,    /// range
+                                   cl::Buffer   /// output
+                                   >("quantised_snapshot");
+    }
+
+private:
+    core::program_wrapper wrapper_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
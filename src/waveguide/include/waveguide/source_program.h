@@ -0,0 +1,33 @@
+#pragma once
+
+#include "core/program_wrapper.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Kernels for adding inputs to the mesh on the device.
+class source_program final {
+public:
+    source_program(const core::compute_context& cc);
+
+    /// Applies one step of every source, in order, so several sources may
+    /// share a node.
+    /// Run with one work-item per band.
+    auto get_inject_sources_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl::Buffer,  /// nodes
+                                   cl::Buffer,  /// soft
+                                   cl::Buffer,  /// lengths
+                                   cl::Buffer,  /// signals
+                                   cl_uint,     /// sources
+                                   cl_uint,     /// signal_stride
+                                   cl_uint      /// step
+                                   >("inject_sources");
+    }
+
+private:
+    core::program_wrapper wrapper_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
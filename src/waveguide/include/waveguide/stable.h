@@ -1,8 +1,11 @@
 #pragma once
 
+#include "waveguide/cl/filter_structs.h"
+
 #include "utilities/tuple_like.h"
 
 #include <cmath>
+#include <stdexcept>
 
 namespace wayverb {
 namespace waveguide {
@@ -49,5 +52,43 @@ constexpr auto is_stable(T&& a) {
     return is_stable(detail::make_next_array(std::forward<T>(a), rci));
 }
 
+/// Checks the denominator of a boundary filter, as it will be run (i.e. at
+/// the precision of filt_real).
+template <size_t order>
+bool is_stable_filter(const coefficients<order>& c) {
+    if (c.a[0] == 0) {
+        return false;
+    }
+    std::array<double, order + 1> a;
+    for (auto i = 0u; i != a.size(); ++i) {
+        a[i] = c.a[i] / static_cast<double>(c.a[0]);
+    }
+    return is_stable(a);
+}
+
+/// Filters with poles close to the unit circle may become unstable once
+/// their coefficients are rounded to filt_real.
+/// If so, the poles are pulled towards the origin (by scaling a[k] by r^k)
+/// a little at a time, until the rounded filter is stable.
+/// Throws if the poles have to move too far.
+template <size_t order>
+coefficients<order> make_stable(const coefficients<order>& c) {
+    constexpr auto attempts = 200;
+    constexpr auto radius_step = 0.0005;
+    for (auto i = 0; i != attempts; ++i) {
+        const auto radius = 1 - i * radius_step;
+        auto ret = c;
+        auto scale = 1.0;
+        for (auto& a : ret.a) {
+            a = static_cast<filt_real>(a * scale);
+            scale *= radius;
+        }
+        if (is_stable_filter(ret)) {
+            return ret;
+        }
+    }
+    throw std::runtime_error{"Unable to generate stable boundary filter."};
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
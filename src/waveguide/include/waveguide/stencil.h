@@ -0,0 +1,67 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+namespace wayverb {
+namespace waveguide {
+
+/// The finite-difference scheme used to update the mesh.
+///
+/// Every scheme runs on the same cubic grid, and belongs to the family of
+/// compact explicit schemes described by Kowalczyk and van Walstijn in
+/// "Room Acoustics Simulation Using 3-D Compact Explicit FDTD Schemes"
+/// (2011). They differ in how much each of the 26 surrounding nodes
+/// contributes to an update, and so in their dispersion and in the largest
+/// stable Courant number.
+enum class stencil {
+    /// Standard rectilinear: six axial neighbours, Courant number 1/sqrt(3).
+    /// Dispersion is strongest along the axes, so only a small part of the
+    /// simulated bandwidth is usable.
+    rectilinear,
+
+    /// Interpolated wideband: all 26 neighbours, Courant number 1.
+    /// Dispersion is much more even, so the mesh can run at a far lower
+    /// sampling rate (and so with far fewer nodes and steps) for the same
+    /// valid bandwidth.
+    interpolated_wideband,
+};
+
+/// The weights of a compact explicit update, which computes
+///
+///     next = axial * (sum of the 6 axial neighbours) +
+///            side_diagonal * (sum of the 12 side-diagonal neighbours) +
+///            diagonal * (sum of the 8 diagonal neighbours) +
+///            centre * current - previous
+struct stencil_coefficients final {
+    double courant;
+    double axial;
+    double side_diagonal;
+    double diagonal;
+    double centre;
+};
+
+stencil_coefficients get_coefficients(stencil s);
+
+/// The ratio of the simulated phase velocity to the speed of sound, for a
+/// plane wave travelling in `direction`.
+///
+/// normalised_frequency:   the frequency of the wave, divided by the mesh
+///                         sampling rate
+///
+/// returns:                1 for a dispersionless wave, or NaN if the wave
+///                         can't propagate in this direction
+double compute_relative_phase_velocity(stencil s,
+                                       double normalised_frequency,
+                                       const glm::dvec3& direction);
+
+/// The largest absolute dispersion error (|1 - relative phase velocity|) in
+/// any direction, found by sampling directions across one octant (the other
+/// octants are symmetrical).
+double compute_dispersion_error(stencil s, double normalised_frequency);
+
+/// The highest normalised frequency below which the dispersion error in
+/// every direction stays under `max_error`.
+double compute_valid_bandwidth(stencil s, double max_error);
+
+}  // namespace waveguide
+}  // namespace wayverb
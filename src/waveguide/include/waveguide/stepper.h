@@ -0,0 +1,132 @@
+#pragma once
+
+#include "waveguide/cl/structs.h"
+#include "waveguide/mesh_descriptor.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/aligned/vector.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+
+namespace wayverb {
+namespace waveguide {
+
+class mesh;
+
+namespace native {
+struct out_of_core_parameters;
+}  // namespace native
+
+/// Owns the device-side state of a single waveguide simulation (pressure
+/// buffers, boundary filter state, error flag) and enqueues mesh updates on
+/// the chosen compute backend.
+///
+/// The mesh is updated with the stencil it was built for.
+///
+/// Updates are enqueued without blocking, so that several can be queued
+/// back-to-back. The only blocking calls are reset_error_flag,
+/// read_error_flag, and the update itself when running on the native backend.
+class stepper final {
+public:
+    stepper(const core::compute_context& cc, const mesh& mesh);
+
+    /// Simulates several bands at once, each with its own boundary
+    /// coefficients, sharing the node classification and neighbour lookups.
+    /// Pressures are stored node-major, band-minor, so the pressure of band
+    /// `b` at storage index `i` is at element `i * bands + b`.
+    /// Only supported by the OpenCL backend.
+    ///
+    /// band_coefficients:  for each band, one set of coefficients per
+    ///                     surface, as passed to mesh::set_coefficients
+    stepper(const core::compute_context& cc,
+            const mesh& mesh,
+            const util::aligned::vector<
+                    util::aligned::vector<coefficients_canonical>>&
+                    band_coefficients);
+
+    /// Keeps the pressures in memory-mapped files (see native::pressure_files)
+    /// rather than in RAM, and streams through them once per update.
+    /// The mesh and the engine's node and boundary structures must still
+    /// fit in memory; only the pressures are moved out.
+    /// Updates run one step at a time, so `out_of_core.block_size` is unused.
+    /// Only supported by the native backend, on a CPU device. Pre- and
+    /// post-processors see the files through host-pointer buffers, which
+    /// other devices would copy whole on every step.
+    stepper(const core::compute_context& cc,
+            const mesh& mesh,
+            const native::out_of_core_parameters& out_of_core);
+
+    stepper(const stepper&) = delete;
+    stepper& operator=(const stepper&) = delete;
+    stepper(stepper&&) noexcept = delete;
+    stepper& operator=(stepper&&) noexcept = delete;
+
+    ~stepper() noexcept;
+
+    cl::CommandQueue& get_queue();
+
+    /// The number of bands stored at each node.
+    size_t get_bands() const;
+
+    /// The backend which runs the update.
+    /// Saved states can only be restored on the same backend.
+    core::compute_backend get_backend() const;
+
+    const mesh_descriptor& get_descriptor() const;
+
+    /// A fingerprint of the node types, boundary surfaces and boundary
+    /// coefficients.
+    /// Saved states can only be restored into a stepper with the same
+    /// boundaries.
+    std::uint64_t get_boundary_hash() const;
+
+    /// The pressures at the current step.
+    cl::Buffer& get_current();
+
+    /// The pressures at the previous step.
+    /// After enqueue_update, this holds the pressures at the next step.
+    cl::Buffer& get_previous();
+
+    /// Computes the next pressure at every node, overwriting `previous`.
+    void enqueue_update();
+
+    /// Swaps `previous` and `current`, ready for the next step.
+    void swap();
+
+    /// Clears the error flag.
+    /// On the OpenCL backend this is a blocking write, so it waits for every
+    /// update queued before it to finish.
+    void reset_error_flag();
+
+    /// Blocks until all queued updates have finished.
+    ///
+    /// returns:    a combination of the error_code flags raised by every
+    ///             update since the flag was last reset
+    error_code read_error_flag();
+
+    /// The size in bytes written by write_state.
+    size_t get_state_size() const;
+
+    /// Writes out the pressures at the previous and current steps, followed
+    /// by the boundary filter state.
+    /// Buffers are copied in small chunks, so the whole state is never held
+    /// in host memory at once.
+    /// Blocks until all queued updates have finished.
+    void write_state(std::ostream& os);
+
+    /// Replaces the simulation state with one saved by write_state, from a
+    /// stepper with the same mesh and number of bands.
+    void read_state(std::istream& is);
+
+private:
+    class impl;
+    class opencl_impl;
+    class native_impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "core/program_wrapper.h"
+
+namespace wayverb {
+namespace waveguide {
+
+/// Kernels for gathering pressures from the mesh while it runs, and for
+/// writing them back.
+class tap_program final {
+public:
+    tap_program(const core::compute_context& cc);
+
+    auto get_gather_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl::Buffer,  /// nodes
+                                   cl::Buffer,  /// output
+                                   cl_uint      /// output_offset
+                                   >("gather_taps");
+    }
+
+    auto get_scatter_kernel() const {
+        return wrapper_.get_kernel<cl::Buffer,  /// pressures
+                                   cl::Buffer,  /// nodes
+                                   cl::Buffer,  /// input
+                                   cl_uint      /// input_offset
+                                   >("scatter_taps");
+    }
+
+private:
+    core::program_wrapper wrapper_;
+};
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -1,22 +1,61 @@
 #pragma once
 
+#include "waveguide/checkpoint.h"
 #include "waveguide/mesh.h"
+#include "waveguide/stepper.h"
 
 #include "core/cl/include.h"
 #include "core/conversions.h"
 #include "core/exceptions.h"
 
+#include "utilities/string_builder.h"
+
+#include "cereal/archives/binary.hpp"
+#include "cereal/types/vector.hpp"
+
 #include <atomic>
 #include <cassert>
+#include <cstdio>
 #include <functional>
 #include <iostream>
 
 namespace wayverb {
 namespace waveguide {
 
+namespace detail {
+
+/// where:          appended to exception messages, to say when the error
+///                 happened
+inline void throw_if_error(error_code error_flag,
+                           const std::string& where = "") {
+    if (error_flag & id_inf_error) {
+        throw core::exceptions::value_is_inf(
+                "Pressure value is inf" + where +
+                ", check filter coefficients.");
+    }
+
+    if (error_flag & id_nan_error) {
+        throw core::exceptions::value_is_nan(
+                "Pressure value is nan" + where +
+                ", check filter coefficients.");
+    }
+
+    if (error_flag & id_outside_mesh_error) {
+        throw std::runtime_error("Tried to read non-existant node" + where +
+                                 ".");
+    }
+
+    if (error_flag & id_suspicious_boundary_error) {
+        throw std::runtime_error("Suspicious boundary read" + where + ".");
+    }
+}
+
+}  // namespace detail
+
 /// Will set up and run a waveguide using an existing 'template' (the mesh).
 ///
-/// cc:             OpenCL context and device to use
+/// cc:             OpenCL context and device to use, and the backend which
+///                 should run the mesh update
 /// mesh:           contains node placements and surface filter information
 /// pre:            will be run before each step, should inject inputs
 /// post:           will be run after each step, should collect outputs
@@ -32,6 +71,41 @@ namespace waveguide {
 /// step_postprocessor
 /// Run after each waveguide iteration.
 /// Could be a stateful object which accumulates mesh state in some way.
+///
+/// The overload taking a stepper runs an existing simulation, e.g. one which
+/// updates several bands at once. Pre- and post-processors must then use the
+/// stepper's packed pressure layout.
+
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run(stepper& stepper,
+           step_preprocessor&& pre,
+           step_postprocessor&& post,
+           const std::atomic_bool& keep_going) {
+    auto& queue = stepper.get_queue();
+
+    //  run
+    auto step = 0u;
+
+    //  The preprocessor returns 'true' while it should be run.
+    //  It also updates the mesh with new pressure values.
+    for (; pre(queue, stepper.get_current(), step) && keep_going; ++step) {
+        //  set flag state to successful
+        stepper.reset_error_flag();
+
+        //  run kernels
+        stepper.enqueue_update();
+
+        //  read out flag value
+        detail::throw_if_error(stepper.read_error_flag());
+
+        post(queue, stepper.get_current(), step);
+
+        stepper.swap();
+    }
+
+    queue.finish();
+    return step;
+}
 
 template <typename step_preprocessor, typename step_postprocessor>
 size_t run(const core::compute_context& cc,
@@ -39,91 +113,321 @@ size_t run(const core::compute_context& cc,
            step_preprocessor&& pre,
            step_postprocessor&& post,
            const std::atomic_bool& keep_going) {
+    stepper stepper{cc, mesh};
+    return run(stepper,
+               std::forward<step_preprocessor>(pre),
+               std::forward<step_postprocessor>(post),
+               keep_going);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Like run, but saves the simulation to disk every `checkpoint.interval`
+/// steps, and when it is cancelled through keep_going, so that it can be
+/// resumed later.
+///
+/// If a snapshot already exists at `checkpoint.path`, the simulation resumes
+/// from it, and the pre- and post-processors are restored to their saved
+/// state. The snapshot is removed once the simulation finishes.
+///
+/// The pre- and post-processors must be serializable with cereal, and must be
+/// constructed exactly as they were for the original run.
+///
+/// returns:        the total number of steps completed, including any run
+///                 before resuming
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run(stepper& stepper,
+           step_preprocessor&& pre,
+           step_postprocessor&& post,
+           const checkpoint_parameters& checkpoint,
+           const std::atomic_bool& keep_going) {
+    if (!checkpoint.interval) {
+        throw std::runtime_error{
+                "Checkpoint interval must be greater than zero."};
+    }
+
+    auto& queue = stepper.get_queue();
 
-    const auto num_nodes = mesh.get_structure().get_condensed_nodes().size();
+    auto step = read_checkpoint(checkpoint.path,
+                                stepper,
+                                [&](std::istream& is) {
+                                    cereal::BinaryInputArchive archive{is};
+                                    archive(pre, post);
+                                })
+                        .value_or(0);
 
-    const program program{cc};
-    cl::CommandQueue queue{cc.context, cc.device};
-    const auto make_zeroed_buffer = [&] {
-        auto ret = cl::Buffer{
-                cc.context, CL_MEM_READ_WRITE, sizeof(cl_float) * num_nodes};
-        auto kernel = program.get_zero_buffer_kernel();
-        kernel(cl::EnqueueArgs{queue, cl::NDRange{num_nodes}}, ret);
-        return ret;
+    auto saved_step = step;
+    const auto save = [&] {
+        if (step != saved_step) {
+            write_checkpoint(checkpoint.path,
+                             step,
+                             stepper,
+                             [&](std::ostream& os) {
+                                 cereal::BinaryOutputArchive archive{os};
+                                 archive(pre, post);
+                             });
+            saved_step = step;
+        }
     };
 
-    auto previous = make_zeroed_buffer();
-    auto current = make_zeroed_buffer();
+    //  Snapshots are only taken between steps, before the preprocessor has
+    //  touched the mesh.
+    for (;; ++step) {
+        if (!keep_going) {
+            save();
+            queue.finish();
+            return step;
+        }
 
-    const auto node_buffer = core::load_to_buffer(
-            cc.context, mesh.get_structure().get_condensed_nodes(), true);
+        if (step % checkpoint.interval == 0) {
+            save();
+        }
 
-    const auto boundary_coefficients_buffer = core::load_to_buffer(
-            cc.context, mesh.get_structure().get_coefficients(), true);
+        if (!pre(queue, stepper.get_current(), step)) {
+            break;
+        }
 
-    cl::Buffer error_flag_buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+        stepper.reset_error_flag();
+        stepper.enqueue_update();
+        detail::throw_if_error(stepper.read_error_flag());
 
-    auto boundary_buffer_1 = core::load_to_buffer(
-            cc.context, get_boundary_data<1>(mesh.get_structure()), false);
-    auto boundary_buffer_2 = core::load_to_buffer(
-            cc.context, get_boundary_data<2>(mesh.get_structure()), false);
-    auto boundary_buffer_3 = core::load_to_buffer(
-            cc.context, get_boundary_data<3>(mesh.get_structure()), false);
+        post(queue, stepper.get_current(), step);
 
-    auto kernel = program.get_kernel();
+        stepper.swap();
+    }
+
+    queue.finish();
+    std::remove(checkpoint.path.c_str());
+    return step;
+}
+
+template <typename step_preprocessor, typename step_postprocessor>
+size_t run(const core::compute_context& cc,
+           const mesh& mesh,
+           step_preprocessor&& pre,
+           step_postprocessor&& post,
+           const checkpoint_parameters& checkpoint,
+           const std::atomic_bool& keep_going) {
+    stepper stepper{cc, mesh};
+    return run(stepper,
+               std::forward<step_preprocessor>(pre),
+               std::forward<step_postprocessor>(post),
+               checkpoint,
+               keep_going);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Like run, but enqueues up to `batch_size` steps back-to-back, and only
+/// waits for the device once per batch.
+/// Use this when the mesh is small enough that the per-step round-trip to the
+/// host dominates.
+/// Errors are still reported, but only to the nearest batch.
+///
+/// batch_preprocessor
+/// Must have the following members:
+///
+///     size_t prepare(cl::CommandQueue& queue,
+///                    size_t first_step,
+///                    size_t max_steps);
+///
+/// Run before each batch. It may block (e.g. to upload inputs).
+/// Should return the number of steps to run in this batch (no more than
+/// max_steps), or zero to stop.
+///
+///     void operator()(cl::CommandQueue& queue,
+///                     cl::Buffer& current,
+///                     size_t step);
+///
+/// Run before each step in the batch. It must only enqueue non-blocking
+/// commands.
+///
+/// batch_postprocessor
+/// Must have the following members:
+///
+///     void operator()(cl::CommandQueue& queue,
+///                     const cl::Buffer& current,
+///                     size_t step);
+///
+/// Run after each step in the batch. It should only enqueue non-blocking
+/// commands, as anything which waits for the device stalls the batch.
+///
+///     void finish(cl::CommandQueue& queue, size_t first_step, size_t steps);
+///
+/// Run once each batch has completed successfully. It may block (e.g. to
+/// read back outputs for the whole batch).
+///
+/// As with run, the overload taking a stepper runs an existing simulation.
+
+template <typename batch_preprocessor, typename batch_postprocessor>
+size_t run_batched(stepper& stepper,
+                   batch_preprocessor&& pre,
+                   batch_postprocessor&& post,
+                   size_t batch_size,
+                   const std::atomic_bool& keep_going) {
+    if (!batch_size) {
+        throw std::runtime_error{"Batch size must be greater than zero."};
+    }
+
+    auto& queue = stepper.get_queue();
 
-    //  run
     auto step = 0u;
+    while (keep_going) {
+        const auto steps = pre.prepare(queue, step, batch_size);
+        if (!steps) {
+            break;
+        }
 
-    //  The preprocessor returns 'true' while it should be run.
-    //  It also updates the mesh with new pressure values.
-    for (; pre(queue, current, step) && keep_going; ++step) {
-        //  set flag state to successful
-        core::write_value(queue, error_flag_buffer, 0, id_success);
-
-        //  run kernel
-        kernel(cl::EnqueueArgs(queue,
-                               cl::NDRange(mesh.get_structure()
-                                                   .get_condensed_nodes()
-                                                   .size())),
-               previous,
-               current,
-               node_buffer,
-               mesh.get_descriptor().dimensions,
-               boundary_buffer_1,
-               boundary_buffer_2,
-               boundary_buffer_3,
-               boundary_coefficients_buffer,
-               error_flag_buffer);
+        stepper.reset_error_flag();
 
-        //  read out flag value
-        if (const auto error_flag =
-                    core::read_value<error_code>(queue, error_flag_buffer, 0)) {
-            if (error_flag & id_inf_error) {
-                throw core::exceptions::value_is_inf(
-                        "Pressure value is inf, check filter coefficients.");
-            }
-
-            if (error_flag & id_nan_error) {
-                throw core::exceptions::value_is_nan(
-                        "Pressure value is nan, check filter coefficients.");
-            }
-
-            if (error_flag & id_outside_mesh_error) {
-                throw std::runtime_error("Tried to read non-existant node.");
-            }
-
-            if (error_flag & id_suspicious_boundary_error) {
-                throw std::runtime_error("Suspicious boundary read.");
-            }
+        for (auto i = step, e = step + steps; i != e; ++i) {
+            pre(queue, stepper.get_current(), i);
+            stepper.enqueue_update();
+            post(queue, stepper.get_current(), i);
+            stepper.swap();
+        }
+
+        detail::throw_if_error(stepper.read_error_flag(),
+                               util::build_string(" between steps ",
+                                                  step,
+                                                  " and ",
+                                                  step + steps - 1));
+
+        post.finish(queue, step, steps);
+
+        step += steps;
+    }
+
+    queue.finish();
+    return step;
+}
+
+template <typename batch_preprocessor, typename batch_postprocessor>
+size_t run_batched(const core::compute_context& cc,
+                   const mesh& mesh,
+                   batch_preprocessor&& pre,
+                   batch_postprocessor&& post,
+                   size_t batch_size,
+                   const std::atomic_bool& keep_going) {
+    stepper stepper{cc, mesh};
+    return run_batched(stepper,
+                       std::forward<batch_preprocessor>(pre),
+                       std::forward<batch_postprocessor>(post),
+                       batch_size,
+                       keep_going);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Like run_batched, but saves the simulation to disk between batches, and
+/// when it is cancelled through keep_going, so that it can be resumed later
+/// (see the checkpointing overload of run).
+///
+/// Snapshots are only taken once post.finish has collected the outputs of
+/// the last batch, so nothing is left in flight on the device.
+///
+/// The pre- and post-processors must be serializable with cereal, and must be
+/// constructed exactly as they were for the original run.
+///
+/// returns:        the total number of steps completed, including any run
+///                 before resuming
+template <typename batch_preprocessor, typename batch_postprocessor>
+size_t run_batched(stepper& stepper,
+                   batch_preprocessor&& pre,
+                   batch_postprocessor&& post,
+                   size_t batch_size,
+                   const checkpoint_parameters& checkpoint,
+                   const std::atomic_bool& keep_going) {
+    if (!batch_size) {
+        throw std::runtime_error{"Batch size must be greater than zero."};
+    }
+
+    if (!checkpoint.interval) {
+        throw std::runtime_error{
+                "Checkpoint interval must be greater than zero."};
+    }
+
+    auto& queue = stepper.get_queue();
+
+    auto step = read_checkpoint(checkpoint.path,
+                                stepper,
+                                [&](std::istream& is) {
+                                    cereal::BinaryInputArchive archive{is};
+                                    archive(pre, post);
+                                })
+                        .value_or(0);
+
+    auto saved_step = step;
+    const auto save = [&] {
+        if (step != saved_step) {
+            write_checkpoint(checkpoint.path,
+                             step,
+                             stepper,
+                             [&](std::ostream& os) {
+                                 cereal::BinaryOutputArchive archive{os};
+                                 archive(pre, post);
+                             });
+            saved_step = step;
+        }
+    };
+
+    for (;;) {
+        if (!keep_going) {
+            save();
+            queue.finish();
+            return step;
+        }
+
+        if (checkpoint.interval <= step - saved_step) {
+            save();
+        }
+
+        const auto steps = pre.prepare(queue, step, batch_size);
+        if (!steps) {
+            break;
         }
 
-        post(queue, current, step);
+        stepper.reset_error_flag();
 
-        std::swap(previous, current);
+        for (auto i = step, e = step + steps; i != e; ++i) {
+            pre(queue, stepper.get_current(), i);
+            stepper.enqueue_update();
+            post(queue, stepper.get_current(), i);
+            stepper.swap();
+        }
+
+        detail::throw_if_error(stepper.read_error_flag(),
+                               util::build_string(" between steps ",
+                                                  step,
+                                                  " and ",
+                                                  step + steps - 1));
+
+        post.finish(queue, step, steps);
+
+        step += steps;
     }
+
+    queue.finish();
+    std::remove(checkpoint.path.c_str());
     return step;
 }
 
+template <typename batch_preprocessor, typename batch_postprocessor>
+size_t run_batched(const core::compute_context& cc,
+                   const mesh& mesh,
+                   batch_preprocessor&& pre,
+                   batch_postprocessor&& post,
+                   size_t batch_size,
+                   const checkpoint_parameters& checkpoint,
+                   const std::atomic_bool& keep_going) {
+    stepper stepper{cc, mesh};
+    return run_batched(stepper,
+                       std::forward<batch_preprocessor>(pre),
+                       std::forward<batch_postprocessor>(post),
+                       batch_size,
+                       checkpoint,
+                       keep_going);
+}
+
 }  // namespace waveguide
 }  // namespace wayverb
@@ -76,12 +76,9 @@ boundary_index_data compute_boundary_index_data(
                nodes_buffer,
                descriptor,
                index_buffer_1,
-               buffers.get_voxel_index_buffer(),
-               buffers.get_global_aabb(),
-               buffers.get_side(),
+               buffers.get_bvh_nodes_buffer(),
+               buffers.get_bvh_triangle_indices_buffer(),
                buffers.get_triangles_buffer(),
-               buffers.get_triangles_buffer().getInfo<CL_MEM_SIZE>() /
-                       sizeof(core::triangle),
                buffers.get_vertices_buffer());
         const auto out = core::read_from_buffer<boundary_index_array_1>(
                 queue, index_buffer_1);
@@ -0,0 +1,179 @@
+#include "waveguide/brick_map.h"
+
+#include "core/conversions.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace wayverb {
+namespace waveguide {
+
+namespace {
+
+size_t compute_brick_index(const brick_map& bricks, const glm::ivec3& locator) {
+    const auto brick = locator / static_cast<int>(brick_map::brick_size);
+    return brick.x + brick.y * bricks.dimensions.x +
+           brick.z * bricks.dimensions.x * bricks.dimensions.y;
+}
+
+/// Spreads the low 21 bits of x out so that there are two zero bits between
+/// each one.
+std::uint64_t spread_bits(std::uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffff;
+    x = (x | x << 16) & 0x1f0000ff0000ff;
+    x = (x | x << 8) & 0x100f00f00f00f00f;
+    x = (x | x << 4) & 0x10c30c30c30c30c3;
+    x = (x | x << 2) & 0x1249249249249249;
+    return x;
+}
+
+}  // namespace
+
+std::uint64_t compute_morton_code(const glm::ivec3& locator) {
+    return spread_bits(locator.x) | spread_bits(locator.y) << 1 |
+           spread_bits(locator.z) << 2;
+}
+
+brick_map compute_brick_map(const mesh_descriptor& descriptor,
+                            const util::aligned::vector<condensed_node>& nodes,
+                            brick_order order) {
+    const auto dim = core::to_ivec3{}(descriptor.dimensions);
+    const auto size = static_cast<int>(brick_map::brick_size);
+
+    brick_map ret{(dim + size - 1) / size, {}, 1, order};
+    ret.slots.resize(ret.dimensions.x * ret.dimensions.y * ret.dimensions.z,
+                     0);
+
+    //  Mark bricks which contain anything other than outside nodes.
+    for (auto i = 0u, e = static_cast<unsigned>(nodes.size()); i != e; ++i) {
+        if (nodes[i].boundary_type != id_none) {
+            ret.slots[compute_brick_index(ret, compute_locator(descriptor, i))] =
+                    1;
+        }
+    }
+
+    //  Find the order in which to visit the marked bricks.
+    util::aligned::vector<cl_uint> visit_order;
+    visit_order.reserve(ret.slots.size());
+    for (auto i = 0u, e = static_cast<unsigned>(ret.slots.size()); i != e;
+         ++i) {
+        if (ret.slots[i]) {
+            visit_order.emplace_back(i);
+        }
+    }
+
+    if (order == brick_order::morton) {
+        const auto morton_code = [&](auto brick_index) {
+            const auto x = div(static_cast<int>(brick_index),
+                               ret.dimensions.x);
+            const auto y = div(x.quot, ret.dimensions.y);
+            return compute_morton_code(glm::ivec3{x.rem, y.rem, y.quot});
+        };
+        std::sort(begin(visit_order),
+                  end(visit_order),
+                  [&](auto a, auto b) {
+                      return morton_code(a) < morton_code(b);
+                  });
+    }
+
+    //  Slot 0 is reserved for the empty brick.
+    ret.bricks.resize(visit_order.size() + 1, 0);
+    for (const auto i : visit_order) {
+        ret.bricks[ret.num_slots] = i;
+        ret.slots[i] = ret.num_slots++;
+    }
+
+    return ret;
+}
+
+brick_map make_brick_map(const mesh_descriptor& descriptor,
+                         util::aligned::vector<cl_uint> slots,
+                         brick_order order) {
+    const auto dim = core::to_ivec3{}(descriptor.dimensions);
+    const auto size = static_cast<int>(brick_map::brick_size);
+
+    brick_map ret{(dim + size - 1) / size, std::move(slots), 1, order};
+    if (ret.slots.size() !=
+        static_cast<size_t>(ret.dimensions.x * ret.dimensions.y *
+                            ret.dimensions.z)) {
+        throw std::runtime_error{"Brick table has the wrong size."};
+    }
+
+    //  Every stored brick must have its own slot, and slots must be dense.
+    for (const auto i : ret.slots) {
+        ret.num_slots = std::max(ret.num_slots, size_t{i} + 1);
+    }
+    ret.bricks.resize(ret.num_slots, 0);
+    util::aligned::vector<bool> used(ret.num_slots, false);
+    for (auto i = 0u, e = static_cast<unsigned>(ret.slots.size()); i != e;
+         ++i) {
+        if (const auto slot = ret.slots[i]) {
+            if (used[slot]) {
+                throw std::runtime_error{"Brick table reuses a slot."};
+            }
+            used[slot] = true;
+            ret.bricks[slot] = i;
+        }
+    }
+    if (std::count(begin(used), end(used), true) + 1 !=
+        static_cast<std::ptrdiff_t>(ret.num_slots)) {
+        throw std::runtime_error{"Brick table skips a slot."};
+    }
+
+    return ret;
+}
+
+size_t compute_slot(const brick_map& bricks, const glm::ivec3& locator) {
+    return bricks.slots[compute_brick_index(bricks, locator)];
+}
+
+size_t compute_storage_index(const brick_map& bricks,
+                             const glm::ivec3& locator) {
+    const auto size = static_cast<int>(brick_map::brick_size);
+    const auto offset = locator % size;
+    return compute_slot(bricks, locator) * brick_map::brick_volume + offset.x +
+           offset.y * size + offset.z * size * size;
+}
+
+glm::ivec3 compute_locator(const brick_map& bricks, size_t storage_index) {
+    const auto size = static_cast<int>(brick_map::brick_size);
+    const auto brick = static_cast<int>(
+            bricks.bricks[storage_index / brick_map::brick_volume]);
+    const auto offset =
+            static_cast<int>(storage_index % brick_map::brick_volume);
+    const auto bx = div(brick, bricks.dimensions.x);
+    const auto by = div(bx.quot, bricks.dimensions.y);
+    return glm::ivec3{bx.rem, by.rem, by.quot} * size +
+           glm::ivec3{
+                   offset % size, offset / size % size, offset / (size * size)};
+}
+
+size_t compute_num_stored_nodes(const brick_map& bricks) {
+    return bricks.num_slots * brick_map::brick_volume;
+}
+
+util::aligned::vector<cl_uint> compute_brick_table(const brick_map& bricks) {
+    auto ret = bricks.slots;
+    ret.insert(end(ret), begin(bricks.bricks), end(bricks.bricks));
+    return ret;
+}
+
+util::aligned::vector<condensed_node> compact_nodes(
+        const mesh_descriptor& descriptor,
+        const brick_map& bricks,
+        const util::aligned::vector<condensed_node>& nodes) {
+    util::aligned::vector<condensed_node> ret(
+            compute_num_stored_nodes(bricks));
+    for (auto i = 0u, e = static_cast<unsigned>(nodes.size()); i != e; ++i) {
+        const auto locator = compute_locator(descriptor, i);
+        if (compute_slot(bricks, locator)) {
+            ret[compute_storage_index(bricks, locator)] = nodes[i];
+        }
+    }
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
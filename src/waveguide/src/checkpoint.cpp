@@ -0,0 +1,130 @@
+#include "waveguide/checkpoint.h"
+#include "waveguide/stepper.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace wayverb {
+namespace waveguide {
+namespace {
+
+constexpr char file_magic[8] = {'W', 'V', 'C', 'H', 'E', 'C', 'K', '\0'};
+
+//  Bump this whenever the file layout changes.
+constexpr std::uint64_t file_version = 4;
+
+struct header final {
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t step;
+    std::uint64_t bands;
+    std::uint64_t state_size;
+
+    /// The two backends store boundary state differently.
+    std::uint64_t backend;
+
+    /// The mesh descriptor, field by field, so that padding is never
+    /// compared.
+    float min_corner[3];
+    std::int32_t dimensions[3];
+    float spacing;
+
+    /// Node types, boundary surfaces and coefficients (see
+    /// stepper::get_boundary_hash).
+    std::uint64_t boundary_hash;
+};
+
+header make_header(size_t step, const stepper& stepper) {
+    header ret;
+    std::memset(&ret, 0, sizeof(ret));
+    std::copy(std::begin(file_magic), std::end(file_magic), ret.magic);
+    ret.version = file_version;
+    ret.step = step;
+    ret.bands = stepper.get_bands();
+    ret.state_size = stepper.get_state_size();
+    ret.backend = static_cast<std::uint64_t>(stepper.get_backend());
+
+    const auto& descriptor = stepper.get_descriptor();
+    std::copy(descriptor.min_corner.s,
+              descriptor.min_corner.s + 3,
+              ret.min_corner);
+    std::copy(descriptor.dimensions.s,
+              descriptor.dimensions.s + 3,
+              ret.dimensions);
+    ret.spacing = descriptor.spacing;
+    ret.boundary_hash = stepper.get_boundary_hash();
+    return ret;
+}
+
+/// Whether a checkpoint can be restored into `stepper`.
+/// Everything but the step number has to match.
+bool is_compatible(const header& h, const stepper& stepper) {
+    const auto expected = make_header(h.step, stepper);
+    return std::memcmp(&h, &expected, sizeof(header)) == 0;
+}
+
+}  // namespace
+
+void write_checkpoint(const std::string& path,
+                      size_t step,
+                      stepper& stepper,
+                      const std::function<void(std::ostream&)>& write_extra) {
+    const auto h = make_header(step, stepper);
+
+    const auto temporary_path = path + ".tmp";
+    {
+        std::ofstream os{temporary_path, std::ios::binary | std::ios::trunc};
+        os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        stepper.write_state(os);
+        write_extra(os);
+
+        if (!os) {
+            throw std::runtime_error{"Unable to write checkpoint file " +
+                                     temporary_path + "."};
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str())) {
+        std::remove(temporary_path.c_str());
+        throw std::runtime_error{"Unable to write checkpoint file " + path +
+                                 "."};
+    }
+}
+
+std::experimental::optional<size_t> read_checkpoint(
+        const std::string& path,
+        stepper& stepper,
+        const std::function<void(std::istream&)>& read_extra) {
+    std::ifstream is{path, std::ios::binary};
+    if (!is) {
+        return std::experimental::nullopt;
+    }
+
+    header h;
+    if (!is.read(reinterpret_cast<char*>(&h), sizeof(h)) ||
+        !std::equal(std::begin(file_magic), std::end(file_magic), h.magic) ||
+        h.version != file_version) {
+        throw std::runtime_error{"Unable to read checkpoint file " + path +
+                                 "."};
+    }
+
+    if (!is_compatible(h, stepper)) {
+        throw std::runtime_error{"Checkpoint file " + path +
+                                 " is for a different simulation."};
+    }
+
+    stepper.read_state(is);
+    read_extra(is);
+
+    if (!is) {
+        throw std::runtime_error{"Unable to read checkpoint file " + path +
+                                 "."};
+    }
+
+    return h.step;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
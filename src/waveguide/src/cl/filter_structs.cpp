@@ -2,12 +2,15 @@
 
 namespace wayverb {
 
+//  Structs are aligned like their host counterparts, so that the layouts of
+//  structs which contain them still match when filt_real is a float.
+
 const std::string core::cl_representation<waveguide::memory_biquad>::value{
         R"(
 typedef struct {
     filt_real array[)" +
         std::to_string(waveguide::memory_biquad::order) + R"(];
-} memory_)" +
+} __attribute__((aligned(8))) memory_)" +
         std::to_string(waveguide::memory_biquad::order) + R"(;
 
 typedef memory_)" +
@@ -24,7 +27,7 @@ typedef struct {
     filt_real a[)" +
                 std::to_string(waveguide::coefficients_biquad::order + 1) +
                 R"(];
-} coefficients_)" +
+} __attribute__((aligned(8))) coefficients_)" +
                 std::to_string(waveguide::coefficients_biquad::order) + R"(;
 
 typedef coefficients_)" +
@@ -37,7 +40,7 @@ const std::string core::cl_representation<waveguide::memory_canonical>::value{
 typedef struct {
     filt_real array[)" +
         std::to_string(waveguide::memory_canonical::order) + R"(];
-} memory_)" +
+} __attribute__((aligned(8))) memory_)" +
         std::to_string(waveguide::memory_canonical::order) + R"(;
 
 typedef memory_)" +
@@ -55,7 +58,7 @@ typedef struct {
     filt_real a[)" +
                 std::to_string(waveguide::coefficients_canonical::order + 1) +
                 R"(];
-} coefficients_)" +
+} __attribute__((aligned(8))) coefficients_)" +
                 std::to_string(waveguide::coefficients_canonical::order) + R"(;
 
 typedef coefficients_)" +
@@ -41,6 +41,76 @@ FILTER_STEP(CANONICAL_FILTER_ORDER);
 #define filter_step_biquad CAT(filter_step_, BIQUAD_ORDER)
 #define filter_step_canonical CAT(filter_step_, CANONICAL_FILTER_ORDER)
 
+//  As filter_step_canonical, but for filter state stored as a structure of
+//  arrays: tap `i` of the delay line is at `m[i * stride]`.
+//  When neighbouring work-items own neighbouring filters, each tap is read
+//  and written as one contiguous block across the work-group, and the
+//  compiler can pack several filters into each vector register.
+//
+//  Only the first `used` taps are touched. Coefficients above that order
+//  must be zero, so the remaining taps would stay at zero anyway.
+#define FILTER_STEP_STRIDED(used)                                            \
+    filt_real CAT(filter_step_strided_, used)(                               \
+            filt_real input,                                                 \
+            global filt_real * m,                                            \
+            size_t stride,                                                   \
+            const global coefficients_canonical* c);                         \
+    filt_real CAT(filter_step_strided_, used)(                               \
+            filt_real input,                                                 \
+            global filt_real * m,                                            \
+            size_t stride,                                                   \
+            const global coefficients_canonical* c) {                        \
+        filt_real state[used + 1];                                           \
+        for (int i = 0; i != used; ++i) {                                    \
+            state[i] = m[i * stride];                                        \
+        }                                                                    \
+        state[used] = 0;                                                     \
+        const filt_real output = (input * c->b[0] + state[0]) / c->a[0];     \
+        for (int i = 0; i != used; ++i) {                                    \
+            const filt_real b = c->b[i + 1] == 0 ? 0 : c->b[i + 1] * input;  \
+            const filt_real a = c->a[i + 1] == 0 ? 0 : c->a[i + 1] * output; \
+            m[i * stride] = b - a + state[i + 1];                            \
+        }                                                                    \
+        return output;                                                       \
+    }
+
+FILTER_STEP_STRIDED(0);
+FILTER_STEP_STRIDED(BIQUAD_ORDER);
+FILTER_STEP_STRIDED(CANONICAL_FILTER_ORDER);
+
+//  Boundary filters are fitted at the lowest order which matches the
+//  surface, and padded with zeros up to the canonical order.
+int effective_order(const global coefficients_canonical* c);
+int effective_order(const global coefficients_canonical* c) {
+    int ret = CANONICAL_FILTER_ORDER;
+    while (ret && c->b[ret] == 0 && c->a[ret] == 0) {
+        --ret;
+    }
+    return ret;
+}
+
+//  Most scenes use only a few materials, so work-items in the same
+//  work-group usually take the same branch.
+filt_real filter_step_canonical_strided(filt_real input,
+                                        global filt_real* m,
+                                        size_t stride,
+                                        const global coefficients_canonical* c);
+filt_real filter_step_canonical_strided(
+        filt_real input,
+        global filt_real* m,
+        size_t stride,
+        const global coefficients_canonical* c) {
+    const int used = effective_order(c);
+    if (used == 0) {
+        return filter_step_strided_0(input, m, stride, c);
+    }
+    if (used <= BIQUAD_ORDER) {
+        return CAT(filter_step_strided_, BIQUAD_ORDER)(input, m, stride, c);
+    }
+    return CAT(filter_step_strided_, CANONICAL_FILTER_ORDER)(
+            input, m, stride, c);
+}
+
 float biquad_cascade(filt_real input,
                      global biquad_memory_array* bm,
                      const global biquad_coefficients_array* bc);
@@ -74,6 +144,19 @@ kernel void filter_test_2(
                                           canonical_coefficients + index);
 }
 
+kernel void filter_test_strided(
+        const global float* input,
+        global float* output,
+        global filt_real* canonical_memory,
+        const global coefficients_canonical* canonical_coefficients) {
+    const size_t index = get_global_id(0);
+    output[index] = filter_step_canonical_strided(input[index],
+                                                  canonical_memory + index,
+                                                  get_global_size(0),
+                                                  canonical_coefficients +
+                                                          index);
+}
+
 )";
 
 }  // namespace cl_sources
@@ -1,27 +1,22 @@
 #include "waveguide/config.h"
+#include "waveguide/resampler.h"
 
 #include <cmath>
 
-#include "samplerate.h"
-
 namespace wayverb {
 namespace waveguide {
 namespace config {
 
-namespace {
-constexpr auto DIM = 3;
-}  // namespace
-
-double speed_of_sound(double time_step, double grid_spacing) {
-    return grid_spacing / (time_step * std::sqrt(DIM));
+double speed_of_sound(double time_step, double grid_spacing, stencil s) {
+    return grid_spacing * get_coefficients(s).courant / time_step;
 }
 
-double time_step(double speed_of_sound, double grid_spacing) {
-    return grid_spacing / (speed_of_sound * std::sqrt(DIM));
+double time_step(double speed_of_sound, double grid_spacing, stencil s) {
+    return grid_spacing * get_coefficients(s).courant / speed_of_sound;
 }
 
-double grid_spacing(double speed_of_sound, double time_step) {
-    return speed_of_sound * time_step * std::sqrt(DIM);
+double grid_spacing(double speed_of_sound, double time_step, stencil s) {
+    return speed_of_sound * time_step / get_coefficients(s).courant;
 }
 
 }  // namespace config
@@ -35,16 +30,8 @@ util::aligned::vector<float> adjust_sampling_rate(const float* data,
                 "Sample rate of 0 gives few hints about how to proceed."};
     }
     const auto ratio = out_sr / in_sr;
-    util::aligned::vector<float> out_signal(ratio * size);
-    SRC_DATA sample_rate_info{data,
-                              out_signal.data(),
-                              static_cast<long>(size),
-                              static_cast<long>(out_signal.size()),
-                              0,
-                              0,
-                              0,
-                              ratio};
-    src_simple(&sample_rate_info, SRC_SINC_BEST_QUALITY, 1);
+    auto out_signal =
+            resample(data, size, in_sr, out_sr, resampler_quality::best);
 
     //  Correct output level.
     const auto volume_scale = 1 / ratio;
@@ -0,0 +1,88 @@
+#include "waveguide/early_termination.h"
+
+#include "core/azimuth_elevation.h"
+#include "core/filters_common.h"
+
+#include "utilities/decibels.h"
+
+#include <numeric>
+#include <random>
+
+namespace wayverb {
+namespace waveguide {
+
+void synthesize_tail(band& band,
+                     size_t steps,
+                     double decay_rate,
+                     size_t reference_steps,
+                     double cutoff,
+                     double acoustic_impedance) {
+    auto& output = band.directional;
+    if (steps <= output.size()) {
+        return;
+    }
+
+    if (!(decay_rate < 0)) {
+        throw std::runtime_error{
+                "Can't synthesize a tail which doesn't decay."};
+    }
+
+    reference_steps = std::min(reference_steps, output.size());
+    if (!reference_steps) {
+        throw std::runtime_error{
+                "Can't synthesize a tail without reference output."};
+    }
+
+    const auto reference_rms = std::sqrt(
+            std::accumulate(end(output) - reference_steps,
+                            end(output),
+                            0.0,
+                            [](auto running_total, const auto& i) {
+                                return running_total +
+                                       i.pressure * i.pressure;
+                            }) /
+            reference_steps);
+
+    //  The RMS is taken to be the level at the middle of the reference region.
+    const auto decay_per_step =
+            util::decibels::db2a(decay_rate / band.sample_rate);
+    auto amplitude =
+            reference_rms * util::decibels::db2a(decay_rate * reference_steps /
+                                                 (2 * band.sample_rate));
+
+    //  Fixed seed, so that results are repeatable.
+    std::default_random_engine engine{0};
+    std::normal_distribution<double> distribution;
+
+    util::aligned::vector<double> noise(steps - output.size());
+    std::generate(begin(noise), end(noise), [&] {
+        return distribution(engine);
+    });
+
+    core::filter::biquad lopass{
+            core::filter::compute_linkwitz_riley_lopass_coefficients(
+                    cutoff, band.sample_rate)};
+    core::filter::run_one_pass(lopass, begin(noise), end(noise));
+
+    const auto noise_rms = std::sqrt(
+            std::inner_product(
+                    begin(noise), end(noise), begin(noise), 0.0) /
+            noise.size());
+    if (noise_rms == 0) {
+        throw std::runtime_error{"Synthesized noise is silent."};
+    }
+
+    output.reserve(steps);
+    for (const auto i : noise) {
+        amplitude *= decay_per_step;
+        const auto pressure = amplitude * i / noise_rms;
+        output.emplace_back(postprocessor::directional_receiver::output{
+                core::random_unit_vector(engine) *
+                        static_cast<float>(pressure * pressure /
+                                           acoustic_impedance),
+                static_cast<float>(pressure)});
+    }
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,31 @@
+#include "waveguide/energy_program.h"
+
+namespace wayverb {
+namespace waveguide {
+
+constexpr auto source = R"(
+//  Pressures are stored node-major, band-minor.
+//  The global size must be a multiple of the number of bands.
+//  Neighbouring threads read neighbouring values.
+kernel void partial_energy(const global float* pressures,
+                           uint nodes,
+                           uint bands,
+                           global float* output) {
+    const size_t thread = get_global_id(0);
+    const size_t stride = get_global_size(0) / bands;
+    const size_t band = thread % bands;
+
+    float sum = 0;
+    for (size_t node = thread / bands; node < nodes; node += stride) {
+        const float pressure = pressures[node * bands + band];
+        sum += pressure * pressure;
+    }
+    output[thread] = sum;
+}
+)";
+
+energy_program::energy_program(const core::compute_context& cc)
+        : wrapper_{cc, source} {}
+
+}  // namespace waveguide
+}  // namespace wayverb
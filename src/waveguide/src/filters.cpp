@@ -14,9 +14,10 @@ coefficients_biquad get_peak_coefficients(const filter_descriptor& n) {
     const auto sw0 = sin(w0);
     const auto alpha = sw0 / 2.0 * n.Q;
     const auto a0 = 1 + alpha / A;
+    const auto coeff = [&](auto i) { return static_cast<filt_real>(i / a0); };
     return coefficients_biquad{
-            {(1 + (alpha * A)) / a0, (-2 * cw0) / a0, (1 - alpha * A) / a0},
-            {1, (-2 * cw0) / a0, (1 - alpha / A) / a0}};
+            {coeff(1 + (alpha * A)), coeff(-2 * cw0), coeff(1 - alpha * A)},
+            {1, coeff(-2 * cw0), coeff(1 - alpha / A)}};
 }
 
 biquad_coefficients_array get_peak_biquads_array(
@@ -12,20 +12,97 @@
 
 #include "utilities/popcount.h"
 
+#include <chrono>
 #include <iostream>
 
 namespace wayverb {
 namespace waveguide {
 
-mesh::mesh(mesh_descriptor descriptor, vectors vectors)
+mesh::mesh(mesh_descriptor descriptor, vectors vectors, stencil s)
         : descriptor_(std::move(descriptor))
-        , vectors_(std::move(vectors)) {}
+        , vectors_(std::move(vectors))
+        , stencil_(s) {}
 
 const mesh_descriptor& mesh::get_descriptor() const { return descriptor_; }
 const vectors& mesh::get_structure() const { return vectors_; }
+stencil mesh::get_stencil() const { return stencil_; }
+
+condensed_node get_node(const mesh& m, size_t node_index) {
+    const auto& nodes = m.get_structure().get_condensed_nodes();
+    if (const auto& bricks = m.get_structure().get_brick_map()) {
+        const auto locator = compute_locator(m.get_descriptor(), node_index);
+        return compute_slot(*bricks, locator)
+                       ? nodes[compute_storage_index(*bricks, locator)]
+                       : condensed_node{};
+    }
+    return nodes[node_index];
+}
 
 bool is_inside(const mesh& m, size_t node_index) {
-    return is_inside(m.get_structure().get_condensed_nodes()[node_index]);
+    return is_inside(get_node(m, node_index));
+}
+
+size_t compute_storage_index(const mesh& m, size_t node_index) {
+    if (const auto& bricks = m.get_structure().get_brick_map()) {
+        const auto locator = compute_locator(m.get_descriptor(), node_index);
+        if (!compute_slot(*bricks, locator)) {
+            throw std::runtime_error{
+                    "Node is not stored in this compacted mesh."};
+        }
+        return compute_storage_index(*bricks, locator);
+    }
+    return node_index;
+}
+
+bool is_stored(const mesh& m, size_t node_index) {
+    const auto& bricks = m.get_structure().get_brick_map();
+    return !bricks ||
+           compute_slot(*bricks,
+                        compute_locator(m.get_descriptor(), node_index));
+}
+
+mesh compact(const mesh& m, brick_order order) {
+    if (m.get_structure().get_brick_map()) {
+        return m;
+    }
+
+    const auto& descriptor = m.get_descriptor();
+    const auto& structure = m.get_structure();
+
+    auto bricks = compute_brick_map(
+            descriptor, structure.get_condensed_nodes(), order);
+    auto nodes =
+            compact_nodes(descriptor, bricks, structure.get_condensed_nodes());
+
+    //  The node lists are rebuilt in storage order, so that neighbouring
+    //  work-items touch neighbouring memory.
+    auto node_indices = compute_node_index_data(descriptor, nodes, bricks);
+
+    return {descriptor,
+            vectors{std::move(nodes),
+                    structure.get_coefficients(),
+                    boundary_index_data{structure.get_boundary_indices<1>(),
+                                        structure.get_boundary_indices<2>(),
+                                        structure.get_boundary_indices<3>()},
+                    std::move(node_indices),
+                    std::move(bricks)},
+            m.get_stencil()};
+}
+
+brick_order compute_brick_order(const core::compute_context& cc) {
+    return cc.backend == core::compute_backend::native ? brick_order::linear
+                                                       : brick_order::morton;
+}
+
+bool is_worth_compacting(const mesh& m) {
+    if (m.get_structure().get_brick_map()) {
+        return false;
+    }
+    const auto& descriptor = m.get_descriptor();
+    const auto bricks = compute_brick_map(
+            descriptor, m.get_structure().get_condensed_nodes());
+    return compute_num_stored_nodes(bricks) * 4 <=
+           compute_num_nodes(descriptor) * 3;
 }
 
 void mesh::set_coefficients(coefficients_canonical coefficients) {
@@ -50,13 +127,32 @@ double estimate_volume(const mesh& mesh) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+util::aligned::vector<coefficients_canonical> compute_boundary_coefficients(
+        const util::aligned::vector<core::surface<core::simulation_bands>>&
+                surfaces,
+        double sample_rate) {
+    return util::map_to_vector(
+            begin(surfaces), end(surfaces), [&](const auto& surface) {
+                return make_stable(to_impedance_coefficients(
+                        compute_reflectance_filter_coefficients(
+                                surface.absorption.s, sample_rate)));
+            });
+}
+
 mesh compute_mesh(
         const core::compute_context& cc,
         const core::voxelised_scene_data<cl_float3,
                                          core::surface<core::simulation_bands>>&
                 voxelised,
         float mesh_spacing,
-        float speed_of_sound) {
+        float speed_of_sound,
+        stencil s,
+        mesh_setup_timings* timings) {
+    using clock = std::chrono::steady_clock;
+    const auto seconds_since = [](auto start) {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
     const auto program = setup_program{cc};
     auto queue = cl::CommandQueue{cc.context, cc.device};
 
@@ -81,10 +177,14 @@ mesh compute_mesh(
             return cl::EnqueueArgs(queue, cl::NDRange(num_nodes));
         };
 
-        //  find whether each node is inside or outside the model
+        //  find whether each node is inside or outside the model, one
+        //  column of nodes at a time
+        const auto inside_start = clock::now();
         {
-            auto kernel = program.get_node_inside_kernel();
-            kernel(enqueue(),
+            auto kernel = program.get_column_inside_kernel();
+            kernel(cl::EnqueueArgs(queue,
+                                   cl::NDRange(desc.dimensions.s[0] *
+                                               desc.dimensions.s[1])),
                    node_buffer,
                    desc,
                    buffers.get_voxel_index_buffer(),
@@ -94,6 +194,11 @@ mesh compute_mesh(
                    buffers.get_vertices_buffer());
         }
 
+        if (timings) {
+            queue.finish();
+            timings->inside_test = seconds_since(inside_start);
+        }
+
 #ifndef NDEBUG
         {
             auto nodes =
@@ -120,33 +225,35 @@ mesh compute_mesh(
     //  IMPORTANT
     //  compute_boundary_index_data mutates the nodes array, so it must
     //  be run before condensing the nodes.
+    const auto boundary_start = clock::now();
     auto boundary_data =
             compute_boundary_index_data(cc.device, buffers, desc, nodes);
+    if (timings) {
+        timings->boundary_finder = seconds_since(boundary_start);
+    }
+
+    auto node_indices = compute_node_index_data(desc, nodes);
 
     auto v = vectors{
             std::move(nodes),
-            util::map_to_vector(
-                    begin(voxelised.get_scene_data().get_surfaces()),
-                    end(voxelised.get_scene_data().get_surfaces()),
-                    [&](const auto& surface) {
-                        return to_impedance_coefficients(
-                                compute_reflectance_filter_coefficients(
-                                        surface.absorption.s,
-                                        1 / config::time_step(speed_of_sound,
-                                                              mesh_spacing)));
-                    }),
-            std::move(boundary_data)};
-
-    return {desc, std::move(v)};
+            compute_boundary_coefficients(
+                    voxelised.get_scene_data().get_surfaces(),
+                    1 / config::time_step(speed_of_sound, mesh_spacing, s)),
+            std::move(boundary_data),
+            std::move(node_indices)};
+
+    return {desc, std::move(v), s};
 }
 
 voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
                                         const core::gpu_scene_data& scene,
                                         const glm::vec3& anchor,
                                         double sample_rate,
-                                        double speed_of_sound) {
+                                        double speed_of_sound,
+                                        stencil s,
+                                        bool allow_compaction) {
     const auto mesh_spacing =
-            config::grid_spacing(speed_of_sound, 1 / sample_rate);
+            config::grid_spacing(speed_of_sound, 1 / sample_rate, s);
     auto voxelised = make_voxelised_scene_data(
             scene,
             5,
@@ -154,7 +261,10 @@ voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
                     core::geo::compute_aabb(scene.get_vertices()),
                     anchor,
                     mesh_spacing));
-    auto mesh = compute_mesh(cc, voxelised, mesh_spacing, speed_of_sound);
+    auto mesh = compute_mesh(cc, voxelised, mesh_spacing, speed_of_sound, s);
+    if (allow_compaction && is_worth_compacting(mesh)) {
+        mesh = compact(mesh, compute_brick_order(cc));
+    }
     return {std::move(voxelised), std::move(mesh)};
 }
 
@@ -0,0 +1,319 @@
+#include "waveguide/mesh_cache.h"
+#include "waveguide/config.h"
+
+#include "core/conversions.h"
+
+#include "utilities/fnv1a.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace wayverb {
+namespace waveguide {
+namespace {
+
+constexpr char file_magic[8] = {'W', 'V', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+//  Bump this whenever the file layout, or the layout of any struct stored in
+//  the file, changes.
+constexpr std::uint64_t file_version = 2;
+
+struct header final {
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t key;
+    mesh_descriptor descriptor;
+    cl_float3 voxels_min;
+    cl_float3 voxels_max;
+    std::uint64_t num_nodes;
+    std::uint64_t num_boundary_1;
+    std::uint64_t num_boundary_2;
+    std::uint64_t num_boundary_3;
+    std::uint64_t voxel_index_size;
+    /// Zero if the mesh is not compacted.
+    std::uint64_t num_brick_slots;
+    std::uint64_t brick_order;
+};
+
+constexpr size_t section_alignment = 8;
+
+void write_padding(std::ostream& os) {
+    const char zeros[section_alignment]{};
+    const auto remainder = os.tellp() % section_alignment;
+    if (remainder) {
+        os.write(zeros, section_alignment - remainder);
+    }
+}
+
+template <typename T>
+void write_section(std::ostream& os, const T* data, size_t size) {
+    os.write(reinterpret_cast<const char*>(data), sizeof(T) * size);
+    write_padding(os);
+}
+
+template <typename T>
+void write_section(std::ostream& os, const util::aligned::vector<T>& data) {
+    write_section(os, data.data(), data.size());
+}
+
+template <typename T>
+bool read_section(std::istream& is, T* data, size_t size) {
+    is.read(reinterpret_cast<char*>(data), sizeof(T) * size);
+    const auto remainder = is.tellg() % section_alignment;
+    if (remainder) {
+        is.ignore(section_alignment - remainder);
+    }
+    return static_cast<bool>(is);
+}
+
+template <typename T>
+bool read_section(std::istream& is, util::aligned::vector<T>& data) {
+    return read_section(is, data.data(), data.size());
+}
+
+}  // namespace
+
+std::uint64_t compute_mesh_cache_key(const core::gpu_scene_data& scene,
+                                     const glm::vec3& anchor,
+                                     double sample_rate,
+                                     double speed_of_sound,
+                                     std::experimental::optional<brick_order>
+                                             compaction) {
+    util::fnv1a hash;
+
+    for (const auto& v : scene.get_vertices()) {
+        //  Only the first three elements of a cl_float3 are meaningful.
+        hash(v.s[0]);
+        hash(v.s[1]);
+        hash(v.s[2]);
+    }
+
+    //  Boundary indices refer to surfaces, so those must match too.
+    for (const auto& t : scene.get_triangles()) {
+        hash(t.surface);
+        hash(t.v0);
+        hash(t.v1);
+        hash(t.v2);
+    }
+
+    //  compute_mesh uses single-precision spacing.
+    hash(static_cast<float>(
+            config::grid_spacing(speed_of_sound, 1 / sample_rate)));
+
+    hash(anchor.x);
+    hash(anchor.y);
+    hash(anchor.z);
+
+    hash(static_cast<bool>(compaction));
+    if (compaction) {
+        hash(static_cast<int>(*compaction));
+    }
+
+    return hash.get();
+}
+
+void write_mesh_cache(const std::string& path,
+                      std::uint64_t key,
+                      const voxels_and_mesh& voxels_and_mesh) {
+    const auto& mesh = voxels_and_mesh.mesh;
+    const auto& structure = mesh.get_structure();
+    if (mesh.get_stencil() != stencil::rectilinear) {
+        throw std::runtime_error{
+                "Only meshes for the rectilinear stencil can be cached."};
+    }
+
+    const auto voxel_index =
+            core::get_flattened(voxels_and_mesh.voxels.get_voxels());
+    const auto voxels_aabb = voxels_and_mesh.voxels.get_voxels().get_aabb();
+
+    header h;
+    std::memset(&h, 0, sizeof(h));
+    std::copy(std::begin(file_magic), std::end(file_magic), h.magic);
+    h.version = file_version;
+    h.key = key;
+    h.descriptor = mesh.get_descriptor();
+    h.voxels_min = core::to_cl_float3{}(voxels_aabb.get_min());
+    h.voxels_max = core::to_cl_float3{}(voxels_aabb.get_max());
+    h.num_nodes = structure.get_condensed_nodes().size();
+    h.num_boundary_1 = structure.get_boundary_indices<1>().size();
+    h.num_boundary_2 = structure.get_boundary_indices<2>().size();
+    h.num_boundary_3 = structure.get_boundary_indices<3>().size();
+    h.voxel_index_size = voxel_index.size();
+    if (const auto& bricks = structure.get_brick_map()) {
+        h.num_brick_slots = bricks->slots.size();
+        h.brick_order = static_cast<std::uint64_t>(bricks->order);
+    }
+
+    //  Write to a temporary file and then move it into place, so that readers
+    //  never see a partially-written file.
+    const auto temporary_path = path + ".tmp";
+    {
+        std::ofstream os{temporary_path, std::ios::binary | std::ios::trunc};
+        write_section(os, &h, 1);
+        //  The brick layout comes first, so that readers can check the node
+        //  count before allocating the nodes.
+        if (const auto& bricks = structure.get_brick_map()) {
+            write_section(os, bricks->slots);
+        }
+        write_section(os, structure.get_condensed_nodes());
+        write_section(os, structure.get_boundary_indices<1>());
+        write_section(os, structure.get_boundary_indices<2>());
+        write_section(os, structure.get_boundary_indices<3>());
+        write_section(os, voxel_index);
+
+        if (!os) {
+            throw std::runtime_error{"Unable to write mesh cache file " +
+                                     temporary_path + "."};
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str())) {
+        std::remove(temporary_path.c_str());
+        throw std::runtime_error{"Unable to write mesh cache file " + path +
+                                 "."};
+    }
+}
+
+std::experimental::optional<voxels_and_mesh> read_mesh_cache(
+        const std::string& path,
+        std::uint64_t key,
+        const core::gpu_scene_data& scene,
+        double speed_of_sound) {
+    std::ifstream is{path, std::ios::binary};
+
+    header h;
+    if (!read_section(is, &h, 1) ||
+        !std::equal(std::begin(file_magic), std::end(file_magic), h.magic) ||
+        h.version != file_version || h.key != key) {
+        return std::experimental::nullopt;
+    }
+
+    //  The brick table, if there is one, has a slot for every brick of the
+    //  mesh.
+    const auto size = static_cast<int>(brick_map::brick_size);
+    const auto brick_dimensions =
+            (core::to_ivec3{}(h.descriptor.dimensions) + size - 1) / size;
+    if (h.num_brick_slots &&
+        h.num_brick_slots != static_cast<size_t>(brick_dimensions.x *
+                                                  brick_dimensions.y *
+                                                  brick_dimensions.z)) {
+        return std::experimental::nullopt;
+    }
+
+    util::aligned::vector<cl_uint> brick_slots(h.num_brick_slots);
+    if (!read_section(is, brick_slots)) {
+        return std::experimental::nullopt;
+    }
+
+    std::experimental::optional<brick_map> bricks;
+    if (!brick_slots.empty()) {
+        try {
+            bricks = make_brick_map(h.descriptor,
+                                    std::move(brick_slots),
+                                    static_cast<brick_order>(h.brick_order));
+        } catch (const std::runtime_error&) {
+            return std::experimental::nullopt;
+        }
+    }
+
+    if (h.num_nodes != (bricks ? compute_num_stored_nodes(*bricks)
+                               : compute_num_nodes(h.descriptor))) {
+        return std::experimental::nullopt;
+    }
+
+    util::aligned::vector<condensed_node> nodes(h.num_nodes);
+    boundary_index_data boundary_indices{
+            util::aligned::vector<boundary_index_array_1>(h.num_boundary_1),
+            util::aligned::vector<boundary_index_array_2>(h.num_boundary_2),
+            util::aligned::vector<boundary_index_array_3>(h.num_boundary_3)};
+    util::aligned::vector<cl_uint> voxel_index(h.voxel_index_size);
+
+    if (!read_section(is, nodes) ||
+        !read_section(is, boundary_indices.b1) ||
+        !read_section(is, boundary_indices.b2) ||
+        !read_section(is, boundary_indices.b3) ||
+        !read_section(is, voxel_index)) {
+        return std::experimental::nullopt;
+    }
+
+    const auto voxel_collection = [&]()
+            -> std::experimental::optional<core::voxel_collection<3>> {
+        try {
+            return core::get_unflattened(
+                    core::geo::box{core::to_vec3{}(h.voxels_min),
+                                   core::to_vec3{}(h.voxels_max)},
+                    voxel_index);
+        } catch (const std::runtime_error&) {
+            return std::experimental::nullopt;
+        }
+    }();
+    if (!voxel_collection) {
+        return std::experimental::nullopt;
+    }
+
+    auto voxels = core::voxelised_scene_data<
+            cl_float3,
+            core::surface<core::simulation_bands>>{scene, *voxel_collection};
+
+    auto node_indices = compute_node_index_data(h.descriptor, nodes, bricks);
+
+    auto v = vectors{std::move(nodes),
+                     compute_boundary_coefficients(
+                             scene.get_surfaces(),
+                             compute_sample_rate(h.descriptor, speed_of_sound)),
+                     std::move(boundary_indices),
+                     std::move(node_indices),
+                     std::move(bricks)};
+
+    return voxels_and_mesh{std::move(voxels),
+                           mesh{h.descriptor, std::move(v)}};
+}
+
+voxels_and_mesh compute_voxels_and_mesh(const core::compute_context& cc,
+                                        const core::gpu_scene_data& scene,
+                                        const glm::vec3& anchor,
+                                        double sample_rate,
+                                        double speed_of_sound,
+                                        const std::string& cache_directory,
+                                        bool allow_compaction) {
+    const auto key = compute_mesh_cache_key(
+            scene,
+            anchor,
+            sample_rate,
+            speed_of_sound,
+            allow_compaction ? std::experimental::make_optional(
+                                       compute_brick_order(cc))
+                             : std::experimental::nullopt);
+
+    std::ostringstream path;
+    path << cache_directory << '/' << std::hex << std::setw(16)
+         << std::setfill('0') << key << ".mesh";
+
+    if (auto cached = read_mesh_cache(path.str(), key, scene, speed_of_sound)) {
+        return std::move(*cached);
+    }
+
+    auto ret = compute_voxels_and_mesh(cc,
+                                       scene,
+                                       anchor,
+                                       sample_rate,
+                                       speed_of_sound,
+                                       stencil::rectilinear,
+                                       allow_compaction);
+
+    //  The mesh is fine even if it can't be stored (e.g. the disk is full),
+    //  so just carry on without the cache.
+    try {
+        write_mesh_cache(path.str(), key, ret);
+    } catch (const std::exception& e) {
+        std::cerr << "Not caching mesh: " << e.what() << '\n';
+    }
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
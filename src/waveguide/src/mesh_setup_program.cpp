@@ -139,6 +139,128 @@ kernel void set_node_inside(global condensed_node* nodes,
     }
 }
 
+#define MAX_COLUMN_CROSSINGS 64
+
+//  Finds the distances along a ray to every surface it crosses.
+//  Returns the number of crossings, or ~(uint)(0) if any crossing is
+//  degenerate (near an edge or vertex) or there are too many to store.
+uint find_crossings(ray r,
+                    const global uint* voxel_index,
+                    aabb global_aabb,
+                    uint side,
+                    const global triangle* triangles,
+                    const global float3* vertices,
+                    float* crossings);
+uint find_crossings(ray r,
+                    const global uint* voxel_index,
+                    aabb global_aabb,
+                    uint side,
+                    const global triangle* triangles,
+                    const global float3* vertices,
+                    float* crossings) {
+    uint count = 0;
+
+    VOXEL_TRAVERSAL_ALGORITHM(for (uint i = 0; i != num_triangles; ++i) {
+        const uint tri_ind = voxel_begin[i];
+        const triangle tri = triangles[tri_ind];
+        const triangle_inter inter = triangle_intersection(tri, vertices, r);
+        if (inter.t) {
+            if (is_degenerate(inter)) {
+                return ~(uint)(0);
+            }
+            if (prev_max < inter.t && inter.t <= max_dist_inside_voxel) {
+                if (count == MAX_COLUMN_CROSSINGS) {
+                    return ~(uint)(0);
+                }
+                crossings[count++] = inter.t;
+            }
+        }
+    })
+
+    return count;
+}
+
+//  Classifies a whole column of nodes (all z, for one x and y) with a
+//  single ray cast along +z from the bottom node.
+//  A node is inside if an odd number of crossings lie above it, which is
+//  the same test that voxel_inside makes, but sharing one traversal between
+//  every node in the column.
+//  If the ray is degenerate, every node in the column falls back to
+//  voxel_inside. A node lying on a crossing falls back on its own.
+kernel void set_column_inside(global condensed_node* nodes,
+                              const mesh_descriptor descriptor,
+
+                              const global uint* voxel_index,  //  voxel
+                              aabb global_aabb,
+                              uint side,
+
+                              const global triangle* triangles,  //  scene
+                              const global float3* vertices) {
+    const size_t thread = get_global_id(0);
+    const int3 dim = descriptor.dimensions;
+    const int x = thread % dim.x;
+    const int y = thread / dim.x;
+
+    const float3 origin = compute_node_position(descriptor, (int3)(x, y, 0));
+    const ray r = {origin, (float3)(0, 0, 1)};
+
+    float crossings[MAX_COLUMN_CROSSINGS];
+    const uint count = find_crossings(
+            r, voxel_index, global_aabb, side, triangles, vertices, crossings);
+
+    if (count == ~(uint)(0)) {
+        for (int z = 0; z != dim.z; ++z) {
+            const int3 locator = (int3)(x, y, z);
+            const bool inside =
+                    voxel_inside(compute_node_position(descriptor, locator),
+                                 voxel_index,
+                                 global_aabb,
+                                 side,
+                                 triangles,
+                                 vertices);
+            nodes[to_index(locator, dim)] =
+                    (condensed_node){inside ? id_inside : id_none};
+        }
+        return;
+    }
+
+    //  Sort the crossings by distance. There are only ever a few of them.
+    for (uint i = 1; i < count; ++i) {
+        const float t = crossings[i];
+        uint j = i;
+        for (; j != 0 && t < crossings[j - 1]; --j) {
+            crossings[j] = crossings[j - 1];
+        }
+        crossings[j] = t;
+    }
+
+    //  Walk up the column, keeping track of the first crossing above the
+    //  current node.
+    const float tolerance = descriptor.spacing * 1.0e-4f;
+    uint above = 0;
+    for (int z = 0; z != dim.z; ++z) {
+        const int3 locator = (int3)(x, y, z);
+        const float3 position = compute_node_position(descriptor, locator);
+        const float t = position.z - origin.z;
+        while (above != count && crossings[above] <= t) {
+            ++above;
+        }
+
+        const bool on_crossing =
+                (above != count && crossings[above] - t < tolerance) ||
+                (above != 0 && t - crossings[above - 1] < tolerance);
+        const bool inside = on_crossing ? voxel_inside(position,
+                                                       voxel_index,
+                                                       global_aabb,
+                                                       side,
+                                                       triangles,
+                                                       vertices)
+                                        : (count - above) % 2;
+        nodes[to_index(locator, dim)] =
+                (condensed_node){inside ? id_inside : id_none};
+    }
+}
+
 kernel void set_node_boundary_type(global condensed_node* nodes,
                                    const mesh_descriptor descriptor) {
     const size_t thread = get_global_id(0);
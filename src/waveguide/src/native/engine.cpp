@@ -0,0 +1,688 @@
+#include "waveguide/native/engine.h"
+#include "waveguide/cl/utils.h"
+#include "waveguide/waveguide.h"
+
+#include "utilities/map_to_vector.h"
+#include "utilities/string_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace wayverb {
+namespace waveguide {
+namespace native {
+
+namespace {
+
+//  These must match the definitions in program.cpp.
+const float courant = 1.0f / std::sqrt(3.0f);
+constexpr float courant_sq = 1.0f / 3.0f;
+
+/// Runs a filter whose coefficients are zero above order `used`.
+/// The delay line above `used` stays at zero, so it is skipped.
+template <size_t used, size_t order>
+filt_real filter_step(filt_real input,
+                      memory<order>& m,
+                      const coefficients<order>& c) {
+    //  Zero coefficients are skipped so that an infinite input or output
+    //  doesn't produce a nan.
+    const auto weight = [](filt_real coeff, filt_real x) {
+        return coeff == 0 ? filt_real{0} : coeff * x;
+    };
+    const auto output = (input * c.b[0] + m.array[0]) / c.a[0];
+    for (auto i = 0u; i != used; ++i) {
+        m.array[i] = weight(c.b[i + 1], input) - weight(c.a[i + 1], output) +
+                     (i + 1 != used ? m.array[i + 1] : 0);
+    }
+    return output;
+}
+
+/// Picks the cheapest filter update which will give the right answer.
+template <size_t order>
+filt_real filter_step(filt_real input,
+                      memory<order>& m,
+                      const coefficients<order>& c,
+                      size_t used) {
+    switch (used) {
+        case 0: return filter_step<0>(input, m, c);
+        case 1:
+        case 2: return filter_step<2>(input, m, c);
+        default: return filter_step<order>(input, m, c);
+    }
+}
+
+cl_int classify_non_finite(float f) {
+    if (std::isinf(f)) {
+        return id_inf_error;
+    }
+    if (std::isnan(f)) {
+        return id_nan_error;
+    }
+    return id_success;
+}
+
+/// Branch-free, so that it can be used inside vectorised loops.
+unsigned is_non_finite(float f) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return (bits & 0x7f800000u) == 0x7f800000u;
+}
+
+//  Port numbers are in the same order as PortDirection in the kernel:
+//  nx, px, ny, py, nz, pz.
+constexpr size_t port_axis(size_t port) { return port / 2; }
+
+float normal_update(const std::array<cl_uint, num_ports>& neighbors,
+                    const float* current,
+                    float prev_pressure) {
+    float ret = 0;
+    for (auto i : neighbors) {
+        if (i != no_neighbor) {
+            ret += current[i];
+        }
+    }
+    ret /= num_ports / 2;
+    ret -= prev_pressure;
+    return ret;
+}
+
+/// Flags surrounding nodes in the boundary plane which shouldn't be there.
+/// These depend only on the mesh, so can be found once up-front.
+cl_int compute_surrounding_errors(
+        const util::aligned::vector<condensed_node>& nodes,
+        size_t index,
+        const std::array<cl_uint, num_ports>& neighbors) {
+    const auto boundary_type = nodes[index].boundary_type;
+    auto ret = cl_int{id_success};
+    for (auto port = 0u; port != num_ports; ++port) {
+        const auto axis_bits = port_index_to_boundary_type(port & ~1u) |
+                               port_index_to_boundary_type(port | 1u);
+        const auto neighbor = neighbors[port];
+        if (!(boundary_type & axis_bits) && neighbor != no_neighbor) {
+            const auto t = nodes[neighbor].boundary_type;
+            if (t == id_none || t == id_inside) {
+                ret |= id_suspicious_boundary_error;
+            }
+        }
+    }
+    return ret;
+}
+
+template <size_t D>
+float boundary_update(const std::array<cl_uint, num_ports>& neighbors,
+                      const condensed_node& node,
+                      cl_int surrounding_errors,
+                      const float* current,
+                      float prev_pressure,
+                      boundary_data_array<D>& bda,
+                      const coefficients_canonical* boundary_coefficients,
+                      const size_t* coefficient_orders,
+                      cl_int& error_flag) {
+    //  Find the directions which point back into the mesh.
+    std::array<size_t, D> inner{};
+    auto num_inner = 0u;
+    for (auto i = 0u; i != num_ports && num_inner != D; ++i) {
+        if (node.boundary_type & port_index_to_boundary_type(i)) {
+            inner[num_inner++] = i;
+        }
+    }
+
+    const auto get_inner_pressure = [&](size_t port) {
+        const auto neighbor = neighbors[port];
+        if (neighbor == no_neighbor) {
+            error_flag |= id_outside_mesh_error;
+            return 0.0f;
+        }
+        return current[neighbor];
+    };
+
+    const auto on_inner_axis = [&](size_t port) {
+        return std::any_of(begin(inner), end(inner), [&](auto i) {
+            return port_axis(i) == port_axis(port);
+        });
+    };
+
+    //  Corners have no surrounding nodes on the boundary plane.
+    const auto get_summed_surrounding = [&] {
+        float ret = 0;
+        if (D == 3) {
+            return ret;
+        }
+        error_flag |= surrounding_errors;
+        for (auto port = 0u; port != num_ports; ++port) {
+            if (on_inner_axis(port)) {
+                continue;
+            }
+            const auto neighbor = neighbors[port];
+            if (neighbor == no_neighbor) {
+                error_flag |= id_outside_mesh_error;
+                return 0.0f;
+            }
+            ret += current[neighbor];
+        }
+        return ret;
+    };
+
+    const auto current_surrounding_weighting = [&] {
+        float sum = 0;
+        for (auto i : inner) {
+            sum += 2 * get_inner_pressure(i);
+        }
+        return courant_sq * (sum + get_summed_surrounding());
+    }();
+
+    const auto filter_weighting = [&] {
+        float sum = 0;
+        for (const auto& bd : bda.array) {
+            sum += bd.filter_memory.array[0] /
+                   boundary_coefficients[bd.coefficient_index].b[0];
+        }
+        return courant_sq * sum;
+    }();
+
+    const auto coeff_weighting = [&] {
+        float sum = 0;
+        for (const auto& bd : bda.array) {
+            const auto& boundary = boundary_coefficients[bd.coefficient_index];
+            sum += boundary.a[0] / boundary.b[0];
+        }
+        return sum * courant;
+    }();
+
+    const auto prev_weighting = (coeff_weighting - 1) * prev_pressure;
+    const auto ret = (current_surrounding_weighting + filter_weighting +
+                      prev_weighting) /
+                     (1 + coeff_weighting);
+
+    //  Update the ghost points.
+    for (auto& bd : bda.array) {
+        const auto& boundary = boundary_coefficients[bd.coefficient_index];
+        const filt_real filt_state = bd.filter_memory.array[0];
+        const filt_real diff =
+                (boundary.a[0] * (prev_pressure - ret)) /
+                        (boundary.b[0] * courant) +
+                (filt_state / boundary.b[0]);
+        filter_step(-diff,
+                    bd.filter_memory,
+                    boundary,
+                    coefficient_orders[bd.coefficient_index]);
+    }
+
+    return ret;
+}
+
+/// The plain rectilinear update for a run of nodes, none of which are on the
+/// edge of the mesh.
+/// Returns non-zero if any of the updated values are nan or inf.
+unsigned interior_update(float* previous,
+                         const float* current,
+                         size_t begin,
+                         size_t end,
+                         size_t stride_y,
+                         size_t stride_z) {
+    auto non_finite = 0u;
+    for (auto i = begin; i != end; ++i) {
+        const auto next =
+                (current[i - 1] + current[i + 1] + current[i - stride_y] +
+                 current[i + stride_y] + current[i - stride_z] +
+                 current[i + stride_z]) /
+                        (num_ports / 2) -
+                previous[i];
+        previous[i] = next;
+        non_finite |= is_non_finite(next);
+    }
+    return non_finite;
+}
+
+/// The plain rectilinear update for a run of nodes in compacted storage,
+/// none of which are on the edge of the mesh.
+/// Neighbours in the same brick are found directly, and the rest through the
+/// neighbouring brick's slot.
+/// Returns non-zero if any of the updated values are nan or inf.
+unsigned interior_update(
+        float* previous,
+        const float* current,
+        size_t begin,
+        size_t end,
+        const std::array<cl_uint, num_ports>* slot_neighbors) {
+    constexpr size_t size = brick_map::brick_size;
+    constexpr size_t volume = brick_map::brick_volume;
+
+    //  For each axis, the distance between neighbouring nodes in a brick.
+    constexpr std::array<size_t, 3> strides{{1, size, size * size}};
+
+    auto non_finite = 0u;
+    for (auto i = begin; i != end; ++i) {
+        const auto slot = i / volume;
+        const auto offset = i % volume;
+        const auto& neighbor_slots = slot_neighbors[slot];
+
+        float sum = 0;
+        for (auto axis = 0u; axis != 3; ++axis) {
+            const auto stride = strides[axis];
+            const auto position = offset / stride % size;
+            //  Stepping off the edge of a brick lands on the opposite face
+            //  of the neighbouring brick.
+            const auto wrap = stride * (size - 1);
+            sum += current[position ? i - stride
+                                    : neighbor_slots[2 * axis] * volume +
+                                              offset + wrap];
+            sum += current[position != size - 1
+                                   ? i + stride
+                                   : neighbor_slots[2 * axis + 1] * volume +
+                                             offset - wrap];
+        }
+
+        const auto next = sum / (num_ports / 2) - previous[i];
+        previous[i] = next;
+        non_finite |= is_non_finite(next);
+    }
+    return non_finite;
+}
+
+}  // namespace
+
+engine::engine(const mesh& mesh, size_t threads)
+        : descriptor_{mesh.get_descriptor()}
+        , num_nodes_{mesh.get_structure().get_condensed_nodes().size()}
+        , coefficients_{mesh.get_structure().get_coefficients()}
+        , coefficient_orders_{util::map_to_vector(
+                  begin(coefficients_),
+                  end(coefficients_),
+                  [](const auto& i) { return effective_order(i); })}
+        , boundary_data_1_{get_boundary_data<1>(mesh.get_structure())}
+        , boundary_data_2_{get_boundary_data<2>(mesh.get_structure())}
+        , boundary_data_3_{get_boundary_data<3>(mesh.get_structure())}
+        , pool_{threads} {
+    const auto& bricks = mesh.get_structure().get_brick_map();
+    if (bricks && bricks->order != brick_order::linear) {
+        throw std::runtime_error{
+                "The native backend needs compacted meshes to use linear "
+                "brick order."};
+    }
+
+    //  One slab per z-plane, or per layer of bricks.
+    //  This gives plenty of slabs to share out between threads, and keeps the
+    //  working set of step_blocked small.
+    if (bricks) {
+        //  In linear order, each layer's bricks follow on from the layer
+        //  below, after the empty brick.
+        const size_t layer_size = bricks->dimensions.x * bricks->dimensions.y;
+        auto next_slot = size_t{1};
+        for (auto layer = 0; layer != bricks->dimensions.z; ++layer) {
+            slab_offsets_.emplace_back(next_slot * brick_map::brick_volume);
+            next_slot += std::count_if(
+                    begin(bricks->slots) + layer * layer_size,
+                    begin(bricks->slots) + (layer + 1) * layer_size,
+                    [](auto i) { return i != 0; });
+        }
+        slab_offsets_.emplace_back(next_slot * brick_map::brick_volume);
+
+        const auto brick_locator = [&](size_t brick) {
+            const auto x = div(static_cast<int>(brick), bricks->dimensions.x);
+            const auto y = div(x.quot, bricks->dimensions.y);
+            return glm::ivec3{x.rem, y.rem, y.quot};
+        };
+        slot_neighbors_.resize(bricks->num_slots);
+        for (auto slot = 1u; slot != bricks->num_slots; ++slot) {
+            const auto locator = brick_locator(bricks->bricks[slot]);
+            for (auto port = 0u; port != num_ports; ++port) {
+                auto neighbor = locator;
+                neighbor[port_axis(port)] += port % 2 ? 1 : -1;
+                const auto outside =
+                        glm::any(glm::lessThan(neighbor, glm::ivec3{0})) ||
+                        glm::any(glm::greaterThanEqual(neighbor,
+                                                       bricks->dimensions));
+                slot_neighbors_[slot][port] =
+                        outside ? 0
+                                : bricks->slots[neighbor.x +
+                                                bricks->dimensions.x *
+                                                        (neighbor.y +
+                                                         bricks->dimensions.y *
+                                                                 neighbor.z)];
+            }
+        }
+    } else {
+        const size_t plane_size =
+                descriptor_.dimensions.s[0] * descriptor_.dimensions.s[1];
+        for (auto z = 0; z <= descriptor_.dimensions.s[2]; ++z) {
+            slab_offsets_.emplace_back(z * plane_size);
+        }
+    }
+
+    slabs_.resize(slab_offsets_.size() - 1);
+    slab_errors_.resize(slabs_.size());
+
+    const auto get_slab = [&](size_t index) -> slab& {
+        return slabs_[std::upper_bound(begin(slab_offsets_),
+                                       end(slab_offsets_),
+                                       index) -
+                      begin(slab_offsets_) - 1];
+    };
+
+    //  Neighbours, as storage indices.
+    const auto get_neighbors = [&](size_t index) {
+        if (!bricks) {
+            return compute_neighbors(descriptor_, index);
+        }
+        auto ret = compute_neighbors(
+                descriptor_,
+                compute_index(descriptor_, compute_locator(*bricks, index)));
+        for (auto& i : ret) {
+            if (i != no_neighbor) {
+                i = compute_storage_index(*bricks,
+                                          compute_locator(descriptor_, i));
+            }
+        }
+        return ret;
+    };
+
+    //  The mesh splits rows of interior nodes into short runs for the
+    //  OpenCL kernel. Here, longer runs are better, so join them back up.
+    //  Slabs are contiguous, so a run which doesn't fit in one slab can just
+    //  be split where slabs meet.
+    const auto& node_indices = mesh.get_structure().get_node_indices();
+
+    for (const auto& r : node_indices.interior) {
+        for (size_t begin = r.begin, end = r.begin + r.length; begin != end;) {
+            const auto slab_end = *std::upper_bound(
+                    std::begin(slab_offsets_), std::end(slab_offsets_), begin);
+            const auto run_end = std::min<size_t>(end, slab_end);
+            auto& runs = get_slab(begin).interior;
+            if (!runs.empty() && runs.back().end == begin) {
+                runs.back().end = run_end;
+            } else {
+                runs.emplace_back(run{begin, run_end});
+            }
+            begin = run_end;
+        }
+    }
+
+    const auto& nodes = mesh.get_structure().get_condensed_nodes();
+
+    //  Everything the boundary update needs from the node array is copied
+    //  here, so that the array isn't needed while stepping.
+    const auto add_boundary_nodes = [&](const auto& indices, auto member) {
+        for (const auto index : indices) {
+            const auto neighbors = get_neighbors(index);
+            const auto surrounding_errors =
+                    compute_surrounding_errors(nodes, index, neighbors);
+            (get_slab(index).*member)
+                    .emplace_back(boundary_node{index,
+                                                nodes[index],
+                                                neighbors,
+                                                surrounding_errors});
+        }
+    };
+    add_boundary_nodes(node_indices.boundary_1, &slab::boundary_1);
+    add_boundary_nodes(node_indices.boundary_2, &slab::boundary_2);
+    add_boundary_nodes(node_indices.boundary_3, &slab::boundary_3);
+
+    //  Group boundary nodes by the highest filter order they use, so that
+    //  nodes taking the same path through filter_step are updated together.
+    const auto group_by_order = [&](auto member, const auto& boundary_data) {
+        const auto max_order = [&](const boundary_node& b) {
+            size_t ret = 0;
+            for (const auto& bd : boundary_data[b.node.boundary_index].array) {
+                ret = std::max(ret, coefficient_orders_[bd.coefficient_index]);
+            }
+            return ret;
+        };
+        for (auto& slab : slabs_) {
+            auto& nodes = slab.*member;
+            std::stable_sort(begin(nodes), end(nodes), [&](auto& a, auto& b) {
+                return max_order(a) < max_order(b);
+            });
+        }
+    };
+    group_by_order(&slab::boundary_1, boundary_data_1_);
+    group_by_order(&slab::boundary_2, boundary_data_2_);
+    group_by_order(&slab::boundary_3, boundary_data_3_);
+
+    for (const auto index : node_indices.other) {
+        get_slab(index).other.emplace_back(
+                edge_node{index, get_neighbors(index)});
+    }
+}
+
+error_code engine::step(float* previous, const float* current) {
+    pool_.parallel_for(slabs_.size(), [&](auto i) {
+        slab_errors_[i] = this->step_slab(slabs_[i], previous, current);
+    });
+
+    auto ret = cl_int{id_success};
+    for (const auto& i : slab_errors_) {
+        ret |= i;
+    }
+    return static_cast<error_code>(ret);
+}
+
+error_code engine::step_blocked(float*& previous,
+                                float*& current,
+                                size_t steps,
+                                const slab_callback& callback,
+                                const wavefront_callback& progress) {
+    if (!steps) {
+        return id_success;
+    }
+
+    const auto num_slabs = slabs_.size();
+
+    //  The input to the first step is already complete.
+    callback(0, current, 0, num_nodes_);
+
+    //  Step k reads from buffers[k % 2] and writes to buffers[(k + 1) % 2].
+    const std::array<float*, 2> buffers{{current, previous}};
+    util::aligned::vector<cl_int> step_errors(steps, id_success);
+
+    //  At wavefront w, step k updates slab w - 2k.
+    //  Slab s at step k depends on slabs s - 1 to s + 1 at step k - 1, which
+    //  were all finished by wavefront w - 1.
+    //  The two-slab gap means that steps running at the same time never read
+    //  a slab which another is writing.
+    const auto wavefronts = num_slabs + 2 * (steps - 1);
+    for (auto w = 0ul; w != wavefronts; ++w) {
+        const size_t first_step = w < num_slabs ? 0 : (w - num_slabs) / 2 + 1;
+        const size_t last_step = std::min(steps - 1, w / 2);
+        pool_.parallel_for(last_step + 1 - first_step, [&](auto i) {
+            const auto k = first_step + i;
+            const auto s = w - 2 * k;
+            const auto output = buffers[(k + 1) % 2];
+            step_errors[k] |=
+                    this->step_slab(slabs_[s], output, buffers[k % 2]);
+            if (k + 1 != steps) {
+                callback(k + 1,
+                         output,
+                         slab_offsets_[s],
+                         slab_offsets_[s + 1]);
+            }
+        });
+
+        if (progress) {
+            //  The next wavefront's last step updates slab w + 1 - 2k, and
+            //  its first step reads slab w + 2.
+            const auto lowest = w + 1 - std::min(w + 1, 2 * (steps - 1));
+            progress(lowest ? lowest - 1 : 0, std::min(num_slabs, w + 3));
+        }
+    }
+
+    if (steps % 2) {
+        std::swap(previous, current);
+    }
+
+    auto ret = cl_int{id_success};
+    for (const auto& i : step_errors) {
+        ret |= i;
+    }
+    return static_cast<error_code>(ret);
+}
+
+const mesh_descriptor& engine::get_descriptor() const { return descriptor_; }
+
+size_t engine::get_num_nodes() const { return num_nodes_; }
+
+const util::aligned::vector<size_t>& engine::get_slab_offsets() const {
+    return slab_offsets_;
+}
+
+namespace {
+
+template <typename T>
+size_t size_in_bytes(const util::aligned::vector<T>& t) {
+    return sizeof(T) * t.size();
+}
+
+template <typename T>
+void write_vector(std::ostream& os, const util::aligned::vector<T>& t) {
+    os.write(reinterpret_cast<const char*>(t.data()), size_in_bytes(t));
+}
+
+template <typename T>
+void read_vector(std::istream& is, util::aligned::vector<T>& t) {
+    is.read(reinterpret_cast<char*>(t.data()), size_in_bytes(t));
+}
+
+}  // namespace
+
+size_t engine::get_boundary_state_size() const {
+    return size_in_bytes(boundary_data_1_) + size_in_bytes(boundary_data_2_) +
+           size_in_bytes(boundary_data_3_);
+}
+
+void engine::write_boundary_state(std::ostream& os) const {
+    write_vector(os, boundary_data_1_);
+    write_vector(os, boundary_data_2_);
+    write_vector(os, boundary_data_3_);
+}
+
+void engine::read_boundary_state(std::istream& is) {
+    read_vector(is, boundary_data_1_);
+    read_vector(is, boundary_data_2_);
+    read_vector(is, boundary_data_3_);
+    if (!is) {
+        throw std::runtime_error{"Unable to read boundary filter state."};
+    }
+}
+
+cl_int engine::step_slab(const slab& s, float* previous, const float* current) {
+    auto error_flag = cl_int{id_success};
+
+    const size_t stride_y = descriptor_.dimensions.s[0];
+    const size_t stride_z = stride_y * descriptor_.dimensions.s[1];
+    auto non_finite = 0u;
+    for (const auto& r : s.interior) {
+        non_finite |= slot_neighbors_.empty()
+                              ? interior_update(previous,
+                                                current,
+                                                r.begin,
+                                                r.end,
+                                                stride_y,
+                                                stride_z)
+                              : interior_update(previous,
+                                                current,
+                                                r.begin,
+                                                r.end,
+                                                slot_neighbors_.data());
+    }
+
+    //  Only go back and find out exactly what went wrong if something did.
+    if (non_finite) {
+        for (const auto& r : s.interior) {
+            for (auto i = r.begin; i != r.end; ++i) {
+                error_flag |= classify_non_finite(previous[i]);
+            }
+        }
+    }
+
+    const auto update_boundaries = [&](const auto& boundary_nodes,
+                                       auto& boundary_data) {
+        for (const auto& b : boundary_nodes) {
+            const auto next_pressure =
+                    boundary_update(b.neighbors,
+                                    b.node,
+                                    b.surrounding_errors,
+                                    current,
+                                    previous[b.index],
+                                    boundary_data[b.node.boundary_index],
+                                    coefficients_.data(),
+                                    coefficient_orders_.data(),
+                                    error_flag);
+            error_flag |= classify_non_finite(next_pressure);
+            previous[b.index] = next_pressure;
+        }
+    };
+    update_boundaries(s.boundary_1, boundary_data_1_);
+    update_boundaries(s.boundary_2, boundary_data_2_);
+    update_boundaries(s.boundary_3, boundary_data_3_);
+
+    //  Inside nodes on the edge of the mesh might have missing neighbours.
+    for (const auto& e : s.other) {
+        const auto next_pressure =
+                normal_update(e.neighbors, current, previous[e.index]);
+        error_flag |= classify_non_finite(next_pressure);
+        previous[e.index] = next_pressure;
+    }
+
+    return error_flag;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+util::aligned::vector<float> run_blocked(
+        engine& engine,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        size_t block_size,
+        const std::atomic_bool& keep_going) {
+    if (!block_size) {
+        throw std::runtime_error{"Block size must be greater than zero."};
+    }
+
+    util::aligned::vector<float> previous_storage(engine.get_num_nodes(), 0);
+    util::aligned::vector<float> current_storage(engine.get_num_nodes(), 0);
+    auto previous = previous_storage.data();
+    auto current = current_storage.data();
+
+    util::aligned::vector<float> ret;
+    auto step = 0ul;
+    while (keep_going && step != signal.size()) {
+        const auto steps = std::min(block_size, signal.size() - step);
+        ret.resize(ret.size() + steps * taps.size());
+        const auto output = ret.data() + step * taps.size();
+
+        const auto error_flag = engine.step_blocked(
+                previous,
+                current,
+                steps,
+                [&](auto i, auto pressures, auto begin, auto end) {
+                    if (begin <= source && source < end) {
+                        pressures[source] = signal[step + i];
+                    }
+                    for (auto j = 0u; j != taps.size(); ++j) {
+                        if (begin <= taps[j] && taps[j] < end) {
+                            output[i * taps.size() + j] = pressures[taps[j]];
+                        }
+                    }
+                });
+
+        detail::throw_if_error(error_flag,
+                               util::build_string(" between steps ",
+                                                  step,
+                                                  " and ",
+                                                  step + steps - 1));
+
+        step += steps;
+    }
+
+    return ret;
+}
+
+}  // namespace native
+}  // namespace waveguide
+}  // namespace wayverb
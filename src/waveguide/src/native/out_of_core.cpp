@@ -0,0 +1,282 @@
+#include "waveguide/native/out_of_core.h"
+#include "waveguide/waveguide.h"
+
+#include "utilities/string_builder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace wayverb {
+namespace waveguide {
+namespace native {
+
+namespace {
+
+std::runtime_error make_system_error(const char* what) {
+    return std::runtime_error{util::build_string(what, ": ", strerror(errno))};
+}
+
+/// An array of floats backed by an unlinked temporary file.
+/// The file starts out full of zeros, and goes away with the mapping.
+///
+/// Unmapping pages isn't enough to free their memory, because the file's
+/// pages stay in the page cache. Evicted pages are written back
+/// synchronously, so that they are clean, and then dropped from the cache.
+class mapped_buffer final {
+public:
+    mapped_buffer(const std::string& directory, size_t size)
+            : bytes_{std::max(size_t{1}, size) * sizeof(float)}
+            , page_size_{static_cast<size_t>(sysconf(_SC_PAGESIZE))} {
+        auto path = directory + "/wayverb_pressure_XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.emplace_back('\0');
+
+        const auto fd = mkstemp(name.data());
+        if (fd == -1) {
+            throw make_system_error("Unable to create pressure file");
+        }
+        unlink(name.data());
+
+        if (ftruncate(fd, bytes_) == -1) {
+            close(fd);
+            throw make_system_error("Unable to size pressure file");
+        }
+
+        data_ = mmap(
+                nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data_ == MAP_FAILED) {
+            close(fd);
+            throw make_system_error("Unable to map pressure file");
+        }
+        fd_ = fd;
+
+        //  Pages are only read where prefetch asks for them, rather than
+        //  around every fault.
+        madvise(data_, bytes_, MADV_RANDOM);
+    }
+
+    mapped_buffer(const mapped_buffer&) = delete;
+    mapped_buffer& operator=(const mapped_buffer&) = delete;
+
+    ~mapped_buffer() noexcept {
+        munmap(data_, bytes_);
+        close(fd_);
+    }
+
+    float* data() { return static_cast<float*>(data_); }
+
+    /// Asks for the floats in [begin, end) to be read in the background.
+    void prefetch(size_t begin, size_t end) {
+        const auto range = page_range(begin, end, true);
+        if (range.second) {
+            madvise(range.first, range.second, MADV_WILLNEED);
+        }
+    }
+
+    /// Writes back the floats in [begin, end), and releases their memory.
+    /// Everything before `begin` must already be finished with.
+    void evict(size_t begin, size_t end) {
+        //  A page which straddles `end` is still in use, so it is left for
+        //  the next eviction.
+        const auto range = page_range(begin, end, false);
+        if (range.second) {
+            if (msync(range.first, range.second, MS_SYNC) == -1) {
+                throw make_system_error("Unable to write pressure file");
+            }
+            //  The cache can only drop pages which nothing maps.
+            madvise(range.first, range.second, MADV_DONTNEED);
+            posix_fadvise(fd_,
+                          range.first - static_cast<char*>(data_),
+                          range.second,
+                          POSIX_FADV_DONTNEED);
+        }
+    }
+
+    /// The number of bytes of the file currently held in memory.
+    size_t get_resident_bytes() const {
+        std::vector<unsigned char> pages((bytes_ + page_size_ - 1) /
+                                         page_size_);
+        if (mincore(data_, bytes_, pages.data()) == -1) {
+            throw make_system_error("Unable to query pressure file");
+        }
+        return std::count_if(pages.begin(),
+                             pages.end(),
+                             [](auto i) { return i & 1; }) *
+               page_size_;
+    }
+
+private:
+    /// Only whole pages can be advised on.
+    std::pair<char*, size_t> page_range(size_t begin,
+                                        size_t end,
+                                        bool round_end_up) const {
+        const auto first = begin * sizeof(float) / page_size_ * page_size_;
+        const auto end_bytes = end * sizeof(float);
+        const auto last =
+                bytes_ <= end_bytes
+                        ? bytes_
+                        : (end_bytes + (round_end_up ? page_size_ - 1 : 0)) /
+                                  page_size_ * page_size_;
+        return {static_cast<char*>(data_) + first,
+                first < last ? last - first : 0};
+    }
+
+    size_t bytes_;
+    size_t page_size_;
+    int fd_;
+    void* data_;
+};
+
+}  // namespace
+
+class pressure_files::impl final {
+public:
+    impl(const engine& engine, const out_of_core_parameters& params)
+            : plane_offsets_{engine.get_slab_offsets()}
+            , num_planes_{plane_offsets_.size() - 1}
+            , slab_planes_{params.planes_per_slab}
+            , storage_{{{params.scratch_directory, engine.get_num_nodes()},
+                        {params.scratch_directory, engine.get_num_nodes()}}} {
+        if (!slab_planes_) {
+            throw std::runtime_error{"Slabs must hold at least one plane."};
+        }
+    }
+
+    float* get_field(size_t i) { return storage_[i].data(); }
+
+    void begin_pass() {
+        //  Keep one slab requested ahead of the wavefront, so that it is
+        //  being read while the current one is updated.
+        requested_ = std::min(num_planes_, 2 * slab_planes_);
+        for_each_buffer(&mapped_buffer::prefetch, 0, requested_);
+        evicted_ = 0;
+    }
+
+    void advance(size_t begin, size_t end) {
+        while (requested_ < num_planes_ && requested_ < end + slab_planes_) {
+            for_each_buffer(&mapped_buffer::prefetch,
+                            requested_,
+                            requested_ + slab_planes_);
+            requested_ += slab_planes_;
+        }
+        while (evicted_ + slab_planes_ <= begin) {
+            for_each_buffer(&mapped_buffer::evict,
+                            evicted_,
+                            evicted_ + slab_planes_);
+            evicted_ += slab_planes_;
+        }
+    }
+
+    void end_pass() {
+        //  The next pass starts from the bottom again, so there's no point
+        //  keeping the top of the mesh around.
+        for_each_buffer(&mapped_buffer::evict, evicted_, num_planes_);
+        evicted_ = num_planes_;
+    }
+
+    size_t get_resident_bytes() const {
+        return storage_[0].get_resident_bytes() +
+               storage_[1].get_resident_bytes();
+    }
+
+private:
+    template <typename Member>
+    void for_each_buffer(Member member, size_t begin, size_t end) {
+        for (auto& i : storage_) {
+            (i.*member)(plane_offsets_[begin],
+                        plane_offsets_[std::min(end, num_planes_)]);
+        }
+    }
+
+    /// Where each of the engine's slabs starts.
+    util::aligned::vector<size_t> plane_offsets_;
+    size_t num_planes_;
+    size_t slab_planes_;
+    std::array<mapped_buffer, 2> storage_;
+    size_t requested_{0};
+    size_t evicted_{0};
+};
+
+pressure_files::pressure_files(const engine& engine,
+                               const out_of_core_parameters& params)
+        : pimpl_{std::make_unique<impl>(engine, params)} {}
+
+pressure_files::~pressure_files() noexcept = default;
+
+float* pressure_files::get_field(size_t i) { return pimpl_->get_field(i); }
+void pressure_files::begin_pass() { pimpl_->begin_pass(); }
+void pressure_files::advance(size_t begin, size_t end) {
+    pimpl_->advance(begin, end);
+}
+void pressure_files::end_pass() { pimpl_->end_pass(); }
+size_t pressure_files::get_resident_bytes() const {
+    return pimpl_->get_resident_bytes();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+util::aligned::vector<float> run_out_of_core(
+        engine& engine,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        const out_of_core_parameters& params,
+        const std::atomic_bool& keep_going) {
+    if (!params.block_size) {
+        throw std::runtime_error{"Block size must be greater than zero."};
+    }
+
+    pressure_files files{engine, params};
+    auto previous = files.get_field(0);
+    auto current = files.get_field(1);
+
+    util::aligned::vector<float> ret;
+    auto step = 0ul;
+    while (keep_going && step != signal.size()) {
+        const auto steps = std::min(params.block_size, signal.size() - step);
+        ret.resize(ret.size() + steps * taps.size());
+        const auto output = ret.data() + step * taps.size();
+
+        //  Every pass starts again from the bottom of the mesh.
+        files.begin_pass();
+        const auto error_flag = engine.step_blocked(
+                previous,
+                current,
+                steps,
+                [&](auto i, auto pressures, auto begin, auto end) {
+                    if (begin <= source && source < end) {
+                        pressures[source] = signal[step + i];
+                    }
+                    for (auto j = 0u; j != taps.size(); ++j) {
+                        if (begin <= taps[j] && taps[j] < end) {
+                            output[i * taps.size() + j] = pressures[taps[j]];
+                        }
+                    }
+                },
+                [&](auto begin, auto end) { files.advance(begin, end); });
+        files.end_pass();
+
+        detail::throw_if_error(error_flag,
+                               util::build_string(" between steps ",
+                                                  step,
+                                                  " and ",
+                                                  step + steps - 1));
+
+        step += steps;
+    }
+
+    return ret;
+}
+
+}  // namespace native
+}  // namespace waveguide
+}  // namespace wayverb
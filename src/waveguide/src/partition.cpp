@@ -0,0 +1,434 @@
+#include "waveguide/partition.h"
+#include "waveguide/boundary_coefficient_finder.h"
+#include "waveguide/postprocessor/taps.h"
+#include "waveguide/preprocessor/device_sources.h"
+#include "waveguide/stepper.h"
+#include "waveguide/tap_program.h"
+#include "waveguide/waveguide.h"
+
+#include "core/conversions.h"
+
+#include "utilities/string_builder.h"
+#include "utilities/thread_pool.h"
+
+#include <array>
+#include <memory>
+
+namespace wayverb {
+namespace waveguide {
+namespace {
+
+size_t find_longest_axis(const mesh_descriptor& descriptor) {
+    const auto& dim = descriptor.dimensions.s;
+    return std::max_element(dim, dim + 3) - dim;
+}
+
+template <size_t n>
+void copy_boundary_node(const vectors& full,
+                        condensed_node& node,
+                        util::aligned::vector<boundary_index_array<n>>& out) {
+    out.emplace_back(full.get_boundary_indices<n>()[node.boundary_index]);
+    node.boundary_index = out.size() - 1;
+}
+
+partition make_partition(const mesh& full,
+                         size_t axis,
+                         size_t begin,
+                         size_t end) {
+    const auto& full_descriptor = full.get_descriptor();
+    const auto& full_structure = full.get_structure();
+    const size_t planes = full_descriptor.dimensions.s[axis];
+
+    //  Add a halo plane on each side which borders another slab.
+    const auto offset = begin ? begin - 1 : 0;
+    const auto last = std::min(end + 1, planes);
+
+    auto descriptor = full_descriptor;
+    descriptor.min_corner.s[axis] += offset * descriptor.spacing;
+    descriptor.dimensions.s[axis] = last - offset;
+
+    //  The slab is built uncompacted, and compacted afterwards if the full
+    //  mesh was.
+    util::aligned::vector<condensed_node> nodes;
+    nodes.reserve(compute_num_nodes(descriptor));
+    boundary_index_data boundary_indices;
+
+    const auto dim = core::to_ivec3{}(descriptor.dimensions);
+    for (auto z = 0; z != dim.z; ++z) {
+        for (auto y = 0; y != dim.y; ++y) {
+            for (auto x = 0; x != dim.x; ++x) {
+                auto locator = glm::ivec3{x, y, z};
+                const auto plane = locator[axis] + offset;
+                locator[axis] = plane;
+
+                auto node =
+                        get_node(full, compute_index(full_descriptor, locator));
+
+                if (plane < begin || end <= plane) {
+                    //  Halo nodes must not flag missing neighbours, and
+                    //  must not be flagged as suspicious by owned nodes.
+                    if (is_boundary(node.boundary_type) &&
+                        node.boundary_type != id_none) {
+                        node = condensed_node{id_reentrant, 0};
+                    }
+                } else if (is_boundary<1>(node.boundary_type)) {
+                    copy_boundary_node(
+                            full_structure, node, boundary_indices.b1);
+                } else if (is_boundary<2>(node.boundary_type)) {
+                    copy_boundary_node(
+                            full_structure, node, boundary_indices.b2);
+                } else if (is_boundary<3>(node.boundary_type)) {
+                    copy_boundary_node(
+                            full_structure, node, boundary_indices.b3);
+                }
+
+                nodes.emplace_back(node);
+            }
+        }
+    }
+
+    auto node_indices = compute_node_index_data(descriptor, nodes);
+    auto slab = mesh{descriptor,
+                     vectors{std::move(nodes),
+                             full_structure.get_coefficients(),
+                             std::move(boundary_indices),
+                             std::move(node_indices)},
+                     full.get_stencil()};
+    if (const auto& bricks = full_structure.get_brick_map()) {
+        slab = compact(slab, bricks->order);
+    }
+    return {std::move(slab), axis, offset, begin, end};
+}
+
+/// Whether the slab updates the node at `index` in the full mesh.
+/// Nodes which the slab doesn't store are outside nodes, which never change,
+/// so no slab needs to inject into or record them.
+bool owns(const partition& p, const mesh_descriptor& descriptor, size_t index) {
+    auto locator = compute_locator(descriptor, index);
+    const size_t plane = locator[p.axis];
+    if (plane < p.begin || p.end <= plane) {
+        return false;
+    }
+    locator[p.axis] -= p.offset;
+    return is_stored(p.mesh, compute_index(p.mesh.get_descriptor(), locator));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Runs one slab of a partitioned simulation.
+class slab_runner final {
+public:
+    /// capacity:   the longest batch which will be run
+    slab_runner(const core::compute_context& cc,
+                const mesh_descriptor& full_descriptor,
+                const partition& p,
+                size_t index,
+                size_t source,
+                const util::aligned::vector<float>& signal,
+                const util::aligned::vector<cl_uint>& taps,
+                size_t capacity)
+            : stepper_{cc, p.mesh}
+            , program_{cc}
+            , index_{index} {
+        if (owns(p, full_descriptor, source)) {
+            const auto node =
+                    compute_partition_index(full_descriptor, p, source);
+            sources_ = std::make_unique<preprocessor::device_sources>(
+                    cc,
+                    util::aligned::vector<preprocessor::source_signal>{
+                            {node, signal, preprocessor::injection::hard}});
+        }
+
+        util::aligned::vector<cl_uint> tap_nodes;
+        for (auto i = 0u; i != taps.size(); ++i) {
+            if (owns(p, full_descriptor, taps[i])) {
+                tap_nodes.emplace_back(
+                        compute_partition_index(full_descriptor, p, taps[i]));
+                tap_positions_.emplace_back(i);
+            }
+        }
+        if (!tap_nodes.empty()) {
+            taps_ = std::make_unique<postprocessor::taps>(
+                    cc, std::move(tap_nodes), capacity);
+        }
+
+        const auto planes =
+                static_cast<size_t>(full_descriptor.dimensions.s[p.axis]);
+        if (p.begin != 0) {
+            faces_[0] = std::make_unique<face>(
+                    cc,
+                    compute_plane_indices(p, p.begin),
+                    compute_plane_indices(p, p.begin - 1));
+        }
+        if (p.end != planes) {
+            faces_[1] = std::make_unique<face>(
+                    cc,
+                    compute_plane_indices(p, p.end - 1),
+                    compute_plane_indices(p, p.end));
+        }
+    }
+
+    void begin_batch() { stepper_.reset_error_flag(); }
+
+    /// Injects the source, records the taps and computes the next step.
+    /// Then copies the planes needed by the neighbouring slabs to host
+    /// memory, and waits for just those copies.
+    void step(size_t step) {
+        auto& queue = stepper_.get_queue();
+
+        if (sources_) {
+            (*sources_)(queue, stepper_.get_current(), step);
+        }
+
+        if (taps_) {
+            (*taps_)(queue, stepper_.get_current(), step);
+        }
+
+        stepper_.enqueue_update();
+
+        for (const auto& f : faces_) {
+            if (f) {
+                gather_(cl::EnqueueArgs{queue,
+                                        cl::NDRange{f->outgoing.size()}},
+                        stepper_.get_previous(),
+                        f->send_nodes,
+                        f->buffer,
+                        0);
+                queue.enqueueReadBuffer(f->buffer,
+                                        CL_FALSE,
+                                        0,
+                                        sizeof(cl_float) * f->outgoing.size(),
+                                        f->outgoing.data(),
+                                        nullptr,
+                                        &f->sent);
+            }
+        }
+
+        for (const auto& f : faces_) {
+            if (f) {
+                f->sent.wait();
+            }
+        }
+    }
+
+    /// Copies in the planes sent by the neighbouring slabs, and swaps
+    /// buffers ready for the next step.
+    void exchange(const slab_runner* lower, const slab_runner* upper) {
+        auto& queue = stepper_.get_queue();
+
+        //  The neighbour overwrites its outgoing plane during its next step,
+        //  so this write has to block.
+        const auto receive = [&](face& f, const face& from) {
+            queue.enqueueWriteBuffer(f.buffer,
+                                     CL_TRUE,
+                                     0,
+                                     sizeof(cl_float) * from.outgoing.size(),
+                                     from.outgoing.data());
+            scatter_(cl::EnqueueArgs{queue, cl::NDRange{f.outgoing.size()}},
+                     stepper_.get_previous(),
+                     f.receive_nodes,
+                     f.buffer,
+                     0);
+        };
+
+        if (lower) {
+            receive(*faces_[0], *lower->faces_[1]);
+        }
+        if (upper) {
+            receive(*faces_[1], *upper->faces_[0]);
+        }
+
+        stepper_.swap();
+    }
+
+    /// Checks for errors during the batch, and copies the tap pressures
+    /// into their places in `output`.
+    ///
+    /// output:     one row of `num_taps` pressures per step of the batch
+    void finish_batch(size_t first_step,
+                      size_t steps,
+                      size_t num_taps,
+                      float* output) {
+        detail::throw_if_error(stepper_.read_error_flag(),
+                               util::build_string(" in slab ",
+                                                  index_,
+                                                  " between steps ",
+                                                  first_step,
+                                                  " and ",
+                                                  first_step + steps - 1));
+
+        if (taps_) {
+            taps_->finish(stepper_.get_queue(), first_step, steps);
+            const auto pressures =
+                    taps_->get_output().data() +
+                    first_step * tap_positions_.size();
+            for (auto step = 0u; step != steps; ++step) {
+                for (auto i = 0u; i != tap_positions_.size(); ++i) {
+                    output[step * num_taps + tap_positions_[i]] =
+                            pressures[step * tap_positions_.size() + i];
+                }
+            }
+        }
+    }
+
+private:
+    /// The plane sent to a neighbour, and the halo plane received from it.
+    struct face final {
+        face(const core::compute_context& cc,
+             const util::aligned::vector<cl_uint>& send,
+             const util::aligned::vector<cl_uint>& receive)
+                : send_nodes{core::load_to_buffer(cc.context, send, true)}
+                , receive_nodes{core::load_to_buffer(
+                          cc.context, receive, true)}
+                , outgoing(send.size())
+                , buffer{cc.context,
+                         CL_MEM_READ_WRITE,
+                         sizeof(cl_float) * outgoing.size()} {}
+
+        cl::Buffer send_nodes;
+        cl::Buffer receive_nodes;
+        util::aligned::vector<float> outgoing;
+        cl::Buffer buffer;
+        cl::Event sent;
+    };
+
+    stepper stepper_;
+    tap_program program_;
+    decltype(program_.get_gather_kernel()) gather_{
+            program_.get_gather_kernel()};
+    decltype(program_.get_scatter_kernel()) scatter_{
+            program_.get_scatter_kernel()};
+
+    size_t index_;
+    std::unique_ptr<preprocessor::device_sources> sources_;
+    std::unique_ptr<postprocessor::taps> taps_;
+    util::aligned::vector<size_t> tap_positions_;
+
+    std::array<std::unique_ptr<face>, 2> faces_;
+};
+
+}  // namespace
+
+util::aligned::vector<partition> partition_mesh(const mesh& mesh,
+                                                size_t slabs) {
+    const auto& descriptor = mesh.get_descriptor();
+    const auto axis = find_longest_axis(descriptor);
+    const size_t planes = descriptor.dimensions.s[axis];
+
+    if (!slabs || planes < slabs) {
+        throw std::runtime_error{util::build_string("Can't split a mesh with ",
+                                                    planes,
+                                                    " planes into ",
+                                                    slabs,
+                                                    " slabs.")};
+    }
+
+    util::aligned::vector<partition> ret;
+    ret.reserve(slabs);
+    for (auto i = 0u; i != slabs; ++i) {
+        ret.emplace_back(make_partition(mesh,
+                                        axis,
+                                        planes * i / slabs,
+                                        planes * (i + 1) / slabs));
+    }
+    return ret;
+}
+
+size_t compute_partition_index(const mesh_descriptor& descriptor,
+                               const partition& p,
+                               size_t index) {
+    auto locator = compute_locator(descriptor, index);
+    locator[p.axis] -= p.offset;
+    return compute_storage_index(
+            p.mesh, compute_index(p.mesh.get_descriptor(), locator));
+}
+
+util::aligned::vector<cl_uint> compute_plane_indices(const partition& p,
+                                                     size_t plane) {
+    const auto& descriptor = p.mesh.get_descriptor();
+    const auto dim = core::to_ivec3{}(descriptor.dimensions);
+    const auto u = (p.axis + 1) % 3;
+    const auto v = (p.axis + 2) % 3;
+
+    util::aligned::vector<cl_uint> ret;
+    ret.reserve(dim[u] * dim[v]);
+    glm::ivec3 locator;
+    locator[p.axis] = plane - p.offset;
+    for (locator[v] = 0; locator[v] != dim[v]; ++locator[v]) {
+        for (locator[u] = 0; locator[u] != dim[u]; ++locator[u]) {
+            //  Outside nodes are zero in every slab, so they needn't be
+            //  exchanged. Slabs may not even store them.
+            const auto index = compute_index(descriptor, locator);
+            if (get_node(p.mesh, index).boundary_type != id_none) {
+                ret.emplace_back(compute_storage_index(p.mesh, index));
+            }
+        }
+    }
+    return ret;
+}
+
+util::aligned::vector<float> run_partitioned(
+        const util::aligned::vector<core::compute_context>& contexts,
+        const mesh& mesh,
+        size_t source,
+        const util::aligned::vector<float>& signal,
+        const util::aligned::vector<cl_uint>& taps,
+        const std::atomic_bool& keep_going,
+        size_t batch_size) {
+    if (!batch_size) {
+        throw std::runtime_error{"Batch size must be greater than zero."};
+    }
+
+    const auto partitions = partition_mesh(mesh, contexts.size());
+
+    std::vector<std::unique_ptr<slab_runner>> runners;
+    for (auto i = 0u; i != partitions.size(); ++i) {
+        runners.emplace_back(std::make_unique<slab_runner>(
+                contexts[i],
+                mesh.get_descriptor(),
+                partitions[i],
+                i,
+                source,
+                signal,
+                taps,
+                batch_size));
+    }
+
+    util::thread_pool pool{runners.size()};
+
+    util::aligned::vector<float> ret;
+    for (size_t step = 0; keep_going && step != signal.size();) {
+        const auto steps = std::min(batch_size, signal.size() - step);
+
+        pool.parallel_for(runners.size(),
+                          [&](auto i) { runners[i]->begin_batch(); });
+
+        for (auto i = step, e = step + steps; i != e; ++i) {
+            //  Each call to parallel_for waits for every slab to finish, so
+            //  the exchange only starts once every slab has computed its
+            //  next step.
+            pool.parallel_for(runners.size(),
+                              [&](auto j) { runners[j]->step(i); });
+
+            pool.parallel_for(runners.size(), [&](auto j) {
+                runners[j]->exchange(j ? runners[j - 1].get() : nullptr,
+                                     j + 1 != runners.size()
+                                             ? runners[j + 1].get()
+                                             : nullptr);
+            });
+        }
+
+        ret.resize(ret.size() + steps * taps.size());
+        const auto output = ret.data() + step * taps.size();
+        pool.parallel_for(runners.size(), [&](auto i) {
+            runners[i]->finish_batch(step, steps, taps.size(), output);
+        });
+
+        step += steps;
+    }
+
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
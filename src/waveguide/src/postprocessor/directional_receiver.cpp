@@ -1,5 +1,5 @@
 #include "waveguide/postprocessor/directional_receiver.h"
-#include "waveguide/mesh_descriptor.h"
+#include "waveguide/mesh.h"
 
 #include "core/cl/common.h"
 
@@ -26,13 +26,47 @@ directional_receiver::directional_receiver(
     }
 }
 
+directional_receiver::directional_receiver(const mesh& mesh,
+                                           double sample_rate,
+                                           double ambient_density,
+                                           size_t output_node)
+        : directional_receiver{mesh.get_descriptor(),
+                               sample_rate,
+                               ambient_density,
+                               output_node} {
+    //  Find where the nodes are in the pressure buffer.
+    output_node_ = compute_storage_index(mesh, output_node_);
+    for (auto& i : surrounding_nodes_) {
+        i = compute_storage_index(mesh, i);
+    }
+}
+
 directional_receiver::return_type directional_receiver::operator()(
         cl::CommandQueue& queue, const cl::Buffer& buffer, size_t /*unused*/) {
-    //  copy out node pressure
-    const auto pressure =
-            core::read_value<cl_float>(queue, buffer, output_node_);
+    //  copy out node pressure, and surrounding pressures
+    const auto tap_nodes = get_tap_nodes();
+    std::array<cl_float, num_taps> tap_pressures;
+    for (auto i = 0ul; i != num_taps; ++i) {
+        tap_pressures[i] =
+                core::read_value<cl_float>(queue, buffer, tap_nodes[i]);
+    }
+    return integrate(tap_pressures.data());
+}
+
+std::array<cl_uint, directional_receiver::num_taps>
+directional_receiver::get_tap_nodes() const {
+    return {{static_cast<cl_uint>(output_node_),
+             surrounding_nodes_[0],
+             surrounding_nodes_[1],
+             surrounding_nodes_[2],
+             surrounding_nodes_[3],
+             surrounding_nodes_[4],
+             surrounding_nodes_[5]}};
+}
 
-    //  copy out surrounding pressures
+directional_receiver::return_type directional_receiver::integrate(
+        const cl_float* tap_pressures) {
+    const auto pressure = tap_pressures[0];
 
     //  pressure difference vector is obtained by subtracting the central
     //  junction pressure from the pressure values of neighboring junctions
@@ -40,10 +74,7 @@ directional_receiver::return_type directional_receiver::operator()(
     constexpr auto num_surrounding = 6;
     std::array<cl_float, num_surrounding> surrounding;
     for (auto i = 0ul; i != num_surrounding; ++i) {
-        surrounding[i] = (core::read_value<cl_float>(
-                                  queue, buffer, surrounding_nodes_[i]) -
-                          pressure) /
-                         mesh_spacing_;
+        surrounding[i] = (tap_pressures[i + 1] - pressure) / mesh_spacing_;
     }
 
     //  The approximation of the pressure gradient is obtained by
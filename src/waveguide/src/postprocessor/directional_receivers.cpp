@@ -0,0 +1,94 @@
+#include "waveguide/postprocessor/directional_receivers.h"
+#include "waveguide/mesh.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+directional_receivers::directional_receivers(
+        const core::compute_context& cc,
+        const mesh& mesh,
+        double sample_rate,
+        double ambient_density,
+        const util::aligned::vector<size_t>& output_nodes,
+        size_t capacity,
+        size_t bands)
+        : bands_{bands}
+        , receivers_{make_receivers(
+                  mesh, sample_rate, ambient_density, output_nodes, bands)}
+        , taps_{cc, compute_tap_nodes(receivers_, bands), capacity}
+        , outputs_(receivers_.size()) {}
+
+util::aligned::vector<directional_receiver>
+directional_receivers::make_receivers(
+        const mesh& mesh,
+        double sample_rate,
+        double ambient_density,
+        const util::aligned::vector<size_t>& output_nodes,
+        size_t bands) {
+    if (!bands) {
+        throw std::runtime_error{"At least one band is required."};
+    }
+
+    util::aligned::vector<directional_receiver> ret;
+    ret.reserve(output_nodes.size() * bands);
+    for (const auto node : output_nodes) {
+        ret.insert(ret.end(),
+                   bands,
+                   directional_receiver{
+                           mesh, sample_rate, ambient_density, node});
+    }
+    return ret;
+}
+
+//  Each receiver's taps are adjacent, so that they can be integrated straight
+//  out of the tap output.
+//  The pressure of band `b` at storage index `i` is at `i * bands + b`.
+util::aligned::vector<cl_uint> directional_receivers::compute_tap_nodes(
+        const util::aligned::vector<directional_receiver>& receivers,
+        size_t bands) {
+    util::aligned::vector<cl_uint> ret;
+    ret.reserve(receivers.size() * directional_receiver::num_taps);
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        for (const auto node : receivers[i].get_tap_nodes()) {
+            ret.emplace_back(node * bands + i % bands);
+        }
+    }
+    return ret;
+}
+
+void directional_receivers::operator()(cl::CommandQueue& queue,
+                                       const cl::Buffer& buffer,
+                                       size_t step) {
+    taps_(queue, buffer, step);
+}
+
+void directional_receivers::finish(cl::CommandQueue& queue,
+                                   size_t first_step,
+                                   size_t steps) {
+    taps_.finish(queue, first_step, steps);
+
+    const auto num_taps = taps_.get_num_taps();
+    for (auto step = first_step; step != first_step + steps; ++step) {
+        const auto pressures = taps_.get_output().data() + step * num_taps;
+        for (auto i = 0u; i != receivers_.size(); ++i) {
+            outputs_[i].emplace_back(receivers_[i].integrate(
+                    pressures + i * directional_receiver::num_taps));
+        }
+    }
+}
+
+size_t directional_receivers::get_num_receivers() const {
+    return receivers_.size() / bands_;
+}
+
+size_t directional_receivers::get_bands() const { return bands_; }
+
+const util::aligned::vector<directional_receiver::output>&
+directional_receivers::get_output(size_t receiver, size_t band) const {
+    return outputs_[receiver * bands_ + band];
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,124 @@
+#include "waveguide/postprocessor/energy_decay.h"
+
+#include "core/cl/common.h"
+#include "core/linear_regression.h"
+
+#include "utilities/decibels.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+namespace {
+
+//  Each band gets this many threads, so there are this many partial sums per
+//  band to add up on the host.
+constexpr size_t threads_per_band = 256;
+
+}  // namespace
+
+energy_decay::energy_decay(const core::compute_context& cc,
+                           size_t nodes,
+                           size_t bands,
+                           double sample_rate,
+                           const early_termination_parameters& params)
+        : nodes_{nodes}
+        , bands_{bands}
+        , sample_rate_{sample_rate}
+        , params_{params}
+        , threads_{threads_per_band * bands}
+        , partial_buffer_{cc.context,
+                          CL_MEM_READ_WRITE,
+                          sizeof(cl_float) * threads_}
+        , partial_(threads_)
+        , kernel_{energy_program{cc}.get_partial_energy_kernel()}
+        , band_states_(bands)
+        , decay_rates_(bands, 0) {
+    if (!params_.interval || params_.window < 2) {
+        throw std::runtime_error{
+                "Early termination needs a non-zero interval, and a window "
+                "of at least two measurements."};
+    }
+}
+
+void energy_decay::operator()(cl::CommandQueue& queue,
+                              const cl::Buffer& buffer,
+                              size_t step) {
+    if (is_settled_ || (step + 1) % params_.interval) {
+        return;
+    }
+
+    kernel_(cl::EnqueueArgs{queue, cl::NDRange{threads_}},
+            buffer,
+            static_cast<cl_uint>(nodes_),
+            static_cast<cl_uint>(bands_),
+            partial_buffer_);
+    queue.enqueueReadBuffer(partial_buffer_,
+                            CL_TRUE,
+                            0,
+                            sizeof(cl_float) * partial_.size(),
+                            partial_.data());
+
+    auto settled = true;
+    for (auto band = 0u; band != bands_; ++band) {
+        auto energy = 0.0;
+        for (auto i = band; i < threads_; i += bands_) {
+            energy += partial_[i];
+        }
+
+        update(band_states_[band], step, energy);
+
+        if (const auto rate = check_settled(band_states_[band])) {
+            decay_rates_[band] = *rate;
+        } else {
+            settled = false;
+        }
+    }
+
+    is_settled_ = settled;
+}
+
+void energy_decay::update(band_state& band, size_t step, double energy) const {
+    //  Nothing to measure until the impulse has been injected.
+    if (energy <= 0) {
+        return;
+    }
+    const auto level = util::decibels::p2db(energy);
+    band.history.emplace_back((step + 1) / sample_rate_, level);
+    band.peak = std::max(band.peak, level);
+}
+
+std::experimental::optional<double> energy_decay::check_settled(
+        const band_state& band) const {
+    const auto& history = band.history;
+    if (history.size() < 2 * params_.window ||
+        params_.min_decay > band.peak - history.back().y) {
+        return std::experimental::nullopt;
+    }
+
+    const auto current = core::simple_linear_regression(
+            end(history) - params_.window, end(history));
+    const auto previous = core::simple_linear_regression(
+            end(history) - 2 * params_.window, end(history) - params_.window);
+
+    if (!(current.m < 0 && current.r <= -params_.min_correlation &&
+          std::abs(current.m - previous.m) <=
+                  params_.max_slope_change * std::abs(current.m))) {
+        return std::experimental::nullopt;
+    }
+
+    return current.m;
+}
+
+bool energy_decay::is_settled() const { return is_settled_; }
+
+const util::aligned::vector<double>& energy_decay::get_decay_rates() const {
+    return decay_rates_;
+}
+
+size_t energy_decay::get_fit_steps() const {
+    return params_.interval * params_.window;
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
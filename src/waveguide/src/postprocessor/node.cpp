@@ -4,6 +4,9 @@
 
 #include "utilities/map_to_vector.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace wayverb {
 namespace waveguide {
 namespace postprocessor {
@@ -19,6 +22,57 @@ node::return_type node::operator()(cl::CommandQueue& queue,
 
 size_t node::get_output_node() const { return output_node_; }
 
+////////////////////////////////////////////////////////////////////////////////
+
+batched_node::batched_node(size_t output_node)
+        : output_node_{output_node} {}
+
+void batched_node::operator()(cl::CommandQueue& queue,
+                              const cl::Buffer& buffer,
+                              size_t step) {
+    //  Steps which have been read back are already in the output.
+    const auto offset = step - output_.size();
+
+    if (capacity_ <= offset) {
+        //  Grow on the device, keeping anything recorded earlier in this
+        //  batch.
+        const auto capacity = std::max(capacity_ * 2, offset + 1);
+        cl::Buffer batch{queue.getInfo<CL_QUEUE_CONTEXT>(),
+                         CL_MEM_READ_WRITE,
+                         sizeof(cl_float) * capacity};
+        if (capacity_) {
+            queue.enqueueCopyBuffer(
+                    batch_, batch, 0, 0, sizeof(cl_float) * capacity_);
+        }
+        batch_ = std::move(batch);
+        capacity_ = capacity;
+    }
+
+    queue.enqueueCopyBuffer(buffer,
+                            batch_,
+                            sizeof(cl_float) * output_node_,
+                            sizeof(cl_float) * offset,
+                            sizeof(cl_float));
+}
+
+void batched_node::finish(cl::CommandQueue& queue,
+                          size_t first_step,
+                          size_t steps) {
+    assert(first_step == output_.size());
+    output_.resize(first_step + steps);
+    queue.enqueueReadBuffer(batch_,
+                            CL_TRUE,
+                            0,
+                            sizeof(cl_float) * steps,
+                            output_.data() + first_step);
+}
+
+const util::aligned::vector<float>& batched_node::get_output() const {
+    return output_;
+}
+
+size_t batched_node::get_output_node() const { return output_node_; }
+
 }  // namespace postprocessor
 }  // namespace waveguide
 }  // namespace wayverb
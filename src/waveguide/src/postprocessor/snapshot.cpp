@@ -0,0 +1,200 @@
+#include "waveguide/postprocessor/snapshot.h"
+
+#include "core/cl/common.h"
+#include "core/conversions.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+namespace {
+
+/// Failed commands count as finished, so that waiting reports the error.
+bool is_finished(const cl::Event& event) {
+    return event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() <= CL_COMPLETE;
+}
+
+}  // namespace
+
+snapshot_region compute_whole_mesh_region(const mesh_descriptor& descriptor) {
+    return {glm::ivec3{0}, core::to_ivec3{}(descriptor.dimensions)};
+}
+
+snapshot_region compute_plane_region(const mesh_descriptor& descriptor,
+                                     size_t axis,
+                                     size_t index) {
+    auto ret = compute_whole_mesh_region(descriptor);
+    ret.begin[axis] = index;
+    ret.end[axis] = index + 1;
+    return ret;
+}
+
+size_t compute_num_nodes(const snapshot_region& region) {
+    const auto extent = region.end - region.begin;
+    return extent.x * extent.y * extent.z;
+}
+
+util::aligned::vector<glm::vec3> compute_node_positions(
+        const mesh_descriptor& descriptor, const snapshot_region& region) {
+    util::aligned::vector<glm::vec3> ret;
+    ret.reserve(compute_num_nodes(region));
+    for (auto z = region.begin.z; z != region.end.z; ++z) {
+        for (auto y = region.begin.y; y != region.end.y; ++y) {
+            for (auto x = region.begin.x; x != region.end.x; ++x) {
+                ret.emplace_back(
+                        compute_position(descriptor, glm::ivec3{x, y, z}));
+            }
+        }
+    }
+    return ret;
+}
+
+util::aligned::vector<float> get_pressures(const pressure_snapshot& snapshot) {
+    if (snapshot.quantised.empty()) {
+        return snapshot.pressures;
+    }
+
+    util::aligned::vector<float> ret;
+    ret.reserve(snapshot.quantised.size());
+    for (const auto i : snapshot.quantised) {
+        ret.emplace_back((i / 127.5f - 1) * snapshot.quantisation_range);
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+snapshot_region check_region(const mesh_descriptor& descriptor,
+                             const snapshot_region& region) {
+    const auto dimensions = core::to_ivec3{}(descriptor.dimensions);
+    if (glm::any(glm::lessThan(region.begin, glm::ivec3{0})) ||
+        glm::any(glm::greaterThan(region.end, dimensions)) ||
+        glm::any(glm::lessThanEqual(region.end, region.begin))) {
+        throw std::runtime_error{
+                "Snapshot region must be a non-empty box inside the mesh."};
+    }
+    return region;
+}
+
+}  // namespace
+
+snapshot::snapshot(const core::compute_context& cc,
+                   const mesh& mesh,
+                   const snapshot_parameters& params,
+                   callback_t callback)
+        : descriptor_{mesh.get_descriptor()}
+        , params_{params}
+        , region_{check_region(
+                  descriptor_,
+                  params.region ? *params.region
+                                : compute_whole_mesh_region(descriptor_))}
+        , callback_{std::move(callback)}
+        , output_buffer_{cc.context,
+                         CL_MEM_READ_WRITE,
+                         (params.quantisation_range ? sizeof(cl_uchar)
+                                                    : sizeof(cl_float)) *
+                                 compute_num_nodes(region_)}
+        , program_{cc}
+        , snapshot_kernel_{program_.get_snapshot_kernel()}
+        , quantised_kernel_{program_.get_quantised_snapshot_kernel()} {
+    if (!params_.interval) {
+        throw std::runtime_error{"Snapshot interval must be non-zero."};
+    }
+    if (params_.quantisation_range && !(0 < *params_.quantisation_range)) {
+        throw std::runtime_error{"Quantisation range must be positive."};
+    }
+    if (const auto& bricks = mesh.get_structure().get_brick_map()) {
+        brick_buffer_ = core::load_to_buffer(
+                cc.context, compute_brick_table(*bricks), true);
+    }
+}
+
+void snapshot::operator()(cl::CommandQueue& queue,
+                          const cl::Buffer& buffer,
+                          size_t step) {
+    if (!is_due(step)) {
+        return;
+    }
+
+    //  Earlier reads which have already finished can be passed on without
+    //  waiting.
+    hand_off(false);
+
+    const auto nodes = compute_num_nodes(region_);
+    const auto args = cl::EnqueueArgs{queue, cl::NDRange{nodes}};
+    const auto dimensions = descriptor_.dimensions;
+    const auto origin = core::to_cl_int3{}(region_.begin);
+    const auto extent = core::to_cl_int3{}(region_.end - region_.begin);
+
+    pressure_snapshot snapshot{step, region_, {}, {}, 0};
+    cl::Event read;
+
+    if (params_.quantisation_range) {
+        snapshot.quantisation_range = *params_.quantisation_range;
+        snapshot.quantised.resize(nodes);
+        quantised_kernel_(args,
+                          buffer,
+                          dimensions,
+                          brick_buffer_,
+                          origin,
+                          extent,
+                          snapshot.quantisation_range,
+                          output_buffer_);
+        queue.enqueueReadBuffer(output_buffer_,
+                                CL_FALSE,
+                                0,
+                                sizeof(cl_uchar) * nodes,
+                                snapshot.quantised.data(),
+                                nullptr,
+                                &read);
+    } else {
+        snapshot.pressures.resize(nodes);
+        snapshot_kernel_(args,
+                         buffer,
+                         dimensions,
+                         brick_buffer_,
+                         origin,
+                         extent,
+                         output_buffer_);
+        queue.enqueueReadBuffer(output_buffer_,
+                                CL_FALSE,
+                                0,
+                                sizeof(cl_float) * nodes,
+                                snapshot.pressures.data(),
+                                nullptr,
+                                &read);
+    }
+
+    //  Moving the snapshot doesn't move the storage being read into.
+    pending_.push_back(pending_snapshot{std::move(snapshot), std::move(read)});
+}
+
+bool snapshot::is_due(size_t step) const {
+    return step % params_.interval == 0;
+}
+
+void snapshot::finish(cl::CommandQueue& queue, size_t, size_t) {
+    queue.finish();
+    hand_off(true);
+}
+
+void snapshot::flush() { hand_off(true); }
+
+void snapshot::hand_off(bool wait) {
+    while (!pending_.empty()) {
+        auto& read = pending_.front().read;
+        if (!wait && !is_finished(read)) {
+            return;
+        }
+        read.wait();
+        auto snapshot = std::move(pending_.front().snapshot);
+        pending_.pop_front();
+        callback_(std::move(snapshot));
+    }
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,85 @@
+#include "waveguide/postprocessor/taps.h"
+
+#include "core/cl/common.h"
+
+#include <cassert>
+
+namespace wayverb {
+namespace waveguide {
+namespace postprocessor {
+
+taps::taps(const core::compute_context& cc,
+           util::aligned::vector<cl_uint> nodes,
+           size_t capacity)
+        : nodes_{check_nodes(std::move(nodes))}
+        , capacity_{capacity}
+        , node_buffer_{core::load_to_buffer(cc.context, nodes_, true)}
+        , ring_buffer_{cc.context,
+                       CL_MEM_READ_WRITE,
+                       sizeof(cl_float) * nodes_.size() * capacity_}
+        , kernel_{tap_program{cc}.get_gather_kernel()} {}
+
+//  Checked before any buffers are created, as zero-sized buffers are not
+//  allowed.
+util::aligned::vector<cl_uint> taps::check_nodes(
+        util::aligned::vector<cl_uint> nodes) {
+    if (nodes.empty()) {
+        throw std::runtime_error{"At least one tap node is required."};
+    }
+    return nodes;
+}
+
+void taps::operator()(cl::CommandQueue& queue,
+                      const cl::Buffer& buffer,
+                      size_t step) {
+    if (capacity_ <= step - get_num_steps()) {
+        throw std::runtime_error{
+                "Batch is too long for the tap ring buffer capacity."};
+    }
+
+    const auto slot = step % capacity_;
+    kernel_(cl::EnqueueArgs{queue, cl::NDRange{nodes_.size()}},
+            buffer,
+            node_buffer_,
+            ring_buffer_,
+            static_cast<cl_uint>(slot * nodes_.size()));
+}
+
+void taps::finish(cl::CommandQueue& queue, size_t first_step, size_t steps) {
+    assert(first_step == get_num_steps());
+
+    const auto step_size = sizeof(cl_float) * nodes_.size();
+    output_.resize(output_.size() + nodes_.size() * steps);
+    const auto output =
+            reinterpret_cast<char*>(output_.data()) + step_size * first_step;
+
+    //  The batch may wrap around the end of the ring buffer, in which case it
+    //  has to be read in two parts.
+    const auto slot = first_step % capacity_;
+    const auto first_part = std::min(steps, capacity_ - slot);
+    queue.enqueueReadBuffer(ring_buffer_,
+                            CL_FALSE,
+                            step_size * slot,
+                            step_size * first_part,
+                            output);
+    if (first_part != steps) {
+        queue.enqueueReadBuffer(ring_buffer_,
+                                CL_FALSE,
+                                0,
+                                step_size * (steps - first_part),
+                                output + step_size * first_part);
+    }
+    queue.finish();
+}
+
+size_t taps::get_num_taps() const { return nodes_.size(); }
+
+size_t taps::get_num_steps() const { return output_.size() / nodes_.size(); }
+
+const util::aligned::vector<cl_float>& taps::get_output() const {
+    return output_;
+}
+
+}  // namespace postprocessor
+}  // namespace waveguide
+}  // namespace wayverb
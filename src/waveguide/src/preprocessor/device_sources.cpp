@@ -0,0 +1,102 @@
+#include "waveguide/preprocessor/device_sources.h"
+
+#include "core/cl/common.h"
+
+#include "utilities/map_to_vector.h"
+
+namespace wayverb {
+namespace waveguide {
+namespace preprocessor {
+namespace {
+
+const util::aligned::vector<source_signal>& check_sources(
+        const util::aligned::vector<source_signal>& sources) {
+    if (sources.empty()) {
+        throw std::runtime_error{"At least one source is required."};
+    }
+    return sources;
+}
+
+size_t compute_num_steps(const util::aligned::vector<source_signal>& sources) {
+    size_t ret = 0;
+    for (const auto& i : sources) {
+        ret = std::max(ret, i.signal.size());
+    }
+    if (!ret) {
+        throw std::runtime_error{"At least one source signal must be "
+                                 "non-empty."};
+    }
+    return ret;
+}
+
+}  // namespace
+
+device_sources::device_sources(
+        const core::compute_context& cc,
+        const util::aligned::vector<source_signal>& sources,
+        size_t bands)
+        : sources_{check_sources(sources).size()}
+        , steps_{compute_num_steps(sources)}
+        , bands_{bands}
+        , kernel_{source_program{cc}.get_inject_sources_kernel()} {
+    const auto map = [&](auto func) {
+        return util::map_to_vector(begin(sources), end(sources), func);
+    };
+
+    nodes_ = core::load_to_buffer(
+            cc.context,
+            map([](const auto& i) { return static_cast<cl_uint>(i.node); }),
+            true);
+    soft_ = core::load_to_buffer(
+            cc.context,
+            map([](const auto& i) {
+                return static_cast<cl_int>(i.type == injection::soft);
+            }),
+            true);
+    lengths_ = core::load_to_buffer(
+            cc.context,
+            map([](const auto& i) {
+                return static_cast<cl_uint>(i.signal.size());
+            }),
+            true);
+
+    //  Signals are padded to the same length, so that they can be stored in a
+    //  single buffer.
+    util::aligned::vector<cl_float> signals(sources_ * steps_, 0);
+    for (auto i = 0u; i != sources_; ++i) {
+        std::copy(begin(sources[i].signal),
+                  end(sources[i].signal),
+                  signals.begin() + i * steps_);
+    }
+    signals_ = core::load_to_buffer(cc.context, signals, true);
+}
+
+bool device_sources::operator()(cl::CommandQueue& queue,
+                                cl::Buffer& buffer,
+                                size_t step) {
+    if (steps_ <= step) {
+        return false;
+    }
+    kernel_(cl::EnqueueArgs{queue, cl::NDRange{bands_}},
+            buffer,
+            nodes_,
+            soft_,
+            lengths_,
+            signals_,
+            static_cast<cl_uint>(sources_),
+            static_cast<cl_uint>(steps_),
+            static_cast<cl_uint>(step));
+    return true;
+}
+
+size_t device_sources::prepare(cl::CommandQueue& /*queue*/,
+                               size_t first_step,
+                               size_t max_steps) const {
+    return first_step < steps_ ? std::min(max_steps, steps_ - first_step) : 0;
+}
+
+size_t device_sources::get_num_steps() const { return steps_; }
+
+}  // namespace preprocessor
+}  // namespace waveguide
+}  // namespace wayverb
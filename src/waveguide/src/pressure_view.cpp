@@ -0,0 +1,46 @@
+#include "waveguide/pressure_view.h"
+
+namespace wayverb {
+namespace waveguide {
+
+pressure_view::pressure_view(const cl::Buffer& pressures)
+        : pressures_{&pressures} {}
+
+pressure_view::pressure_view(cl::CommandQueue& queue,
+                             const cl::Buffer& pressures,
+                             size_t nodes,
+                             size_t bands,
+                             const cl::Buffer& first_band)
+        : queue_{&queue}
+        , pressures_{&pressures}
+        , nodes_{nodes}
+        , bands_{bands}
+        , first_band_{&first_band} {}
+
+const cl::Buffer& pressure_view::get() const {
+    if (!first_band_) {
+        return *pressures_;
+    }
+
+    if (!is_copied_) {
+        cl::size_t<3> origin;
+        cl::size_t<3> region;
+        region[0] = sizeof(cl_float);
+        region[1] = nodes_;
+        region[2] = 1;
+        queue_->enqueueCopyBufferRect(*pressures_,
+                                      *first_band_,
+                                      origin,
+                                      origin,
+                                      region,
+                                      sizeof(cl_float) * bands_,
+                                      0,
+                                      sizeof(cl_float),
+                                      0);
+        is_copied_ = true;
+    }
+    return *first_band_;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
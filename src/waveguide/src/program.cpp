@@ -5,12 +5,168 @@
 #include "waveguide/cl/utils.h"
 #include "waveguide/mesh_descriptor.h"
 
+#include <iomanip>
+#include <sstream>
+
 namespace wayverb {
 namespace waveguide {
 
 constexpr auto source = R"(
+//  The host defines STENCIL_COMPACT, and the weights of the update scheme.
+//  The rectilinear scheme (STENCIL_COMPACT == 0) only reads the six axial
+//  neighbours, and uses its own specialised boundary update.
+#if STENCIL_COMPACT
+#define courant (STENCIL_COURANT)
+#define courant_sq (STENCIL_COURANT * STENCIL_COURANT)
+#else
 #define courant (1.0f / sqrt(3.0f))
 #define courant_sq (1.0f / 3.0f)
+#endif
+
+//  Must match brick_map::brick_size.
+#define BRICK_SIZE (4)
+
+//  Must match node_run::max_length.
+#define NODE_RUN_LENGTH (32)
+
+//  BANDS is defined by the host.
+//  Pressures are stored node-major, band-minor, so that all bands at a node
+//  can be updated together.
+//  Boundary coefficients are stored surface-major, band-minor.
+
+//  Nodes in compacted meshes are stored brick-by-brick.
+//  `bricks` holds the storage slot of each brick, followed by the brick in
+//  each slot (see compute_brick_table), and is null if the mesh is not
+//  compacted.
+#define BRICK_VOLUME (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+size_t storage_index(int3 locator, int3 dim, const global uint* bricks);
+size_t storage_index(int3 locator, int3 dim, const global uint* bricks) {
+    if (!bricks) {
+        return to_index(locator, dim);
+    }
+    const int3 brick_dim = (dim + (BRICK_SIZE - 1)) / BRICK_SIZE;
+    const size_t slot = bricks[to_index(locator / BRICK_SIZE, brick_dim)];
+    return slot * BRICK_VOLUME +
+           to_index(locator % BRICK_SIZE, (int3)(BRICK_SIZE));
+}
+
+//  The inverse of storage_index.
+int3 storage_locator(size_t index, int3 dim, const global uint* bricks);
+int3 storage_locator(size_t index, int3 dim, const global uint* bricks) {
+    if (!bricks) {
+        return to_locator(index, dim);
+    }
+    const int3 brick_dim = (dim + (BRICK_SIZE - 1)) / BRICK_SIZE;
+    const size_t num_bricks = brick_dim.x * brick_dim.y * brick_dim.z;
+    const uint brick = bricks[num_bricks + index / BRICK_VOLUME];
+    return to_locator(brick, brick_dim) * BRICK_SIZE +
+           to_locator(index % BRICK_VOLUME, (int3)(BRICK_SIZE));
+}
+
+uint neighbor_storage_index(int3 locator,
+                            int3 dim,
+                            const global uint* bricks,
+                            PortDirection pd);
+uint neighbor_storage_index(int3 locator,
+                            int3 dim,
+                            const global uint* bricks,
+                            PortDirection pd) {
+    const uint index = neighbor_index(locator, dim, pd);
+    if (index == no_neighbor || !bricks) {
+        return index;
+    }
+    return storage_index(to_locator(index, dim), dim, bricks);
+}
+
+//  The boundary filters of all nodes which touch the same number of
+//  boundaries.
+//  Filter state is stored as a structure of arrays, so that the boundary
+//  nodes updated by neighbouring work-items have their state in neighbouring
+//  memory.
+//  Each filter has a lane, ordered by dimension, then band, then boundary
+//  node. Tap `t` of the filter in lane `l` is at
+//  `filter_memory[t * lanes + l]`.
+//  The coefficient index for dimension `d` of boundary node `n` is at
+//  `coefficient_indices[d * nodes + n]`.
+typedef struct {
+    global filt_real* filter_memory;
+    const global uint* coefficient_indices;
+    uint nodes;
+    uint dimensions;
+} boundary_filters;
+
+size_t filter_lane(boundary_filters bf, uint node, int dimension, int band);
+size_t filter_lane(boundary_filters bf, uint node, int dimension, int band) {
+    return (dimension * BANDS + band) * (size_t)bf.nodes + node;
+}
+
+size_t filter_lanes(boundary_filters bf);
+size_t filter_lanes(boundary_filters bf) {
+    return bf.dimensions * BANDS * (size_t)bf.nodes;
+}
+
+const global coefficients_canonical* filter_coefficients(
+        boundary_filters bf,
+        const global coefficients_canonical* boundary_coefficients,
+        uint node,
+        int dimension,
+        int band);
+const global coefficients_canonical* filter_coefficients(
+        boundary_filters bf,
+        const global coefficients_canonical* boundary_coefficients,
+        uint node,
+        int dimension,
+        int band) {
+    const uint index = bf.coefficient_indices[dimension * bf.nodes + node];
+    return boundary_coefficients + index * BANDS + band;
+}
+
+#if STENCIL_COMPACT
+//  Compact schemes read all 26 surrounding nodes. Each one is identified by
+//  its offset from the node being updated, with components in -1..1.
+
+float stencil_weight(int3 offset);
+float stencil_weight(int3 offset) {
+    switch (abs(offset.x) + abs(offset.y) + abs(offset.z)) {
+        case 1: return STENCIL_AXIAL;
+        case 2: return STENCIL_SIDE_DIAGONAL;
+        case 3: return STENCIL_DIAGONAL;
+        default: return 0;
+    }
+}
+
+uint offset_storage_index(int3 locator,
+                          int3 dim,
+                          const global uint* bricks,
+                          int3 offset);
+uint offset_storage_index(int3 locator,
+                          int3 dim,
+                          const global uint* bricks,
+                          int3 offset) {
+    const int3 neighbor = locator + offset;
+    if (locator_outside(neighbor, dim)) {
+        return no_neighbor;
+    }
+    return storage_index(neighbor, dim, bricks);
+}
+
+//  The offset of the ghost points beyond a boundary, given the direction of
+//  the boundary node's inner neighbour.
+int3 ghost_offset(PortDirection inner);
+int3 ghost_offset(PortDirection inner) {
+    switch (inner) {
+        case id_port_nx: return (int3)(1, 0, 0);
+        case id_port_px: return (int3)(-1, 0, 0);
+        case id_port_ny: return (int3)(0, 1, 0);
+        case id_port_py: return (int3)(0, -1, 0);
+        case id_port_nz: return (int3)(0, 0, 1);
+        case id_port_pz: return (int3)(0, 0, -1);
+
+        default: return (int3)(0);
+    }
+}
+#endif
 
 typedef struct { PortDirection array[1]; } InnerNodeDirections1;
 typedef struct { PortDirection array[2]; } InnerNodeDirections2;
@@ -150,15 +306,17 @@ SurroundingPorts2 on_boundary_2(InnerNodeDirections2 ind) {
 void ghost_point_pressure_update(float next_pressure,
                                  float prev_pressure,
                                  float inner_pressure,
-                                 global boundary_data* bd,
+                                 global filt_real* filter_memory,
+                                 size_t stride,
                                  const global coefficients_canonical* boundary);
 void ghost_point_pressure_update(
         float next_pressure,
         float prev_pressure,
         float inner_pressure,
-        global boundary_data* bd,
+        global filt_real* filter_memory,
+        size_t stride,
         const global coefficients_canonical* boundary) {
-    const filt_real filt_state = bd->filter_memory.array[0];
+    const filt_real filt_state = filter_memory[0];
     const filt_real b0 = boundary->b[0];
     const filt_real a0 = boundary->a[0];
 
@@ -170,7 +328,8 @@ void ghost_point_pressure_update(
 #else
     const filt_real filter_input = -diff;
 #endif
-    filter_step_canonical(filter_input, &(bd->filter_memory), boundary);
+    filter_step_canonical_strided(
+            filter_input, filter_memory, stride, boundary);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -182,6 +341,8 @@ void ghost_point_pressure_update(
             const global float* current,                                     \
             int3 locator,                                                    \
             int3 dim,                                                        \
+            const global uint* bricks,                                       \
+            int band,                                                        \
             volatile global int* error_flag);                                \
     float CAT(get_summed_surrounding_, dimensions)(                          \
             const global condensed_node* nodes,                              \
@@ -189,12 +350,15 @@ void ghost_point_pressure_update(
             const global float* current,                                     \
             int3 locator,                                                    \
             int3 dim,                                                        \
+            const global uint* bricks,                                       \
+            int band,                                                        \
             volatile global int* error_flag) {                               \
         float ret = 0;                                                       \
         CAT(SurroundingPorts, dimensions)                                    \
         on_boundary = CAT(on_boundary_, dimensions)(pd);                     \
         for (int i = 0; i != CAT(NUM_SURROUNDING_PORTS_, dimensions); ++i) { \
-            uint index = neighbor_index(locator, dim, on_boundary.array[i]); \
+            uint index = neighbor_storage_index(                             \
+                    locator, dim, bricks, on_boundary.array[i]);             \
             if (index == no_neighbor) {                                      \
                 atomic_or(error_flag, id_outside_mesh_error);                \
                 return 0;                                                    \
@@ -203,7 +367,7 @@ void ghost_point_pressure_update(
             if (boundary_type == id_none || boundary_type == id_inside) {    \
                 atomic_or(error_flag, id_suspicious_boundary_error);         \
             }                                                                \
-            ret += current[index];                                           \
+            ret += current[index * BANDS + band];                            \
         }                                                                    \
         return ret;                                                          \
     }
@@ -216,12 +380,16 @@ float get_summed_surrounding_3(const global condensed_node* nodes,
                                const global float* current,
                                int3 locator,
                                int3 dimensions,
+                               const global uint* bricks,
+                               int band,
                                volatile global int* error_flag);
 float get_summed_surrounding_3(const global condensed_node* nodes,
                                InnerNodeDirections3 i,
                                const global float* current,
                                int3 locator,
                                int3 dimensions,
+                               const global uint* bricks,
+                               int band,
                                volatile global int* error_flag) {
     return 0;
 }
@@ -232,20 +400,24 @@ float get_inner_pressure(const global condensed_node* nodes,
                          const global float* current,
                          int3 locator,
                          int3 dim,
+                         const global uint* bricks,
                          PortDirection bt,
+                         int band,
                          volatile global int* error_flag);
 float get_inner_pressure(const global condensed_node* nodes,
                          const global float* current,
                          int3 locator,
                          int3 dim,
+                         const global uint* bricks,
                          PortDirection bt,
+                         int band,
                          volatile global int* error_flag) {
-    uint neighbor = neighbor_index(locator, dim, bt);
+    uint neighbor = neighbor_storage_index(locator, dim, bricks, bt);
     if (neighbor == no_neighbor) {
         atomic_or(error_flag, id_outside_mesh_error);
         return 0;
     }
-    return current[neighbor];
+    return current[neighbor * BANDS + band];
 }
 
 #define GET_CURRENT_SURROUNDING_WEIGHTING_TEMPLATE(dimensions)                 \
@@ -254,14 +426,18 @@ float get_inner_pressure(const global condensed_node* nodes,
             const global float* current,                                       \
             int3 locator,                                                      \
             int3 dim,                                                          \
+            const global uint* bricks,                                         \
             CAT(InnerNodeDirections, dimensions) ind,                          \
+            int band,                                                          \
             volatile global int* error_flag);                                  \
     float CAT(get_current_surrounding_weighting_, dimensions)(                 \
             const global condensed_node* nodes,                                \
             const global float* current,                                       \
             int3 locator,                                                      \
             int3 dim,                                                          \
+            const global uint* bricks,                                         \
             CAT(InnerNodeDirections, dimensions) ind,                          \
+            int band,                                                          \
             volatile global int* error_flag) {                                 \
         float sum = 0;                                                         \
         for (int i = 0; i != dimensions; ++i) {                                \
@@ -269,12 +445,21 @@ float get_inner_pressure(const global condensed_node* nodes,
                                           current,                             \
                                           locator,                             \
                                           dim,                                 \
+                                          bricks,                              \
                                           ind.array[i],                        \
+                                          band,                                \
                                           error_flag);                         \
         }                                                                      \
         return courant_sq *                                                    \
                (sum + CAT(get_summed_surrounding_, dimensions)(                \
-                              nodes, ind, current, locator, dim, error_flag)); \
+                              nodes,                                           \
+                              ind,                                             \
+                              current,                                         \
+                              locator,                                         \
+                              dim,                                             \
+                              bricks,                                          \
+                              band,                                            \
+                              error_flag));                                    \
     }
 
 GET_CURRENT_SURROUNDING_WEIGHTING_TEMPLATE(1);
@@ -283,21 +468,27 @@ GET_CURRENT_SURROUNDING_WEIGHTING_TEMPLATE(3);
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#define GET_FILTER_WEIGHTING_TEMPLATE(dimensions)                         \
-    float CAT(get_filter_weighting_, dimensions)(                         \
-            global CAT(boundary_data_array_, dimensions) * bda,           \
-            const global coefficients_canonical* boundary_coefficients);  \
-    float CAT(get_filter_weighting_, dimensions)(                         \
-            global CAT(boundary_data_array_, dimensions) * bda,           \
-            const global coefficients_canonical* boundary_coefficients) { \
-        float sum = 0;                                                    \
-        for (int i = 0; i != dimensions; ++i) {                           \
-            boundary_data bd = bda->array[i];                             \
-            const filt_real filt_state = bd.filter_memory.array[0];            \
-            sum += filt_state /                                           \
-                   boundary_coefficients[bd.coefficient_index].b[0];      \
-        }                                                                 \
-        return courant_sq * sum;                                          \
+#define GET_FILTER_WEIGHTING_TEMPLATE(dimensions)                           \
+    float CAT(get_filter_weighting_, dimensions)(                           \
+            boundary_filters bf,                                            \
+            uint node,                                                      \
+            const global coefficients_canonical* boundary_coefficients,     \
+            int band);                                                      \
+    float CAT(get_filter_weighting_, dimensions)(                           \
+            boundary_filters bf,                                            \
+            uint node,                                                      \
+            const global coefficients_canonical* boundary_coefficients,     \
+            int band) {                                                     \
+        float sum = 0;                                                      \
+        for (int i = 0; i != dimensions; ++i) {                             \
+            const filt_real filt_state =                                    \
+                    bf.filter_memory[filter_lane(bf, node, i, band)];       \
+            sum += filt_state /                                             \
+                   filter_coefficients(                                     \
+                           bf, boundary_coefficients, node, i, band)        \
+                           ->b[0];                                          \
+        }                                                                   \
+        return courant_sq * sum;                                            \
     }
 
 GET_FILTER_WEIGHTING_TEMPLATE(1);
@@ -308,15 +499,20 @@ GET_FILTER_WEIGHTING_TEMPLATE(3);
 
 #define GET_COEFF_WEIGHTING_TEMPLATE(dimensions)                             \
     float CAT(get_coeff_weighting_, dimensions)(                             \
-            global CAT(boundary_data_array_, dimensions) * bda,              \
-            const global coefficients_canonical* boundary_coefficients);     \
+            boundary_filters bf,                                             \
+            uint node,                                                       \
+            const global coefficients_canonical* boundary_coefficients,      \
+            int band);                                                       \
     float CAT(get_coeff_weighting_, dimensions)(                             \
-            global CAT(boundary_data_array_, dimensions) * bda,              \
-            const global coefficients_canonical* boundary_coefficients) {    \
+            boundary_filters bf,                                             \
+            uint node,                                                       \
+            const global coefficients_canonical* boundary_coefficients,      \
+            int band) {                                                      \
         float sum = 0;                                                       \
         for (int i = 0; i != dimensions; ++i) {                              \
             const global coefficients_canonical* boundary =                  \
-                    boundary_coefficients + bda->array[i].coefficient_index; \
+                    filter_coefficients(                                     \
+                            bf, boundary_coefficients, node, i, band);       \
             sum += boundary->a[0] / boundary->b[0];                          \
         }                                                                    \
         return sum * courant;                                                \
@@ -336,8 +532,10 @@ GET_COEFF_WEIGHTING_TEMPLATE(3);
             const global condensed_node* nodes,                                \
             int3 locator,                                                      \
             int3 dim,                                                          \
-            global CAT(boundary_data_array_, dimensions) * bdat,               \
+            const global uint* bricks,                                         \
+            boundary_filters bf,                                               \
             const global coefficients_canonical* boundary_coefficients,        \
+            int band,                                                          \
             volatile global int* error_flag);                                  \
     float CAT(boundary_, dimensions)(                                          \
             const global float* current,                                       \
@@ -346,45 +544,183 @@ GET_COEFF_WEIGHTING_TEMPLATE(3);
             const global condensed_node* nodes,                                \
             int3 locator,                                                      \
             int3 dim,                                                          \
-            global CAT(boundary_data_array_, dimensions) * bdat,               \
+            const global uint* bricks,                                         \
+            boundary_filters bf,                                               \
             const global coefficients_canonical* boundary_coefficients,        \
+            int band,                                                          \
             volatile global int* error_flag) {                                 \
         CAT(InnerNodeDirections, dimensions)                                   \
         ind = CAT(get_inner_node_directions_, dimensions)(node.boundary_type); \
         float current_surrounding_weighting =                                  \
                 CAT(get_current_surrounding_weighting_, dimensions)(           \
-                        nodes, current, locator, dim, ind, error_flag);        \
-        global CAT(boundary_data_array_, dimensions)* bda =                    \
-                bdat + node.boundary_index;                                    \
+                        nodes,                                                 \
+                        current,                                               \
+                        locator,                                               \
+                        dim,                                                   \
+                        bricks,                                                \
+                        ind,                                                   \
+                        band,                                                  \
+                        error_flag);                                           \
         const float filter_weighting = CAT(get_filter_weighting_, dimensions)( \
-                bda, boundary_coefficients);                                   \
+                bf, node.boundary_index, boundary_coefficients, band);         \
         const float coeff_weighting = CAT(get_coeff_weighting_, dimensions)(   \
-                bda, boundary_coefficients);                                   \
+                bf, node.boundary_index, boundary_coefficients, band);         \
         const float prev_weighting = (coeff_weighting - 1) * prev_pressure;    \
         const float ret = (current_surrounding_weighting + filter_weighting +  \
                            prev_weighting) /                                   \
                           (1 + coeff_weighting);                               \
         for (int i = 0; i != dimensions; ++i) {                                \
-            global boundary_data* bd = bda->array + i;                         \
             const global coefficients_canonical* boundary =                    \
-                    boundary_coefficients + bd->coefficient_index;             \
+                    filter_coefficients(bf,                                    \
+                                        boundary_coefficients,                 \
+                                        node.boundary_index,                   \
+                                        i,                                     \
+                                        band);                                 \
+            const size_t lane =                                                \
+                    filter_lane(bf, node.boundary_index, i, band);             \
+            ghost_point_pressure_update(ret,                                   \
+                                        prev_pressure,                         \
+                                        get_inner_pressure(nodes,              \
+                                                           current,            \
+                                                           locator,            \
+                                                           dim,                \
+                                                           bricks,             \
+                                                           ind.array[i],       \
+                                                           band,               \
+                                                           error_flag),        \
+                                        bf.filter_memory + lane,               \
+                                        filter_lanes(bf),                      \
+                                        boundary);                             \
+        }                                                                      \
+        return ret;                                                            \
+    }
+
+//  The same ghost-point formulation, for compact schemes.
+//  Each surrounding node which lies beyond a boundary is a ghost point, and
+//  is replaced by its mirror image through that boundary (or boundaries),
+//  plus the pressure difference across each boundary crossed. That
+//  difference comes from the boundary filter, as in
+//  ghost_point_pressure_update, so each boundary's filter contributes in
+//  proportion to the summed weights of the ghost points which cross it.
+//  With only axial weights, this is exactly the rectilinear update above.
+#define COMPACT_BOUNDARY_TEMPLATE(dimensions)                                  \
+    float CAT(boundary_, dimensions)(                                          \
+            const global float* current,                                       \
+            float prev_pressure,                                               \
+            condensed_node node,                                               \
+            const global condensed_node* nodes,                                \
+            int3 locator,                                                      \
+            int3 dim,                                                          \
+            const global uint* bricks,                                         \
+            boundary_filters bf,                                               \
+            const global coefficients_canonical* boundary_coefficients,        \
+            int band,                                                          \
+            volatile global int* error_flag);                                  \
+    float CAT(boundary_, dimensions)(                                          \
+            const global float* current,                                       \
+            float prev_pressure,                                               \
+            condensed_node node,                                               \
+            const global condensed_node* nodes,                                \
+            int3 locator,                                                      \
+            int3 dim,                                                          \
+            const global uint* bricks,                                         \
+            boundary_filters bf,                                               \
+            const global coefficients_canonical* boundary_coefficients,        \
+            int band,                                                          \
+            volatile global int* error_flag) {                                 \
+        CAT(InnerNodeDirections, dimensions)                                   \
+        ind = CAT(get_inner_node_directions_, dimensions)(node.boundary_type); \
+        int3 ghosts[dimensions];                                               \
+        float ghost_weights[dimensions];                                       \
+        for (int i = 0; i != dimensions; ++i) {                                \
+            ghosts[i] = ghost_offset(ind.array[i]);                            \
+            ghost_weights[i] = 0;                                              \
+        }                                                                      \
+        const size_t index = storage_index(locator, dim, bricks);              \
+        float surrounding = STENCIL_CENTRE * current[index * BANDS + band];    \
+        for (int z = -1; z <= 1; ++z) {                                        \
+            for (int y = -1; y <= 1; ++y) {                                    \
+                for (int x = -1; x <= 1; ++x) {                                \
+                    if (x == 0 && y == 0 && z == 0) {                          \
+                        continue;                                              \
+                    }                                                          \
+                    const int3 offset = (int3)(x, y, z);                       \
+                    const float weight = stencil_weight(offset);               \
+                    int3 mirrored = offset;                                    \
+                    for (int i = 0; i != dimensions; ++i) {                    \
+                        const int3 g = ghosts[i];                              \
+                        if (g.x * x + g.y * y + g.z * z == 1) {                \
+                            mirrored -= 2 * g;                                 \
+                            ghost_weights[i] += weight;                        \
+                        }                                                      \
+                    }                                                          \
+                    const uint neighbor = offset_storage_index(                \
+                            locator, dim, bricks, mirrored);                   \
+                    if (neighbor == no_neighbor) {                             \
+                        atomic_or(error_flag, id_outside_mesh_error);          \
+                        return 0;                                              \
+                    }                                                          \
+                    if (nodes[neighbor].boundary_type == id_none) {            \
+                        atomic_or(error_flag, id_suspicious_boundary_error);   \
+                    }                                                          \
+                    surrounding += weight * current[neighbor * BANDS + band];  \
+                }                                                              \
+            }                                                                  \
+        }                                                                      \
+        float filter_weighting = 0;                                            \
+        float coeff_weighting = 0;                                             \
+        for (int i = 0; i != dimensions; ++i) {                                \
+            const global coefficients_canonical* boundary =                    \
+                    filter_coefficients(bf,                                    \
+                                        boundary_coefficients,                 \
+                                        node.boundary_index,                   \
+                                        i,                                     \
+                                        band);                                 \
+            const filt_real filt_state = bf.filter_memory[filter_lane(         \
+                    bf, node.boundary_index, i, band)];                        \
+            filter_weighting +=                                                \
+                    ghost_weights[i] * filt_state / boundary->b[0];            \
+            coeff_weighting += ghost_weights[i] * boundary->a[0] /             \
+                               (boundary->b[0] * courant);                     \
+        }                                                                      \
+        const float ret = (surrounding + filter_weighting +                    \
+                           (coeff_weighting - 1) * prev_pressure) /            \
+                          (1 + coeff_weighting);                               \
+        for (int i = 0; i != dimensions; ++i) {                                \
+            const global coefficients_canonical* boundary =                    \
+                    filter_coefficients(bf,                                    \
+                                        boundary_coefficients,                 \
+                                        node.boundary_index,                   \
+                                        i,                                     \
+                                        band);                                 \
+            const size_t lane =                                                \
+                    filter_lane(bf, node.boundary_index, i, band);             \
             ghost_point_pressure_update(ret,                                   \
                                         prev_pressure,                         \
                                         get_inner_pressure(nodes,              \
                                                            current,            \
                                                            locator,            \
                                                            dim,                \
+                                                           bricks,             \
                                                            ind.array[i],       \
+                                                           band,               \
                                                            error_flag),        \
-                                        bd,                                    \
+                                        bf.filter_memory + lane,               \
+                                        filter_lanes(bf),                      \
                                         boundary);                             \
         }                                                                      \
         return ret;                                                            \
     }
 
+#if STENCIL_COMPACT
+COMPACT_BOUNDARY_TEMPLATE(1);
+COMPACT_BOUNDARY_TEMPLATE(2);
+COMPACT_BOUNDARY_TEMPLATE(3);
+#else
 BOUNDARY_TEMPLATE(1);
 BOUNDARY_TEMPLATE(2);
 BOUNDARY_TEMPLATE(3);
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -393,22 +729,46 @@ BOUNDARY_TEMPLATE(3);
 float normal_waveguide_update(float prev_pressure,
                               const global float* current,
                               int3 dimensions,
-                              int3 locator);
+                              const global uint* bricks,
+                              int3 locator,
+                              int band);
 float normal_waveguide_update(float prev_pressure,
                               const global float* current,
                               int3 dimensions,
-                              int3 locator) {
+                              const global uint* bricks,
+                              int3 locator,
+                              int band) {
+#if STENCIL_COMPACT
+    const size_t index = storage_index(locator, dimensions, bricks);
+    float ret = STENCIL_CENTRE * current[index * BANDS + band];
+    for (int z = -1; z <= 1; ++z) {
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                const int3 offset = (int3)(x, y, z);
+                const uint neighbor = offset_storage_index(
+                        locator, dimensions, bricks, offset);
+                if ((x || y || z) && neighbor != no_neighbor) {
+                    ret += stencil_weight(offset) *
+                           current[neighbor * BANDS + band];
+                }
+            }
+        }
+    }
+    return ret - prev_pressure;
+#else
     float ret = 0;
     for (int i = 0; i != PORTS; ++i) {
-        uint port_index = neighbor_index(locator, dimensions, i);
+        uint port_index =
+                neighbor_storage_index(locator, dimensions, bricks, i);
         if (port_index != no_neighbor) {
-            ret += current[port_index];
+            ret += current[port_index * BANDS + band];
         }
     }
 
     ret /= (PORTS / 2);
     ret -= prev_pressure;
     return ret;
+#endif
 }
 
 float next_waveguide_pressure(
@@ -417,11 +777,13 @@ float next_waveguide_pressure(
         float prev_pressure,
         const global float* current,
         int3 dimensions,
+        const global uint* bricks,
         int3 locator,
-        global boundary_data_array_1* boundary_data_1,
-        global boundary_data_array_2* boundary_data_2,
-        global boundary_data_array_3* boundary_data_3,
+        boundary_filters filters_1,
+        boundary_filters filters_2,
+        boundary_filters filters_3,
         const global coefficients_canonical* boundary_coefficients,
+        int band,
         volatile global int* error_flag);
 float next_waveguide_pressure(
         const condensed_node node,
@@ -429,11 +791,13 @@ float next_waveguide_pressure(
         float prev_pressure,
         const global float* current,
         int3 dimensions,
+        const global uint* bricks,
         int3 locator,
-        global boundary_data_array_1* boundary_data_1,
-        global boundary_data_array_2* boundary_data_2,
-        global boundary_data_array_3* boundary_data_3,
+        boundary_filters filters_1,
+        boundary_filters filters_2,
+        boundary_filters filters_3,
         const global coefficients_canonical* boundary_coefficients,
+        int band,
         volatile global int* error_flag) {
     //  find the next pressure at this node, assign it to next_pressure
     switch (popcount(node.boundary_type)) {
@@ -441,8 +805,12 @@ float next_waveguide_pressure(
         case 1:
             if (node.boundary_type & id_inside ||
                 node.boundary_type & id_reentrant) {
-                return normal_waveguide_update(
-                        prev_pressure, current, dimensions, locator);
+                return normal_waveguide_update(prev_pressure,
+                                               current,
+                                               dimensions,
+                                               bricks,
+                                               locator,
+                                               band);
             } else {
 #if ENABLE_BOUNDARIES
                 return boundary_1(current,
@@ -451,8 +819,10 @@ float next_waveguide_pressure(
                                   nodes,
                                   locator,
                                   dimensions,
-                                  boundary_data_1,
+                                  bricks,
+                                  filters_1,
                                   boundary_coefficients,
+                                  band,
                                   error_flag);
 #endif
             }
@@ -465,8 +835,10 @@ float next_waveguide_pressure(
                               nodes,
                               locator,
                               dimensions,
-                              boundary_data_2,
+                              bricks,
+                              filters_2,
                               boundary_coefficients,
+                              band,
                               error_flag);
 #endif
         //  this is a corner where three boundaries meet
@@ -478,8 +850,10 @@ float next_waveguide_pressure(
                               nodes,
                               locator,
                               dimensions,
-                              boundary_data_3,
+                              bricks,
+                              filters_3,
                               boundary_coefficients,
+                              band,
                               error_flag);
 #endif
         default: return 0;
@@ -491,50 +865,231 @@ kernel void zero_buffer(global float* buffer) {
     buffer[thread] = 0.0f;
 }
 
+void check_pressure(float pressure, volatile global int* error_flag);
+void check_pressure(float pressure, volatile global int* error_flag) {
+    if (isinf(pressure)) {
+        atomic_or(error_flag, id_inf_error);
+    }
+    if (isnan(pressure)) {
+        atomic_or(error_flag, id_nan_error);
+    }
+}
+
+//  General update, for nodes which don't fit into any of the specialised
+//  kernels below.
 kernel void condensed_waveguide(
         global float* previous,
         const global float* current,
         const global condensed_node* nodes,
+        const global uint* indices,
         int3 dimensions,
-        global boundary_data_array_1* boundary_data_1,
-        global boundary_data_array_2* boundary_data_2,
-        global boundary_data_array_3* boundary_data_3,
+        const global uint* bricks,
+        global filt_real* filter_memory_1,
+        const global uint* coefficient_indices_1,
+        uint boundary_nodes_1,
+        global filt_real* filter_memory_2,
+        const global uint* coefficient_indices_2,
+        uint boundary_nodes_2,
+        global filt_real* filter_memory_3,
+        const global uint* coefficient_indices_3,
+        uint boundary_nodes_3,
         const global coefficients_canonical* boundary_coefficients,
         volatile global int* error_flag) {
-    const size_t index = get_global_id(0);
+    const boundary_filters filters_1 = {
+            filter_memory_1, coefficient_indices_1, boundary_nodes_1, 1};
+    const boundary_filters filters_2 = {
+            filter_memory_2, coefficient_indices_2, boundary_nodes_2, 2};
+    const boundary_filters filters_3 = {
+            filter_memory_3, coefficient_indices_3, boundary_nodes_3, 3};
+
+    const size_t index = indices[get_global_id(0)];
+    const int3 locator = storage_locator(index, dimensions, bricks);
 
     const condensed_node node = nodes[index];
-    const int3 locator = to_locator(index, dimensions);
-
-    const float prev_pressure = previous[index];
-    const float next_pressure = next_waveguide_pressure(node,
-                                                        nodes,
-                                                        prev_pressure,
-                                                        current,
-                                                        dimensions,
-                                                        locator,
-                                                        boundary_data_1,
-                                                        boundary_data_2,
-                                                        boundary_data_3,
-                                                        boundary_coefficients,
-                                                        error_flag);
-
-    if (isinf(next_pressure)) {
-        atomic_or(error_flag, id_inf_error);
+
+    for (int band = 0; band != BANDS; ++band) {
+        const size_t element = index * BANDS + band;
+        const float next_pressure =
+                next_waveguide_pressure(node,
+                                        nodes,
+                                        previous[element],
+                                        current,
+                                        dimensions,
+                                        bricks,
+                                        locator,
+                                        filters_1,
+                                        filters_2,
+                                        filters_3,
+                                        boundary_coefficients,
+                                        band,
+                                        error_flag);
+
+        check_pressure(next_pressure, error_flag);
+
+        previous[element] = next_pressure;
     }
-    if (isnan(next_pressure)) {
-        atomic_or(error_flag, id_nan_error);
+}
+
+//  Interior nodes never lie on the edge of the mesh, so all six neighbours
+//  are guaranteed to exist and we can skip the bounds checks.
+//  Each run gets NODE_RUN_LENGTH work-items, and those past the end of a
+//  short run do nothing.
+kernel void condensed_waveguide_interior(global float* previous,
+                                         const global float* current,
+                                         const global node_run* runs,
+                                         int3 dimensions,
+                                         const global uint* bricks,
+                                         volatile global int* error_flag) {
+    const node_run run = runs[get_global_id(0) / NODE_RUN_LENGTH];
+    const uint lane = get_global_id(0) % NODE_RUN_LENGTH;
+    if (run.length <= lane) {
+        return;
+    }
+    const size_t index = run.begin + lane;
+
+#if STENCIL_COMPACT
+    //  All 26 surrounding nodes exist too.
+    const int3 locator = storage_locator(index, dimensions, bricks);
+    size_t neighbors[26];
+    float weights[26];
+    int count = 0;
+    for (int z = -1; z <= 1; ++z) {
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                if (x || y || z) {
+                    const int3 offset = (int3)(x, y, z);
+                    neighbors[count] =
+                            storage_index(locator + offset, dimensions, bricks);
+                    weights[count] = stencil_weight(offset);
+                    ++count;
+                }
+            }
+        }
+    }
+
+    for (int band = 0; band != BANDS; ++band) {
+        float sum = STENCIL_CENTRE * current[index * BANDS + band];
+        for (int i = 0; i != 26; ++i) {
+            sum += weights[i] * current[neighbors[i] * BANDS + band];
+        }
+
+        const size_t element = index * BANDS + band;
+        const float next_pressure = sum - previous[element];
+
+        check_pressure(next_pressure, error_flag);
+
+        previous[element] = next_pressure;
+    }
+#else
+    //  Neighbour positions are found once, and shared by all bands.
+    size_t neighbors[PORTS];
+    if (bricks) {
+        //  Neighbours might be in other bricks, so use the slow path.
+        const int3 locator = storage_locator(index, dimensions, bricks);
+        for (int i = 0; i != PORTS; ++i) {
+            neighbors[i] =
+                    neighbor_storage_index(locator, dimensions, bricks, i);
+        }
+    } else {
+        const size_t stride_y = dimensions.x;
+        const size_t stride_z = dimensions.x * dimensions.y;
+        neighbors[id_port_nx] = index - 1;
+        neighbors[id_port_px] = index + 1;
+        neighbors[id_port_ny] = index - stride_y;
+        neighbors[id_port_py] = index + stride_y;
+        neighbors[id_port_nz] = index - stride_z;
+        neighbors[id_port_pz] = index + stride_z;
     }
 
-    previous[index] = next_pressure;
+    for (int band = 0; band != BANDS; ++band) {
+        float sum = 0;
+        for (int i = 0; i != PORTS; ++i) {
+            sum += current[neighbors[i] * BANDS + band];
+        }
+
+        const size_t element = index * BANDS + band;
+        const float next_pressure = sum / (PORTS / 2) - previous[element];
+
+        check_pressure(next_pressure, error_flag);
+
+        previous[element] = next_pressure;
+    }
+#endif
 }
 
+#define BOUNDARY_KERNEL_TEMPLATE(dimensions)                                  \
+    kernel void CAT(condensed_waveguide_boundary_, dimensions)(               \
+            global float* previous,                                           \
+            const global float* current,                                      \
+            const global condensed_node* nodes,                               \
+            const global uint* indices,                                       \
+            int3 dim,                                                         \
+            const global uint* bricks,                                        \
+            global filt_real* filter_memory,                                  \
+            const global uint* coefficient_indices,                           \
+            uint boundary_nodes,                                              \
+            const global coefficients_canonical* boundary_coefficients,       \
+            volatile global int* error_flag) {                                \
+        const boundary_filters filters = {filter_memory,                      \
+                                          coefficient_indices,                \
+                                          boundary_nodes,                     \
+                                          dimensions};                        \
+        const size_t index = indices[get_global_id(0)];                       \
+        const int3 locator = storage_locator(index, dim, bricks);             \
+        const condensed_node node = nodes[index];                             \
+        for (int band = 0; band != BANDS; ++band) {                           \
+            const size_t element = index * BANDS + band;                      \
+            const float next_pressure =                                       \
+                    CAT(boundary_, dimensions)(current,                       \
+                                               previous[element],             \
+                                               node,                          \
+                                               nodes,                         \
+                                               locator,                       \
+                                               dim,                           \
+                                               bricks,                        \
+                                               filters,                       \
+                                               boundary_coefficients,         \
+                                               band,                          \
+                                               error_flag);                   \
+            check_pressure(next_pressure, error_flag);                        \
+            previous[element] = next_pressure;                                \
+        }                                                                     \
+    }
+
+BOUNDARY_KERNEL_TEMPLATE(1);
+BOUNDARY_KERNEL_TEMPLATE(2);
+BOUNDARY_KERNEL_TEMPLATE(3);
+
 )";
 
-program::program(const core::compute_context& cc)
+namespace {
+
+std::string to_float_literal(double x) {
+    std::ostringstream ss;
+    ss << std::showpoint << std::setprecision(9) << x;
+    return "(" + ss.str() + "f)";
+}
+
+std::string stencil_definitions(stencil s) {
+    const auto c = get_coefficients(s);
+    return "#define STENCIL_COMPACT " +
+           std::to_string(s != stencil::rectilinear) + "\n" +
+           "#define STENCIL_COURANT " + to_float_literal(c.courant) + "\n" +
+           "#define STENCIL_AXIAL " + to_float_literal(c.axial) + "\n" +
+           "#define STENCIL_SIDE_DIAGONAL " +
+           to_float_literal(c.side_diagonal) + "\n" +
+           "#define STENCIL_DIAGONAL " + to_float_literal(c.diagonal) + "\n" +
+           "#define STENCIL_CENTRE " + to_float_literal(c.centre) + "\n";
+}
+
+}  // namespace
+
+program::program(const core::compute_context& cc, size_t bands, stencil s)
         : program_wrapper_{
                   cc,
                   std::vector<std::string>{
+                          "#define BANDS " + std::to_string(bands) + "\n",
+                          stencil_definitions(s),
                           cl_sources::filter_constants,
                           core::cl_representation_v<filt_real>,
                           core::cl_representation_v<memory_biquad>,
@@ -546,10 +1101,7 @@ program::program(const core::compute_context& cc)
                           core::cl_representation_v<mesh_descriptor>,
                           core::cl_representation_v<error_code>,
                           core::cl_representation_v<condensed_node>,
-                          core::cl_representation_v<boundary_data>,
-                          core::cl_representation_v<boundary_data_array_1>,
-                          core::cl_representation_v<boundary_data_array_2>,
-                          core::cl_representation_v<boundary_data_array_3>,
+                          core::cl_representation_v<node_run>,
                           core::cl_representation_v<boundary_type>,
                           cl_sources::filters,
                           cl_sources::utils,
@@ -0,0 +1,229 @@
+#include "waveguide/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+namespace wayverb {
+namespace waveguide {
+
+resampling_ratio compute_resampling_ratio(double in_sr,
+                                          double out_sr,
+                                          size_t max_up) {
+    if (!(0 < in_sr && 0 < out_sr)) {
+        throw std::runtime_error{"Sampling rates must be positive."};
+    }
+
+    //  Walk the continued fraction expansion of the ratio, keeping the last
+    //  convergent whose numerator is small enough.
+    const auto target = out_sr / in_sr;
+    auto x = target;
+    size_t num = 1, den = 0, prev_num = 0, prev_den = 1;
+    for (auto i = 0; i != 64; ++i) {
+        const auto whole = std::floor(x);
+        const auto next_num = static_cast<size_t>(whole) * num + prev_num;
+        const auto next_den = static_cast<size_t>(whole) * den + prev_den;
+        if (max_up < next_num) {
+            break;
+        }
+        prev_num = num;
+        prev_den = den;
+        num = next_num;
+        den = next_den;
+
+        const auto remainder = x - whole;
+        if (std::abs(static_cast<double>(num) / den - target) <=
+                    target * 1.0e-12 ||
+            remainder < 1.0e-12) {
+            break;
+        }
+        x = 1 / remainder;
+    }
+
+    if (den == 0 || num == 0) {
+        throw std::runtime_error{
+                "Can't find a resampling ratio with a small enough "
+                "numerator."};
+    }
+    return {num, den};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct filter_parameters final {
+    /// Zero crossings of the sinc on each side of the centre.
+    double zero_crossings;
+    /// Passband edge, as a proportion of the lower of the two Nyquist
+    /// frequencies.
+    double rolloff;
+    /// Kaiser window shape. Higher values give more stopband attenuation
+    /// and a wider transition band.
+    double beta;
+};
+
+filter_parameters get_parameters(resampler_quality quality) {
+    switch (quality) {
+        case resampler_quality::fast: return {8, 0.85, 6};
+        case resampler_quality::medium: return {16, 0.9, 8};
+        case resampler_quality::best: return {32, 0.94, 10};
+    }
+    throw std::runtime_error{"Unknown resampler quality."};
+}
+
+/// Zeroth-order modified Bessel function of the first kind.
+double bessel_i0(double x) {
+    auto ret = 1.0;
+    auto term = 1.0;
+    for (auto k = 1; k != 64; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        ret += term;
+        if (term < ret * 1.0e-16) {
+            break;
+        }
+    }
+    return ret;
+}
+
+double sinc(double x) {
+    return x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+}
+
+/// Splitting the sum across several accumulators breaks the dependency
+/// chain, so that the compiler is free to vectorise the loop.
+/// `size` must be a multiple of 4.
+float dot_product(const float* a, const float* b, size_t size) {
+    float sum[4]{};
+    for (size_t i = 0; i != size; i += 4) {
+        sum[0] += a[i + 0] * b[i + 0];
+        sum[1] += a[i + 1] * b[i + 1];
+        sum[2] += a[i + 2] * b[i + 2];
+        sum[3] += a[i + 3] * b[i + 3];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+}  // namespace
+
+resampler::resampler(double in_sr, double out_sr, resampler_quality quality)
+        : ratio_{compute_resampling_ratio(in_sr, out_sr)} {
+    const auto up = ratio_.up;
+    const auto params = get_parameters(quality);
+
+    //  The prototype runs at the upsampled rate. Its cutoff (in cycles per
+    //  upsampled sample) sits below the lower of the two Nyquist
+    //  frequencies.
+    const auto cutoff = 0.5 * params.rolloff / std::max(up, ratio_.down);
+    const auto half_length = static_cast<size_t>(
+            std::ceil(params.zero_crossings / (2 * cutoff)));
+
+    //  Round the taps per phase up to a multiple of 4, to suit the dot
+    //  product.
+    taps_ = (2 * half_length / up + 1 + 3) / 4 * 4;
+    centre_ = half_length;
+
+    const auto window_norm = 1 / bessel_i0(params.beta);
+    const auto length = taps_ * up;
+    util::aligned::vector<double> prototype(length, 0);
+    for (size_t i = 0; i != length; ++i) {
+        const auto x = static_cast<double>(i) - static_cast<double>(centre_);
+        const auto r = x / half_length;
+        if (std::abs(r) <= 1) {
+            //  Scaling by `up` restores the level lost by zero-stuffing.
+            prototype[i] = up * 2 * cutoff * sinc(2 * cutoff * x) *
+                           bessel_i0(params.beta * std::sqrt(1 - r * r)) *
+                           window_norm;
+        }
+    }
+
+    //  Reverse each phase, so that it multiplies the input in order.
+    table_.resize(length);
+    for (size_t phase = 0; phase != up; ++phase) {
+        for (size_t m = 0; m != taps_; ++m) {
+            table_[phase * taps_ + m] =
+                    prototype[phase + (taps_ - 1 - m) * up];
+        }
+    }
+
+    history_.assign(taps_ - 1, 0);
+    history_end_ = history_.size();
+}
+
+size_t resampler::first_input(size_t output_index) const {
+    return (output_index * ratio_.down + centre_) / ratio_.up;
+}
+
+void resampler::compute_available(util::aligned::vector<float>& output) {
+    for (auto first = first_input(output_index_);
+         first + taps_ <= history_end_;
+         first = first_input(++output_index_)) {
+        const auto phase =
+                (output_index_ * ratio_.down + centre_) % ratio_.up;
+        output.emplace_back(
+                dot_product(table_.data() + phase * taps_,
+                            history_.data() + (first - history_begin_),
+                            taps_));
+    }
+
+    //  Drop input which no later output will read.
+    const auto first = std::min(first_input(output_index_), history_end_);
+    if (history_begin_ < first) {
+        history_.erase(history_.begin(),
+                       history_.begin() + (first - history_begin_));
+        history_begin_ = first;
+    }
+}
+
+void resampler::push(const float* begin,
+                     const float* end,
+                     util::aligned::vector<float>& output) {
+    history_.insert(history_.end(), begin, end);
+    history_end_ += std::distance(begin, end);
+    input_size_ += std::distance(begin, end);
+    compute_available(output);
+}
+
+void resampler::flush(util::aligned::vector<float>& output) {
+    //  Every output sample which falls before the end of the input.
+    const auto total =
+            (input_size_ * ratio_.up + ratio_.down - 1) / ratio_.down;
+    if (output_index_ < total) {
+        //  Enough zeros for the filter of the final output to run off the
+        //  end of the input.
+        const auto required = first_input(total - 1) + taps_;
+        if (history_end_ < required) {
+            history_.resize(history_.size() + (required - history_end_), 0);
+            history_end_ = required;
+        }
+        compute_available(output);
+        output.resize(output.size() - (output_index_ - total));
+    }
+
+    history_.assign(taps_ - 1, 0);
+    history_begin_ = 0;
+    history_end_ = history_.size();
+    input_size_ = 0;
+    output_index_ = 0;
+}
+
+resampling_ratio resampler::get_ratio() const { return ratio_; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+util::aligned::vector<float> resample(const float* data,
+                                      size_t size,
+                                      double in_sr,
+                                      double out_sr,
+                                      resampler_quality quality) {
+    resampler r{in_sr, out_sr, quality};
+    util::aligned::vector<float> ret;
+    ret.reserve(size * r.get_ratio().up / r.get_ratio().down + 1);
+    r.push(data, data + size, ret);
+    r.flush(ret);
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -1,15 +1,78 @@
 #include "waveguide/setup.h"
 #include "waveguide/mesh_setup_program.h"
+#include "waveguide/stable.h"
+
+#include "core/conversions.h"
+
+#include "utilities/popcount.h"
+
+#include "glm/glm.hpp"
 
 namespace wayverb {
 namespace waveguide {
 
+node_index_data compute_node_index_data(
+        const mesh_descriptor& descriptor,
+        const util::aligned::vector<condensed_node>& nodes,
+        const std::experimental::optional<brick_map>& bricks) {
+    node_index_data ret;
+
+    const auto dim = core::to_ivec3{}(descriptor.dimensions);
+    const auto on_edge = [&](size_t index) {
+        const auto locator = bricks ? compute_locator(*bricks, index)
+                                    : compute_locator(descriptor, index);
+        return glm::any(glm::equal(locator, glm::ivec3{0})) ||
+               glm::any(glm::equal(locator, dim - 1));
+    };
+
+    const auto add_interior = [&](cl_uint index) {
+        auto& runs = ret.interior;
+        if (!runs.empty() && runs.back().begin + runs.back().length == index &&
+            runs.back().length != node_run::max_length) {
+            runs.back().length += 1;
+        } else {
+            runs.emplace_back(node_run{index, 1});
+        }
+    };
+
+    //  This must match the switch in next_waveguide_pressure.
+    for (auto i = 0u, e = static_cast<unsigned>(nodes.size()); i != e; ++i) {
+        const auto boundary_type = nodes[i].boundary_type;
+        switch (util::popcount(boundary_type)) {
+            case 1:
+                if (boundary_type & id_inside ||
+                    boundary_type & id_reentrant) {
+                    if (on_edge(i)) {
+                        ret.other.emplace_back(i);
+                    } else {
+                        add_interior(i);
+                    }
+                } else {
+                    ret.boundary_1.emplace_back(i);
+                }
+                break;
+            case 2: ret.boundary_2.emplace_back(i); break;
+            case 3: ret.boundary_3.emplace_back(i); break;
+            //  Outside nodes are always zero.
+            default: break;
+        }
+    }
+
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 vectors::vectors(util::aligned::vector<condensed_node> nodes,
                  util::aligned::vector<coefficients_canonical> coefficients,
-                 boundary_index_data boundary_index_data)
+                 boundary_index_data boundary_index_data,
+                 node_index_data node_index_data,
+                 std::experimental::optional<brick_map> bricks)
         : condensed_nodes_(std::move(nodes))
         , coefficients_(std::move(coefficients))
-        , boundary_index_data_(std::move(boundary_index_data)) {
+        , boundary_index_data_(std::move(boundary_index_data))
+        , node_index_data_(std::move(node_index_data))
+        , brick_map_(std::move(bricks)) {
 #ifndef NDEBUG
     auto throw_if_mismatch = [&](auto checker, auto size) {
         if (count_boundary_type(condensed_nodes_.begin(),
@@ -23,6 +86,14 @@ vectors::vectors(util::aligned::vector<condensed_node> nodes,
     throw_if_mismatch(is_boundary<1>, boundary_index_data_.b1.size());
     throw_if_mismatch(is_boundary<2>, boundary_index_data_.b2.size());
     throw_if_mismatch(is_boundary<3>, boundary_index_data_.b3.size());
+
+    if (node_index_data_.boundary_1.size() != boundary_index_data_.b1.size() ||
+        node_index_data_.boundary_2.size() != boundary_index_data_.b2.size() ||
+        node_index_data_.boundary_3.size() != boundary_index_data_.b3.size()) {
+        throw std::runtime_error(
+                "Number of boundary indices does not match number of "
+                "boundaries.");
+    }
 #endif
 }
 
@@ -31,12 +102,33 @@ const util::aligned::vector<condensed_node>& vectors::get_condensed_nodes()
     return condensed_nodes_;
 }
 
+const node_index_data& vectors::get_node_indices() const {
+    return node_index_data_;
+}
+
+const std::experimental::optional<brick_map>& vectors::get_brick_map() const {
+    return brick_map_;
+}
+
 const util::aligned::vector<coefficients_canonical>& vectors::get_coefficients()
         const {
     return coefficients_;
 }
 
+namespace {
+
+void throw_if_unstable(const coefficients_canonical& c) {
+    if (!is_stable_filter(c)) {
+        throw std::runtime_error(
+                "Boundary filter is unstable at the current filter "
+                "precision.");
+    }
+}
+
+}  // namespace
+
 void vectors::set_coefficients(coefficients_canonical c) {
+    throw_if_unstable(c);
     std::fill(begin(coefficients_), end(coefficients_), c);
 }
 
@@ -47,6 +139,9 @@ void vectors::set_coefficients(
                 "Size of new coefficients vector must be equal to the existing "
                 "one in order to maintain object invariants.");
     }
+    for (const auto& i : c) {
+        throw_if_unstable(i);
+    }
     coefficients_ = std::move(c);
 }
 
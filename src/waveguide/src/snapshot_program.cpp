@@ -0,0 +1,72 @@
+#include "waveguide/snapshot_program.h"
+
+namespace wayverb {
+namespace waveguide {
+
+constexpr auto source = R"(
+//  Must match brick_map::brick_size.
+#define BRICK_SIZE (4)
+
+int to_flat_index(int3 locator, int3 dimensions);
+int to_flat_index(int3 locator, int3 dimensions) {
+    return locator.x + locator.y * dimensions.x +
+           locator.z * dimensions.x * dimensions.y;
+}
+
+//  `bricks` is the table from compute_brick_table, or null if the mesh is not
+//  compacted.
+//  Unstored bricks map to slot 0, which only holds zeros.
+size_t stored_index(int3 locator, int3 dimensions, const global uint* bricks);
+size_t stored_index(int3 locator, int3 dimensions, const global uint* bricks) {
+    if (!bricks) {
+        return to_flat_index(locator, dimensions);
+    }
+    const int3 brick_dimensions = (dimensions + (BRICK_SIZE - 1)) / BRICK_SIZE;
+    const size_t slot =
+            bricks[to_flat_index(locator / BRICK_SIZE, brick_dimensions)];
+    return slot * BRICK_SIZE * BRICK_SIZE * BRICK_SIZE +
+           to_flat_index(locator % BRICK_SIZE, (int3)(BRICK_SIZE));
+}
+
+//  One thread per node in the box.
+float read_pressure(const global float* pressures,
+                    int3 dimensions,
+                    const global uint* bricks,
+                    int3 origin,
+                    int3 extent) {
+    const int thread = get_global_id(0);
+    const int3 locator = origin + (int3)(thread % extent.x,
+                                         thread / extent.x % extent.y,
+                                         thread / (extent.x * extent.y));
+    return pressures[stored_index(locator, dimensions, bricks)];
+}
+
+kernel void snapshot(const global float* pressures,
+                     int3 dimensions,
+                     const global uint* bricks,
+                     int3 origin,
+                     int3 extent,
+                     global float* output) {
+    output[get_global_id(0)] =
+            read_pressure(pressures, dimensions, bricks, origin, extent);
+}
+
+kernel void quantised_snapshot(const global float* pressures,
+                               int3 dimensions,
+                               const global uint* bricks,
+                               int3 origin,
+                               int3 extent,
+                               float range,
+                               global uchar* output) {
+    const float pressure =
+            read_pressure(pressures, dimensions, bricks, origin, extent);
+    output[get_global_id(0)] =
+            convert_uchar_sat_rte((pressure / range + 1) * 127.5f);
+}
+)";
+
+snapshot_program::snapshot_program(const core::compute_context& cc)
+        : wrapper_{cc, source} {}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,33 @@
+#include "waveguide/source_program.h"
+
+namespace wayverb {
+namespace waveguide {
+
+constexpr auto source = R"(
+//  Pressures are stored node-major, band-minor.
+//  Each source's signal starts at source_index * signal_stride.
+kernel void inject_sources(global float* pressures,
+                           const global uint* nodes,
+                           const global int* soft,
+                           const global uint* lengths,
+                           const global float* signals,
+                           uint sources,
+                           uint signal_stride,
+                           uint step) {
+    const size_t band = get_global_id(0);
+    const size_t bands = get_global_size(0);
+    for (uint i = 0; i != sources; ++i) {
+        if (step < lengths[i]) {
+            const float value = signals[i * signal_stride + step];
+            global float* pressure = pressures + nodes[i] * bands + band;
+            *pressure = soft[i] ? *pressure + value : value;
+        }
+    }
+}
+)";
+
+source_program::source_program(const core::compute_context& cc)
+        : wrapper_{cc, source} {}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,110 @@
+#include "waveguide/stencil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace wayverb {
+namespace waveguide {
+
+stencil_coefficients get_coefficients(stencil s) {
+    switch (s) {
+        case stencil::rectilinear:
+            return {1 / std::sqrt(3.0), 1 / 3.0, 0, 0, 0};
+        case stencil::interpolated_wideband:
+            return {1, 1 / 4.0, 1 / 8.0, 1 / 16.0, -3 / 2.0};
+    }
+    throw std::runtime_error{"Unknown stencil."};
+}
+
+namespace {
+
+/// Twice the cosine of the angular frequency of a plane wave with
+/// normalised wavenumber `k` (radians per node) which the scheme supports.
+double compute_stencil_response(const stencil_coefficients& c,
+                                const glm::dvec3& k) {
+    const auto x = std::cos(k.x);
+    const auto y = std::cos(k.y);
+    const auto z = std::cos(k.z);
+    return 2 * c.axial * (x + y + z) +
+           4 * c.side_diagonal * (x * y + x * z + y * z) +
+           8 * c.diagonal * x * y * z + c.centre;
+}
+
+}  // namespace
+
+double compute_relative_phase_velocity(stencil s,
+                                       double normalised_frequency,
+                                       const glm::dvec3& direction) {
+    if (normalised_frequency <= 0) {
+        return 1;
+    }
+
+    const auto c = get_coefficients(s);
+    const auto unit = glm::normalize(direction);
+    const auto omega = 2 * M_PI * normalised_frequency;
+    const auto target = 2 * std::cos(omega);
+
+    //  The response falls from 2 (at zero wavenumber) as the wavenumber
+    //  grows, until one component reaches the edge of the grid's Brillouin
+    //  zone. Find where it meets the target by bisection.
+    const auto largest = std::max({std::abs(unit.x),
+                                   std::abs(unit.y),
+                                   std::abs(unit.z)});
+    auto lower = 0.0;
+    auto upper = M_PI / largest;
+    if (target < compute_stencil_response(c, unit * upper)) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    for (auto i = 0; i != 64; ++i) {
+        const auto middle = (lower + upper) / 2;
+        if (target < compute_stencil_response(c, unit * middle)) {
+            lower = middle;
+        } else {
+            upper = middle;
+        }
+    }
+
+    const auto wavenumber = (lower + upper) / 2;
+    return omega / (wavenumber * c.courant);
+}
+
+double compute_dispersion_error(stencil s, double normalised_frequency) {
+    constexpr auto steps = 16;
+    auto ret = 0.0;
+    for (auto i = 0; i <= steps; ++i) {
+        const auto azimuth = M_PI / 2 * i / steps;
+        for (auto j = 0; j <= steps; ++j) {
+            const auto elevation = M_PI / 2 * j / steps;
+            const auto velocity = compute_relative_phase_velocity(
+                    s,
+                    normalised_frequency,
+                    glm::dvec3{std::cos(azimuth) * std::cos(elevation),
+                               std::sin(azimuth) * std::cos(elevation),
+                               std::sin(elevation)});
+            if (std::isnan(velocity)) {
+                return std::numeric_limits<double>::infinity();
+            }
+            ret = std::max(ret, std::abs(1 - velocity));
+        }
+    }
+    return ret;
+}
+
+double compute_valid_bandwidth(stencil s, double max_error) {
+    constexpr auto resolution = 0.001;
+    auto ret = 0.0;
+    for (auto frequency = resolution; frequency < 0.5;
+         frequency += resolution) {
+        if (max_error < compute_dispersion_error(s, frequency)) {
+            break;
+        }
+        ret = frequency;
+    }
+    return ret;
+}
+
+}  // namespace waveguide
+}  // namespace wayverb
@@ -0,0 +1,628 @@
+#include "waveguide/stepper.h"
+#include "waveguide/mesh.h"
+#include "waveguide/native/engine.h"
+#include "waveguide/native/out_of_core.h"
+#include "waveguide/program.h"
+
+#include "utilities/fnv1a.h"
+
+#include <istream>
+#include <ostream>
+
+namespace wayverb {
+namespace waveguide {
+namespace {
+
+/// The filter state and coefficient indices of the boundary nodes which
+/// touch the same number of boundaries, laid out as described in program.h.
+struct boundary_filter_buffers final {
+    cl::Buffer filter_memory;
+    cl::Buffer coefficient_indices;
+    cl_uint nodes{};
+    size_t memory_bytes{};
+};
+
+template <size_t n>
+boundary_filter_buffers make_boundary_filter_buffers(
+        const cl::Context& context, const vectors& structure, size_t bands) {
+    boundary_filter_buffers ret;
+    ret.nodes = structure.get_boundary_indices<n>().size();
+
+    const auto lanes = n * bands * ret.nodes;
+    ret.memory_bytes = sizeof(filt_real) * memory_canonical::order * lanes;
+
+    //  Zero-sized buffers are not allowed, and won't be dispatched anyway.
+    if (ret.nodes) {
+        ret.filter_memory = core::load_to_buffer(
+                context,
+                util::aligned::vector<filt_real>(
+                        memory_canonical::order * lanes, 0),
+                false);
+        ret.coefficient_indices = core::load_to_buffer(
+                context, get_coefficient_index_table<n>(structure), true);
+    }
+    return ret;
+}
+
+/// Interleaves per-band coefficients, so that each surface's coefficients
+/// for all bands are adjacent.
+util::aligned::vector<coefficients_canonical> pack_coefficients(
+        const mesh& mesh,
+        const util::aligned::vector<
+                util::aligned::vector<coefficients_canonical>>&
+                band_coefficients) {
+    if (band_coefficients.empty()) {
+        throw std::runtime_error{"At least one band is required."};
+    }
+
+    const auto surfaces = mesh.get_structure().get_coefficients().size();
+    for (const auto& i : band_coefficients) {
+        if (i.size() != surfaces) {
+            throw std::runtime_error{
+                    "Each band must have one set of coefficients per "
+                    "surface."};
+        }
+    }
+
+    util::aligned::vector<coefficients_canonical> ret;
+    ret.reserve(surfaces * band_coefficients.size());
+    for (auto surface = 0u; surface != surfaces; ++surface) {
+        for (const auto& band : band_coefficients) {
+            ret.emplace_back(band[surface]);
+        }
+    }
+    return ret;
+}
+
+/// Fingerprints everything about the boundaries that a saved state depends
+/// on: the type of every node, the surfaces touched by each boundary node,
+/// and the coefficients of every surface.
+std::uint64_t compute_boundary_hash(
+        const mesh& mesh,
+        const util::aligned::vector<coefficients_canonical>& coefficients) {
+    util::fnv1a hash;
+
+    const auto& structure = mesh.get_structure();
+    for (const auto& node : structure.get_condensed_nodes()) {
+        hash(node.boundary_type);
+        hash(node.boundary_index);
+    }
+
+    const auto hash_indices = [&](const auto& indices) {
+        for (const auto& node : indices) {
+            for (const auto surface : node.array) {
+                hash(surface);
+            }
+        }
+    };
+    hash_indices(structure.get_boundary_indices<1>());
+    hash_indices(structure.get_boundary_indices<2>());
+    hash_indices(structure.get_boundary_indices<3>());
+
+    for (const auto& surface : coefficients) {
+        for (const auto i : surface.b) {
+            hash(i);
+        }
+        for (const auto i : surface.a) {
+            hash(i);
+        }
+    }
+
+    return hash.get();
+}
+
+/// Buffers are saved and restored through a staging area of this size.
+constexpr size_t staging_bytes = 1 << 22;
+
+void write_buffer(std::ostream& os,
+                  cl::CommandQueue& queue,
+                  const cl::Buffer& buffer,
+                  size_t bytes) {
+    util::aligned::vector<char> staging(std::min(bytes, staging_bytes));
+    for (size_t offset = 0; offset != bytes;) {
+        const auto chunk = std::min(staging.size(), bytes - offset);
+        queue.enqueueReadBuffer(buffer, CL_TRUE, offset, chunk, staging.data());
+        os.write(staging.data(), chunk);
+        offset += chunk;
+    }
+}
+
+void read_buffer(std::istream& is,
+                 cl::CommandQueue& queue,
+                 const cl::Buffer& buffer,
+                 size_t bytes) {
+    util::aligned::vector<char> staging(std::min(bytes, staging_bytes));
+    for (size_t offset = 0; offset != bytes;) {
+        const auto chunk = std::min(staging.size(), bytes - offset);
+        if (!is.read(staging.data(), chunk)) {
+            throw std::runtime_error{"Unable to read simulation state."};
+        }
+        queue.enqueueWriteBuffer(
+                buffer, CL_TRUE, offset, chunk, staging.data());
+        offset += chunk;
+    }
+}
+
+}  // namespace
+
+class stepper::impl {
+public:
+    impl(const core::compute_context& cc,
+         const mesh& mesh,
+         size_t bands,
+         const util::aligned::vector<coefficients_canonical>& coefficients)
+            : queue_{cc.context, cc.device}
+            , backend_{cc.backend}
+            , descriptor_{mesh.get_descriptor()}
+            , bands_{bands}
+            , boundary_hash_{compute_boundary_hash(mesh, coefficients)} {}
+
+    impl(const impl&) = delete;
+    impl& operator=(const impl&) = delete;
+    impl(impl&&) noexcept = delete;
+    impl& operator=(impl&&) noexcept = delete;
+
+    virtual ~impl() noexcept = default;
+
+    cl::CommandQueue& get_queue() { return queue_; }
+    core::compute_backend get_backend() const { return backend_; }
+    const mesh_descriptor& get_descriptor() const { return descriptor_; }
+    size_t get_bands() const { return bands_; }
+    std::uint64_t get_boundary_hash() const { return boundary_hash_; }
+    cl::Buffer& get_current() { return current_; }
+    cl::Buffer& get_previous() { return previous_; }
+
+    void swap() { std::swap(previous_, current_); }
+
+    virtual void enqueue_update() = 0;
+    virtual void reset_error_flag() = 0;
+    virtual error_code read_error_flag() = 0;
+
+    virtual size_t get_state_size() const = 0;
+    virtual void write_state(std::ostream& os) = 0;
+    virtual void read_state(std::istream& is) = 0;
+
+protected:
+    cl::CommandQueue queue_;
+    core::compute_backend backend_;
+    mesh_descriptor descriptor_;
+    size_t bands_;
+    std::uint64_t boundary_hash_;
+    cl::Buffer previous_;
+    cl::Buffer current_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class stepper::opencl_impl final : public impl {
+public:
+    opencl_impl(const core::compute_context& cc,
+                const mesh& mesh,
+                size_t bands,
+                const util::aligned::vector<coefficients_canonical>&
+                        coefficients)
+            : impl{cc, mesh, bands, coefficients}
+            , program_{cc, bands, mesh.get_stencil()}
+            , node_indices_{mesh.get_structure().get_node_indices()}
+            , dimensions_{mesh.get_descriptor().dimensions}
+            , interior_kernel_{program_.get_interior_kernel()}
+            , boundary_1_kernel_{program_.get_boundary_kernel<1>()}
+            , boundary_2_kernel_{program_.get_boundary_kernel<2>()}
+            , boundary_3_kernel_{program_.get_boundary_kernel<3>()}
+            , other_kernel_{program_.get_kernel()} {
+        const auto& structure = mesh.get_structure();
+
+        const auto num_elements =
+                structure.get_condensed_nodes().size() * bands_;
+        const auto make_zeroed_buffer = [&] {
+            auto ret = cl::Buffer{cc.context,
+                                  CL_MEM_READ_WRITE,
+                                  sizeof(cl_float) * num_elements};
+            auto kernel = program_.get_zero_buffer_kernel();
+            kernel(cl::EnqueueArgs{queue_, cl::NDRange{num_elements}}, ret);
+            return ret;
+        };
+
+        previous_ = make_zeroed_buffer();
+        current_ = make_zeroed_buffer();
+        pressure_bytes_ = sizeof(cl_float) * num_elements;
+
+        node_buffer_ = core::load_to_buffer(
+                cc.context, structure.get_condensed_nodes(), true);
+        boundary_coefficients_buffer_ =
+                core::load_to_buffer(cc.context, coefficients, true);
+        error_flag_buffer_ =
+                cl::Buffer{cc.context, CL_MEM_READ_WRITE, sizeof(cl_int)};
+
+        boundary_filters_1_ = make_boundary_filter_buffers<1>(
+                cc.context, structure, bands_);
+        boundary_filters_2_ = make_boundary_filter_buffers<2>(
+                cc.context, structure, bands_);
+        boundary_filters_3_ = make_boundary_filter_buffers<3>(
+                cc.context, structure, bands_);
+
+        //  Zero-sized buffers are not allowed, and won't be dispatched anyway.
+        const auto make_index_buffer = [&](const auto& indices) {
+            return indices.empty()
+                           ? cl::Buffer{}
+                           : core::load_to_buffer(cc.context, indices, true);
+        };
+
+        interior_buffer_ = make_index_buffer(node_indices_.interior);
+        boundary_1_buffer_ = make_index_buffer(node_indices_.boundary_1);
+        boundary_2_buffer_ = make_index_buffer(node_indices_.boundary_2);
+        boundary_3_buffer_ = make_index_buffer(node_indices_.boundary_3);
+        other_buffer_ = make_index_buffer(node_indices_.other);
+
+        //  A null buffer tells the kernels that the mesh is not compacted.
+        if (const auto& bricks = structure.get_brick_map()) {
+            brick_buffer_ = core::load_to_buffer(
+                    cc.context, compute_brick_table(*bricks), true);
+        }
+    }
+
+    //  Each class of node gets its own kernel, so that the common (interior)
+    //  case doesn't have to branch on the node type.
+    //  They all go to the same in-order queue, and each node is updated by
+    //  exactly one of them, so they don't need to synchronise.
+    void enqueue_update() override {
+        dispatch(interior_kernel_,
+                 node_indices_.interior.size() * node_run::max_length,
+                 previous_,
+                 current_,
+                 interior_buffer_,
+                 dimensions_,
+                 brick_buffer_,
+                 error_flag_buffer_);
+        dispatch(boundary_1_kernel_,
+                 node_indices_.boundary_1.size(),
+                 previous_,
+                 current_,
+                 node_buffer_,
+                 boundary_1_buffer_,
+                 dimensions_,
+                 brick_buffer_,
+                 boundary_filters_1_.filter_memory,
+                 boundary_filters_1_.coefficient_indices,
+                 boundary_filters_1_.nodes,
+                 boundary_coefficients_buffer_,
+                 error_flag_buffer_);
+        dispatch(boundary_2_kernel_,
+                 node_indices_.boundary_2.size(),
+                 previous_,
+                 current_,
+                 node_buffer_,
+                 boundary_2_buffer_,
+                 dimensions_,
+                 brick_buffer_,
+                 boundary_filters_2_.filter_memory,
+                 boundary_filters_2_.coefficient_indices,
+                 boundary_filters_2_.nodes,
+                 boundary_coefficients_buffer_,
+                 error_flag_buffer_);
+        dispatch(boundary_3_kernel_,
+                 node_indices_.boundary_3.size(),
+                 previous_,
+                 current_,
+                 node_buffer_,
+                 boundary_3_buffer_,
+                 dimensions_,
+                 brick_buffer_,
+                 boundary_filters_3_.filter_memory,
+                 boundary_filters_3_.coefficient_indices,
+                 boundary_filters_3_.nodes,
+                 boundary_coefficients_buffer_,
+                 error_flag_buffer_);
+        dispatch(other_kernel_,
+                 node_indices_.other.size(),
+                 previous_,
+                 current_,
+                 node_buffer_,
+                 other_buffer_,
+                 dimensions_,
+                 brick_buffer_,
+                 boundary_filters_1_.filter_memory,
+                 boundary_filters_1_.coefficient_indices,
+                 boundary_filters_1_.nodes,
+                 boundary_filters_2_.filter_memory,
+                 boundary_filters_2_.coefficient_indices,
+                 boundary_filters_2_.nodes,
+                 boundary_filters_3_.filter_memory,
+                 boundary_filters_3_.coefficient_indices,
+                 boundary_filters_3_.nodes,
+                 boundary_coefficients_buffer_,
+                 error_flag_buffer_);
+    }
+
+    void reset_error_flag() override {
+        const auto value = cl_int{id_success};
+        queue_.enqueueWriteBuffer(
+                error_flag_buffer_, CL_TRUE, 0, sizeof(cl_int), &value);
+    }
+
+    error_code read_error_flag() override {
+        return core::read_value<error_code>(queue_, error_flag_buffer_, 0);
+    }
+
+    size_t get_state_size() const override {
+        return 2 * pressure_bytes_ + boundary_filters_1_.memory_bytes +
+               boundary_filters_2_.memory_bytes +
+               boundary_filters_3_.memory_bytes;
+    }
+
+    void write_state(std::ostream& os) override {
+        write_buffer(os, queue_, previous_, pressure_bytes_);
+        write_buffer(os, queue_, current_, pressure_bytes_);
+        for (const auto* filters : {&boundary_filters_1_,
+                                    &boundary_filters_2_,
+                                    &boundary_filters_3_}) {
+            write_buffer(os,
+                         queue_,
+                         filters->filter_memory,
+                         filters->memory_bytes);
+        }
+    }
+
+    void read_state(std::istream& is) override {
+        read_buffer(is, queue_, previous_, pressure_bytes_);
+        read_buffer(is, queue_, current_, pressure_bytes_);
+        for (const auto* filters : {&boundary_filters_1_,
+                                    &boundary_filters_2_,
+                                    &boundary_filters_3_}) {
+            read_buffer(is,
+                        queue_,
+                        filters->filter_memory,
+                        filters->memory_bytes);
+        }
+    }
+
+private:
+    template <typename Kernel, typename... Ts>
+    void dispatch(Kernel& kernel, size_t work_items, Ts&&... params) {
+        if (work_items) {
+            kernel(cl::EnqueueArgs(queue_, cl::NDRange(work_items)),
+                   std::forward<Ts>(params)...);
+        }
+    }
+
+    using interior_kernel_t =
+            decltype(std::declval<program>().get_interior_kernel());
+    template <size_t n>
+    using boundary_kernel_t =
+            decltype(std::declval<program>().get_boundary_kernel<n>());
+    using other_kernel_t = decltype(std::declval<program>().get_kernel());
+
+    program program_;
+    node_index_data node_indices_;
+    cl_int3 dimensions_;
+    size_t pressure_bytes_;
+
+    cl::Buffer node_buffer_;
+    cl::Buffer boundary_coefficients_buffer_;
+    cl::Buffer error_flag_buffer_;
+    boundary_filter_buffers boundary_filters_1_;
+    boundary_filter_buffers boundary_filters_2_;
+    boundary_filter_buffers boundary_filters_3_;
+
+    cl::Buffer interior_buffer_;
+    cl::Buffer boundary_1_buffer_;
+    cl::Buffer boundary_2_buffer_;
+    cl::Buffer boundary_3_buffer_;
+    cl::Buffer other_buffer_;
+    cl::Buffer brick_buffer_;
+
+    interior_kernel_t interior_kernel_;
+    boundary_kernel_t<1> boundary_1_kernel_;
+    boundary_kernel_t<2> boundary_2_kernel_;
+    boundary_kernel_t<3> boundary_3_kernel_;
+    other_kernel_t other_kernel_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// Runs the mesh update on the host, using native::engine.
+/// The pressure buffers are created over host memory, so that the engine can
+/// update them in-place while pre- and post-processors still see ordinary
+/// OpenCL buffers.
+/// That memory is either a pair of vectors, or a pair of memory-mapped files.
+/// Mapping the buffers every step is only free because the device shares
+/// host memory, so out-of-core steppers are restricted to CPU devices.
+class stepper::native_impl final : public impl {
+public:
+    native_impl(const core::compute_context& cc, const mesh& mesh)
+            : impl{cc, mesh, 1, mesh.get_structure().get_coefficients()}
+            , engine_{mesh}
+            , previous_storage_(engine_.get_num_nodes(), 0)
+            , current_storage_(engine_.get_num_nodes(), 0) {
+        previous_ = make_host_buffer(cc, previous_storage_.data());
+        current_ = make_host_buffer(cc, current_storage_.data());
+    }
+
+    native_impl(const core::compute_context& cc,
+                const mesh& mesh,
+                const native::out_of_core_parameters& out_of_core)
+            : impl{cc, mesh, 1, mesh.get_structure().get_coefficients()}
+            , engine_{mesh}
+            , files_{std::make_unique<native::pressure_files>(
+                      engine_, out_of_core)} {
+        previous_ = make_host_buffer(cc, files_->get_field(0));
+        current_ = make_host_buffer(cc, files_->get_field(1));
+    }
+
+    void enqueue_update() override {
+        //  Mapping makes sure that writes from the preprocessor are visible
+        //  on the host, and that our writes are visible to the device.
+        const auto previous_ptr = map(previous_);
+        const auto current_ptr = map(current_);
+
+        if (files_) {
+            //  A single blocked step sweeps the mesh in order, so the files
+            //  can be streamed through.
+            //  step_blocked swaps its arguments, so pass copies.
+            auto previous = previous_ptr;
+            auto current = current_ptr;
+            files_->begin_pass();
+            error_flag_ |= engine_.step_blocked(
+                    previous,
+                    current,
+                    1,
+                    [](auto, auto, auto, auto) {},
+                    [&](auto begin, auto end) {
+                        files_->advance(begin, end);
+                    });
+            files_->end_pass();
+        } else {
+            error_flag_ |= engine_.step(previous_ptr, current_ptr);
+        }
+
+        queue_.enqueueUnmapMemObject(current_, current_ptr);
+        queue_.enqueueUnmapMemObject(previous_, previous_ptr);
+    }
+
+    void reset_error_flag() override { error_flag_ = id_success; }
+
+    error_code read_error_flag() override {
+        queue_.finish();
+        return static_cast<error_code>(error_flag_);
+    }
+
+    size_t get_state_size() const override {
+        return 2 * sizeof(cl_float) * engine_.get_num_nodes() +
+               engine_.get_boundary_state_size();
+    }
+
+    void write_state(std::ostream& os) override {
+        for (const auto& buffer : {previous_, current_}) {
+            const auto ptr = map(buffer);
+            os.write(reinterpret_cast<const char*>(ptr),
+                     sizeof(cl_float) * engine_.get_num_nodes());
+            queue_.enqueueUnmapMemObject(buffer, ptr);
+        }
+        queue_.finish();
+        engine_.write_boundary_state(os);
+    }
+
+    void read_state(std::istream& is) override {
+        for (const auto& buffer : {previous_, current_}) {
+            const auto ptr = map(buffer);
+            is.read(reinterpret_cast<char*>(ptr),
+                    sizeof(cl_float) * engine_.get_num_nodes());
+            queue_.enqueueUnmapMemObject(buffer, ptr);
+        }
+        queue_.finish();
+        if (!is) {
+            throw std::runtime_error{"Unable to read simulation state."};
+        }
+        engine_.read_boundary_state(is);
+    }
+
+private:
+    cl::Buffer make_host_buffer(const core::compute_context& cc,
+                                cl_float* storage) const {
+        return cl::Buffer{cc.context,
+                          CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+                          sizeof(cl_float) * engine_.get_num_nodes(),
+                          storage};
+    }
+
+    cl_float* map(const cl::Buffer& buffer) {
+        return static_cast<cl_float*>(queue_.enqueueMapBuffer(
+                buffer,
+                CL_TRUE,
+                CL_MAP_READ | CL_MAP_WRITE,
+                0,
+                sizeof(cl_float) * engine_.get_num_nodes()));
+    }
+
+    native::engine engine_;
+    util::aligned::vector<cl_float> previous_storage_;
+    util::aligned::vector<cl_float> current_storage_;
+    std::unique_ptr<native::pressure_files> files_;
+    cl_int error_flag_{id_success};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+stepper::stepper(const core::compute_context& cc, const mesh& mesh)
+        : pimpl_{[&]() -> std::unique_ptr<impl> {
+            if (cc.backend == core::compute_backend::native) {
+                if (mesh.get_stencil() != stencil::rectilinear) {
+                    throw std::runtime_error{
+                            "The native backend only supports the rectilinear "
+                            "stencil."};
+                }
+                return std::make_unique<native_impl>(cc, mesh);
+            }
+            return std::make_unique<opencl_impl>(
+                    cc, mesh, 1, mesh.get_structure().get_coefficients());
+        }()} {}
+
+stepper::stepper(const core::compute_context& cc,
+                 const mesh& mesh,
+                 const util::aligned::vector<
+                         util::aligned::vector<coefficients_canonical>>&
+                         band_coefficients)
+        : pimpl_{[&]() -> std::unique_ptr<impl> {
+            if (cc.backend == core::compute_backend::native) {
+                throw std::runtime_error{
+                        "The native backend can't simulate several bands at "
+                        "once."};
+            }
+            return std::make_unique<opencl_impl>(
+                    cc,
+                    mesh,
+                    band_coefficients.size(),
+                    pack_coefficients(mesh, band_coefficients));
+        }()} {}
+
+stepper::stepper(const core::compute_context& cc,
+                 const mesh& mesh,
+                 const native::out_of_core_parameters& out_of_core)
+        : pimpl_{[&]() -> std::unique_ptr<impl> {
+            if (cc.backend != core::compute_backend::native) {
+                throw std::runtime_error{
+                        "Out-of-core simulation requires the native backend."};
+            }
+            if (!(cc.device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)) {
+                throw std::runtime_error{
+                        "Out-of-core simulation requires a CPU device."};
+            }
+            if (mesh.get_stencil() != stencil::rectilinear) {
+                throw std::runtime_error{
+                        "The native backend only supports the rectilinear "
+                        "stencil."};
+            }
+            return std::make_unique<native_impl>(cc, mesh, out_of_core);
+        }()} {}
+
+stepper::~stepper() noexcept = default;
+
+cl::CommandQueue& stepper::get_queue() { return pimpl_->get_queue(); }
+size_t stepper::get_bands() const { return pimpl_->get_bands(); }
+
+core::compute_backend stepper::get_backend() const {
+    return pimpl_->get_backend();
+}
+
+std::uint64_t stepper::get_boundary_hash() const {
+    return pimpl_->get_boundary_hash();
+}
+
+const mesh_descriptor& stepper::get_descriptor() const {
+    return pimpl_->get_descriptor();
+}
+cl::Buffer& stepper::get_current() { return pimpl_->get_current(); }
+cl::Buffer& stepper::get_previous() { return pimpl_->get_previous(); }
+
+void stepper::enqueue_update() { pimpl_->enqueue_update(); }
+void stepper::swap() { pimpl_->swap(); }
+
+void stepper::reset_error_flag() { pimpl_->reset_error_flag(); }
+error_code stepper::read_error_flag() { return pimpl_->read_error_flag(); }
+
+size_t stepper::get_state_size() const { return pimpl_->get_state_size(); }
+void stepper::write_state(std::ostream& os) { pimpl_->write_state(os); }
+void stepper::read_state(std::istream& is) { pimpl_->read_state(is); }
+
+}  // namespace waveguide
+}  // namespace wayverb
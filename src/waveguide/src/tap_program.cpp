@@ -0,0 +1,28 @@
+#include "waveguide/tap_program.h"
+
+namespace wayverb {
+namespace waveguide {
+
+constexpr auto source = R"(
+kernel void gather_taps(const global float* pressures,
+                        const global uint* nodes,
+                        global float* output,
+                        uint output_offset) {
+    const size_t thread = get_global_id(0);
+    output[output_offset + thread] = pressures[nodes[thread]];
+}
+
+kernel void scatter_taps(global float* pressures,
+                         const global uint* nodes,
+                         const global float* input,
+                         uint input_offset) {
+    const size_t thread = get_global_id(0);
+    pressures[nodes[thread]] = input[input_offset + thread];
+}
+)";
+
+tap_program::tap_program(const core::compute_context& cc)
+        : wrapper_{cc, source} {}
+
+}  // namespace waveguide
+}  // namespace wayverb
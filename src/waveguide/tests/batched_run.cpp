@@ -0,0 +1,55 @@
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(batched_run, matches_unbatched) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+
+    //  Not a multiple of the batch size, so the last batch is short.
+    util::aligned::vector<float> input(401, 0);
+    input.front() = 1;
+
+    callback_accumulator<postprocessor::node> unbatched{receiver_index};
+    const auto unbatched_steps = run(
+            cc,
+            model,
+            preprocessor::make_hard_source(
+                    source_index, input.begin(), input.end()),
+            [&](auto& queue, const auto& buffer, auto step) {
+                unbatched(queue, buffer, step);
+            },
+            true);
+
+    for (const auto batch_size : {1, 7, 64, 1000}) {
+        postprocessor::batched_node batched{receiver_index};
+        const auto batched_steps =
+                run_batched(cc,
+                            model,
+                            preprocessor::make_batched_hard_source(
+                                    source_index, input.begin(), input.end()),
+                            batched,
+                            batch_size,
+                            true);
+
+        ASSERT_EQ(unbatched_steps, batched_steps);
+        ASSERT_EQ(unbatched.get_output(), batched.get_output())
+                << "batch size " << batch_size;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "waveguide/mesh.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+#include "core/scene_data.h"
+
+/// The small box which most of the waveguide tests simulate.
+/// It is big enough to have interior, boundary and corner nodes, and small
+/// enough to run a few hundred steps quickly.
+namespace box_fixture {
+
+constexpr glm::vec3 source{0.5, 0.5, 0.5};
+constexpr glm::vec3 receiver{1.5, 1, 0.5};
+constexpr auto speed_of_sound = 340.0;
+constexpr auto sample_rate = 10000.0;
+
+inline auto get_scene_data(
+        const wayverb::core::surface<wayverb::core::simulation_bands>&
+                surface) {
+    const wayverb::core::geo::box box{glm::vec3{0, 0, 0},
+                                      glm::vec3{2, 1.5, 1}};
+    return wayverb::core::geo::get_scene_data(box, surface);
+}
+
+/// Every wall has the same, flat absorption.
+inline auto get_scene_data(float absorption = 0.2) {
+    return get_scene_data(
+            wayverb::core::make_surface<wayverb::core::simulation_bands>(
+                    absorption, 0));
+}
+
+/// A mesh of the box, with a node on the receiver.
+inline auto get_voxels_and_mesh(
+        const wayverb::core::compute_context& cc,
+        const wayverb::core::gpu_scene_data& scene = get_scene_data(),
+        double mesh_sample_rate = sample_rate,
+        wayverb::waveguide::stencil s =
+                wayverb::waveguide::stencil::rectilinear) {
+    return wayverb::waveguide::compute_voxels_and_mesh(
+            cc, scene, receiver, mesh_sample_rate, speed_of_sound, s);
+}
+
+struct node_indices final {
+    size_t source;
+    size_t receiver;
+};
+
+inline node_indices get_node_indices(const wayverb::waveguide::mesh& model) {
+    return {wayverb::waveguide::compute_index(model.get_descriptor(), source),
+            wayverb::waveguide::compute_index(model.get_descriptor(),
+                                              receiver)};
+}
+
+}  // namespace box_fixture
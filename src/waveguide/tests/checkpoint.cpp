@@ -0,0 +1,230 @@
+#include "waveguide/canonical.h"
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+using accumulator =
+        callback_accumulator<postprocessor::directional_receiver>;
+
+/// Records outputs, and cancels the simulation after a number of steps.
+struct cancelling_receiver final {
+    accumulator receiver;
+    std::atomic_bool& keep_going;
+    size_t cancel_after;
+
+    void operator()(cl::CommandQueue& queue,
+                    const cl::Buffer& buffer,
+                    size_t step) {
+        receiver(queue, buffer, step);
+        if (step + 1 == cancel_after) {
+            keep_going = false;
+        }
+    }
+
+    template <typename Archive>
+    void serialize(Archive& archive) {
+        archive(receiver);
+    }
+};
+
+bool file_exists(const std::string& path) {
+    return static_cast<bool>(std::ifstream{path});
+}
+
+}  // namespace
+
+TEST(checkpoint, resumed_matches_uninterrupted) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+
+    util::aligned::vector<float> input(401, 0);
+    input.front() = 1;
+
+    const auto make_source = [&] {
+        return preprocessor::make_hard_source(
+                source_index, input.begin(), input.end());
+    };
+    const auto make_receiver = [&] {
+        return accumulator{
+                model, box_fixture::sample_rate, 1.0, receiver_index};
+    };
+
+    auto uninterrupted = make_receiver();
+    ASSERT_EQ(run(cc, model, make_source(), uninterrupted, true),
+              input.size());
+
+    const auto path = std::string{SCRATCH_PATH} + "/checkpoint_test.chk";
+    std::remove(path.c_str());
+
+    //  Cancel part-way through, between snapshots.
+    {
+        std::atomic_bool keep_going{true};
+        cancelling_receiver cancelling{make_receiver(), keep_going, 123};
+        ASSERT_EQ(run(cc,
+                      model,
+                      make_source(),
+                      cancelling,
+                      checkpoint_parameters{path, 50},
+                      keep_going),
+                  123);
+        ASSERT_TRUE(file_exists(path));
+    }
+
+    //  Resume with freshly-constructed processors.
+    auto resumed = make_receiver();
+    ASSERT_EQ(run(cc,
+                  model,
+                  make_source(),
+                  resumed,
+                  checkpoint_parameters{path, 50},
+                  true),
+              input.size());
+    ASSERT_FALSE(file_exists(path));
+
+    const auto& a = uninterrupted.get_output();
+    const auto& b = resumed.get_output();
+    ASSERT_EQ(a.size(), b.size());
+    for (auto i = 0u; i != a.size(); ++i) {
+        ASSERT_EQ(a[i].pressure, b[i].pressure) << i;
+        ASSERT_EQ(a[i].intensity, b[i].intensity) << i;
+    }
+}
+
+TEST(checkpoint, rejects_different_mesh) {
+    const compute_context cc{};
+
+    const auto path = std::string{SCRATCH_PATH} + "/checkpoint_mesh.chk";
+    const auto nothing_extra = [](auto&) {};
+
+    {
+        const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+        stepper stepper{cc, voxels_and_mesh.mesh};
+        write_checkpoint(path, 10, stepper, nothing_extra);
+
+        //  The same mesh is fine.
+        ASSERT_EQ(*read_checkpoint(path, stepper, nothing_extra), 10u);
+    }
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(), 9000);
+    stepper stepper{cc, voxels_and_mesh.mesh};
+    EXPECT_THROW(read_checkpoint(path, stepper, nothing_extra),
+                 std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(checkpoint, rejects_different_boundaries) {
+    const compute_context cc{};
+
+    const auto path =
+            std::string{SCRATCH_PATH} + "/checkpoint_boundaries.chk";
+    const auto nothing_extra = [](auto&) {};
+
+    {
+        const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+        stepper stepper{cc, voxels_and_mesh.mesh};
+        write_checkpoint(path, 10, stepper, nothing_extra);
+    }
+
+    //  Same geometry, so the same mesh descriptor, but different materials.
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(0.5));
+    stepper stepper{cc, voxels_and_mesh.mesh};
+    EXPECT_THROW(read_checkpoint(path, stepper, nothing_extra),
+                 std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(checkpoint, canonical_resumed_matches_uninterrupted) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+
+    const environment env{};
+    const single_band_parameters params{2000, 0.6};
+    constexpr auto simulation_time = 0.04;
+
+    const auto run_canonical = [&](const std::atomic_bool& keep_going,
+                                   auto&& callback,
+                                   const auto& checkpoint) {
+        return canonical(cc,
+                         voxels_and_mesh,
+                         box_fixture::source,
+                         box_fixture::receiver,
+                         env,
+                         params,
+                         simulation_time,
+                         keep_going,
+                         callback,
+                         std::experimental::nullopt,
+                         std::experimental::nullopt,
+                         checkpoint);
+    };
+
+    const auto ignore = [](auto&, const auto&, auto, auto) {};
+    constexpr auto batch_size = wayverb::waveguide::detail::batch_size;
+
+    const auto uninterrupted =
+            run_canonical(true, ignore, std::experimental::nullopt);
+    ASSERT_TRUE(uninterrupted);
+
+    const auto path = std::string{SCRATCH_PATH} + "/checkpoint_canonical.chk";
+    std::remove(path.c_str());
+
+    //  Snapshots are only taken between batches, so cancel part-way through
+    //  one, after the first snapshot.
+    const checkpoint_parameters checkpoint{path, batch_size};
+    {
+        std::atomic_bool keep_going{true};
+        const auto cancelled = run_canonical(
+                keep_going,
+                [&](auto&, const auto&, auto step, auto) {
+                    if (step == 3 * batch_size / 2) {
+                        keep_going = false;
+                    }
+                },
+                checkpoint);
+        ASSERT_FALSE(cancelled);
+        ASSERT_TRUE(file_exists(path));
+    }
+
+    //  Only the steps after the snapshot are run again.
+    size_t first_step = 0;
+    const auto resumed = run_canonical(
+            true,
+            [&](auto&, const auto&, auto step, auto) {
+                first_step = first_step ? first_step : step;
+            },
+            checkpoint);
+    ASSERT_TRUE(resumed);
+    ASSERT_FALSE(file_exists(path));
+    ASSERT_EQ(first_step, 2 * batch_size);
+
+    const auto& a = uninterrupted->front().band.directional;
+    const auto& b = resumed->front().band.directional;
+    ASSERT_EQ(a.size(), b.size());
+    for (auto i = 0u; i != a.size(); ++i) {
+        ASSERT_EQ(a[i].pressure, b[i].pressure) << i;
+        ASSERT_EQ(a[i].intensity, b[i].intensity) << i;
+    }
+}
@@ -0,0 +1,284 @@
+#include "waveguide/mesh.h"
+#include "waveguide/native/engine.h"
+#include "waveguide/partition.h"
+#include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+#include "core/environment.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+/// An L-shaped room, made of a 2 x 0.6 m bar and a 0.6 x 1.5 m bar.
+/// A large block of its bounding box is outside the room, so compacting the
+/// mesh leaves whole bricks unstored.
+auto get_l_shaped_scene_data() {
+    const util::aligned::vector<glm::vec2> floor_plan{
+            {0, 0}, {2, 0}, {2, 0.6}, {0.6, 0.6}, {0.6, 1.5}, {0, 1.5}};
+    const cl_uint sides = floor_plan.size();
+
+    util::aligned::vector<cl_float3> vertices;
+    for (const auto z : {0.0f, 1.0f}) {
+        for (const auto& i : floor_plan) {
+            vertices.push_back(cl_float3{{i.x, i.y, z}});
+        }
+    }
+
+    util::aligned::vector<triangle> triangles;
+    //  The plan is star-shaped about its first corner, so the floor and
+    //  ceiling can be fans.
+    for (cl_uint i = 1; i + 1 != sides; ++i) {
+        triangles.push_back({0, 0, i + 1, i});
+        triangles.push_back({0, sides, sides + i, sides + i + 1});
+    }
+    for (cl_uint i = 0; i != sides; ++i) {
+        const cl_uint j = (i + 1) % sides;
+        triangles.push_back({0, i, j, sides + j});
+        triangles.push_back({0, i, sides + j, sides + i});
+    }
+
+    return make_scene_data(std::move(triangles),
+                           std::move(vertices),
+                           util::aligned::vector<surface<simulation_bands>>{
+                                   make_surface<simulation_bands>(0.2, 0)});
+}
+
+//  Either side of the corner, so that sound has to travel around it.
+constexpr glm::vec3 source{0.3, 1.2, 0.5};
+constexpr glm::vec3 receiver{1.6, 0.3, 0.5};
+
+//  Well inside the bounding box, but outside the room.
+constexpr glm::vec3 missing{1.4, 1.1, 0.5};
+
+auto get_voxels_and_mesh(const compute_context& cc) {
+    return compute_voxels_and_mesh(cc,
+                                   get_l_shaped_scene_data(),
+                                   receiver,
+                                   box_fixture::sample_rate,
+                                   box_fixture::speed_of_sound);
+}
+
+auto run_mesh(const compute_context& cc,
+              const mesh& model,
+              size_t source_index,
+              size_t receiver_index,
+              size_t steps) {
+    util::aligned::vector<float> input(steps, 0);
+    input.front() = 1;
+
+    const environment env{};
+    callback_accumulator<postprocessor::directional_receiver> postprocessor{
+            model,
+            compute_sample_rate(model.get_descriptor(), env.speed_of_sound),
+            get_ambient_density(env),
+            receiver_index};
+
+    const auto completed = run(
+            cc,
+            model,
+            preprocessor::make_hard_source(
+                    compute_storage_index(model, source_index),
+                    input.begin(),
+                    input.end()),
+            [&](auto& queue, const auto& buffer, auto step) {
+                postprocessor(queue, buffer, step);
+            },
+            true);
+
+    EXPECT_EQ(completed, steps);
+    return postprocessor.get_output();
+}
+
+}  // namespace
+
+TEST(compacted_mesh, matches_uncompacted) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+    const auto compacted = compact(model);
+
+    const auto& bricks = compacted.get_structure().get_brick_map();
+    ASSERT_TRUE(bricks);
+    ASSERT_EQ(estimate_volume(model), estimate_volume(compacted));
+
+    //  Bricks inside the bounding box must have been dropped, and nodes in
+    //  them should read from the empty brick.
+    ASSERT_LT(bricks->num_slots - 1, bricks->slots.size());
+    const auto missing_locator =
+            compute_locator(model.get_descriptor(), missing);
+    ASSERT_EQ(compute_slot(*bricks, missing_locator), 0);
+    ASSERT_THROW(compute_storage_index(
+                         compacted,
+                         compute_index(model.get_descriptor(), missing)),
+                 std::runtime_error);
+
+    const auto source_index = compute_index(model.get_descriptor(), source);
+    const auto receiver_index =
+            compute_index(model.get_descriptor(), receiver);
+    ASSERT_TRUE(is_inside(compacted, source_index));
+    ASSERT_TRUE(is_inside(compacted, receiver_index));
+
+    constexpr auto steps = 400;
+
+    const auto dense =
+            run_mesh(cc, model, source_index, receiver_index, steps);
+    const auto sparse =
+            run_mesh(cc, compacted, source_index, receiver_index, steps);
+
+    ASSERT_EQ(dense.size(), sparse.size());
+    for (auto i = 0u; i != dense.size(); ++i) {
+        ASSERT_EQ(dense[i].pressure, sparse[i].pressure) << "step " << i;
+        ASSERT_EQ(dense[i].intensity, sparse[i].intensity) << "step " << i;
+    }
+}
+
+TEST(compacted_mesh, morton_code) {
+    ASSERT_EQ(compute_morton_code(glm::ivec3{0, 0, 0}), 0);
+    ASSERT_EQ(compute_morton_code(glm::ivec3{1, 0, 0}), 1);
+    ASSERT_EQ(compute_morton_code(glm::ivec3{0, 1, 0}), 2);
+    ASSERT_EQ(compute_morton_code(glm::ivec3{0, 0, 1}), 4);
+    ASSERT_EQ(compute_morton_code(glm::ivec3{3, 3, 3}), 63);
+    ASSERT_EQ(compute_morton_code(glm::ivec3{0x1fffff, 0, 0}),
+              0x1249249249249249u);
+}
+
+TEST(compacted_mesh, brick_order_does_not_change_output) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+    const auto linear = compact(model, brick_order::linear);
+    const auto morton = compact(model, brick_order::morton);
+
+    ASSERT_EQ(linear.get_structure().get_brick_map()->num_slots,
+              morton.get_structure().get_brick_map()->num_slots);
+
+    const auto source_index = compute_index(model.get_descriptor(), source);
+    const auto receiver_index =
+            compute_index(model.get_descriptor(), receiver);
+
+    constexpr auto steps = 200;
+
+    const auto a = run_mesh(cc, linear, source_index, receiver_index, steps);
+    const auto b = run_mesh(cc, morton, source_index, receiver_index, steps);
+
+    ASSERT_EQ(a.size(), b.size());
+    for (auto i = 0u; i != a.size(); ++i) {
+        ASSERT_EQ(a[i].pressure, b[i].pressure) << "step " << i;
+        ASSERT_EQ(a[i].intensity, b[i].intensity) << "step " << i;
+    }
+}
+
+TEST(compacted_mesh, compacted_when_allowed) {
+    const compute_context cc{};
+
+    const auto model = get_voxels_and_mesh(cc).mesh;
+    const auto allowed = compute_voxels_and_mesh(cc,
+                                                 get_l_shaped_scene_data(),
+                                                 receiver,
+                                                 box_fixture::sample_rate,
+                                                 box_fixture::speed_of_sound,
+                                                 stencil::rectilinear,
+                                                 true)
+                                 .mesh;
+
+    ASSERT_FALSE(model.get_structure().get_brick_map());
+    ASSERT_TRUE(is_worth_compacting(model));
+    const auto& bricks = allowed.get_structure().get_brick_map();
+    ASSERT_TRUE(bricks);
+    ASSERT_EQ(bricks->order, brick_order::morton);
+    ASSERT_EQ(estimate_volume(model), estimate_volume(allowed));
+}
+
+TEST(compacted_mesh, brick_order_follows_backend) {
+    auto cc = compute_context{};
+    ASSERT_EQ(compute_brick_order(cc), brick_order::morton);
+    cc.backend = compute_backend::native;
+    ASSERT_EQ(compute_brick_order(cc), brick_order::linear);
+}
+
+TEST(compacted_mesh, native_matches_uncompacted) {
+    auto cc = compute_context{};
+
+    const auto voxels_and_mesh = get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+    const auto compacted = compact(model, brick_order::linear);
+
+    const auto source_index = compute_index(model.get_descriptor(), source);
+    const auto receiver_index =
+            compute_index(model.get_descriptor(), receiver);
+
+    constexpr auto steps = 200;
+
+    const auto dense =
+            run_mesh(cc, model, source_index, receiver_index, steps);
+
+    cc.backend = compute_backend::native;
+    const auto sparse =
+            run_mesh(cc, compacted, source_index, receiver_index, steps);
+
+    ASSERT_EQ(dense.size(), sparse.size());
+    for (auto i = 0u; i != dense.size(); ++i) {
+        ASSERT_NEAR(dense[i].pressure, sparse[i].pressure, 1.0e-5)
+                << "step " << i;
+    }
+
+    //  Blocked runs take storage indices.
+    util::aligned::vector<float> input(steps, 0);
+    input.front() = 1;
+    native::engine engine{compacted, 3};
+    const auto blocked = native::run_blocked(
+            engine,
+            compute_storage_index(compacted, source_index),
+            input,
+            {static_cast<cl_uint>(
+                    compute_storage_index(compacted, receiver_index))},
+            16,
+            true);
+
+    ASSERT_EQ(blocked.size(), sparse.size());
+    for (auto i = 0u; i != blocked.size(); ++i) {
+        ASSERT_EQ(blocked[i], sparse[i].pressure) << "step " << i;
+    }
+
+    //  The native engine walks bricks in storage order.
+    ASSERT_THROW(native::engine{compact(model, brick_order::morton)},
+                 std::runtime_error);
+}
+
+TEST(compacted_mesh, partitioned_matches_uncompacted) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+    const auto compacted = compact(model);
+
+    const auto source_index = compute_index(model.get_descriptor(), source);
+    const auto receiver_index =
+            compute_index(model.get_descriptor(), receiver);
+
+    util::aligned::vector<float> input(200, 0);
+    input.front() = 1;
+
+    const util::aligned::vector<cl_uint> taps{
+            static_cast<cl_uint>(receiver_index),
+            static_cast<cl_uint>(
+                    compute_index(model.get_descriptor(), missing))};
+
+    const util::aligned::vector<compute_context> contexts(3, cc);
+    const auto dense =
+            run_partitioned(contexts, model, source_index, input, taps, true);
+    const auto sparse = run_partitioned(
+            contexts, compacted, source_index, input, taps, true);
+
+    ASSERT_EQ(dense, sparse);
+}
@@ -0,0 +1,96 @@
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/device_sources.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/preprocessor/soft_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+class device_sources_test : public ::testing::Test {
+protected:
+    template <typename Pre>
+    auto run_with(Pre&& pre) const {
+        callback_accumulator<postprocessor::node> output{receiver_index};
+        run(cc,
+            model,
+            std::forward<Pre>(pre),
+            [&](auto& queue, const auto& buffer, auto step) {
+                output(queue, buffer, step);
+            },
+            true);
+        return output.get_output();
+    }
+
+    static auto make_signal(size_t steps, float frequency) {
+        util::aligned::vector<float> ret;
+        for (auto i = 0u; i != steps; ++i) {
+            ret.emplace_back(std::sin(i * frequency) * std::exp(-0.05f * i));
+        }
+        return ret;
+    }
+
+    const compute_context cc{};
+    const voxels_and_mesh voxels_and_mesh_{
+            box_fixture::get_voxels_and_mesh(cc)};
+    const mesh& model = voxels_and_mesh_.mesh;
+    const size_t source_index = box_fixture::get_node_indices(model).source;
+    const size_t receiver_index =
+            box_fixture::get_node_indices(model).receiver;
+};
+
+}  // namespace
+
+TEST_F(device_sources_test, matches_hard_source) {
+    const auto signal = make_signal(200, 0.3);
+    const auto expected = run_with(preprocessor::make_hard_source(
+            source_index, signal.begin(), signal.end()));
+    const auto actual = run_with(preprocessor::device_sources{
+            cc, {{source_index, signal, preprocessor::injection::hard}}});
+    ASSERT_EQ(expected, actual);
+}
+
+TEST_F(device_sources_test, matches_soft_source) {
+    const auto signal = make_signal(200, 0.3);
+    const auto expected = run_with(preprocessor::make_soft_source(
+            source_index, signal.begin(), signal.end()));
+    const auto actual = run_with(preprocessor::device_sources{
+            cc, {{source_index, signal, preprocessor::injection::soft}}});
+    ASSERT_EQ(expected, actual);
+}
+
+TEST_F(device_sources_test, multiple_sources) {
+    //  The mesh is linear, so two soft sources should sum.
+    const auto second_index = compute_index(model.get_descriptor(),
+                                            glm::vec3{1, 0.5, 0.5});
+    const auto a = make_signal(200, 0.3);
+    const auto b = make_signal(100, 0.7);
+
+    const auto only_a = run_with(preprocessor::device_sources{
+            cc, {{source_index, a, preprocessor::injection::soft}}});
+    const auto only_b = run_with(preprocessor::device_sources{
+            cc,
+            {{second_index, b, preprocessor::injection::soft},
+             {source_index,
+              util::aligned::vector<float>(a.size(), 0),
+              preprocessor::injection::soft}}});
+    const auto both = run_with(preprocessor::device_sources{
+            cc,
+            {{source_index, a, preprocessor::injection::soft},
+             {second_index, b, preprocessor::injection::soft}}});
+
+    ASSERT_EQ(both.size(), a.size());
+    ASSERT_EQ(only_b.size(), a.size());
+    for (auto i = 0u; i != both.size(); ++i) {
+        ASSERT_NEAR(both[i], only_a[i] + only_b[i], 1e-5);
+    }
+}
@@ -0,0 +1,147 @@
+#include "waveguide/canonical.h"
+#include "waveguide/early_termination.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "utilities/decibels.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+double rms_pressure(const band& band, size_t begin, size_t end) {
+    auto ret = 0.0;
+    for (auto i = begin; i != end; ++i) {
+        ret += band.directional[i].pressure * band.directional[i].pressure;
+    }
+    return std::sqrt(ret / (end - begin));
+}
+
+}  // namespace
+
+TEST(early_termination, synthesized_tail) {
+    constexpr auto sample_rate = 10000.0;
+    constexpr auto decay_rate = -60.0;  //  dB per second
+    constexpr size_t reference_steps = 1000;
+
+    //  Decaying noise, standing in for a simulation which stopped early.
+    std::default_random_engine engine{1};
+    std::normal_distribution<double> distribution;
+    band b{{}, sample_rate};
+    for (auto i = 0u; i != 5000; ++i) {
+        const auto pressure =
+                util::decibels::db2a(decay_rate * i / sample_rate) *
+                distribution(engine);
+        b.directional.emplace_back(
+                postprocessor::directional_receiver::output{
+                        glm::vec3{0}, static_cast<float>(pressure)});
+    }
+
+    synthesize_tail(b, 20000, decay_rate, reference_steps, 2000, 400);
+    ASSERT_EQ(b.directional.size(), 20000);
+
+    //  The level carries on smoothly from the existing output...
+    const auto before = rms_pressure(b, 4000, 5000);
+    const auto after = rms_pressure(b, 5000, 6000);
+    const auto expected_change = decay_rate * reference_steps / sample_rate;
+    EXPECT_NEAR(util::decibels::a2db(after / before), expected_change, 1.5);
+
+    //  ...and keeps decaying at the same rate.
+    const auto late = rms_pressure(b, 15000, 20000);
+    const auto early = rms_pressure(b, 5000, 10000);
+    EXPECT_NEAR(util::decibels::a2db(late / early),
+                decay_rate * 10000 / sample_rate,
+                1.5);
+
+    //  Intensities match pressures, as for a plane wave.
+    for (auto i = 5000u; i != b.directional.size(); ++i) {
+        const auto& out = b.directional[i];
+        ASSERT_NEAR(glm::length(out.intensity),
+                    out.pressure * out.pressure / 400,
+                    1e-6);
+    }
+}
+
+TEST(early_termination, canonical) {
+    const compute_context cc{};
+
+    //  A more reverberant box than usual, and a coarse mesh, so that a long
+    //  simulation stays quick.
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(0.1), 4000);
+
+    const environment env{};
+    const single_band_parameters params{500, 0.5};
+    constexpr auto simulation_time = 1.0;
+
+    const auto run = [&](auto& steps, const auto& early_termination) {
+        const auto ret = canonical(
+                cc,
+                voxels_and_mesh,
+                box_fixture::source,
+                box_fixture::receiver,
+                env,
+                params,
+                simulation_time,
+                true,
+                [&](auto&, const auto&, auto, auto) { ++steps; },
+                early_termination);
+        if (!ret) {
+            throw std::runtime_error{"Simulation failed."};
+        }
+        return ret->front().band;
+    };
+
+    auto early_steps = 0ul;
+    const auto early = run(early_steps, early_termination_parameters{16, 16});
+
+    auto full_steps = 0ul;
+    const auto full = run(
+            full_steps,
+            std::experimental::optional<early_termination_parameters>{});
+
+    ASSERT_EQ(early.directional.size(), full.directional.size());
+    ASSERT_EQ(full_steps, full.directional.size());
+
+    //  The mesh should have stopped before the end.
+    ASSERT_LT(early_steps, full_steps);
+
+    //  Up to that point, the outputs are the same.
+    for (auto i = 0u; i != early_steps; ++i) {
+        ASSERT_EQ(early.directional[i].pressure, full.directional[i].pressure);
+    }
+
+    for (const auto& i : early.directional) {
+        ASSERT_TRUE(std::isfinite(i.pressure));
+    }
+
+    //  The synthesized tail can't match the full run sample-for-sample, but
+    //  its level should follow the full run's decay, window by window, until
+    //  the full run has decayed by 40 dB.
+    const auto window = static_cast<size_t>(full.sample_rate / 20);
+    const auto reference =
+            rms_pressure(full, early_steps, early_steps + window);
+    auto windows = 0;
+    for (auto begin = early_steps; begin + window <= full_steps;
+         begin += window) {
+        const auto expected = rms_pressure(full, begin, begin + window);
+        if (util::decibels::a2db(expected / reference) < -40) {
+            break;
+        }
+        const auto actual = rms_pressure(early, begin, begin + window);
+        EXPECT_NEAR(util::decibels::a2db(actual / expected), 0, 4)
+                << "window starting at step " << begin;
+        ++windows;
+    }
+
+    //  Make sure the comparison actually covered some of the tail.
+    ASSERT_LE(3, windows);
+}
@@ -1,5 +1,10 @@
 #include "waveguide/fitted_boundary.h"
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
 
+#include "core/callback_accumulator.h"
 #include "core/serialize/filter_coefficients.h"
 
 #include "utilities/apply.h"
@@ -8,6 +13,8 @@
 
 #include "cereal/archives/json.hpp"
 
+#include "box_fixture.h"
+
 #include "gtest/gtest.h"
 
 using namespace wayverb::waveguide;
@@ -21,6 +28,51 @@ std::ostream &operator<<(std::ostream &os,
     archive(coeffs);
     return os;
 }
+
+/// The same filter, at the full canonical order.
+/// Numerator and denominator are both multiplied by (1 - 0.5z^-1) until every
+/// coefficient is used, so the extra poles and zeros cancel out.
+coefficients_canonical raise_to_full_order(coefficients_canonical c) {
+    for (auto order = effective_order(c);
+         order != coefficients_canonical::order;
+         ++order) {
+        for (auto i = order + 1; i != 0; --i) {
+            c.b[i] -= 0.5 * c.b[i - 1];
+            c.a[i] -= 0.5 * c.a[i - 1];
+        }
+    }
+    return c;
+}
+
+/// The pressure at the receiver, with every wall using `coefficients`.
+auto run_with_coefficients(compute_context cc,
+                           compute_backend backend,
+                           mesh model,
+                           const coefficients_canonical& coefficients,
+                           size_t steps) {
+    cc.backend = backend;
+    model.set_coefficients(coefficients);
+
+    const auto indices = box_fixture::get_node_indices(model);
+
+    util::aligned::vector<float> input(steps, 0);
+    input.front() = 1;
+
+    callback_accumulator<postprocessor::node> postprocessor{indices.receiver};
+
+    const auto completed = run(
+            cc,
+            model,
+            preprocessor::make_hard_source(
+                    indices.source, input.begin(), input.end()),
+            [&](auto& queue, const auto& buffer, auto step) {
+                postprocessor(queue, buffer, step);
+            },
+            true);
+
+    EXPECT_EQ(completed, steps);
+    return postprocessor.get_output();
+}
 }  // namespace
 
 template <typename T, size_t N>
@@ -38,3 +90,84 @@ TEST(fitted_boundary, compute_boundary_filter) {
 
     std::cout << coeffs << '\n';
 }
+
+TEST(fitted_boundary, adaptive_order) {
+    constexpr auto sample_rate = 10000.0;
+    constexpr auto tolerance = 0.01;
+
+    const auto band_centres =
+            util::map([](auto i) { return i * 2; },
+                      hrtf_data::hrtf_band_centres(sample_rate));
+    const auto reflectance_of = [](const auto& absorption) {
+        return util::map(
+                [](double i) { return absorption_to_pressure_reflectance(i); },
+                absorption);
+    };
+
+    //  Flat absorption only needs a flat filter.
+    const auto& flat_absorption =
+            make_surface<simulation_bands>(0.2, 0).absorption.s;
+    const auto flat = compute_reflectance_filter_coefficients(
+            flat_absorption, sample_rate, tolerance);
+    ASSERT_EQ(effective_order(flat), 0u);
+    ASSERT_NEAR(flat.b[0] / flat.a[0],
+                absorption_to_pressure_reflectance(0.2),
+                1.0e-6);
+
+    //  Absorption which varies a little is reduced too, and the reduced
+    //  filter still matches the target.
+    //  The reflectances are about 0.006 apart, so their mean is well within
+    //  tolerance of all of them.
+    std::array<float, simulation_bands> nearly_flat{};
+    for (auto i = 0u; i != nearly_flat.size(); ++i) {
+        nearly_flat[i] = i % 2 ? 0.21 : 0.2;
+    }
+    const auto reduced = compute_reflectance_filter_coefficients(
+            nearly_flat, sample_rate, tolerance);
+    ASSERT_EQ(effective_order(reduced), 0u);
+    ASSERT_LE(max_reflectance_error(
+                      reduced, band_centres, reflectance_of(nearly_flat)),
+              tolerance);
+
+    //  A flat filter can't follow absorption which varies a lot.
+    std::array<float, simulation_bands> varied{};
+    for (auto i = 0u; i != varied.size(); ++i) {
+        varied[i] = 0.05 + 0.9 * i / (varied.size() - 1);
+    }
+    const auto coeffs = compute_reflectance_filter_coefficients(
+            varied, sample_rate, tolerance);
+    ASSERT_NE(effective_order(coeffs), 0u);
+}
+
+TEST(fitted_boundary, reduced_order_matches_full_order) {
+    const compute_context cc{};
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+
+    constexpr auto steps = 300;
+
+    const coefficients_canonical flat{{0.8f}, {1}};
+    const coefficients_canonical second_order{{0.5f, -0.2f, 0.1f},
+                                              {1, -0.3f, 0.2f}};
+
+    for (const auto& reduced : {flat, second_order}) {
+        const auto full = raise_to_full_order(reduced);
+        ASSERT_EQ(effective_order(full), size_t{coefficients_canonical::order});
+
+        for (const auto backend :
+             {compute_backend::opencl, compute_backend::native}) {
+            const auto a = run_with_coefficients(
+                    cc, backend, voxels_and_mesh.mesh, reduced, steps);
+            const auto b = run_with_coefficients(
+                    cc, backend, voxels_and_mesh.mesh, full, steps);
+
+            ASSERT_EQ(a.size(), b.size());
+            for (auto i = 0u; i != a.size(); ++i) {
+                ASSERT_NEAR(a[i], b[i], 1.0e-5)
+                        << "order " << effective_order(reduced) << ", "
+                        << (backend == compute_backend::native ? "native"
+                                                               : "opencl")
+                        << ", step " << i;
+            }
+        }
+    }
+}
@@ -0,0 +1,165 @@
+#include "waveguide/mesh_cache.h"
+
+#include "core/cl/common.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+using box_fixture::speed_of_sound;
+using box_fixture::sample_rate;
+constexpr auto anchor = box_fixture::receiver;
+
+auto get_scene(float absorption) {
+    return box_fixture::get_scene_data(absorption);
+}
+
+}  // namespace
+
+TEST(mesh_cache, key) {
+    const auto scene = get_scene(0.2);
+    const auto key =
+            compute_mesh_cache_key(scene, anchor, sample_rate, speed_of_sound);
+
+    ASSERT_EQ(key,
+              compute_mesh_cache_key(
+                      scene, anchor, sample_rate, speed_of_sound));
+
+    //  Materials don't change the mesh layout.
+    ASSERT_EQ(key,
+              compute_mesh_cache_key(
+                      get_scene(0.5), anchor, sample_rate, speed_of_sound));
+
+    ASSERT_NE(key,
+              compute_mesh_cache_key(scene,
+                                     anchor + glm::vec3{0.01, 0, 0},
+                                     sample_rate,
+                                     speed_of_sound));
+    ASSERT_NE(key,
+              compute_mesh_cache_key(
+                      scene, anchor, sample_rate * 2, speed_of_sound));
+    const auto linear = compute_mesh_cache_key(
+            scene, anchor, sample_rate, speed_of_sound, brick_order::linear);
+    ASSERT_NE(key, linear);
+    ASSERT_NE(linear,
+              compute_mesh_cache_key(scene,
+                                     anchor,
+                                     sample_rate,
+                                     speed_of_sound,
+                                     brick_order::morton));
+
+    const geo::box bigger{glm::vec3{0, 0, 0}, glm::vec3{2, 1.5, 1.1}};
+    ASSERT_NE(key,
+              compute_mesh_cache_key(
+                      geo::get_scene_data(
+                              bigger, make_surface<simulation_bands>(0.2, 0)),
+                      anchor,
+                      sample_rate,
+                      speed_of_sound));
+}
+
+TEST(mesh_cache, round_trip) {
+    const compute_context cc{};
+    const auto scene = get_scene(0.2);
+
+    const auto computed = compute_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+
+    const auto key =
+            compute_mesh_cache_key(scene, anchor, sample_rate, speed_of_sound);
+    const std::string path{"mesh_cache_round_trip.mesh"};
+    write_mesh_cache(path, key, computed);
+
+    ASSERT_FALSE(read_mesh_cache(path, key + 1, scene, speed_of_sound));
+    ASSERT_FALSE(read_mesh_cache(
+            "no_such_file.mesh", key, scene, speed_of_sound));
+
+    //  Coefficients should be recomputed for the new materials.
+    const auto new_scene = get_scene(0.5);
+    const auto loaded =
+            read_mesh_cache(path, key, new_scene, speed_of_sound);
+    std::remove(path.c_str());
+    ASSERT_TRUE(loaded);
+
+    const auto& a = computed.mesh;
+    const auto& b = loaded->mesh;
+    ASSERT_EQ(a.get_descriptor(), b.get_descriptor());
+    ASSERT_EQ(a.get_structure().get_condensed_nodes(),
+              b.get_structure().get_condensed_nodes());
+
+    const auto compare_boundary_indices = [&](auto n) {
+        const auto& x = a.get_structure().get_boundary_indices<n>();
+        const auto& y = b.get_structure().get_boundary_indices<n>();
+        ASSERT_EQ(x.size(), y.size());
+        for (auto i = 0u; i != x.size(); ++i) {
+            for (auto j = 0u; j != n; ++j) {
+                ASSERT_EQ(x[i].array[j], y[i].array[j]);
+            }
+        }
+    };
+    compare_boundary_indices(std::integral_constant<size_t, 1>{});
+    compare_boundary_indices(std::integral_constant<size_t, 2>{});
+    compare_boundary_indices(std::integral_constant<size_t, 3>{});
+
+    ASSERT_EQ(a.get_structure().get_node_indices().interior,
+              b.get_structure().get_node_indices().interior);
+    ASSERT_EQ(get_flattened(computed.voxels.get_voxels()),
+              get_flattened(loaded->voxels.get_voxels()));
+
+    ASSERT_EQ(compute_boundary_coefficients(
+                      new_scene.get_surfaces(),
+                      compute_sample_rate(b.get_descriptor(), speed_of_sound)),
+              b.get_structure().get_coefficients());
+}
+
+TEST(mesh_cache, compacted_round_trip) {
+    const compute_context cc{};
+    const auto scene = get_scene(0.2);
+
+    auto computed = compute_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    computed.mesh = compact(computed.mesh, brick_order::linear);
+
+    const auto key = compute_mesh_cache_key(
+            scene, anchor, sample_rate, speed_of_sound, brick_order::linear);
+    const std::string path{"mesh_cache_compacted_round_trip.mesh"};
+    write_mesh_cache(path, key, computed);
+    const auto loaded = read_mesh_cache(path, key, scene, speed_of_sound);
+    std::remove(path.c_str());
+    ASSERT_TRUE(loaded);
+
+    const auto& a = computed.mesh.get_structure();
+    const auto& b = loaded->mesh.get_structure();
+    ASSERT_TRUE(b.get_brick_map());
+    ASSERT_EQ(a.get_brick_map()->slots, b.get_brick_map()->slots);
+    ASSERT_EQ(a.get_brick_map()->bricks, b.get_brick_map()->bricks);
+    ASSERT_EQ(a.get_brick_map()->order, b.get_brick_map()->order);
+    ASSERT_EQ(a.get_condensed_nodes(), b.get_condensed_nodes());
+    ASSERT_EQ(a.get_node_indices().interior, b.get_node_indices().interior);
+    ASSERT_EQ(a.get_node_indices().other, b.get_node_indices().other);
+}
+
+TEST(mesh_cache, unwritable_directory) {
+    const compute_context cc{};
+    const auto scene = get_scene(0.2);
+
+    //  Failing to store the mesh shouldn't stop it being used.
+    const auto computed = compute_voxels_and_mesh(
+            cc, scene, anchor, sample_rate, speed_of_sound);
+    const auto cached = compute_voxels_and_mesh(cc,
+                                                scene,
+                                                anchor,
+                                                sample_rate,
+                                                speed_of_sound,
+                                                "no_such_directory");
+    ASSERT_EQ(computed.mesh.get_descriptor(), cached.mesh.get_descriptor());
+    ASSERT_EQ(computed.mesh.get_structure().get_condensed_nodes(),
+              cached.mesh.get_structure().get_condensed_nodes());
+}
@@ -1,10 +1,16 @@
 #include "waveguide/mesh.h"
+#include "waveguide/mesh_setup_program.h"
 
+#include "core/cl/common.h"
+#include "core/conversions.h"
 #include "core/scene_data_loader.h"
+#include "core/spatial_division/scene_buffers.h"
 #include "core/spatial_division/voxelised_scene_data.h"
 
 #include "gtest/gtest.h"
 
+#include <numeric>
+
 #ifndef OBJ_PATH_BEDROOM
 #define OBJ_PATH_BEDROOM ""
 #endif
@@ -27,4 +33,60 @@ TEST(mesh_setup, setup) {
     const auto m = compute_mesh(compute_context{}, boundary, 0.1, 340);
 }
 
+TEST(mesh_setup, column_inside_matches_node_inside) {
+    const compute_context cc{};
+    const auto boundary = get_voxelised(scene_with_extracted_surfaces(
+            *scene_data_loader{OBJ_PATH_BEDROOM}.get_scene_data(),
+            util::aligned::unordered_map<std::string,
+                                         surface<simulation_bands>>{}));
+
+    const auto program = setup_program{cc};
+    auto queue = cl::CommandQueue{cc.context, cc.device};
+    const auto buffers = make_scene_buffers(cc.context, boundary);
+
+    const auto spacing = 0.05f;
+    const auto aabb = boundary.get_voxels().get_aabb();
+    const auto dim = glm::ivec3{dimensions(aabb) / spacing};
+    const mesh_descriptor desc{
+            to_cl_float3{}(aabb.get_min()), to_cl_int3{}(dim), spacing};
+    const auto num_nodes = compute_num_nodes(desc);
+
+    const auto run = [&](auto kernel, size_t threads) {
+        cl::Buffer node_buffer{cc.context,
+                               CL_MEM_READ_WRITE,
+                               num_nodes * sizeof(condensed_node)};
+        kernel(cl::EnqueueArgs(queue, cl::NDRange(threads)),
+               node_buffer,
+               desc,
+               buffers.get_voxel_index_buffer(),
+               buffers.get_global_aabb(),
+               buffers.get_side(),
+               buffers.get_triangles_buffer(),
+               buffers.get_vertices_buffer());
+        return read_from_buffer<condensed_node>(queue, node_buffer);
+    };
+
+    const auto per_node = run(program.get_node_inside_kernel(), num_nodes);
+    const auto per_column =
+            run(program.get_column_inside_kernel(), dim.x * dim.y);
+
+    ASSERT_EQ(per_node.size(), per_column.size());
+    const auto inside = std::count_if(
+            per_node.begin(), per_node.end(), [](const auto& i) {
+                return i.boundary_type == id_inside;
+            });
+    ASSERT_NE(inside, 0);
+
+    //  The tests fire rays in different directions, so they may disagree
+    //  where the model isn't watertight, but only at a handful of nodes.
+    const auto mismatches = std::inner_product(
+            per_node.begin(),
+            per_node.end(),
+            per_column.begin(),
+            size_t{0},
+            std::plus<>{},
+            [](const auto& a, const auto& b) { return a != b ? 1 : 0; });
+    ASSERT_LT(mismatches, num_nodes / 1000);
+}
+
 }  // namespace
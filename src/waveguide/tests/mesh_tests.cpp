@@ -69,4 +69,55 @@ TEST_F(mesh_fixture, position_index) {
     }
 }
 
+TEST_F(mesh_fixture, coefficient_index_table) {
+    const auto mesh{get_mesh(voxelised)};
+    const auto& structure{mesh.get_structure()};
+
+    const auto check = [&](auto n) {
+        constexpr auto dimensions = decltype(n)::value;
+        const auto& indices{structure.get_boundary_indices<dimensions>()};
+        const auto table{get_coefficient_index_table<dimensions>(structure)};
+        ASSERT_EQ(table.size(), indices.size() * dimensions);
+        for (auto node{0u}; node != indices.size(); ++node) {
+            for (auto i{0u}; i != dimensions; ++i) {
+                ASSERT_EQ(table[i * indices.size() + node],
+                          indices[node].array[i]);
+            }
+        }
+    };
+
+    check(std::integral_constant<size_t, 1>{});
+    check(std::integral_constant<size_t, 2>{});
+    check(std::integral_constant<size_t, 3>{});
+}
+
+TEST_F(mesh_fixture, node_index_data) {
+    const auto mesh{get_mesh(voxelised)};
+    const auto& nodes{mesh.get_structure().get_condensed_nodes()};
+    const auto& indices{mesh.get_structure().get_node_indices()};
+
+    //  Every node which can change is updated exactly once, and outside
+    //  nodes aren't updated at all.
+    util::aligned::vector<int> updates(nodes.size(), 0);
+    for (const auto& run : indices.interior) {
+        ASSERT_NE(run.length, 0u);
+        ASSERT_LE(run.length, node_run::max_length + 0);
+        for (auto i{0u}; i != run.length; ++i) {
+            updates[run.begin + i] += 1;
+        }
+    }
+    for (const auto* list : {&indices.boundary_1,
+                             &indices.boundary_2,
+                             &indices.boundary_3,
+                             &indices.other}) {
+        for (const auto i : *list) {
+            updates[i] += 1;
+        }
+    }
+
+    for (auto i{0u}; i != nodes.size(); ++i) {
+        ASSERT_EQ(updates[i], nodes[i].boundary_type == id_none ? 0 : 1);
+    }
+}
+
 }  // namespace
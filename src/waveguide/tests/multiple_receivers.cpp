@@ -0,0 +1,59 @@
+#include "waveguide/canonical.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(multiple_receivers, matches_separate_runs) {
+    const compute_context cc{};
+
+    constexpr auto source = box_fixture::source;
+    const util::aligned::vector<glm::vec3> receivers{
+            box_fixture::receiver, {1.2, 0.4, 0.6}, {0.3, 1.1, 0.4}};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+
+    const environment env{};
+    const single_band_parameters params{2000, 0.6};
+    constexpr auto simulation_time = 0.02;
+    const auto callback = [](auto&, const auto&, auto, auto) {};
+
+    const auto combined = canonical(cc,
+                                    voxels_and_mesh,
+                                    source,
+                                    receivers,
+                                    env,
+                                    params,
+                                    simulation_time,
+                                    true,
+                                    callback);
+    ASSERT_TRUE(combined);
+    ASSERT_EQ(combined->size(), receivers.size());
+
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        const auto separate = canonical(cc,
+                                        voxels_and_mesh,
+                                        source,
+                                        receivers[i],
+                                        env,
+                                        params,
+                                        simulation_time,
+                                        true,
+                                        callback);
+        ASSERT_TRUE(separate);
+
+        const auto& a = (*combined)[i].front().band.directional;
+        const auto& b = separate->front().band.directional;
+        ASSERT_EQ(a.size(), b.size());
+        for (auto j = 0u; j != a.size(); ++j) {
+            ASSERT_EQ(a[j].pressure, b[j].pressure) << "receiver " << i;
+            ASSERT_EQ(a[j].intensity, b[j].intensity) << "receiver " << i;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include "waveguide/mesh.h"
+#include "waveguide/native/engine.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+auto run_backend(compute_context cc,
+                 compute_backend backend,
+                 const mesh& model,
+                 size_t source_index,
+                 size_t receiver_index,
+                 size_t steps) {
+    cc.backend = backend;
+
+    util::aligned::vector<float> input(steps, 0);
+    input.front() = 1;
+
+    callback_accumulator<postprocessor::node> postprocessor{receiver_index};
+
+    const auto completed = run(
+            cc,
+            model,
+            preprocessor::make_hard_source(
+                    source_index, input.begin(), input.end()),
+            [&](auto& queue, const auto& buffer, auto step) {
+                postprocessor(queue, buffer, step);
+            },
+            true);
+
+    EXPECT_EQ(completed, steps);
+    return postprocessor.get_output();
+}
+
+}  // namespace
+
+TEST(native_engine, matches_opencl) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+    ASSERT_TRUE(is_inside(model, source_index));
+    ASSERT_TRUE(is_inside(model, receiver_index));
+
+    constexpr auto steps = 400;
+
+    const auto opencl = run_backend(cc,
+                                    compute_backend::opencl,
+                                    model,
+                                    source_index,
+                                    receiver_index,
+                                    steps);
+    const auto native = run_backend(cc,
+                                    compute_backend::native,
+                                    model,
+                                    source_index,
+                                    receiver_index,
+                                    steps);
+
+    ASSERT_EQ(opencl.size(), native.size());
+    for (auto i = 0u; i != opencl.size(); ++i) {
+        ASSERT_NEAR(opencl[i], native[i], 1.0e-5) << "step " << i;
+    }
+}
+
+TEST(native_engine, blocked_matches_per_step) {
+    auto cc = compute_context{};
+    cc.backend = compute_backend::native;
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+
+    //  Not a multiple of the block sizes, so the last block is short.
+    util::aligned::vector<float> input(401, 0);
+    input.front() = 1;
+
+    callback_accumulator<postprocessor::node> per_step{receiver_index};
+    run(cc,
+        model,
+        preprocessor::make_hard_source(
+                source_index, input.begin(), input.end()),
+        [&](auto& queue, const auto& buffer, auto step) {
+            per_step(queue, buffer, step);
+        },
+        true);
+
+    //  Boundary filter state lives in the engine, so each block size needs a
+    //  fresh one.
+    for (const auto block_size : {1, 2, 7, 64, 1000}) {
+        native::engine engine{model, 3};
+        const auto blocked = native::run_blocked(
+                engine,
+                source_index,
+                input,
+                {static_cast<cl_uint>(receiver_index)},
+                block_size,
+                true);
+        ASSERT_EQ(per_step.get_output(), blocked)
+                << "block size " << block_size;
+    }
+}
@@ -0,0 +1,155 @@
+#include "waveguide/canonical.h"
+#include "waveguide/mesh.h"
+#include "waveguide/native/out_of_core.h"
+#include "waveguide/waveguide.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(out_of_core, matches_in_memory) {
+    auto cc = compute_context{};
+    cc.backend = compute_backend::native;
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const util::aligned::vector<cl_uint> taps{
+            static_cast<cl_uint>(indices.source),
+            static_cast<cl_uint>(indices.receiver)};
+
+    util::aligned::vector<float> input(301, 0);
+    input.front() = 1;
+
+    native::engine in_memory_engine{model, 3};
+    const auto in_memory = native::run_blocked(
+            in_memory_engine, source_index, input, taps, 16, true);
+
+    //  Slabs smaller and larger than the wavefront, and a slab size which
+    //  doesn't divide the mesh evenly.
+    for (const auto planes_per_slab : {1, 3, 64}) {
+        native::engine engine{model, 3};
+        const auto out_of_core = native::run_out_of_core(
+                engine,
+                source_index,
+                input,
+                taps,
+                native::out_of_core_parameters{
+                        SCRATCH_PATH, static_cast<size_t>(planes_per_slab), 16},
+                true);
+        ASSERT_EQ(in_memory, out_of_core)
+                << "planes per slab " << planes_per_slab;
+    }
+}
+
+TEST(out_of_core, resident_size_is_bounded) {
+    auto cc = compute_context{};
+    cc.backend = compute_backend::native;
+
+    //  A finer mesh than usual, so that it has plenty of slabs.
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(), 40000);
+    const auto& model = voxels_and_mesh.mesh;
+    const auto source_index = box_fixture::get_node_indices(model).source;
+
+    native::engine engine{model, 3};
+    const native::out_of_core_parameters params{SCRATCH_PATH, 1, 4};
+    native::pressure_files files{engine, params};
+
+    //  Every pass keeps the wavefront (about two slabs per step in the
+    //  block), plus a slab either side of it, resident. Partial pages at
+    //  either end of the range may add a page per field.
+    const auto& offsets = engine.get_slab_offsets();
+    auto largest_slab = size_t{0};
+    for (auto i = 1u; i != offsets.size(); ++i) {
+        largest_slab = std::max(largest_slab, offsets[i] - offsets[i - 1]);
+    }
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const auto bound =
+            2 * ((2 * params.block_size + 4) * largest_slab * sizeof(float) +
+                 2 * page_size);
+    const auto total = 2 * engine.get_num_nodes() * sizeof(float);
+    ASSERT_LT(bound, total / 2) << "mesh is too small for this test";
+
+    auto previous = files.get_field(0);
+    auto current = files.get_field(1);
+    auto peak = size_t{0};
+    for (auto block = 0u; block != 4; ++block) {
+        files.begin_pass();
+        engine.step_blocked(
+                previous,
+                current,
+                params.block_size,
+                [&](auto, auto pressures, auto begin, auto end) {
+                    if (!block && begin <= source_index &&
+                        source_index < end) {
+                        pressures[source_index] = 1;
+                    }
+                },
+                [&](auto begin, auto end) {
+                    files.advance(begin, end);
+                    peak = std::max(peak, files.get_resident_bytes());
+                });
+        files.end_pass();
+
+        //  Only pages straddling slab boundaries can be left behind.
+        ASSERT_LE(files.get_resident_bytes(), 4 * page_size);
+    }
+
+    ASSERT_LT(0, peak);
+    ASSERT_LE(peak, bound);
+}
+
+TEST(out_of_core, canonical) {
+    const compute_context cc{device_type::cpu, compute_backend::native};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const environment env{};
+    const single_band_parameters params{500, 0.5};
+
+    const auto run = [&](const auto& out_of_core) {
+        const auto ret = canonical(
+                cc,
+                voxels_and_mesh,
+                box_fixture::source,
+                box_fixture::receiver,
+                env,
+                params,
+                0.05,
+                true,
+                [](auto&, const auto&, auto, auto) {},
+                std::experimental::nullopt,
+                out_of_core);
+        if (!ret) {
+            throw std::runtime_error{"Simulation failed."};
+        }
+        return ret->front().band.directional;
+    };
+
+    const auto in_memory =
+            run(std::experimental::optional<native::out_of_core_parameters>{});
+    const auto out_of_core =
+            run(native::out_of_core_parameters{SCRATCH_PATH, 3, 16});
+
+    ASSERT_FALSE(in_memory.empty());
+    ASSERT_EQ(in_memory.size(), out_of_core.size());
+    for (auto i = 0u; i != in_memory.size(); ++i) {
+        ASSERT_EQ(in_memory[i].pressure, out_of_core[i].pressure) << i;
+        ASSERT_EQ(in_memory[i].intensity, out_of_core[i].intensity) << i;
+    }
+
+    //  The pressures have to live somewhere the native engine can update.
+    EXPECT_THROW(stepper(compute_context{},
+                         voxels_and_mesh.mesh,
+                         native::out_of_core_parameters{SCRATCH_PATH}),
+                 std::runtime_error);
+}
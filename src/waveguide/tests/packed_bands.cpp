@@ -0,0 +1,141 @@
+#include "waveguide/canonical.h"
+
+#include "core/cl/common.h"
+#include "core/geo/box.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(packed_bands, matches_sequential_bands) {
+    const compute_context cc{};
+
+    //  Each band needs different boundary filters, to check that bands don't
+    //  get mixed up.
+    auto surface = make_surface<simulation_bands>(0, 0);
+    for (auto i = 0; i != simulation_bands; ++i) {
+        surface.absorption.s[i] = 0.1f + 0.1f * i;
+    }
+
+    constexpr auto source = box_fixture::source;
+    const util::aligned::vector<glm::vec3> receivers{box_fixture::receiver,
+                                                     {1.2, 0.4, 0.6}};
+
+    auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(surface));
+
+    const environment env{};
+    constexpr auto simulation_time = 0.02;
+    constexpr auto bands = 3;
+    const auto callback = [](auto&, const auto&, auto, auto) {};
+
+    util::aligned::vector<util::aligned::vector<coefficients_canonical>>
+            band_coefficients;
+    for (auto band = 0; band != bands; ++band) {
+        band_coefficients.emplace_back(
+                compute_flat_coefficients_for_band(voxels_and_mesh, band));
+    }
+
+    const auto packed = wayverb::waveguide::detail::canonical_packed_impl(
+            cc,
+            voxels_and_mesh.mesh,
+            band_coefficients,
+            simulation_time,
+            source,
+            receivers,
+            env,
+            true,
+            callback);
+    ASSERT_TRUE(packed);
+    ASSERT_EQ(packed->size(), receivers.size());
+
+    for (auto band = 0; band != bands; ++band) {
+        set_flat_coefficients_for_band(voxels_and_mesh, band);
+        const auto sequential = wayverb::waveguide::detail::canonical_impl(
+                cc,
+                voxels_and_mesh.mesh,
+                simulation_time,
+                source,
+                receivers,
+                env,
+                true,
+                callback);
+        ASSERT_TRUE(sequential);
+
+        for (auto i = 0u; i != receivers.size(); ++i) {
+            const auto& a = (*packed)[i][band].directional;
+            const auto& b = (*sequential)[i].directional;
+            ASSERT_EQ(a.size(), b.size());
+            for (auto j = 0u; j != a.size(); ++j) {
+                ASSERT_EQ(a[j].pressure, b[j].pressure)
+                        << "receiver " << i << ", band " << band;
+                ASSERT_EQ(a[j].intensity, b[j].intensity)
+                        << "receiver " << i << ", band " << band;
+            }
+        }
+    }
+}
+
+TEST(packed_bands, pressure_view_shows_first_band) {
+    const compute_context cc{};
+
+    auto surface = make_surface<simulation_bands>(0, 0);
+    for (auto i = 0; i != simulation_bands; ++i) {
+        surface.absorption.s[i] = 0.1f + 0.1f * i;
+    }
+
+    auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(surface));
+    const auto node = compute_storage_index(
+            voxels_and_mesh.mesh,
+            box_fixture::get_node_indices(voxels_and_mesh.mesh).receiver);
+
+    const environment env{};
+    constexpr auto simulation_time = 0.01;
+
+    //  Records the pressure at the receiver node on every step.
+    const auto record = [&](auto& output) {
+        return [&, node](auto& queue, const auto& pressures, auto, auto) {
+            output.emplace_back(
+                    read_value<cl_float>(queue, pressures.get(), node));
+        };
+    };
+
+    util::aligned::vector<util::aligned::vector<coefficients_canonical>>
+            band_coefficients;
+    for (auto band = 0; band != 3; ++band) {
+        band_coefficients.emplace_back(
+                compute_flat_coefficients_for_band(voxels_and_mesh, band));
+    }
+
+    util::aligned::vector<float> packed;
+    ASSERT_TRUE(wayverb::waveguide::detail::canonical_packed_impl(
+            cc,
+            voxels_and_mesh.mesh,
+            band_coefficients,
+            simulation_time,
+            box_fixture::source,
+            {box_fixture::receiver},
+            env,
+            true,
+            record(packed),
+            std::experimental::nullopt));
+
+    set_flat_coefficients_for_band(voxels_and_mesh, 0);
+    util::aligned::vector<float> single;
+    ASSERT_TRUE(wayverb::waveguide::detail::canonical_impl(
+            cc,
+            voxels_and_mesh.mesh,
+            simulation_time,
+            box_fixture::source,
+            {box_fixture::receiver},
+            env,
+            true,
+            record(single),
+            std::experimental::nullopt));
+
+    ASSERT_EQ(packed, single);
+}
@@ -0,0 +1,153 @@
+#include "waveguide/canonical.h"
+#include "waveguide/mesh.h"
+#include "waveguide/partition.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+auto make_mesh(const compute_context& cc) {
+    return box_fixture::get_voxels_and_mesh(cc).mesh;
+}
+
+}  // namespace
+
+TEST(partition, owns_every_node_once) {
+    const compute_context cc{};
+    const auto model = make_mesh(cc);
+
+    const auto partitions = partition_mesh(model, 3);
+    ASSERT_EQ(partitions.size(), 3);
+
+    const auto& descriptor = model.get_descriptor();
+    ASSERT_EQ(partitions.front().begin, 0);
+    ASSERT_EQ(partitions.back().end,
+              descriptor.dimensions.s[partitions.front().axis]);
+
+    auto owned = 0ul;
+    for (auto i = 0u; i != partitions.size(); ++i) {
+        const auto& p = partitions[i];
+        if (i) {
+            ASSERT_EQ(p.begin, partitions[i - 1].end);
+        }
+        owned += compute_num_nodes(descriptor) /
+                 descriptor.dimensions.s[p.axis] * (p.end - p.begin);
+    }
+    ASSERT_EQ(owned, compute_num_nodes(descriptor));
+
+    //  Halo planes hold no boundary state, so every boundary node is stored
+    //  in exactly one slab.
+    const auto count = [&](auto n) {
+        auto ret = 0ul;
+        for (const auto& p : partitions) {
+            ret += p.mesh.get_structure()
+                           .get_boundary_indices<decltype(n)::value>()
+                           .size();
+        }
+        return ret;
+    };
+    using one = std::integral_constant<size_t, 1>;
+    using two = std::integral_constant<size_t, 2>;
+    using three = std::integral_constant<size_t, 3>;
+    ASSERT_EQ(count(one{}),
+              model.get_structure().get_boundary_indices<1>().size());
+    ASSERT_EQ(count(two{}),
+              model.get_structure().get_boundary_indices<2>().size());
+    ASSERT_EQ(count(three{}),
+              model.get_structure().get_boundary_indices<3>().size());
+}
+
+TEST(partition, matches_unpartitioned) {
+    const compute_context cc{};
+    const auto model = make_mesh(cc);
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+
+    util::aligned::vector<float> input(300, 0);
+    input.front() = 1;
+
+    callback_accumulator<postprocessor::node> postprocessor{receiver_index};
+    run(cc,
+        model,
+        preprocessor::make_hard_source(
+                source_index, input.begin(), input.end()),
+        [&](auto& queue, const auto& buffer, auto step) {
+            postprocessor(queue, buffer, step);
+        },
+        true);
+
+    const util::aligned::vector<cl_uint> taps{
+            static_cast<cl_uint>(receiver_index),
+            static_cast<cl_uint>(source_index)};
+
+    //  Batches of 7 don't divide the input, so the last batch is short.
+    for (const auto slabs : {1, 2, 3}) {
+        const util::aligned::vector<compute_context> contexts(slabs, cc);
+        const auto output = run_partitioned(
+                contexts, model, source_index, input, taps, true, 7);
+
+        ASSERT_EQ(output.size(), input.size() * taps.size());
+        for (auto i = 0u; i != input.size(); ++i) {
+            ASSERT_EQ(output[i * taps.size()], postprocessor.get_output()[i]);
+            ASSERT_EQ(output[i * taps.size() + 1], input[i]);
+        }
+    }
+}
+
+TEST(partition, canonical_matches_unpartitioned) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+
+    const environment env{};
+    const single_band_parameters params{2000, 0.6};
+    constexpr auto simulation_time = 0.02;
+    const util::aligned::vector<glm::vec3> receivers{box_fixture::receiver,
+                                                     {1.2, 0.4, 0.6}};
+
+    const auto run_canonical = [&](const auto& partition) {
+        return canonical(cc,
+                         voxels_and_mesh,
+                         box_fixture::source,
+                         receivers,
+                         env,
+                         params,
+                         simulation_time,
+                         true,
+                         [](auto&, const auto&, auto, auto) {},
+                         std::experimental::nullopt,
+                         std::experimental::nullopt,
+                         std::experimental::nullopt,
+                         partition);
+    };
+
+    const auto unpartitioned = run_canonical(std::experimental::nullopt);
+    ASSERT_TRUE(unpartitioned);
+
+    const auto partitioned =
+            run_canonical(util::aligned::vector<compute_context>(3, cc));
+    ASSERT_TRUE(partitioned);
+    ASSERT_EQ(partitioned->size(), receivers.size());
+
+    for (auto i = 0u; i != receivers.size(); ++i) {
+        const auto& a = (*unpartitioned)[i].front().band.directional;
+        const auto& b = (*partitioned)[i].front().band.directional;
+        ASSERT_EQ(a.size(), b.size());
+        for (auto j = 0u; j != a.size(); ++j) {
+            ASSERT_EQ(a[j].pressure, b[j].pressure) << j;
+            ASSERT_EQ(a[j].intensity, b[j].intensity) << j;
+        }
+    }
+}
@@ -304,6 +304,18 @@ TEST_F(testing_rk_filter_quiet, filtering_2) {
           audio_file::bit_depth::pcm16);
 }
 
+TEST(compare_filters, strided_memory) {
+    rk_filter<NoiseGenerator> packed;
+    rk_filter<NoiseGenerator> strided;
+
+    const auto buf_1 =
+            packed.run_kernel(packed.program.get_filter_test_2_kernel());
+    const auto buf_2 = strided.run_kernel(
+            strided.program.get_filter_test_strided_kernel());
+
+    ASSERT_EQ(buf_1, buf_2);
+}
+
 TEST(compare_filters, compare_filters) {
     const auto test = [](auto biquad, auto filter) {
         for (auto i = 0u; i != biquad.input.size(); ++i) {
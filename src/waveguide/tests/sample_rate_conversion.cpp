@@ -1,4 +1,5 @@
 #include "waveguide/config.h"
+#include "waveguide/resampler.h"
 
 #include "audio_file/audio_file.h"
 
@@ -6,6 +7,8 @@
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+
 namespace {
 
 template <typename T>
@@ -43,3 +46,79 @@ TEST(sample_rate_conversion, convert) {
 
     scale_and_write(scale, "impulse", output, output_sr);
 }
+
+TEST(sample_rate_conversion, ratio) {
+    const auto ratio =
+            wayverb::waveguide::compute_resampling_ratio(40000 / 3.0, 44100);
+    ASSERT_EQ(ratio.up, 1323);
+    ASSERT_EQ(ratio.down, 400);
+
+    const auto down = wayverb::waveguide::compute_resampling_ratio(48000, 8000);
+    ASSERT_EQ(down.up, 1);
+    ASSERT_EQ(down.down, 6);
+}
+
+TEST(sample_rate_conversion, streaming) {
+    util::aligned::vector<float> input(3000);
+    std::generate(input.begin(), input.end(), [i = 0]() mutable {
+        return std::sin(i++ * 0.05f) + ((i * 7919) % 13) / 13.0f;
+    });
+
+    for (const auto q : {wayverb::waveguide::resampler_quality::fast,
+                         wayverb::waveguide::resampler_quality::best}) {
+        const auto batch = wayverb::waveguide::resample(
+                input.data(), input.size(), 11025, 44100, q);
+        ASSERT_EQ(batch.size(), input.size() * 4);
+
+        //  Blocks of awkward sizes must give exactly the same output.
+        wayverb::waveguide::resampler r{11025, 44100, q};
+        util::aligned::vector<float> streamed;
+        for (size_t i = 0, block = 1; i < input.size(); i += block, ++block) {
+            const auto end = std::min(i + block, input.size());
+            r.push(input.data() + i, input.data() + end, streamed);
+        }
+        r.flush(streamed);
+
+        ASSERT_EQ(batch, streamed);
+    }
+}
+
+TEST(sample_rate_conversion, sine) {
+    const auto in_sr = 40000 / 3.0;
+    const auto out_sr = 44100.0;
+    const auto frequency = 1000.0;
+
+    util::aligned::vector<float> input(10000);
+    for (size_t i = 0; i != input.size(); ++i) {
+        input[i] = std::sin(2 * M_PI * frequency * i / in_sr);
+    }
+
+    const auto output = wayverb::waveguide::resample(
+            input.data(), input.size(), in_sr, out_sr);
+    ASSERT_EQ(output.size(), std::ceil(input.size() * out_sr / in_sr));
+
+    //  Away from the ends, the output is the same sine at the new rate.
+    for (size_t i = 2000; i != output.size() - 2000; ++i) {
+        ASSERT_NEAR(output[i],
+                    std::sin(2 * M_PI * frequency * i / out_sr),
+                    1.0e-3);
+    }
+}
+
+TEST(sample_rate_conversion, impulse_alignment) {
+    util::aligned::vector<float> input(1000, 0);
+    input[200] = 1;
+
+    for (const auto q : {wayverb::waveguide::resampler_quality::fast,
+                         wayverb::waveguide::resampler_quality::medium,
+                         wayverb::waveguide::resampler_quality::best}) {
+        const auto output = wayverb::waveguide::resample(
+                input.data(), input.size(), 1000, 3000, q);
+        const auto peak = std::max_element(
+                output.begin(), output.end(), [](auto a, auto b) {
+                    return std::abs(a) < std::abs(b);
+                });
+        ASSERT_EQ(std::distance(output.begin(), peak), 600);
+        ASSERT_NEAR(*peak, 1, 0.2);
+    }
+}
@@ -0,0 +1,182 @@
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/snapshot.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/cl/common.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+struct full_read final {
+    size_t step;
+    util::aligned::vector<float> pressures;
+};
+
+void run_with_snapshots(const postprocessor::snapshot_parameters& params,
+                        size_t expected_interval,
+                        bool compacted = false) {
+    const compute_context cc{};
+
+    //  A coarse mesh, so that whole-mesh reads stay small.
+    auto model = box_fixture::get_voxels_and_mesh(
+                         cc, box_fixture::get_scene_data(), 5000)
+                         .mesh;
+    if (compacted) {
+        model = compact(model);
+    }
+    const auto& descriptor = model.get_descriptor();
+
+    util::aligned::vector<float> input(100, 0);
+    input.front() = 1;
+
+    util::aligned::vector<full_read> full_reads;
+    util::aligned::vector<postprocessor::pressure_snapshot> snapshots;
+    postprocessor::snapshot snapshot{
+            cc, model, params, [&](auto snapshot) {
+                snapshots.emplace_back(std::move(snapshot));
+            }};
+
+    run(cc,
+        model,
+        preprocessor::make_hard_source(
+                compute_storage_index(
+                        model, box_fixture::get_node_indices(model).source),
+                input.begin(),
+                input.end()),
+        [&](auto& queue, const auto& buffer, auto step) {
+            full_reads.emplace_back(
+                    full_read{step, read_from_buffer<float>(queue, buffer)});
+            snapshot(queue, buffer, step);
+        },
+        true);
+    snapshot.flush();
+
+    const auto region =
+            params.region ? *params.region
+                          : postprocessor::compute_whole_mesh_region(
+                                    descriptor);
+    const auto tolerance = params.quantisation_range
+                                   ? *params.quantisation_range / 127
+                                   : 0;
+
+    ASSERT_EQ(snapshots.size(),
+              (input.size() + expected_interval - 1) / expected_interval);
+    for (auto i = 0u; i != snapshots.size(); ++i) {
+        const auto& snapshot = snapshots[i];
+        ASSERT_EQ(snapshot.step, i * expected_interval);
+        ASSERT_EQ(snapshot.region, region);
+
+        const auto pressures = postprocessor::get_pressures(snapshot);
+        ASSERT_EQ(pressures.size(), postprocessor::compute_num_nodes(region));
+
+        const auto& expected = full_reads[snapshot.step].pressures;
+        auto index = 0u;
+        for (auto z = region.begin.z; z != region.end.z; ++z) {
+            for (auto y = region.begin.y; y != region.end.y; ++y) {
+                for (auto x = region.begin.x; x != region.end.x; ++x) {
+                    const auto node =
+                            compute_index(descriptor, glm::ivec3{x, y, z});
+                    const auto value =
+                            is_stored(model, node)
+                                    ? expected[compute_storage_index(model,
+                                                                     node)]
+                                    : 0;
+                    ASSERT_NEAR(pressures[index++],
+                                tolerance ? glm::clamp(value, -1.0f, 1.0f)
+                                          : value,
+                                tolerance);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+TEST(snapshot, whole_mesh) { run_with_snapshots({}, 1); }
+
+TEST(snapshot, decimated_slice) {
+    postprocessor::snapshot_parameters params;
+    params.interval = 3;
+    params.region = postprocessor::snapshot_region{glm::ivec3{0, 0, 5},
+                                                   glm::ivec3{8, 6, 6}};
+    run_with_snapshots(params, 3);
+}
+
+TEST(snapshot, quantised) {
+    postprocessor::snapshot_parameters params;
+    params.interval = 4;
+    params.quantisation_range = 1;
+    run_with_snapshots(params, 4);
+}
+
+TEST(snapshot, compacted) {
+    postprocessor::snapshot_parameters params;
+    params.interval = 2;
+    run_with_snapshots(params, 2, true);
+}
+
+TEST(snapshot, batched) {
+    const compute_context cc{};
+
+    const auto model = box_fixture::get_voxels_and_mesh(
+                               cc, box_fixture::get_scene_data(), 5000)
+                               .mesh;
+
+    //  Not a multiple of the batch size, so the last batch is short.
+    util::aligned::vector<float> input(101, 0);
+    input.front() = 1;
+
+    constexpr auto batch_size = 16;
+
+    postprocessor::snapshot_parameters params;
+    params.interval = 4;
+
+    util::aligned::vector<postprocessor::pressure_snapshot> snapshots;
+    postprocessor::snapshot snapshot{
+            cc, model, params, [&](auto snapshot) {
+                snapshots.emplace_back(std::move(snapshot));
+            }};
+
+    //  Every snapshot in a batch is handed off by the end of that batch.
+    struct checked_snapshot final {
+        postprocessor::snapshot& snapshot;
+        const util::aligned::vector<postprocessor::pressure_snapshot>&
+                snapshots;
+
+        void operator()(cl::CommandQueue& queue,
+                        const cl::Buffer& buffer,
+                        size_t step) {
+            snapshot(queue, buffer, step);
+        }
+
+        void finish(cl::CommandQueue& queue, size_t first_step, size_t steps) {
+            snapshot.finish(queue, first_step, steps);
+            ASSERT_EQ(snapshots.size(), (first_step + steps + 3) / 4);
+        }
+    } checked{snapshot, snapshots};
+
+    run_batched(cc,
+                model,
+                preprocessor::make_batched_hard_source(
+                        compute_storage_index(
+                                model,
+                                box_fixture::get_node_indices(model).source),
+                        input.begin(),
+                        input.end()),
+                checked,
+                batch_size,
+                true);
+
+    ASSERT_EQ(snapshots.size(), (input.size() + 3) / 4);
+    for (auto i = 0u; i != snapshots.size(); ++i) {
+        ASSERT_EQ(snapshots[i].step, i * 4);
+    }
+}
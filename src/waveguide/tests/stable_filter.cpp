@@ -0,0 +1,45 @@
+#include "waveguide/fitted_boundary.h"
+#include "waveguide/stable.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+
+namespace {
+
+/// A resonator with a pair of poles at the given radius.
+coefficients_canonical make_resonator(double radius) {
+    const auto angle = 0.1;
+    return coefficients_canonical{
+            {1},
+            {1,
+             static_cast<filt_real>(-2 * radius * std::cos(angle)),
+             static_cast<filt_real>(radius * radius)}};
+}
+
+}  // namespace
+
+TEST(stable_filter, leaves_stable_filters_alone) {
+    for (const auto& c : {to_flat_coefficients(0.1),
+                          to_flat_coefficients(0.9),
+                          make_resonator(0.99)}) {
+        ASSERT_TRUE(is_stable_filter(c));
+        ASSERT_EQ(c, make_stable(c));
+    }
+}
+
+TEST(stable_filter, refits_unstable_filters) {
+    const auto unstable = make_resonator(1.001);
+    ASSERT_FALSE(is_stable_filter(unstable));
+
+    const auto refitted = make_stable(unstable);
+    ASSERT_TRUE(is_stable_filter(refitted));
+
+    //  Poles should only move as far as necessary.
+    ASSERT_NEAR(refitted.a[2], 1, 0.01);
+    ASSERT_EQ(unstable.b[0], refitted.b[0]);
+}
+
+TEST(stable_filter, rejects_hopeless_filters) {
+    ASSERT_THROW(make_stable(make_resonator(2)), std::runtime_error);
+}
@@ -0,0 +1,183 @@
+#include "waveguide/canonical.h"
+#include "waveguide/config.h"
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/node.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/stencil.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+#include "core/cl/common.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+namespace {
+
+constexpr stencil stencils[]{stencil::rectilinear,
+                             stencil::interpolated_wideband};
+
+}  // namespace
+
+TEST(stencil, consistent) {
+    for (const auto s : stencils) {
+        //  A uniform pressure field must stay uniform.
+        const auto c = get_coefficients(s);
+        ASSERT_NEAR(6 * c.axial + 12 * c.side_diagonal + 8 * c.diagonal +
+                            c.centre,
+                    2,
+                    1.0e-12);
+
+        const auto spacing = config::grid_spacing(340, 1 / 10000.0, s);
+        ASSERT_NEAR(config::time_step(340, spacing, s), 1 / 10000.0, 1.0e-12);
+        ASSERT_NEAR(config::speed_of_sound(1 / 10000.0, spacing, s),
+                    340,
+                    1.0e-9);
+    }
+}
+
+TEST(stencil, dispersion) {
+    //  Each scheme is dispersionless in one direction.
+    ASSERT_NEAR(compute_relative_phase_velocity(
+                        stencil::rectilinear, 0.15, glm::dvec3{1, 1, 1}),
+                1,
+                1.0e-9);
+    ASSERT_NEAR(compute_relative_phase_velocity(stencil::interpolated_wideband,
+                                                0.15,
+                                                glm::dvec3{1, 0, 0}),
+                1,
+                1.0e-9);
+
+    //  The rectilinear scheme can't carry axial waves at a quarter of the
+    //  sampling rate.
+    ASSERT_TRUE(std::isnan(compute_relative_phase_velocity(
+            stencil::rectilinear, 0.25, glm::dvec3{1, 0, 0})));
+
+    for (const auto s : stencils) {
+        ASSERT_NEAR(compute_dispersion_error(s, 0.001), 0, 1.0e-4);
+    }
+
+    ASSERT_LT(2 * compute_valid_bandwidth(stencil::rectilinear, 0.02),
+              compute_valid_bandwidth(stencil::interpolated_wideband, 0.02));
+}
+
+namespace {
+
+struct impulse_response final {
+    util::aligned::vector<float> pressures;
+
+    /// The time taken for sound to get from the source node to the receiver
+    /// node, in steps.
+    double expected_arrival;
+};
+
+impulse_response run_impulse(const compute_context& cc,
+                             stencil s,
+                             size_t steps) {
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+            cc, box_fixture::get_scene_data(), 3000, s);
+    const auto& model = voxels_and_mesh.mesh;
+    if (model.get_stencil() != s) {
+        throw std::runtime_error{"Mesh was built for the wrong stencil."};
+    }
+
+    util::aligned::vector<float> input(steps, 0);
+    input.front() = 1;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    callback_accumulator<postprocessor::node> output{indices.receiver};
+    run(cc,
+        model,
+        preprocessor::make_hard_source(
+                indices.source, input.begin(), input.end()),
+        [&](auto& queue, const auto& buffer, auto step) {
+            output(queue, buffer, step);
+        },
+        true);
+
+    const auto& descriptor = model.get_descriptor();
+    const auto distance =
+            glm::distance(compute_position(descriptor, indices.source),
+                          compute_position(descriptor, indices.receiver));
+    return {output.get_output(),
+            distance / box_fixture::speed_of_sound * 3000};
+}
+
+/// The first step at which the pressure reaches a tenth of its peak.
+size_t find_arrival(const util::aligned::vector<float>& pressures) {
+    auto peak = 0.0f;
+    for (const auto i : pressures) {
+        peak = std::max(peak, std::abs(i));
+    }
+    return std::find_if(begin(pressures),
+                        end(pressures),
+                        [&](auto i) { return peak * 0.1f <= std::abs(i); }) -
+           begin(pressures);
+}
+
+}  // namespace
+
+TEST(stencil, interpolated_wideband_is_stable) {
+    const compute_context cc{};
+
+    //  About a second, by which time the walls should have absorbed several
+    //  hundred dB.
+    constexpr size_t steps = 3000;
+    const auto wideband =
+            run_impulse(cc, stencil::interpolated_wideband, steps);
+    ASSERT_EQ(wideband.pressures.size(), steps);
+
+    //  An unstable scheme grows without bound, however slowly.
+    //  Windows are long enough to smooth over beating between modes.
+    constexpr size_t window = 300;
+    const auto energy = [&](size_t begin) {
+        return std::accumulate(wideband.pressures.begin() + begin,
+                               wideband.pressures.begin() + begin + window,
+                               0.0,
+                               [](auto a, auto b) { return a + b * b; });
+    };
+    for (auto i = window; i + window <= steps; i += window) {
+        ASSERT_LT(energy(i), energy(i - window)) << "window at step " << i;
+        ASSERT_LT(0, energy(i));
+    }
+
+    //  The direct sound should arrive when it would with the rectilinear
+    //  scheme, and when the geometry says it should.
+    const auto rectilinear = run_impulse(cc, stencil::rectilinear, 100);
+    const auto wideband_arrival = find_arrival(
+            {wideband.pressures.begin(), wideband.pressures.begin() + 100});
+    const auto rectilinear_arrival = find_arrival(rectilinear.pressures);
+    EXPECT_NEAR(wideband_arrival, wideband.expected_arrival, 3);
+    EXPECT_NEAR(rectilinear_arrival, rectilinear.expected_arrival, 3);
+    EXPECT_NEAR(static_cast<double>(wideband_arrival),
+                static_cast<double>(rectilinear_arrival),
+                3);
+}
+
+TEST(stencil, canonical_input_requires_rectilinear) {
+    const compute_context cc{};
+    const environment env{};
+
+    for (const auto s : stencils) {
+        const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(
+                cc, box_fixture::get_scene_data(), 3000, s);
+        const auto& model = voxels_and_mesh.mesh;
+        if (s == stencil::rectilinear) {
+            ASSERT_EQ(wayverb::waveguide::detail::compute_input(model, env, 10)
+                              .size(),
+                      10);
+        } else {
+            ASSERT_THROW(
+                    wayverb::waveguide::detail::compute_input(model, env, 10),
+                    std::runtime_error);
+        }
+    }
+}
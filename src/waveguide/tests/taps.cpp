@@ -0,0 +1,129 @@
+#include "waveguide/mesh.h"
+#include "waveguide/postprocessor/directional_receiver.h"
+#include "waveguide/postprocessor/directional_receivers.h"
+#include "waveguide/postprocessor/taps.h"
+#include "waveguide/preprocessor/hard_source.h"
+#include "waveguide/waveguide.h"
+
+#include "core/callback_accumulator.h"
+#include "core/environment.h"
+
+#include "box_fixture.h"
+
+#include "gtest/gtest.h"
+
+using namespace wayverb::waveguide;
+using namespace wayverb::core;
+
+TEST(taps, matches_directional_receiver) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto indices = box_fixture::get_node_indices(model);
+    const auto source_index = indices.source;
+    const auto receiver_index = indices.receiver;
+
+    util::aligned::vector<float> input(400, 0);
+    input.front() = 1;
+
+    const environment env{};
+    const auto sample_rate =
+            compute_sample_rate(model.get_descriptor(), env.speed_of_sound);
+    const auto make_receiver = [&] {
+        return postprocessor::directional_receiver{
+                model, sample_rate, get_ambient_density(env), receiver_index};
+    };
+
+    callback_accumulator<postprocessor::directional_receiver> unbatched{
+            make_receiver()};
+    run(cc,
+        model,
+        preprocessor::make_hard_source(
+                source_index, input.begin(), input.end()),
+        [&](auto& queue, const auto& buffer, auto step) {
+            unbatched(queue, buffer, step);
+        },
+        true);
+
+    //  Batches don't divide the ring buffer evenly, so reads will wrap.
+    auto receiver_for_taps = make_receiver();
+    const auto tap_nodes = receiver_for_taps.get_tap_nodes();
+    postprocessor::taps taps{
+            cc, {tap_nodes.begin(), tap_nodes.end()}, 100};
+    run_batched(cc,
+                model,
+                preprocessor::make_batched_hard_source(
+                        source_index, input.begin(), input.end()),
+                taps,
+                64,
+                true);
+
+    ASSERT_EQ(taps.get_num_steps(), unbatched.get_output().size());
+    for (auto i = 0u; i != taps.get_num_steps(); ++i) {
+        const auto output = receiver_for_taps.integrate(
+                taps.get_output().data() + i * taps.get_num_taps());
+        ASSERT_EQ(unbatched.get_output()[i].pressure, output.pressure);
+        ASSERT_EQ(unbatched.get_output()[i].intensity, output.intensity);
+    }
+}
+
+TEST(taps, directional_receivers_match_separate_receivers) {
+    const compute_context cc{};
+
+    const auto voxels_and_mesh = box_fixture::get_voxels_and_mesh(cc);
+    const auto& model = voxels_and_mesh.mesh;
+
+    const auto source_index = box_fixture::get_node_indices(model).source;
+    const util::aligned::vector<size_t> receiver_indices{
+            box_fixture::get_node_indices(model).receiver,
+            compute_index(model.get_descriptor(), glm::vec3{1.2, 0.4, 0.6}),
+            compute_index(model.get_descriptor(), glm::vec3{0.3, 1.1, 0.4})};
+
+    util::aligned::vector<float> input(300, 0);
+    input.front() = 1;
+
+    const environment env{};
+    const auto sample_rate =
+            compute_sample_rate(model.get_descriptor(), env.speed_of_sound);
+
+    postprocessor::directional_receivers receivers{cc,
+                                                   model,
+                                                   sample_rate,
+                                                   get_ambient_density(env),
+                                                   receiver_indices,
+                                                   64};
+    run_batched(cc,
+                model,
+                preprocessor::make_batched_hard_source(
+                        source_index, input.begin(), input.end()),
+                receivers,
+                64,
+                true);
+    ASSERT_EQ(receivers.get_num_receivers(), receiver_indices.size());
+
+    for (auto i = 0u; i != receiver_indices.size(); ++i) {
+        callback_accumulator<postprocessor::directional_receiver> separate{
+                model,
+                sample_rate,
+                get_ambient_density(env),
+                receiver_indices[i]};
+        run(cc,
+            model,
+            preprocessor::make_hard_source(
+                    source_index, input.begin(), input.end()),
+            [&](auto& queue, const auto& buffer, auto step) {
+                separate(queue, buffer, step);
+            },
+            true);
+
+        const auto& a = receivers.get_output(i);
+        const auto& b = separate.get_output();
+        ASSERT_EQ(a.size(), b.size());
+        for (auto j = 0u; j != a.size(); ++j) {
+            ASSERT_EQ(a[j].pressure, b[j].pressure) << "receiver " << i;
+            ASSERT_EQ(a[j].intensity, b[j].intensity) << "receiver " << i;
+        }
+    }
+}
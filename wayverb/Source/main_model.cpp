@@ -134,16 +134,42 @@ public:
             , encountered_error_connection_{engine_.connect_encountered_error(
                       make_queue_forwarding_call(encountered_error_))}
             , finished_connection_{engine_.connect_finished(
-                      make_queue_forwarding_call(finished_))} {}
+                      make_queue_forwarding_call(finished_))} {
+        const auto data_directory =
+                File::getSpecialLocation(File::userApplicationDataDirectory)
+                        .getChildFile("wayverb");
+
+        //  Meshes are slow to build, so keep them between sessions.
+        const auto mesh_cache = data_directory.getChildFile("mesh_cache");
+        if (mesh_cache.createDirectory().wasOk()) {
+            engine_.set_mesh_cache_directory(
+                    mesh_cache.getFullPathName().toStdString());
+        }
+
+        //  Long waveguide runs can pick up where they left off after a
+        //  cancel or a crash.
+        const auto checkpoints = data_directory.getChildFile("checkpoints");
+        if (checkpoints.createDirectory().wasOk()) {
+            engine_.set_checkpoint_directory(
+                    checkpoints.getFullPathName().toStdString());
+        }
+    }
 
     ~impl() noexcept { cancel_render(); }
 
     void start_render(const class project& project,
                       const wayverb::combined::model::output& output) {
+        //  The view only redraws at screen rate, so there's no point sending
+        //  every step at full precision.
+        wayverb::waveguide::postprocessor::snapshot_parameters snapshot;
+        snapshot.interval = 4;
+        snapshot.quantisation_range = 1;
+
         engine_.run(wayverb::core::compute_context{},
                     generate_scene_data(project),
                     project.persistent,
-                    output);
+                    output,
+                    snapshot);
     }
 
     void cancel_render() { engine_.cancel(); }
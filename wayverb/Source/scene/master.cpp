@@ -63,7 +63,8 @@ public:
                                                 p = std::move(pressures),
                                                 d = distance
                                             ](auto& renderer) {
-                                                renderer.set_node_pressures(std::move(p));
+                                                renderer.set_node_pressures(
+                                                        wayverb::waveguide::postprocessor::get_pressures(p));
                                                 renderer.set_distance_travelled(d);
                                             });
                                         })};